@@ -0,0 +1,188 @@
+/* bench/ChannelHeaders.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* afv_bench_channel_headers times encoding and parsing of cryptodto datagram
+ * headers, comparing Channel's cached-prefix encoder and validating parser with
+ * the generic msgpack dto::Header path they replaced.
+ *
+ * usage: afv_bench_channel_headers [headers]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <msgpack.hpp>
+#include <openssl/rand.h>
+
+#include "afv-native/cryptodto/Channel.h"
+#include "afv-native/cryptodto/DatagramWriter.h"
+#include "afv-native/cryptodto/dto/ChannelConfig.h"
+#include "afv-native/cryptodto/dto/Header.h"
+
+using namespace afv_native;
+
+namespace {
+    typedef std::chrono::steady_clock bench_clock;
+
+    const size_t defaultHeaders = 1000000;
+    /** the same shape as the GUID tags the voice server hands out. */
+    const char *benchChannelTag = "d1f4f2ae-7d4e-4a4a-9a3c-0b3b2fd1c2e7";
+    const size_t headerBufferSize = 128;
+
+    /** HeaderChannel exposes Channel's header encoder and parser to the benchmark. */
+    class HeaderChannel: public cryptodto::Channel {
+    public:
+        using cryptodto::Channel::encodeHeader;
+        using cryptodto::Channel::parseHeader;
+    };
+
+    /** genericEncode packs a dto::Header the way Channel did before the prefix was
+     * cached. */
+    size_t genericEncode(unsigned char *bufOut, const std::string &channelTag, cryptodto::sequence_t sequence)
+    {
+        msgpack::sbuffer headerBuf;
+        cryptodto::dto::Header header(channelTag, sequence, cryptodto::CryptoModeChaCha20Poly1305);
+        msgpack::pack(headerBuf, header);
+        const uint16_t nLen = static_cast<uint16_t>(headerBuf.size());
+        ::memcpy(bufOut, &nLen, 2);
+        ::memcpy(bufOut + 2, headerBuf.data(), headerBuf.size());
+        return 2 + headerBuf.size();
+    }
+
+    /** genericParse unpacks and converts a dto::Header the way Channel did before
+     * the validating parser. */
+    bool genericParse(
+            const unsigned char *datagram,
+            const std::string &channelTag,
+            cryptodto::sequence_t &sequence)
+    {
+        uint16_t headerSize = 0;
+        ::memcpy(&headerSize, datagram, sizeof(headerSize));
+        auto headerObjHdl = msgpack::unpack(reinterpret_cast<const char *>(datagram) + 2, headerSize);
+        cryptodto::dto::Header header;
+        try {
+            headerObjHdl.get().convert(header);
+        } catch (const msgpack::type_error &) {
+            return false;
+        }
+        if (header.ChannelTag != channelTag) {
+            return false;
+        }
+        sequence = header.Sequence;
+        return true;
+    }
+
+    void report(const char *name, size_t count, bench_clock::time_point start, bench_clock::time_point end)
+    {
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        ::printf("%-24s %10.1f ns/header  %12.0f headers/s\n",
+                 name, seconds * 1e9 / count, count / seconds);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = defaultHeaders;
+    if (argc > 1) {
+        count = std::strtoul(argv[1], nullptr, 10);
+    }
+    if (count == 0) {
+        ::fprintf(stderr, "usage: %s [headers]\n", argv[0]);
+        return 1;
+    }
+
+    cryptodto::dto::ChannelConfig config;
+    config.ChannelTag = benchChannelTag;
+    RAND_bytes(config.AeadReceiveKey, cryptodto::aeadModeKeySize);
+    RAND_bytes(config.AeadTransmitKey, cryptodto::aeadModeKeySize);
+    HeaderChannel channel;
+    channel.setChannelConfig(config);
+    const std::string channelTag(benchChannelTag);
+
+    unsigned char buffer[headerBufferSize];
+    // sink keeps the compiler from discarding the work being timed.
+    volatile uint64_t sink = 0;
+
+    ::printf("%zu headers in each direction\n", count);
+
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        cryptodto::DatagramWriter dgWriter(buffer, sizeof(buffer));
+        channel.encodeHeader(dgWriter, i, cryptodto::CryptoModeChaCha20Poly1305);
+        sink = sink + dgWriter.size();
+    }
+    report("encode (cached prefix)", count, start, bench_clock::now());
+
+    start = bench_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        sink = sink + genericEncode(buffer, channelTag, i);
+    }
+    report("encode (msgpack Header)", count, start, bench_clock::now());
+
+    // both parsers get the same, valid, header to chew on.
+    cryptodto::DatagramWriter dgWriter(buffer, sizeof(buffer));
+    channel.encodeHeader(dgWriter, 0x1234, cryptodto::CryptoModeChaCha20Poly1305);
+    const size_t headerLen = dgWriter.size();
+
+    size_t failures = 0;
+    start = bench_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        size_t bodyOffset;
+        cryptodto::sequence_t sequence = 0;
+        cryptodto::CryptoDtoMode mode;
+        if (channel.parseHeader(buffer, headerLen, bodyOffset, sequence, mode) != cryptodto::DecapsulateOutcome::OK) {
+            failures++;
+        }
+        sink = sink + sequence;
+    }
+    report("parse (validating)", count, start, bench_clock::now());
+
+    start = bench_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        cryptodto::sequence_t sequence = 0;
+        if (!genericParse(buffer, channelTag, sequence)) {
+            failures++;
+        }
+        sink = sink + sequence;
+    }
+    report("parse (msgpack Header)", count, start, bench_clock::now());
+
+    if (failures != 0) {
+        ::fprintf(stderr, "%zu headers failed to parse\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+/* bench/DtoDispatch.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* afv_bench_dto_dispatch times the per-datagram DTO dispatch step: UDPChannel's
+ * dispatch table, matched on the raw name bytes, against the string-keyed
+ * unordered_map of std::function it replaced.
+ *
+ * The DTO mix is what a client sees while listening - almost all voice, with the
+ * odd heartbeat acknowledgement.
+ *
+ * usage: afv_bench_dto_dispatch [dispatches]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <event2/event.h>
+
+#include "afv-native/cryptodto/UDPChannel.h"
+
+using namespace afv_native;
+
+namespace {
+    typedef std::chrono::steady_clock bench_clock;
+    typedef std::function<void(const unsigned char *data, size_t len)> dto_callback_t;
+
+    const size_t defaultDispatches = 10000000;
+    /** one heartbeat acknowledgement for every this many voice packets. */
+    const size_t voicePerHeartbeat = 250;
+
+    struct ReceivedName {
+        const char *Name;
+        size_t NameLen;
+    };
+
+    /** DispatchChannel exposes UDPChannel's dispatch table lookup, and repeats the
+     * steps processDatagram takes around it. */
+    class DispatchChannel: public cryptodto::UDPChannel {
+    public:
+        explicit DispatchChannel(struct event_base *evBase):
+            cryptodto::UDPChannel(evBase)
+        {
+        }
+
+        void dispatch(const char *dtoName, size_t dtoNameLen, const unsigned char *payload, size_t payloadLen)
+        {
+            cryptodto::DtoHandlerFunc func = nullptr;
+            void *userData = nullptr;
+            std::shared_ptr<const dto_callback_t> callback;
+            {
+                std::lock_guard<std::mutex> handlersGuard(mDtoHandlersLock);
+                const DtoHandlerEntry *handler = findDtoHandler(dtoName, dtoNameLen);
+                if (handler == nullptr) {
+                    return;
+                }
+                func = handler->Func;
+                userData = handler->UserData;
+                callback = handler->Callback;
+            }
+            if (callback) {
+                (*callback)(payload, payloadLen);
+            } else {
+                func(payload, payloadLen, userData);
+            }
+        }
+    };
+
+    uint64_t voiceHandled = 0;
+    uint64_t heartbeatsHandled = 0;
+
+    void voiceHandler(const unsigned char *data, size_t len, void *user_data)
+    {
+        voiceHandled += len;
+    }
+
+    void report(const char *name, size_t count, bench_clock::time_point start, bench_clock::time_point end)
+    {
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        ::printf("%-28s %8.2f ns/dto  %12.0f dtos/s\n", name, seconds * 1e9 / count, count / seconds);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = defaultDispatches;
+    if (argc > 1) {
+        count = std::strtoul(argv[1], nullptr, 10);
+    }
+    if (count == 0) {
+        ::fprintf(stderr, "usage: %s [dispatches]\n", argv[0]);
+        return 1;
+    }
+
+    // the names point into a datagram-like buffer, as they do when received.
+    const char nameBytes[] = "ARHA";
+    std::vector<ReceivedName> received;
+    received.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (i % voicePerHeartbeat == 0) {
+            received.push_back({nameBytes + 2, 2});
+        } else {
+            received.push_back({nameBytes, 2});
+        }
+    }
+    const unsigned char payload[64] = {};
+
+    struct event_base *evBase = event_base_new();
+    {
+        DispatchChannel channel(evBase);
+        channel.registerDtoHandler("AR", &voiceHandler, nullptr);
+        channel.registerDtoHandler("HA", [](const unsigned char *data, size_t len) {
+            heartbeatsHandled++;
+        });
+
+        auto start = bench_clock::now();
+        for (const auto &name: received) {
+            channel.dispatch(name.Name, name.NameLen, payload, sizeof(payload));
+        }
+        report("dispatch table", count, start, bench_clock::now());
+    }
+    event_base_free(evBase);
+
+    std::unordered_map<std::string, dto_callback_t> handlerMap;
+    handlerMap["AR"] = [](const unsigned char *data, size_t len) {
+        voiceHandler(data, len, nullptr);
+    };
+    handlerMap["HA"] = [](const unsigned char *data, size_t len) {
+        heartbeatsHandled++;
+    };
+
+    auto start = bench_clock::now();
+    for (const auto &name: received) {
+        const std::string dtoName(name.Name, name.NameLen);
+        auto dtoIter = handlerMap.find(dtoName);
+        if (dtoIter != handlerMap.end()) {
+            dtoIter->second(payload, sizeof(payload));
+        }
+    }
+    report("unordered_map<std::function>", count, start, bench_clock::now());
+
+    const uint64_t expected = 2 * count;
+    const uint64_t handled = heartbeatsHandled + voiceHandled / sizeof(payload);
+    if (handled != expected) {
+        ::fprintf(stderr, "only %llu of %llu dtos were handled\n",
+                  static_cast<unsigned long long>(handled), static_cast<unsigned long long>(expected));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+/* bench/SequenceTestThroughput.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* afv_bench_sequencetest times SequenceTest's replay check over a few arrival
+ * patterns, across a range of window sizes, and reports how many packets each
+ * window wrongly rejected as replays.
+ *
+ * usage: afv_bench_sequencetest [packets]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "afv-native/cryptodto/SequenceTest.h"
+
+using namespace afv_native;
+
+namespace {
+    typedef std::chrono::steady_clock bench_clock;
+
+    const size_t defaultPackets = 10000000;
+    /** the reordered pattern shuffles packets within blocks of this many. */
+    const size_t reorderSpan = 200;
+    /** the lossy pattern drops one packet in this many. */
+    const unsigned lossOneIn = 50;
+    /** the jumping pattern skips this far ahead every jumpEvery packets. */
+    const cryptodto::sequence_t jumpDistance = 10000;
+    const size_t jumpEvery = 1000;
+
+    struct Pattern {
+        const char *Name;
+        std::vector<cryptodto::sequence_t> Sequences;
+    };
+
+    std::vector<Pattern> makePatterns(size_t count)
+    {
+        std::mt19937_64 rng(20191);
+        std::vector<Pattern> patterns;
+
+        Pattern inOrder{"in order", {}};
+        inOrder.Sequences.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            inOrder.Sequences.push_back(i);
+        }
+        patterns.push_back(inOrder);
+
+        Pattern reordered{"reordered", inOrder.Sequences};
+        for (size_t i = 0; i < count; i += reorderSpan) {
+            auto blockEnd = reordered.Sequences.begin() + std::min(count, i + reorderSpan);
+            std::shuffle(reordered.Sequences.begin() + i, blockEnd, rng);
+        }
+        patterns.push_back(reordered);
+
+        Pattern lossy{"lossy", {}};
+        lossy.Sequences.reserve(count);
+        for (cryptodto::sequence_t seq = 0; lossy.Sequences.size() < count; seq++) {
+            if (rng() % lossOneIn != 0) {
+                lossy.Sequences.push_back(seq);
+            }
+        }
+        patterns.push_back(lossy);
+
+        Pattern jumping{"jumping", {}};
+        jumping.Sequences.reserve(count);
+        cryptodto::sequence_t seq = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0 && i % jumpEvery == 0) {
+                seq += jumpDistance;
+            }
+            jumping.Sequences.push_back(seq++);
+        }
+        patterns.push_back(jumping);
+
+        return patterns;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = defaultPackets;
+    if (argc > 1) {
+        count = std::strtoul(argv[1], nullptr, 10);
+    }
+    if (count == 0) {
+        ::fprintf(stderr, "usage: %s [packets]\n", argv[0]);
+        return 1;
+    }
+
+    const std::vector<Pattern> patterns = makePatterns(count);
+    const unsigned windows[] = {64, cryptodto::defaultSequenceWindow, 1024, cryptodto::maxSequenceWindow};
+
+    ::printf("%zu packets per run\n", count);
+    ::printf("%-10s %6s %12s %14s %10s\n", "pattern", "window", "ns/packet", "packets/s", "rejected");
+    for (const auto &pattern: patterns) {
+        for (unsigned window: windows) {
+            cryptodto::SequenceTest sequenceTest(0, window);
+            size_t rejected = 0;
+
+            const auto start = bench_clock::now();
+            for (auto sequence: pattern.Sequences) {
+                if (sequenceTest.Received(sequence) == cryptodto::ReceiveOutcome::Before) {
+                    rejected++;
+                }
+            }
+            const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+            ::printf("%-10s %6u %12.2f %14.0f %10zu\n",
+                     pattern.Name, window, seconds * 1e9 / count, count / seconds, rejected);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,403 @@
+/* bench/UDPChannelLoad.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* afv_bench_udpchannel_load measures how many datagrams per second a UDPChannel
+ * can send and receive over the loopback interface, and how many syscalls it makes
+ * doing so.
+ *
+ * A plain socket stands in for the voice server.  The send test has the channel
+ * send heartbeats at it as fast as it can, first one sendDto at a time and then
+ * corked into batches.  The receive test has a second thread blast pre-sealed voice
+ * packets at the channel, which counts them from its AR handler.
+ *
+ * usage: afv_bench_udpchannel_load [datagrams]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <event2/event.h>
+#include <openssl/rand.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "afv-native/afv/dto/voice_server/AudioRxOnTransceivers.h"
+#include "afv-native/afv/dto/voice_server/Heartbeat.h"
+#include "afv-native/cryptodto/UDPChannel.h"
+#include "afv-native/cryptodto/dto/ChannelConfig.h"
+
+using namespace afv_native;
+
+namespace {
+    typedef std::chrono::steady_clock bench_clock;
+
+    const size_t defaultDatagrams = 200000;
+    const int socketBufferBytes = 4 * 1024 * 1024;
+    /** roughly the size of an Opus voice frame at our bitrate. */
+    const size_t voicePayloadBytes = 60;
+    /** how many datagrams the blaster hands to each sendmmsg. */
+    const unsigned blastBatchSize = 64;
+    /** how long the receiving side waits for stragglers once the sender is done. */
+    const int settleMs = 300;
+
+    double secondsBetween(bench_clock::time_point start, bench_clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    /** LoopbackPeer is the stand-in voice server: a plain UDP socket on 127.0.0.1. */
+    class LoopbackPeer {
+    public:
+        int Socket;
+        uint16_t Port;
+        struct sockaddr_storage Client;
+        socklen_t ClientLen;
+        std::atomic<uint64_t> Received;
+
+        LoopbackPeer():
+            Socket(-1),
+            Port(0),
+            Client(),
+            ClientLen(0),
+            Received(0),
+            mDraining(false),
+            mDrainThread()
+        {
+        }
+
+        ~LoopbackPeer()
+        {
+            stopDrain();
+            if (Socket >= 0) {
+                ::close(Socket);
+            }
+        }
+
+        bool open()
+        {
+            Socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+            if (Socket < 0) {
+                return false;
+            }
+            ::setsockopt(Socket, SOL_SOCKET, SO_RCVBUF, &socketBufferBytes, sizeof(socketBufferBytes));
+            ::setsockopt(Socket, SOL_SOCKET, SO_SNDBUF, &socketBufferBytes, sizeof(socketBufferBytes));
+            // the drain thread polls its stop flag between reads.
+            struct timeval timeout = {0, 100 * 1000};
+            ::setsockopt(Socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            struct sockaddr_in addr;
+            ::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = 0;
+            if (::bind(Socket, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+                return false;
+            }
+            socklen_t addrLen = sizeof(addr);
+            if (::getsockname(Socket, reinterpret_cast<struct sockaddr *>(&addr), &addrLen) != 0) {
+                return false;
+            }
+            Port = ntohs(addr.sin_port);
+            return true;
+        }
+
+        /** startDrain reads (and counts) everything sent to the peer on a thread of its own. */
+        void startDrain()
+        {
+            mDraining = true;
+            mDrainThread = std::thread([this]() {
+                unsigned char buffer[cryptodto::maxTxDatagramSize];
+                while (mDraining.load()) {
+                    struct sockaddr_storage from;
+                    socklen_t fromLen = sizeof(from);
+                    auto dgSize = ::recvfrom(Socket, buffer, sizeof(buffer), 0, reinterpret_cast<struct sockaddr *>(&from), &fromLen);
+                    if (dgSize < 0) {
+                        continue;
+                    }
+                    if (ClientLen == 0) {
+                        ::memcpy(&Client, &from, fromLen);
+                        ClientLen = fromLen;
+                    }
+                    Received++;
+                }
+            });
+        }
+
+        void stopDrain()
+        {
+            mDraining = false;
+            if (mDrainThread.joinable()) {
+                mDrainThread.join();
+            }
+        }
+
+    private:
+        std::atomic<bool> mDraining;
+        std::thread mDrainThread;
+    };
+
+    cryptodto::dto::ChannelConfig makeClientConfig()
+    {
+        cryptodto::dto::ChannelConfig clientConfig;
+        clientConfig.ChannelTag = "afv-bench-load";
+        RAND_bytes(clientConfig.AeadReceiveKey, cryptodto::aeadModeKeySize);
+        RAND_bytes(clientConfig.AeadTransmitKey, cryptodto::aeadModeKeySize);
+        return clientConfig;
+    }
+
+    /** makeServerConfig returns the server's view of clientConfig, which has the keys
+     * the other way around. */
+    cryptodto::dto::ChannelConfig makeServerConfig(const cryptodto::dto::ChannelConfig &clientConfig)
+    {
+        cryptodto::dto::ChannelConfig serverConfig(clientConfig);
+        ::memcpy(serverConfig.AeadReceiveKey, clientConfig.AeadTransmitKey, cryptodto::aeadModeKeySize);
+        ::memcpy(serverConfig.AeadTransmitKey, clientConfig.AeadReceiveKey, cryptodto::aeadModeKeySize);
+        return serverConfig;
+    }
+
+    void runSendTest(cryptodto::UDPChannel &channel, LoopbackPeer &peer, size_t count, bool batched)
+    {
+        const afv::dto::Heartbeat heartbeat("LOAD");
+        const uint64_t syscallsBefore = channel.TxSyscalls.load();
+        const uint64_t datagramsBefore = channel.TxDatagrams.load();
+        const uint64_t receivedBefore = peer.Received.load();
+
+        const auto start = bench_clock::now();
+        size_t sent = 0;
+        while (sent < count) {
+            if (batched) {
+                cryptodto::UDPChannel::TxBatch batch(channel);
+                for (int i = 0; i < cryptodto::udpTxBatchSize && sent < count; i++, sent++) {
+                    channel.sendDto(heartbeat);
+                }
+            } else {
+                channel.sendDto(heartbeat);
+                sent++;
+            }
+        }
+        const double elapsed = secondsBetween(start, bench_clock::now());
+        std::this_thread::sleep_for(std::chrono::milliseconds(settleMs));
+
+        const uint64_t syscalls = channel.TxSyscalls.load() - syscallsBefore;
+        const uint64_t datagrams = channel.TxDatagrams.load() - datagramsBefore;
+        const uint64_t delivered = peer.Received.load() - receivedBefore;
+        printf("send %-9s %10.0f datagrams/s  %6.3f syscalls/datagram  %llu of %llu delivered\n",
+               batched ? "(batched)" : "(single)",
+               static_cast<double>(datagrams) / elapsed,
+               datagrams ? static_cast<double>(syscalls) / static_cast<double>(datagrams) : 0.0,
+               static_cast<unsigned long long>(delivered),
+               static_cast<unsigned long long>(count));
+    }
+
+    struct ReceiveCounter {
+        uint64_t Count = 0;
+        bench_clock::time_point Last;
+    };
+
+    void countVoicePacket(const unsigned char *bufIn, size_t bufLen, void *user_data)
+    {
+        auto *counter = reinterpret_cast<ReceiveCounter *>(user_data);
+        counter->Count++;
+        counter->Last = bench_clock::now();
+    }
+
+    struct ReceiveWatch {
+        struct event_base *EvBase;
+        const std::atomic<bool> *SenderDone;
+        const ReceiveCounter *Counter;
+        uint64_t LastCount;
+    };
+
+    void receiveWatchCallback(evutil_socket_t fd, short events, void *arg)
+    {
+        auto *watch = reinterpret_cast<ReceiveWatch *>(arg);
+        // once the sender has finished, stop when a whole tick passes without a datagram.
+        if (watch->SenderDone->load() && watch->Counter->Count == watch->LastCount) {
+            event_base_loopbreak(watch->EvBase);
+        }
+        watch->LastCount = watch->Counter->Count;
+    }
+
+    void runReceiveTest(
+            struct event_base *evBase,
+            cryptodto::UDPChannel &channel,
+            cryptodto::Channel &peerChannel,
+            LoopbackPeer &peer,
+            size_t count)
+    {
+        if (peer.ClientLen == 0) {
+            fprintf(stderr, "receive: never heard from the channel, so don't know where to send\n");
+            return;
+        }
+
+        // seal everything up front so the blaster only has to send.
+        afv::dto::AudioRxOnTransceivers voiceDto;
+        voiceDto.Callsign = "LOAD";
+        voiceDto.Audio.assign(voicePayloadBytes, 0x55);
+        voiceDto.LastPacket = false;
+        afv::dto::RxTransceiver rxTrx;
+        rxTrx.ID = 0;
+        rxTrx.Frequency = 122800000;
+        rxTrx.DistanceRatio = 1.0f;
+        voiceDto.Transceivers.push_back(rxTrx);
+
+        std::vector<unsigned char> sealed(count * cryptodto::maxTxDatagramSize);
+        std::vector<size_t> sealedLen(count);
+        for (size_t i = 0; i < count; i++) {
+            voiceDto.SequenceCounter = static_cast<uint32_t>(i);
+            sealedLen[i] = peerChannel.Encapsulate(
+                    sealed.data() + i * cryptodto::maxTxDatagramSize,
+                    cryptodto::maxTxDatagramSize,
+                    static_cast<cryptodto::sequence_t>(i),
+                    cryptodto::CryptoModeChaCha20Poly1305,
+                    voiceDto);
+        }
+
+        ReceiveCounter counter;
+        channel.registerDtoHandler("AR", &countVoicePacket, &counter);
+        const uint64_t syscallsBefore = channel.RxSyscalls.load();
+        const uint64_t wakeupsBefore = channel.RxWakeups.load();
+        const uint64_t datagramsBefore = channel.RxDatagrams.load();
+
+        std::atomic<bool> senderDone(false);
+        ReceiveWatch watch = {evBase, &senderDone, &counter, 0};
+        struct event *watchTimer = event_new(evBase, -1, EV_PERSIST, &receiveWatchCallback, &watch);
+        const struct timeval tick = {0, settleMs * 1000};
+        event_add(watchTimer, &tick);
+
+        const auto start = bench_clock::now();
+        std::thread blaster([&]() {
+#ifdef __linux__
+            struct mmsghdr msgs[blastBatchSize];
+            struct iovec iovecs[blastBatchSize];
+            size_t next = 0;
+            while (next < count) {
+                const unsigned batch = static_cast<unsigned>(std::min<size_t>(blastBatchSize, count - next));
+                ::memset(msgs, 0, sizeof(msgs));
+                for (unsigned i = 0; i < batch; i++) {
+                    iovecs[i].iov_base = sealed.data() + (next + i) * cryptodto::maxTxDatagramSize;
+                    iovecs[i].iov_len = sealedLen[next + i];
+                    msgs[i].msg_hdr.msg_name = &peer.Client;
+                    msgs[i].msg_hdr.msg_namelen = peer.ClientLen;
+                    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                const int sent = ::sendmmsg(peer.Socket, msgs, batch, 0);
+                if (sent <= 0) {
+                    break;
+                }
+                next += static_cast<size_t>(sent);
+            }
+#else
+            for (size_t i = 0; i < count; i++) {
+                ::sendto(peer.Socket, sealed.data() + i * cryptodto::maxTxDatagramSize, sealedLen[i], 0,
+                         reinterpret_cast<const struct sockaddr *>(&peer.Client), peer.ClientLen);
+            }
+#endif
+            senderDone = true;
+        });
+        event_base_dispatch(evBase);
+        blaster.join();
+        event_free(watchTimer);
+        channel.unregisterDtoHandler("AR");
+
+        const double elapsed = counter.Count ? secondsBetween(start, counter.Last) : 0.0;
+        const uint64_t syscalls = channel.RxSyscalls.load() - syscallsBefore;
+        const uint64_t wakeups = channel.RxWakeups.load() - wakeupsBefore;
+        const uint64_t datagrams = channel.RxDatagrams.load() - datagramsBefore;
+        printf("receive          %10.0f datagrams/s  %6.3f syscalls/datagram  %6.3f wakeups/datagram  %llu of %llu handled\n",
+               elapsed > 0.0 ? static_cast<double>(counter.Count) / elapsed : 0.0,
+               datagrams ? static_cast<double>(syscalls) / static_cast<double>(datagrams) : 0.0,
+               datagrams ? static_cast<double>(wakeups) / static_cast<double>(datagrams) : 0.0,
+               static_cast<unsigned long long>(counter.Count),
+               static_cast<unsigned long long>(count));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = defaultDatagrams;
+    if (argc > 1) {
+        count = std::strtoul(argv[1], nullptr, 10);
+    }
+    if (count == 0) {
+        fprintf(stderr, "usage: %s [datagrams]\n", argv[0]);
+        return 1;
+    }
+
+    LoopbackPeer peer;
+    if (!peer.open()) {
+        fprintf(stderr, "couldn't open the loopback peer socket\n");
+        return 1;
+    }
+
+    const cryptodto::dto::ChannelConfig clientConfig = makeClientConfig();
+    cryptodto::Channel peerChannel;
+    peerChannel.setChannelConfig(makeServerConfig(clientConfig));
+
+    struct event_base *evBase = event_base_new();
+    {
+        cryptodto::UDPChannel channel(evBase);
+        cryptodto::UDPSocketOptions options;
+        options.ReceiveBufferBytes = socketBufferBytes;
+        options.SendBufferBytes = socketBufferBytes;
+        channel.setSocketOptions(options);
+        channel.setAddress("127.0.0.1:" + std::to_string(peer.Port));
+        channel.setChannelConfig(clientConfig);
+        if (!channel.open()) {
+            fprintf(stderr, "couldn't open the channel\n");
+            event_base_free(evBase);
+            return 1;
+        }
+
+        peer.startDrain();
+        runSendTest(channel, peer, count, false);
+        runSendTest(channel, peer, count, true);
+        peer.stopDrain();
+
+        runReceiveTest(evBase, channel, peerChannel, peer, count);
+        channel.close();
+    }
+    event_base_free(evBase);
+    return 0;
+}
@@ -15,6 +15,11 @@ class AfvNativeConan(ConanFile):
         "audio_library": ["portaudio", "soundio"],
         "build_examples": [True, False],
         "build_tests": [True, False],
+        "build_benchmarks": [True, False],
+        # debug only: reports locks, allocations and logging on the audio callback
+        # threads.  The checked library replaces the global operator new and delete,
+        # and so the allocator of the program it's linked into.
+        "rt_checks": [True, False],
     }
     default_options = {
         "shared": False,
@@ -22,6 +27,8 @@ class AfvNativeConan(ConanFile):
         "audio_library": "portaudio",
         "build_examples": False,
         "build_tests": False,
+        "build_benchmarks": False,
+        "rt_checks": False,
         "*:shared": False,
         "*:fPIC": True,
         "libcurl:with_ssl": "openssl",
@@ -48,7 +55,8 @@ class AfvNativeConan(ConanFile):
         "!extern/*/.git",
         "include/*",
         "src/*",
-        "test/*",
+        "tests/*",
+        "bench/*",
         "CMakeLists.txt",
         "Doxyfile",
         "README.md",
@@ -79,14 +87,19 @@ class AfvNativeConan(ConanFile):
 
     def _configure_cmake(self):
         cmake = CMake(self)
-        cmake.configure(source_folder=".")
         cmake.definitions["AFV_NATIVE_AUDIO_LIBRARY"] = self.options.audio_library
         cmake.definitions["BUILD_EXAMPLES"] = self.options.build_examples
+        cmake.definitions["BUILD_TESTS"] = self.options.build_tests
+        cmake.definitions["BUILD_BENCHMARKS"] = self.options.build_benchmarks
+        cmake.definitions["AFV_NATIVE_RT_CHECKS"] = self.options.rt_checks
+        cmake.configure(source_folder=".")
         return cmake
 
     def build(self):
         cmake = self._configure_cmake()
         cmake.build()
+        if self.options.build_tests:
+            cmake.test()
 
     def package(self):
         cmake = self._configure_cmake()
@@ -95,4 +108,6 @@ class AfvNativeConan(ConanFile):
     def package_info(self):
         self.cpp_info.libs = ["afv_native"]
         if self.settings.compiler == 'Visual Studio':
-            self.cpp_info.defines += ["_USE_MATH_DEFINES"]
\ No newline at end of file
+            self.cpp_info.defines += ["_USE_MATH_DEFINES"]
+        if self.options.rt_checks:
+            self.cpp_info.defines += ["AFV_NATIVE_RT_CHECKS"]
\ No newline at end of file
@@ -0,0 +1,209 @@
+/* afv-loadserver/MockApiServer.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "MockApiServer.h"
+
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <vector>
+#include <event2/buffer.h>
+#include <event2/keyvalq_struct.h>
+#include <nlohmann/json.hpp>
+
+#include "afv-native/cryptodto/dto/ChannelConfig.h"
+#include "afv-native/util/base64.h"
+
+using namespace afv_loadserver;
+using namespace afv_native;
+using json = nlohmann::json;
+
+/** lifetime of the tokens we issue.  The client refreshes a minute before expiry. */
+static const time_t tokenLifetimeSec = 60 * 60;
+
+static std::string base64Url(const std::string &in)
+{
+    std::string out = util::Base64Encode(reinterpret_cast<const unsigned char *>(in.data()), in.size());
+    for (auto &c: out) {
+        if (c == '+') {
+            c = '-';
+        } else if (c == '/') {
+            c = '_';
+        }
+    }
+    while (!out.empty() && out.back() == '=') {
+        out.pop_back();
+    }
+    return out;
+}
+
+static std::vector<std::string> splitPath(const char *path)
+{
+    std::vector<std::string> parts;
+    std::string part;
+    for (const char *p = path; *p != '\0'; p++) {
+        if (*p == '/') {
+            if (!part.empty()) {
+                parts.emplace_back(std::move(part));
+                part.clear();
+            }
+        } else {
+            part += *p;
+        }
+    }
+    if (!part.empty()) {
+        parts.emplace_back(std::move(part));
+    }
+    return parts;
+}
+
+MockApiServer::MockApiServer(struct event_base *evBase, VoiceServer &voiceServer):
+        Requests(0),
+        mEvBase(evBase),
+        mVoiceServer(voiceServer),
+        mHttp(nullptr)
+{
+}
+
+MockApiServer::~MockApiServer()
+{
+    if (mHttp != nullptr) {
+        evhttp_free(mHttp);
+    }
+}
+
+bool MockApiServer::open(const std::string &address, uint16_t port)
+{
+    mHttp = evhttp_new(mEvBase);
+    if (mHttp == nullptr) {
+        return false;
+    }
+    evhttp_set_allowed_methods(mHttp, EVHTTP_REQ_GET | EVHTTP_REQ_POST | EVHTTP_REQ_DELETE);
+    evhttp_set_gencb(mHttp, &MockApiServer::requestCallback, this);
+    if (evhttp_bind_socket(mHttp, address.c_str(), port) != 0) {
+        fprintf(stderr, "apiserver: couldn't bind %s:%u\n", address.c_str(), port);
+        return false;
+    }
+    return true;
+}
+
+void MockApiServer::requestCallback(struct evhttp_request *req, void *arg)
+{
+    reinterpret_cast<MockApiServer *>(arg)->handleRequest(req);
+}
+
+std::string MockApiServer::makeToken()
+{
+    const json header = {{"alg", "none"}, {"typ", "JWT"}};
+    const json payload = {{"exp", static_cast<uint64_t>(time(nullptr) + tokenLifetimeSec)}};
+    return base64Url(header.dump()) + "." + base64Url(payload.dump()) + ".";
+}
+
+void MockApiServer::sendResponse(struct evhttp_request *req, int code, const std::string &contentType, const std::string &body)
+{
+    struct evbuffer *outBuf = evbuffer_new();
+    evbuffer_add(outBuf, body.data(), body.size());
+    if (!contentType.empty()) {
+        evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", contentType.c_str());
+    }
+    evhttp_send_reply(req, code, (code == HTTP_OK) ? "OK" : "Error", outBuf);
+    evbuffer_free(outBuf);
+}
+
+void MockApiServer::handleRequest(struct evhttp_request *req)
+{
+    Requests++;
+    const enum evhttp_cmd_type method = evhttp_request_get_command(req);
+    const struct evhttp_uri *uri = evhttp_request_get_evhttp_uri(req);
+    const char *path = (uri != nullptr) ? evhttp_uri_get_path(uri) : nullptr;
+    if (path == nullptr) {
+        sendResponse(req, HTTP_BADREQUEST, "", "");
+        return;
+    }
+    const auto parts = splitPath(path);
+
+    struct evbuffer *inBuf = evhttp_request_get_input_buffer(req);
+    const size_t bodyLen = evbuffer_get_length(inBuf);
+    const std::string body(reinterpret_cast<const char *>(evbuffer_pullup(inBuf, -1)), bodyLen);
+
+    if (parts.size() < 3 || parts[0] != "api" || parts[1] != "v1") {
+        sendResponse(req, HTTP_NOTFOUND, "", "");
+        return;
+    }
+    // POST /api/v1/auth
+    if (parts.size() == 3 && parts[2] == "auth" && method == EVHTTP_REQ_POST) {
+        sendResponse(req, HTTP_OK, "text/plain", makeToken());
+        return;
+    }
+    // GET /api/v1/stations/aliased
+    if (parts.size() == 4 && parts[2] == "stations" && parts[3] == "aliased" && method == EVHTTP_REQ_GET) {
+        sendResponse(req, HTTP_OK, "application/json", "[]");
+        return;
+    }
+    // /api/v1/users/{username}/callsigns/{callsign}[/transceivers]
+    if (parts.size() >= 6 && parts[2] == "users" && parts[4] == "callsigns") {
+        const std::string &callsign = parts[5];
+        if (parts.size() == 6 && method == EVHTTP_REQ_POST) {
+            const json cresp = {
+                    {"voiceServer", {
+                            {"addressIpV4", mVoiceServer.getAddress()},
+                            {"addressIpV6", ""},
+                            {"channelConfig", mVoiceServer.createSession(callsign)},
+                    }},
+            };
+            sendResponse(req, HTTP_OK, "application/json", cresp.dump());
+            return;
+        }
+        if (parts.size() == 6 && method == EVHTTP_REQ_DELETE) {
+            mVoiceServer.removeSession(callsign);
+            sendResponse(req, HTTP_OK, "", "");
+            return;
+        }
+        if (parts.size() == 7 && parts[6] == "transceivers" && method == EVHTTP_REQ_POST) {
+            std::map<uint16_t, uint32_t> tuning;
+            try {
+                const auto trxList = json::parse(body);
+                for (const auto &trx: trxList) {
+                    tuning[trx.at("ID").get<uint16_t>()] = trx.at("Frequency").get<uint32_t>();
+                }
+            } catch (json::exception &e) {
+                sendResponse(req, HTTP_BADREQUEST, "", "");
+                return;
+            }
+            mVoiceServer.setTuning(callsign, std::move(tuning));
+            sendResponse(req, HTTP_OK, "", "");
+            return;
+        }
+    }
+    sendResponse(req, HTTP_NOTFOUND, "", "");
+}
@@ -0,0 +1,74 @@
+/* afv-loadserver/MockApiServer.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_LOADSERVER_MOCKAPISERVER_H
+#define AFV_LOADSERVER_MOCKAPISERVER_H
+
+#include <cstdint>
+#include <string>
+#include <event2/event.h>
+#include <event2/http.h>
+
+#include "VoiceServer.h"
+
+namespace afv_loadserver {
+    /** MockApiServer answers the subset of the AFV HTTP API that the client uses.
+     *
+     * Authentication always succeeds and returns an unsigned token.  Callsign
+     * registration creates a session on the VoiceServer, and transceiver updates set
+     * that session's tuning.
+     */
+    class MockApiServer {
+    public:
+        MockApiServer(struct event_base *evBase, VoiceServer &voiceServer);
+        MockApiServer(const MockApiServer &cpysrc) = delete;
+        virtual ~MockApiServer();
+
+        bool open(const std::string &address, uint16_t port);
+
+        uint64_t Requests;
+
+    protected:
+        struct event_base *mEvBase;
+        VoiceServer &mVoiceServer;
+        struct evhttp *mHttp;
+
+        static void requestCallback(struct evhttp_request *req, void *arg);
+        void handleRequest(struct evhttp_request *req);
+
+        static std::string makeToken();
+        static void sendResponse(struct evhttp_request *req, int code, const std::string &contentType, const std::string &body);
+    };
+}
+
+#endif //AFV_LOADSERVER_MOCKAPISERVER_H
@@ -0,0 +1,179 @@
+/* afv-loadserver/SyntheticTalkers.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SyntheticTalkers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <opus/include/opus.h>
+
+#include "afv-native/audio/audio_params.h"
+
+using namespace afv_loadserver;
+using namespace afv_native;
+
+/** number of distinct tones the talkers are spread across. */
+static const size_t talkerClipCount = 8;
+
+/** length of each tone loop, in frames. */
+static const size_t talkerClipFrames = 50;
+
+/** the largest packet Opus will produce for a single frame. */
+static const size_t maxOpusPacketSize = 1275;
+
+SyntheticTalkers::SyntheticTalkers(struct event_base *evBase, VoiceServer &server, const TalkerConfig &config):
+        FramesSent(0),
+        mEvBase(evBase),
+        mServer(server),
+        mConfig(config),
+        mFrameTimer(nullptr),
+        mClips(),
+        mTalkers(),
+        mFrameNumber(0)
+{
+    mFrameTimer = event_new(mEvBase, -1, EV_PERSIST, &SyntheticTalkers::frameTimerCallback, this);
+}
+
+SyntheticTalkers::~SyntheticTalkers()
+{
+    stop();
+    event_free(mFrameTimer);
+}
+
+bool SyntheticTalkers::encodeClips()
+{
+    int opusStatus;
+    OpusEncoder *encoder = opus_encoder_create(audio::sampleRateHz, 1, OPUS_APPLICATION_VOIP, &opusStatus);
+    if (opusStatus != OPUS_OK) {
+        fprintf(stderr, "talkers: couldn't create encoder: %s\n", opus_strerror(opusStatus));
+        return false;
+    }
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(audio::encoderBitrate));
+
+    std::vector<audio::SampleType> pcm(audio::frameSizeSamples);
+    unsigned char encoded[maxOpusPacketSize];
+    mClips.resize(talkerClipCount);
+    for (size_t clip = 0; clip < talkerClipCount; clip++) {
+        const double toneHz = 400.0 + (clip * 75.0);
+        size_t sampleNumber = 0;
+        for (size_t frame = 0; frame < talkerClipFrames; frame++) {
+            for (auto &sample: pcm) {
+                sample = 0.3f * static_cast<float>(std::sin(2.0 * M_PI * toneHz * sampleNumber++ / audio::sampleRateHz));
+            }
+            const auto encLen = opus_encode_float(
+                    encoder, pcm.data(), audio::frameSizeSamples, encoded, sizeof(encoded));
+            if (encLen < 0) {
+                fprintf(stderr, "talkers: error encoding: %s\n", opus_strerror(encLen));
+                opus_encoder_destroy(encoder);
+                return false;
+            }
+            mClips[clip].emplace_back(encoded, encoded + encLen);
+        }
+    }
+    opus_encoder_destroy(encoder);
+    return true;
+}
+
+bool SyntheticTalkers::start()
+{
+    if (mConfig.Count == 0) {
+        return true;
+    }
+    if (mClips.empty() && !encodeClips()) {
+        return false;
+    }
+    const unsigned talkFrames = std::max(1U, mConfig.TalkMs / audio::frameLengthMs);
+    const unsigned cycleFrames = talkFrames + (mConfig.GapMs / audio::frameLengthMs);
+
+    mTalkers.clear();
+    for (unsigned i = 0; i < mConfig.Count; i++) {
+        Talker talker;
+        char callsign[16];
+        snprintf(callsign, sizeof(callsign), "LOAD%04u", i);
+        talker.Callsign = callsign;
+        talker.Clip = i % talkerClipCount;
+        talker.Sequence = 0;
+        talker.FramesLeft = 0;
+        // spread the start of each talker's transmissions evenly over the cycle.
+        talker.FramesIdle = (i * cycleFrames) / mConfig.Count;
+        mTalkers.push_back(talker);
+    }
+
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = audio::frameLengthMs * 1000;
+    event_add(mFrameTimer, &tv);
+    return true;
+}
+
+void SyntheticTalkers::stop()
+{
+    event_del(mFrameTimer);
+}
+
+void SyntheticTalkers::frameTimerCallback(evutil_socket_t fd, short events, void *arg)
+{
+    reinterpret_cast<SyntheticTalkers *>(arg)->sendFrame();
+}
+
+void SyntheticTalkers::sendFrame()
+{
+    const unsigned talkFrames = std::max(1U, mConfig.TalkMs / audio::frameLengthMs);
+    const unsigned gapFrames = mConfig.GapMs / audio::frameLengthMs;
+
+    for (auto &talker: mTalkers) {
+        if (talker.FramesLeft == 0) {
+            if (talker.FramesIdle > 0) {
+                talker.FramesIdle--;
+                continue;
+            }
+            talker.FramesLeft = talkFrames;
+        }
+        talker.FramesLeft--;
+        // a continuous talker never ends its transmission.
+        const bool lastPacket = (talker.FramesLeft == 0) && (gapFrames > 0);
+        if (talker.FramesLeft == 0) {
+            talker.FramesIdle = gapFrames;
+        }
+        const auto &clip = mClips[talker.Clip];
+        mServer.deliverVoice(
+                talker.Callsign,
+                mConfig.Frequency,
+                talker.Sequence++,
+                clip[mFrameNumber % clip.size()],
+                lastPacket);
+        FramesSent++;
+    }
+    mFrameNumber++;
+}
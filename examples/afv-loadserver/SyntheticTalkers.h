@@ -0,0 +1,102 @@
+/* afv-loadserver/SyntheticTalkers.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_LOADSERVER_SYNTHETICTALKERS_H
+#define AFV_LOADSERVER_SYNTHETICTALKERS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <event2/event.h>
+
+#include "VoiceServer.h"
+
+namespace afv_loadserver {
+    struct TalkerConfig {
+        /** number of simultaneous synthetic talkers. */
+        unsigned Count = 0;
+        /** the frequency (in Hz) the talkers transmit on. */
+        uint32_t Frequency = 122800000;
+        /** length of each transmission. */
+        unsigned TalkMs = 5000;
+        /** pause between transmissions.  0 makes the talkers transmit continuously. */
+        unsigned GapMs = 1000;
+    };
+
+    /** SyntheticTalkers drives a set of fake stations through the VoiceServer.
+     *
+     * Each talker sends a pre-encoded tone every frame period while transmitting, and
+     * the talkers' transmissions are staggered so they don't all key up together.
+     */
+    class SyntheticTalkers {
+    public:
+        SyntheticTalkers(struct event_base *evBase, VoiceServer &server, const TalkerConfig &config);
+        SyntheticTalkers(const SyntheticTalkers &cpysrc) = delete;
+        virtual ~SyntheticTalkers();
+
+        /** start encodes the talkers' audio and begins transmitting. */
+        bool start();
+        void stop();
+
+        uint64_t FramesSent;
+
+    protected:
+        struct Talker {
+            std::string Callsign;
+            /** index into mClips of the tone this talker sends. */
+            size_t Clip;
+            uint32_t Sequence;
+            /** frames remaining in the current transmission, or 0 if not transmitting. */
+            unsigned FramesLeft;
+            /** frames remaining until the next transmission starts. */
+            unsigned FramesIdle;
+        };
+
+        struct event_base *mEvBase;
+        VoiceServer &mServer;
+        TalkerConfig mConfig;
+        struct event *mFrameTimer;
+
+        /** mClips holds a looped tone per pitch, each as a sequence of encoded frames. */
+        std::vector<std::vector<std::vector<unsigned char>>> mClips;
+        std::vector<Talker> mTalkers;
+        size_t mFrameNumber;
+
+        bool encodeClips();
+
+        static void frameTimerCallback(evutil_socket_t fd, short events, void *arg);
+        void sendFrame();
+    };
+}
+
+#endif //AFV_LOADSERVER_SYNTHETICTALKERS_H
@@ -0,0 +1,401 @@
+/* afv-loadserver/VoiceServer.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "VoiceServer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <openssl/rand.h>
+#include <msgpack.hpp>
+
+#include "afv-native/afv/dto/voice_server/AudioRxOnTransceivers.h"
+#include "afv-native/afv/dto/voice_server/AudioTxOnTransceivers.h"
+#include "afv-native/afv/params.h"
+#include "afv-native/audio/audio_params.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+using namespace afv_loadserver;
+using namespace afv_native;
+
+namespace {
+    /** HeartbeatAck is the server's reply to a client Heartbeat.  The client only looks at the name. */
+    class HeartbeatAck {
+    public:
+        std::string Callsign;
+
+        MSGPACK_DEFINE_ARRAY(Callsign);
+
+        static std::string getName()
+        {
+            return "HA";
+        }
+    };
+
+    uint64_t nowUs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+VoiceServer::VoiceServer(struct event_base *evBase, const ImpairmentConfig &impairment, AudioRouting routing, unsigned seed):
+        DatagramsIn(0),
+        DatagramsRejected(0),
+        DatagramsOut(0),
+        DatagramsLost(0),
+        Heartbeats(0),
+        VoicePacketsIn(0),
+        mEvBase(evBase),
+        mImpairment(impairment),
+        mRouting(routing),
+        mRandom(seed),
+        mAddress(),
+        mSocket(-1),
+        mSocketEvent(nullptr),
+        mPendingTimer(nullptr),
+        mRxBuffer(cryptodto::maxPermittedDatagramSize),
+        mTxBuffer(cryptodto::maxTxDatagramSize),
+        mSessions(),
+        mPending(),
+        mPendingOrder(0)
+{
+    mPendingTimer = evtimer_new(mEvBase, &VoiceServer::pendingTimerCallback, this);
+}
+
+VoiceServer::~VoiceServer()
+{
+    close();
+    event_free(mPendingTimer);
+}
+
+bool VoiceServer::open(const std::string &address)
+{
+    struct sockaddr_storage saddr;
+    int saddrLen = sizeof(saddr);
+    if (evutil_parse_sockaddr_port(address.c_str(), reinterpret_cast<struct sockaddr *>(&saddr), &saddrLen) != 0) {
+        fprintf(stderr, "voiceserver: couldn't parse address %s\n", address.c_str());
+        return false;
+    }
+    mSocket = ::socket(saddr.ss_family, SOCK_DGRAM, 0);
+    if (mSocket < 0) {
+        fprintf(stderr, "voiceserver: couldn't create socket\n");
+        return false;
+    }
+    evutil_make_socket_nonblocking(mSocket);
+    if (::bind(mSocket, reinterpret_cast<struct sockaddr *>(&saddr), saddrLen) != 0) {
+        fprintf(stderr, "voiceserver: couldn't bind %s: %s\n",
+                address.c_str(), evutil_socket_error_to_string(EVUTIL_SOCKET_ERROR()));
+        evutil_closesocket(mSocket);
+        mSocket = -1;
+        return false;
+    }
+    mAddress = address;
+    mSocketEvent = event_new(mEvBase, mSocket, EV_READ | EV_PERSIST, &VoiceServer::socketCallback, this);
+    event_add(mSocketEvent, nullptr);
+    return true;
+}
+
+void VoiceServer::close()
+{
+    if (mSocketEvent != nullptr) {
+        event_free(mSocketEvent);
+        mSocketEvent = nullptr;
+    }
+    if (mSocket >= 0) {
+        evutil_closesocket(mSocket);
+        mSocket = -1;
+    }
+    evtimer_del(mPendingTimer);
+    mPending = decltype(mPending)();
+}
+
+const std::string &VoiceServer::getAddress() const
+{
+    return mAddress;
+}
+
+cryptodto::dto::ChannelConfig VoiceServer::createSession(const std::string &callsign)
+{
+    cryptodto::dto::ChannelConfig clientConfig;
+    unsigned char tagBytes[8];
+    RAND_bytes(tagBytes, sizeof(tagBytes));
+    char tagHex[sizeof(tagBytes) * 2 + 1];
+    for (size_t i = 0; i < sizeof(tagBytes); i++) {
+        snprintf(tagHex + (i * 2), 3, "%02x", tagBytes[i]);
+    }
+    clientConfig.ChannelTag = tagHex;
+    RAND_bytes(clientConfig.AeadReceiveKey, cryptodto::aeadModeKeySize);
+    RAND_bytes(clientConfig.AeadTransmitKey, cryptodto::aeadModeKeySize);
+
+    // the server's view of the channel has the keys the other way around.
+    cryptodto::dto::ChannelConfig serverConfig(clientConfig);
+    ::memcpy(serverConfig.AeadReceiveKey, clientConfig.AeadTransmitKey, cryptodto::aeadModeKeySize);
+    ::memcpy(serverConfig.AeadTransmitKey, clientConfig.AeadReceiveKey, cryptodto::aeadModeKeySize);
+
+    std::unique_ptr<Session> session(new Session());
+    session->Callsign = callsign;
+    session->Channel.setChannelConfig(serverConfig);
+    mSessions[callsign] = std::move(session);
+    return clientConfig;
+}
+
+void VoiceServer::removeSession(const std::string &callsign)
+{
+    mSessions.erase(callsign);
+}
+
+void VoiceServer::setTuning(const std::string &callsign, std::map<uint16_t, uint32_t> tuning)
+{
+    auto sessionIter = mSessions.find(callsign);
+    if (sessionIter != mSessions.end()) {
+        sessionIter->second->Tuning = std::move(tuning);
+    }
+}
+
+size_t VoiceServer::getSessionCount() const
+{
+    return mSessions.size();
+}
+
+void VoiceServer::socketCallback(evutil_socket_t fd, short events, void *arg)
+{
+    reinterpret_cast<VoiceServer *>(arg)->readDatagrams();
+}
+
+void VoiceServer::pendingTimerCallback(evutil_socket_t fd, short events, void *arg)
+{
+    reinterpret_cast<VoiceServer *>(arg)->flushPending();
+}
+
+void VoiceServer::readDatagrams()
+{
+    for (;;) {
+        struct sockaddr_storage peer;
+        ev_socklen_t peerLen = sizeof(peer);
+        auto dgSize = ::recvfrom(
+                mSocket,
+                reinterpret_cast<char *>(mRxBuffer.data()),
+                mRxBuffer.size(),
+                0,
+                reinterpret_cast<struct sockaddr *>(&peer),
+                &peerLen);
+        if (dgSize < 0) {
+            return;
+        }
+        DatagramsIn++;
+        processDatagram(mRxBuffer.data(), static_cast<size_t>(dgSize), peer, peerLen);
+    }
+}
+
+void VoiceServer::processDatagram(unsigned char *dgBuffer, size_t dgSize, const struct sockaddr_storage &peer, ev_socklen_t peerLen)
+{
+    for (auto &sessionPair: mSessions) {
+        Session &session = *sessionPair.second;
+        cryptodto::sequence_t seq;
+        cryptodto::CryptoDtoMode mode;
+        const char *dtoName = nullptr;
+        size_t dtoNameLen = 0;
+        const unsigned char *dtoBuf = nullptr;
+        size_t dtoBufLen = 0;
+        const auto outcome = session.Channel.Decapsulate(
+                dgBuffer, dgSize, seq, mode, dtoName, dtoNameLen, dtoBuf, dtoBufLen);
+        if (outcome == cryptodto::DecapsulateOutcome::WrongTag) {
+            continue;
+        }
+        if (outcome != cryptodto::DecapsulateOutcome::OK || dtoBufLen < 2) {
+            DatagramsRejected++;
+            return;
+        }
+        ::memcpy(&session.Peer, &peer, peerLen);
+        session.PeerLen = peerLen;
+
+        const std::string name(dtoName, dtoNameLen);
+        if (name == "H") {
+            Heartbeats++;
+            HeartbeatAck ack;
+            ack.Callsign = session.Callsign;
+            sendDto(session, ack);
+        } else if (name == "AT") {
+            VoicePacketsIn++;
+            handleVoice(session, dtoBuf + 2, dtoBufLen - 2);
+        }
+        return;
+    }
+    // no session recognised the tag.
+    DatagramsRejected++;
+}
+
+void VoiceServer::handleVoice(Session &sender, const unsigned char *dtoBuf, size_t dtoLen)
+{
+    afv::dto::AudioTxOnTransceivers txDto;
+    try {
+        auto objHandle = msgpack::unpack(reinterpret_cast<const char *>(dtoBuf), dtoLen);
+        objHandle.get().convert(txDto);
+    } catch (msgpack::type_error &) {
+        DatagramsRejected++;
+        return;
+    } catch (msgpack::unpack_error &) {
+        DatagramsRejected++;
+        return;
+    }
+
+    std::vector<uint32_t> frequencies;
+    for (const auto &trx: txDto.Transceivers) {
+        auto tuningIter = sender.Tuning.find(trx.ID);
+        if (tuningIter != sender.Tuning.end()) {
+            frequencies.push_back(tuningIter->second);
+        }
+    }
+    switch (mRouting) {
+    case AudioRouting::Reflect:
+        sendAudio(sender, sender.Callsign, txDto.SequenceCounter, txDto.Audio, txDto.LastPacket, frequencies);
+        break;
+    case AudioRouting::FanOut:
+        for (auto &sessionPair: mSessions) {
+            if (sessionPair.second.get() != &sender) {
+                sendAudio(*sessionPair.second, sender.Callsign, txDto.SequenceCounter, txDto.Audio, txDto.LastPacket, frequencies);
+            }
+        }
+        break;
+    }
+}
+
+void VoiceServer::deliverVoice(
+        const std::string &callsign,
+        uint32_t frequency,
+        uint32_t sequence,
+        const std::vector<unsigned char> &audio,
+        bool lastPacket)
+{
+    const std::vector<uint32_t> frequencies{frequency};
+    for (auto &sessionPair: mSessions) {
+        sendAudio(*sessionPair.second, callsign, sequence, audio, lastPacket, frequencies);
+    }
+}
+
+void VoiceServer::sendAudio(
+        Session &target,
+        const std::string &callsign,
+        uint32_t sequence,
+        const std::vector<unsigned char> &audio,
+        bool lastPacket,
+        const std::vector<uint32_t> &frequencies)
+{
+    afv::dto::AudioRxOnTransceivers rxDto;
+    for (const auto &tuning: target.Tuning) {
+        if (rxDto.Transceivers.size() >= afv::maxRxTransceiversPerPacket) {
+            break;
+        }
+        if (std::find(frequencies.begin(), frequencies.end(), tuning.second) != frequencies.end()) {
+            afv::dto::RxTransceiver rxTrx;
+            rxTrx.ID = tuning.first;
+            rxTrx.Frequency = tuning.second;
+            rxTrx.DistanceRatio = 1.0f;
+            rxDto.Transceivers.push_back(rxTrx);
+        }
+    }
+    if (rxDto.Transceivers.empty()) {
+        return;
+    }
+    rxDto.Callsign = callsign;
+    rxDto.SequenceCounter = sequence;
+    rxDto.Audio = audio;
+    rxDto.LastPacket = lastPacket;
+    sendDto(target, rxDto);
+}
+
+void VoiceServer::transmit(const struct sockaddr_storage &peer, ev_socklen_t peerLen, const unsigned char *data, size_t len)
+{
+    std::uniform_real_distribution<double> percent(0.0, 100.0);
+    if (mImpairment.LossPercent > 0.0 && percent(mRandom) < mImpairment.LossPercent) {
+        DatagramsLost++;
+        return;
+    }
+    uint64_t delayUs = 0;
+    if (mImpairment.JitterMs > 0) {
+        std::uniform_int_distribution<uint64_t> jitter(0, mImpairment.JitterMs * 1000ULL);
+        delayUs += jitter(mRandom);
+    }
+    if (mImpairment.ReorderPercent > 0.0 && percent(mRandom) < mImpairment.ReorderPercent) {
+        delayUs += audio::frameLengthMs * 1000ULL;
+    }
+    if (delayUs == 0 && mPending.empty()) {
+        sendNow(peer, peerLen, data, len);
+        return;
+    }
+
+    PendingDatagram pending;
+    pending.DueUs = nowUs() + delayUs;
+    pending.Order = mPendingOrder++;
+    ::memcpy(&pending.Peer, &peer, peerLen);
+    pending.PeerLen = peerLen;
+    pending.Data.assign(data, data + len);
+    mPending.push(std::move(pending));
+    flushPending();
+}
+
+void VoiceServer::sendNow(const struct sockaddr_storage &peer, ev_socklen_t peerLen, const unsigned char *data, size_t len)
+{
+    if (mSocket < 0) {
+        return;
+    }
+    ::sendto(mSocket,
+             reinterpret_cast<const char *>(data),
+             len,
+             0,
+             reinterpret_cast<const struct sockaddr *>(&peer),
+             peerLen);
+    DatagramsOut++;
+}
+
+void VoiceServer::flushPending()
+{
+    const uint64_t now = nowUs();
+    while (!mPending.empty() && mPending.top().DueUs <= now) {
+        const PendingDatagram &pending = mPending.top();
+        sendNow(pending.Peer, pending.PeerLen, pending.Data.data(), pending.Data.size());
+        mPending.pop();
+    }
+    if (!mPending.empty()) {
+        const uint64_t waitUs = mPending.top().DueUs - now;
+        struct timeval tv;
+        tv.tv_sec = static_cast<long>(waitUs / 1000000);
+        tv.tv_usec = static_cast<long>(waitUs % 1000000);
+        evtimer_add(mPendingTimer, &tv);
+    }
+}
@@ -0,0 +1,212 @@
+/* afv-loadserver/VoiceServer.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_LOADSERVER_VOICESERVER_H
+#define AFV_LOADSERVER_VOICESERVER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include "afv-native/cryptodto/Channel.h"
+#include "afv-native/cryptodto/dto/ChannelConfig.h"
+#include "afv-native/cryptodto/params.h"
+
+namespace afv_loadserver {
+    /** ImpairmentConfig describes the network conditions the server simulates on
+     * every datagram it sends.
+     */
+    struct ImpairmentConfig {
+        /** percentage of datagrams silently dropped. */
+        double LossPercent = 0.0;
+        /** each datagram is delayed by a uniformly random 0..JitterMs milliseconds. */
+        unsigned JitterMs = 0;
+        /** percentage of datagrams held back an extra frame so they arrive out of order. */
+        double ReorderPercent = 0.0;
+    };
+
+    enum class AudioRouting {
+        /** voice from a client is sent straight back to that client. */
+        Reflect,
+        /** voice from a client is sent to every other client tuned to the same frequency. */
+        FanOut,
+    };
+
+    /** VoiceServer is a minimal stand-in for the AFV voice server.
+     *
+     * It speaks the cryptodto framing over a single UDP socket, answers heartbeats
+     * and routes AudioTxOnTransceivers back out as AudioRxOnTransceivers.  Sessions
+     * are created by the MockApiServer when a client registers its callsign.
+     *
+     * Everything runs on the one event_base, so no locking is done.
+     */
+    class VoiceServer {
+    public:
+        VoiceServer(struct event_base *evBase, const ImpairmentConfig &impairment, AudioRouting routing, unsigned seed);
+        VoiceServer(const VoiceServer &cpysrc) = delete;
+        virtual ~VoiceServer();
+
+        /** open binds the server's UDP socket.
+         *
+         * @param address the address and port to bind, eg "127.0.0.1:50000".
+         */
+        bool open(const std::string &address);
+        void close();
+
+        /** getAddress returns the address clients should be sent to. */
+        const std::string &getAddress() const;
+
+        /** createSession starts (or restarts) the session for callsign with fresh keys.
+         *
+         * @return the ChannelConfig to give to the client.  This is the mirror image of
+         *      the one the server uses.
+         */
+        afv_native::cryptodto::dto::ChannelConfig createSession(const std::string &callsign);
+        void removeSession(const std::string &callsign);
+
+        /** setTuning replaces the transceiver ID to frequency mapping for callsign's session. */
+        void setTuning(const std::string &callsign, std::map<uint16_t, uint32_t> tuning);
+
+        /** deliverVoice sends an AR DTO from callsign to every session with a transceiver
+         * tuned to frequency.
+         */
+        void deliverVoice(
+                const std::string &callsign,
+                uint32_t frequency,
+                uint32_t sequence,
+                const std::vector<unsigned char> &audio,
+                bool lastPacket);
+
+        size_t getSessionCount() const;
+
+        uint64_t DatagramsIn;
+        uint64_t DatagramsRejected;
+        uint64_t DatagramsOut;
+        uint64_t DatagramsLost;
+        uint64_t Heartbeats;
+        uint64_t VoicePacketsIn;
+
+    protected:
+        struct Session {
+            std::string Callsign;
+            afv_native::cryptodto::Channel Channel;
+            afv_native::cryptodto::sequence_t TxSequence = 0;
+            /** the client's address - only known once it has sent us something. */
+            struct sockaddr_storage Peer;
+            ev_socklen_t PeerLen = 0;
+            std::map<uint16_t, uint32_t> Tuning;
+        };
+
+        struct PendingDatagram {
+            uint64_t DueUs;
+            uint64_t Order;
+            struct sockaddr_storage Peer;
+            ev_socklen_t PeerLen;
+            std::vector<unsigned char> Data;
+        };
+
+        struct PendingDatagramLater {
+            bool operator()(const PendingDatagram &a, const PendingDatagram &b) const
+            {
+                return (a.DueUs != b.DueUs) ? (a.DueUs > b.DueUs) : (a.Order > b.Order);
+            }
+        };
+
+        struct event_base *mEvBase;
+        ImpairmentConfig mImpairment;
+        AudioRouting mRouting;
+        std::mt19937 mRandom;
+
+        std::string mAddress;
+        evutil_socket_t mSocket;
+        struct event *mSocketEvent;
+        struct event *mPendingTimer;
+        std::vector<unsigned char> mRxBuffer;
+        std::vector<unsigned char> mTxBuffer;
+
+        std::map<std::string, std::unique_ptr<Session>> mSessions;
+
+        std::priority_queue<PendingDatagram, std::vector<PendingDatagram>, PendingDatagramLater> mPending;
+        uint64_t mPendingOrder;
+
+        static void socketCallback(evutil_socket_t fd, short events, void *arg);
+        static void pendingTimerCallback(evutil_socket_t fd, short events, void *arg);
+
+        void readDatagrams();
+        void processDatagram(unsigned char *dgBuffer, size_t dgSize, const struct sockaddr_storage &peer, ev_socklen_t peerLen);
+        void handleVoice(Session &sender, const unsigned char *dtoBuf, size_t dtoLen);
+
+        /** sendAudio sends an AR DTO to target covering all its transceivers tuned to one
+         * of frequencies.  Nothing is sent if there are none.
+         */
+        void sendAudio(
+                Session &target,
+                const std::string &callsign,
+                uint32_t sequence,
+                const std::vector<unsigned char> &audio,
+                bool lastPacket,
+                const std::vector<uint32_t> &frequencies);
+
+        template<class T>
+        void sendDto(Session &target, const T &dto)
+        {
+            if (target.PeerLen == 0) {
+                return;
+            }
+            const size_t dgLen = target.Channel.Encapsulate(
+                    mTxBuffer.data(),
+                    mTxBuffer.size(),
+                    target.TxSequence++,
+                    afv_native::cryptodto::CryptoModeChaCha20Poly1305,
+                    dto);
+            if (dgLen > 0) {
+                transmit(target.Peer, target.PeerLen, mTxBuffer.data(), dgLen);
+            }
+        }
+
+        /** transmit applies the configured impairments to a datagram and sends or
+         * queues it.
+         */
+        void transmit(const struct sockaddr_storage &peer, ev_socklen_t peerLen, const unsigned char *data, size_t len);
+        void sendNow(const struct sockaddr_storage &peer, ev_socklen_t peerLen, const unsigned char *data, size_t len);
+        void flushPending();
+    };
+}
+
+#endif //AFV_LOADSERVER_VOICESERVER_H
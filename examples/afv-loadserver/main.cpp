@@ -0,0 +1,201 @@
+/* afv-loadserver/main.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* afv-loadserver is a local stand-in for the AFV API and voice servers.
+ *
+ * Point a client's API base URL at the server's HTTP address and it will
+ * authenticate, register and open a voice channel as normal.  Synthetic talkers can
+ * be added to load the client with any number of simultaneous incoming streams, and
+ * the link can be impaired with loss, jitter and reordering.
+ */
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <event2/event.h>
+
+#include "MockApiServer.h"
+#include "SyntheticTalkers.h"
+#include "VoiceServer.h"
+
+using namespace afv_loadserver;
+
+struct LoadServerOptions {
+    std::string ApiAddress = "127.0.0.1";
+    uint16_t ApiPort = 8080;
+    std::string VoiceAddress = "127.0.0.1:50000";
+    AudioRouting Routing = AudioRouting::Reflect;
+    ImpairmentConfig Impairment;
+    TalkerConfig Talkers;
+    unsigned Seed = 1;
+    unsigned StatsIntervalSec = 5;
+};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --api-address ADDR       address for the HTTP API (default 127.0.0.1)\n"
+            "  --api-port PORT          port for the HTTP API (default 8080)\n"
+            "  --voice-address ADDR:PORT  address for the voice server (default 127.0.0.1:50000)\n"
+            "  --routing reflect|fanout reflect voice back to the sender, or to all other clients\n"
+            "  --talkers N              number of synthetic talkers (default 0)\n"
+            "  --talker-frequency HZ    frequency the talkers transmit on (default 122800000)\n"
+            "  --talk-ms MS             length of each transmission (default 5000)\n"
+            "  --gap-ms MS              gap between transmissions, 0 for continuous (default 1000)\n"
+            "  --loss PCT               percentage of datagrams to drop\n"
+            "  --jitter MS              maximum random delay added to each datagram\n"
+            "  --reorder PCT            percentage of datagrams delayed by an extra frame\n"
+            "  --seed N                 random seed for the impairments (default 1)\n"
+            "  --stats-interval SEC     how often to print statistics, 0 to disable (default 5)\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char **argv, LoadServerOptions &opts)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        if ((i + 1) >= argc) {
+            return false;
+        }
+        const char *val = argv[++i];
+        if (strcmp(opt, "--api-address") == 0) {
+            opts.ApiAddress = val;
+        } else if (strcmp(opt, "--api-port") == 0) {
+            opts.ApiPort = static_cast<uint16_t>(strtoul(val, nullptr, 10));
+        } else if (strcmp(opt, "--voice-address") == 0) {
+            opts.VoiceAddress = val;
+        } else if (strcmp(opt, "--routing") == 0) {
+            if (strcmp(val, "reflect") == 0) {
+                opts.Routing = AudioRouting::Reflect;
+            } else if (strcmp(val, "fanout") == 0) {
+                opts.Routing = AudioRouting::FanOut;
+            } else {
+                return false;
+            }
+        } else if (strcmp(opt, "--talkers") == 0) {
+            opts.Talkers.Count = static_cast<unsigned>(strtoul(val, nullptr, 10));
+        } else if (strcmp(opt, "--talker-frequency") == 0) {
+            opts.Talkers.Frequency = static_cast<uint32_t>(strtoul(val, nullptr, 10));
+        } else if (strcmp(opt, "--talk-ms") == 0) {
+            opts.Talkers.TalkMs = static_cast<unsigned>(strtoul(val, nullptr, 10));
+        } else if (strcmp(opt, "--gap-ms") == 0) {
+            opts.Talkers.GapMs = static_cast<unsigned>(strtoul(val, nullptr, 10));
+        } else if (strcmp(opt, "--loss") == 0) {
+            opts.Impairment.LossPercent = strtod(val, nullptr);
+        } else if (strcmp(opt, "--jitter") == 0) {
+            opts.Impairment.JitterMs = static_cast<unsigned>(strtoul(val, nullptr, 10));
+        } else if (strcmp(opt, "--reorder") == 0) {
+            opts.Impairment.ReorderPercent = strtod(val, nullptr);
+        } else if (strcmp(opt, "--seed") == 0) {
+            opts.Seed = static_cast<unsigned>(strtoul(val, nullptr, 10));
+        } else if (strcmp(opt, "--stats-interval") == 0) {
+            opts.StatsIntervalSec = static_cast<unsigned>(strtoul(val, nullptr, 10));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct StatsContext {
+    VoiceServer *Voice;
+    MockApiServer *Api;
+    SyntheticTalkers *Talkers;
+};
+
+static void statsCallback(evutil_socket_t fd, short events, void *arg)
+{
+    auto *ctx = reinterpret_cast<StatsContext *>(arg);
+    printf("sessions %zu  api-req %llu  dg-in %llu  dg-rejected %llu  dg-out %llu  dg-lost %llu  hb %llu  voice-in %llu  talker-frames %llu\n",
+           ctx->Voice->getSessionCount(),
+           static_cast<unsigned long long>(ctx->Api->Requests),
+           static_cast<unsigned long long>(ctx->Voice->DatagramsIn),
+           static_cast<unsigned long long>(ctx->Voice->DatagramsRejected),
+           static_cast<unsigned long long>(ctx->Voice->DatagramsOut),
+           static_cast<unsigned long long>(ctx->Voice->DatagramsLost),
+           static_cast<unsigned long long>(ctx->Voice->Heartbeats),
+           static_cast<unsigned long long>(ctx->Voice->VoicePacketsIn),
+           static_cast<unsigned long long>(ctx->Talkers->FramesSent));
+    fflush(stdout);
+}
+
+static void interruptCallback(evutil_socket_t fd, short events, void *arg)
+{
+    event_base_loopbreak(reinterpret_cast<struct event_base *>(arg));
+}
+
+int main(int argc, char **argv)
+{
+    LoadServerOptions opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct event_base *evBase = event_base_new();
+    int rv = 0;
+    {
+        VoiceServer voiceServer(evBase, opts.Impairment, opts.Routing, opts.Seed);
+        MockApiServer apiServer(evBase, voiceServer);
+        SyntheticTalkers talkers(evBase, voiceServer, opts.Talkers);
+        if (!voiceServer.open(opts.VoiceAddress) ||
+            !apiServer.open(opts.ApiAddress, opts.ApiPort) ||
+            !talkers.start()) {
+            rv = 1;
+        } else {
+            printf("API on http://%s:%u, voice on %s\n",
+                   opts.ApiAddress.c_str(), opts.ApiPort, voiceServer.getAddress().c_str());
+
+            StatsContext statsCtx{&voiceServer, &apiServer, &talkers};
+            struct event *statsTimer = event_new(evBase, -1, EV_PERSIST, &statsCallback, &statsCtx);
+            if (opts.StatsIntervalSec > 0) {
+                struct timeval tv;
+                tv.tv_sec = opts.StatsIntervalSec;
+                tv.tv_usec = 0;
+                event_add(statsTimer, &tv);
+            }
+            struct event *interruptEvent = evsignal_new(evBase, SIGINT, &interruptCallback, evBase);
+            event_add(interruptEvent, nullptr);
+
+            event_base_dispatch(evBase);
+
+            event_free(interruptEvent);
+            event_free(statsTimer);
+        }
+    }
+    event_base_free(evBase);
+    return rv;
+}
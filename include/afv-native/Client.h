@@ -41,15 +41,28 @@
 
 #include "afv-native/event.h"
 #include "afv-native/afv/APISession.h"
+#include "afv-native/afv/CaptureReplay.h"
 #include "afv-native/afv/EffectResources.h"
 #include "afv-native/afv/VoiceSession.h"
 #include "afv-native/afv/dto/Transceiver.h"
 #include "afv-native/audio/AudioDevice.h"
+#include "afv-native/audio/ClockBridge.h"
 #include "afv-native/event/EventCallbackTimer.h"
+#include "afv-native/event/EventLoopThread.h"
+#include "afv-native/event/LoopLagMonitor.h"
 #include "afv-native/http/EventTransferManager.h"
 #include "afv-native/http/RESTRequest.h"
+#include "afv-native/util/AtomicHistogram.h"
+#include "afv-native/util/monotime.h"
 
 namespace afv_native {
+    /** ConnectTimeline records when each ConnectPhase of the last connect() completed,
+     * in milliseconds after connect() was called, or -1 if it hasn't.
+     */
+    struct ConnectTimeline {
+        int64_t PhaseMs[connectPhaseCount];
+    };
+
     /** Client provides a fully functional PilotClient that can be integrated into
      * an application.
      */
@@ -77,12 +90,17 @@ namespace afv_native {
          *      client.
          * @param clientName The name of this client to advertise to the
          *      audio-subsystem.
+         * @param dedicatedVoiceThread if true, the voice UDP channel is serviced
+         *      by its own event loop on a dedicated thread rather than evBase, so
+         *      that voice reception isn't delayed by API traffic or other work on
+         *      the host's loop.
          */
         Client(
                 struct event_base *evBase,
                 unsigned int numRadios = 2,
                 const std::string &clientName = "AFV-Native",
-                std::string baseUrl = "https://voice1.vatsim.net");
+                std::string baseUrl = "https://voice1.vatsim.net",
+                bool dedicatedVoiceThread = false);
 
         virtual ~Client();
 
@@ -106,7 +124,8 @@ namespace afv_native {
 
         /** set the radio frequency for the nominated radio.
          *
-         * This method will invoke an immediate transceiver set update.
+         * This method will invoke a transceiver set update.  Retunes made in quick
+         * succession are coalesced into a single update.
          *
          * @param radioNum the ordinal of the radio to tune
          * @param freq the frequency in Hz
@@ -135,6 +154,16 @@ namespace afv_native {
          */
         void setPtt(bool pttState);
 
+        /** setOptimisticPtt controls what happens if the PTT is pressed before the
+         * server has acknowledged a retune.
+         *
+         * If false (the default), the PTT stays guarded until the update is acknowledged.
+         * If true, the PTT opens at once and the update is sent at the same time.  The
+         * first few frames may then go out on the old frequencies.
+         */
+        void setOptimisticPtt(bool optimistic);
+        bool getOptimisticPtt() const;
+
         /** setCredentials sets the user Credentials for this client.
          *
          * @note This only affects future attempts to connect.
@@ -197,6 +226,37 @@ namespace afv_native {
         void setOnHeadset(unsigned int radio, bool onHeadset);
         void setSplitAudioChannels(bool split);
 
+        /** setAudioPeriodMs sets the audio device period (callback interval) used the
+         * next time the audio devices are started.  Shorter periods lower the output
+         * latency, but need a backend and host that can keep up with them.
+         */
+        void setAudioPeriodMs(unsigned int periodMs);
+
+        /** setAudioDuplex opens the headset as a single full-duplex device the next
+         * time audio starts, so the microphone and headset share one clock.  The
+         * speaker is then rendered on the headset's clock too, and resampled slightly
+         * to absorb the drift between it and the speaker device.
+         */
+        void setAudioDuplex(bool duplex);
+
+        /** setAudioSharedClock renders the headset and speaker together in a single
+         * pass on the headset's clock the next time audio starts, even if the headset
+         * isn't opened full-duplex.  The speaker is resampled slightly to absorb the
+         * drift between the two devices.  Duplex mode always does this.
+         */
+        void setAudioSharedClock(bool sharedClock);
+
+        /** setAudioRealtimeOptions sets the scheduling, CPU pinning and memory locking
+         * used for the audio threads the next time audio starts.
+         */
+        void setAudioRealtimeOptions(const util::RealtimeOptions &options);
+
+        /** getSpeakerClockCorrectionPpm returns the rate correction currently applied
+         * to the speaker to keep it in step with the headset, or 0 if the speaker isn't
+         * running on the headset's clock.
+         */
+        int getSpeakerClockCorrectionPpm() const;
+
         /** ClientEventCallback provides notifications when certain client events occur.  These can be used to
          * provide feedback within the client itself without needing to poll Client's methods.
          *
@@ -217,6 +277,20 @@ namespace afv_native {
          */
         std::vector<afv::dto::Station> getStationAliases() const;
 
+        /** getStationAliasIndex returns the station aliases indexed by real and aliased
+         * frequency.  Unlike getStationAliases, this doesn't copy, so it's cheap
+         * enough to use on every retune.
+         *
+         * @return the alias set, or nullptr if none has been loaded yet.
+         */
+        std::shared_ptr<const afv::StationAliases> getStationAliasIndex() const;
+
+        /** setStationAliasCachePath sets a file to cache the station aliases in between
+         * sessions.  Cached aliases are available immediately, and are only downloaded
+         * again if they've changed on the server.
+         */
+        void setStationAliasCachePath(const std::string &path);
+
         void startAudio();
         void stopAudio();
 
@@ -239,6 +313,73 @@ namespace afv_native {
          */
         bool getTxActive(unsigned int radioNumber);
 
+        /** getMainLoopLag returns dispatch lag statistics for the host's event loop (evBase). */
+        event::LoopLagStats getMainLoopLag() const;
+
+        /** getVoiceLoopLag returns dispatch lag statistics for the dedicated voice
+         * event loop.  If the client isn't using a dedicated voice thread, these are
+         * the same as getMainLoopLag().
+         */
+        event::LoopLagStats getVoiceLoopLag() const;
+
+        /** getVoiceChannelStats returns the receive counters for the voice UDP channel. */
+        cryptodto::ChannelStats getVoiceChannelStats() const;
+
+        /** getHeartbeatRttMs returns the round trip time of the last acknowledged voice
+         * heartbeat in milliseconds, or -1 if none has been measured yet.
+         */
+        int64_t getHeartbeatRttMs() const;
+
+        /** getHeartbeatRttHistogram returns the distribution of heartbeat round trip times (ms). */
+        util::HistogramSnapshot getHeartbeatRttHistogram() const;
+
+        /** getStreamStats returns the network statistics for each incoming voice stream.
+         *
+         * All of these are lock-free and safe to poll from the UI thread.
+         */
+        std::shared_ptr<const afv::StreamStatsList> getStreamStats() const;
+
+        /** getConnectTimeline returns the timing of each phase of the last connect().
+         * Each phase is also reported as it completes via a ConnectPhaseCompleted event.
+         */
+        ConnectTimeline getConnectTimeline() const;
+
+        /** getPttGuardDelayHistogram returns how long (ms) each PTT press waited for
+         * a transceiver update before it opened.
+         */
+        util::HistogramSnapshot getPttGuardDelayHistogram() const;
+
+        /** getRetuneToPttHistogram returns the time (ms) from the last retune to the
+         * PTT opening, for each transmission that followed a retune.
+         */
+        util::HistogramSnapshot getRetuneToPttHistogram() const;
+
+        /** getTransceiverUpdateRttHistogram returns the round trip time (ms) of each
+         * acknowledged transceiver update.
+         */
+        util::HistogramSnapshot getTransceiverUpdateRttHistogram() const;
+
+        /** setVoiceSocketOptions sets the buffer sizes, QoS marking and timestamping used
+         * for the voice UDP socket.  They take effect the next time the voice session connects.
+         */
+        void setVoiceSocketOptions(const cryptodto::UDPSocketOptions &options);
+
+        /** startVoiceCapture starts recording all DTOs received on the voice channel to
+         * a capture file at path.  Any existing file is replaced.
+         */
+        bool startVoiceCapture(const std::string &path);
+        void stopVoiceCapture();
+
+        /** replayVoiceCapture plays back the voice traffic from a capture file through the
+         * radio simulation.
+         *
+         * @param originalTiming if true, packets are replayed on the event loop with the
+         *      timing they were captured with.  Otherwise, they're replayed as fast as the
+         *      audio output takes delivery of them, which needs the output to be running.
+         */
+        bool replayVoiceCapture(const std::string &path, bool originalTiming);
+        void stopVoiceCaptureReplay();
+
     protected:
         struct ClientRadioState {
             int mCurrentFreq;
@@ -250,6 +391,10 @@ namespace afv_native {
 
         http::EventTransferManager mTransferManager;
         afv::APISession mAPISession;
+        /** mVoiceLoop runs the voice UDP channel when a dedicated voice thread was
+         * requested.  It must outlive mVoiceSession.
+         */
+        std::unique_ptr<event::EventLoopThread> mVoiceLoop;
         afv::VoiceSession mVoiceSession;
         std::shared_ptr<afv::RadioSimulation> mRadioSim;
 
@@ -268,10 +413,32 @@ namespace afv_native {
         void voiceStateCallback(afv::VoiceSessionState state);
 
         bool mTxUpdatePending;
+        util::monotime_t mTxUpdateSentTime;
+        /** mInFlightFreqs are the frequencies carried by the pending transceiver update. */
+        std::vector<int> mInFlightFreqs;
         bool mWantPtt;
         bool mPtt;
+        bool mOptimisticPtt;
+
+        util::monotime_t mLastRetuneTime;
+        util::monotime_t mPttRequestTime;
+        util::monotime_t mPttOpenTime;
+        util::AtomicHistogram mPttGuardDelay;
+        util::AtomicHistogram mRetuneToPtt;
+        util::AtomicHistogram mTransceiverUpdateRtt;
+
+        /** mAudioRunning is true once startAudio has opened all the devices. */
+        bool mAudioRunning;
+
+        util::monotime_t mConnectStartTime;
+        ConnectTimeline mConnectTimeline;
+        /** markConnectPhase records phase in the connect timeline, if it hasn't been already. */
+        void markConnectPhase(ConnectPhase phase);
 
         bool areTransceiversSynced() const;
+        /** isInFlightUpdateCurrent returns true if an update is pending and it carries
+         * the frequencies we currently want. */
+        bool isInFlightUpdateCurrent() const;
         std::vector<afv::dto::Transceiver> makeTransceiverDto();
         /* sendTransceiverUpdate sends the update now, in process.
          * queueTransceiverUpdate schedules it for the next eventloop.  This is a
@@ -279,14 +446,21 @@ namespace afv_native {
          * update callback can trigger a second update if the desired state is
          * out of sync! */
         void sendTransceiverUpdate();
-        void queueTransceiverUpdate();
+        /* queueTransceiverUpdate waits afvTransceiverUpdateCoalesceMs for further
+         * changes before sending, unless urgent is set or the PTT is waiting. */
+        void queueTransceiverUpdate(bool urgent = false);
         void stopTransceiverUpdate();
 
         void aliasUpdateCallback();
+        void aliasCurrentCallback();
     private:
         void unguardPtt();
+        void openPtt();
     protected:
         event::EventCallbackTimer mTransceiverUpdateTimer;
+        event::LoopLagMonitor mMainLoopLag;
+        /** created on first use.  Must be destroyed before mRadioSim. */
+        std::unique_ptr<afv::CaptureReplay> mCaptureReplay;
 
         std::string mClientName;
         audio::AudioDevice::Api mAudioApi;
@@ -294,6 +468,12 @@ namespace afv_native {
         std::string mHeadsetDeviceName;
         std::string mSpeakerDeviceName;
         bool mSplitAudioChannels;
+        unsigned int mAudioPeriodMs;
+        bool mAudioDuplex;
+        bool mAudioSharedClock;
+        util::RealtimeOptions mAudioRealtimeOptions;
+        /** mSpeakerBridge is swapped with std::atomic_store so it can be read from any thread. */
+        std::shared_ptr<audio::ClockBridge> mSpeakerBridge;
         bool mInvalidDeviceConfig = false;
     public:
     };
@@ -38,6 +38,7 @@
 #include <memory>
 #include <event2/event.h>
 
+#include "afv-native/afv/StationAliases.h"
 #include "afv-native/afv/dto/Station.h"
 #include "afv-native/http/TransferManager.h"
 #include "afv-native/http/Request.h"
@@ -103,14 +104,34 @@ namespace afv_native
             void updateStationAliases();
             std::vector<dto::Station> getStationAliases() const;
 
+            /** getStationAliasIndex returns the current station aliases, indexed by
+             * frequency.  This doesn't copy, and is safe to call from any thread.
+             *
+             * @return the alias set, or nullptr if none has been loaded yet.
+             */
+            std::shared_ptr<const StationAliases> getStationAliasIndex() const;
+
+            /** setStationAliasCachePath sets where the station aliases are cached between
+             * sessions, and loads any aliases already cached there.
+             *
+             * With a cache, updateStationAliases only downloads the aliases if they've
+             * changed on the server.  An empty path disables caching.
+             */
+            void setStationAliasCachePath(const std::string &path);
+
             /** Callbacks registered against StateCallback will be called whenever
              * the APISession changes state.
             */
             util::ChainedCallback<void(APISessionState)> StateCallback;
             util::ChainedCallback<void(void)> AliasUpdateCallback;
+            /** Callbacks registered against AliasCurrentCallback will be called when
+             * the server confirms the aliases we already hold are current (a 304).
+             */
+            util::ChainedCallback<void(void)> AliasCurrentCallback;
         protected:
             void _authenticationCallback(http::RESTRequest* req, bool success);
             void _stationsCallback(http::RESTRequest* req, bool success);
+            void _keepWarm();
             void setState(APISessionState newState);
             void raiseError(APISessionError error);
 
@@ -127,10 +148,21 @@ namespace afv_native
 
             event::EventCallbackTimer mRefreshTokenTimer;
 
+            /** mKeepWarmRequest is a periodic HEAD to the API server which keeps the
+             * shared connection (and its TLS session) open between real requests.
+             */
+            http::Request mKeepWarmRequest;
+            event::EventCallbackTimer mKeepWarmTimer;
+
             APISessionError mLastError;
 
             http::RESTRequest mStationAliasRequest;
-            std::vector<dto::Station> mAliasedStations;
+            /** mStationAliases is replaced, never modified, and is accessed with
+             * std::atomic_load/atomic_store so other threads can read it. */
+            std::shared_ptr<const StationAliases> mStationAliases;
+            /** mStationAliasETag is the ETag of mStationAliases, if the server sent one. */
+            std::string mStationAliasETag;
+            std::string mStationAliasCachePath;
         private:
             APISessionState mState;
         };
@@ -0,0 +1,106 @@
+/* afv/CaptureReplay.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_CAPTUREREPLAY_H
+#define AFV_NATIVE_CAPTUREREPLAY_H
+
+#include <cstdint>
+#include <string>
+#include <event2/event.h>
+
+#include "afv-native/afv/RadioSimulation.h"
+#include "afv-native/cryptodto/CaptureFile.h"
+#include "afv-native/event/EventCallbackTimer.h"
+#include "afv-native/util/monotime.h"
+
+namespace afv_native {
+    namespace afv {
+        /** CaptureReplay feeds the voice traffic from a capture file back into a
+         * RadioSimulation, either with the timing it was originally received with, or as
+         * fast as the render passes will take delivery of it.
+         *
+         * Only AR (AudioRxOnTransceivers) records are replayed; anything else in the
+         * capture is skipped.
+         */
+        class CaptureReplay {
+        public:
+            CaptureReplay(struct event_base *evBase, RadioSimulation &radio);
+            CaptureReplay(const CaptureReplay &cpysrc) = delete;
+            virtual ~CaptureReplay();
+
+            bool open(const std::string &path);
+
+            /** start replays the rest of the capture on the event loop.
+             *
+             * @param originalTiming if true, packets are replayed with the timing they
+             *      were captured with.  Otherwise each pass queues as many packets as the
+             *      radio simulation has room for, then waits a frame for the render
+             *      passes to take delivery of them before the next.
+             */
+            bool start(bool originalTiming = true);
+            void stop();
+            bool isRunning() const;
+
+            /** PacketsReplayed counts the voice packets queued for playback. */
+            uint64_t PacketsReplayed;
+            /** PacketsDropped counts the voice packets the radio simulation couldn't queue. */
+            uint64_t PacketsDropped;
+            uint64_t RecordsSkipped;
+
+        protected:
+            RadioSimulation &mRadio;
+            cryptodto::CaptureReader mReader;
+            event::EventCallbackTimer mTimer;
+            bool mRunning;
+            bool mOriginalTiming;
+
+            /** mNext is the next record due to be replayed, if mHaveNext is set. */
+            cryptodto::CaptureRecord mNext;
+            bool mHaveNext;
+            /** the local time the replay started, and the capture time it corresponds to. */
+            util::monotime_t mStartTime;
+            uint64_t mStartTimestampUs;
+
+            /** replayRecord passes record to the radio simulation if it's a voice packet.
+             *
+             * @return true if it was a voice packet, whether or not it could be queued.
+             */
+            bool replayRecord(const cryptodto::CaptureRecord &record);
+            void replayPaced();
+            void replayTimed();
+            void timerFired();
+        };
+    }
+}
+
+#endif //AFV_NATIVE_CAPTUREREPLAY_H
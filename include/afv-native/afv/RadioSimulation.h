@@ -36,16 +36,21 @@
 
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "afv-native/utility.h"
 #include "afv-native/event.h"
 #include "afv-native/afv/EffectResources.h"
 #include "afv-native/afv/RemoteVoiceSource.h"
 #include "afv-native/afv/RollingAverage.h"
+#include "afv-native/afv/StreamStats.h"
 #include "afv-native/afv/VoiceCompressionSink.h"
+#include "afv-native/afv/params.h"
 #include "afv-native/afv/dto/voice_server/AudioRxOnTransceivers.h"
+#include "afv-native/afv/dto/voice_server/AudioRxOnTransceiversView.h"
 #include "afv-native/audio/ISampleSink.h"
 #include "afv-native/audio/ISampleSource.h"
+#include "afv-native/audio/RecordedSampleSource.h"
 #include "afv-native/audio/SineToneSource.h"
 #include "afv-native/audio/SpeexPreprocessor.h"
 #include "afv-native/audio/SimpleCompressorEffect.h"
@@ -53,6 +58,10 @@
 #include "afv-native/cryptodto/UDPChannel.h"
 #include "afv-native/event/EventCallbackTimer.h"
 #include "afv-native/util/ChainedCallback.h"
+#include "afv-native/util/PublishedPtr.h"
+#include "afv-native/util/RealtimeCheck.h"
+#include "afv-native/util/SpscQueue.h"
+#include "afv-native/util/monotime.h"
 
 namespace afv_native {
     namespace afv {
@@ -61,58 +70,148 @@ namespace afv_native {
 
         class OutputAudioDevice : public audio::ISampleSource {
         public:
-            OutputAudioDevice(std::weak_ptr<RadioSimulation> radio, bool onHeadset);
+            /** radio must outlive any audio device this is attached to.  It's held by
+             * plain pointer so the device callback doesn't touch a reference count. */
+            OutputAudioDevice(RadioSimulation *radio, bool onHeadset);
             audio::SourceStatus getAudioFrame(audio::SampleType *bufferOut) override;
         private:
-            std::weak_ptr<RadioSimulation> mRadio;
+            RadioSimulation *mRadio;
             bool onHeadset = false;
         };
 
-        class OutputDeviceState {
-        public:
-            audio::SampleType *mChannelBuffer;
-            audio::SampleType *mMixingBuffer; // for single channel mode
-            audio::SampleType *mLeftMixingBuffer;
-            audio::SampleType *mRightMixingBuffer;
-            audio::SampleType *mFetchBuffer;
-            OutputDeviceState();
-            virtual ~OutputDeviceState();
-        };
-
-        /** RadioState is the internal state object for each radio within a RadioSimulation.
+        /** SharedClockOutput renders the headset and speaker buses together in one pass.
          *
-         * It tracks the current playback position of the mixing effects, the channel frequency and gain.
+         * It's attached to the headset device as its source.  The headset frame is
+         * returned directly, and the speaker frame from the same pass is handed to
+         * speakerSink (normally a ClockBridge feeding the speaker device), so both buses
+         * are rendered on the headset's clock and stay phase-coherent.
          */
-        class RadioState {
+        class SharedClockOutput : public audio::ISampleSource {
         public:
-            unsigned int Frequency;
-            float Gain = 1.0;
-            std::shared_ptr<audio::RecordedSampleSource> Click;
-            std::shared_ptr<audio::RecordedSampleSource> Crackle;
-            std::shared_ptr<audio::RecordedSampleSource> AcBus;
-            std::shared_ptr<audio::RecordedSampleSource> VhfWhiteNoise;
-            std::shared_ptr<audio::RecordedSampleSource> HfWhiteNoise;
-            std::shared_ptr<audio::SineToneSource> BlockTone;
-            audio::SimpleCompressorEffect simpleCompressorEffect;
-            audio::VHFFilterSource vhfFilter;
-            int mLastRxCount;
-            bool mBypassEffects;
-            bool mHfSquelch;
-            bool mIsReceiving;
-            bool onHeadset = true;
+            /** radio must outlive any audio device this is attached to. */
+            SharedClockOutput(RadioSimulation *radio, std::shared_ptr<audio::ISampleSink> speakerSink);
+            virtual ~SharedClockOutput();
+            audio::SourceStatus getAudioFrame(audio::SampleType *bufferOut) override;
+        private:
+            RadioSimulation *mRadio;
+            std::shared_ptr<audio::ISampleSink> mSpeakerSink;
+            /** mSpeakerFrame is big enough for a split (stereo) frame. */
+            audio::SampleType *mSpeakerFrame;
         };
 
         /** CallsignMeta is the per-packetstream metadata stored within the RadioSimulation object.
          *
          * It's used to hold the RemoteVoiceSource object for that callsign+channel combination,
          * and the list of transceivers that this packet stream relates to.
+         *
+         * The headset and speaker entries for a callsign share the same StreamStats.
+         *
+         * id, stats and lastActivity belong to the network side and are guarded by
+         * RadioSimulation's mStreamMapLock.  source, transceivers and frame are only
+         * touched by the render pass, which is fed the stream's packets through its
+         * output's queue.
          */
         struct CallsignMeta {
+            uint32_t id;
             std::shared_ptr<RemoteVoiceSource> source;
             std::vector<dto::RxTransceiver> transceivers;
+            std::shared_ptr<StreamStats> stats;
+            util::monotime_t lastActivity;
+            /** frame holds the audio fetched from source in the current render pass,
+             * if frameValid is set.  It's sized up front so the render never allocates. */
+            std::vector<audio::SampleType> frame;
+            bool frameValid;
             CallsignMeta();
         };
 
+        /** StreamSet is the list of streams an output renders.  A new set is published to
+         * the render pass whenever a stream is added or purged.
+         */
+        struct StreamSet {
+            std::vector<std::shared_ptr<CallsignMeta>> streams;
+            /** newestId is the highest stream id allocated when the set was built.  Queued
+             * packets for a newer stream are left for a later pass to pick up. */
+            uint32_t newestId = 0;
+        };
+
+        /** QueuedVoicePacket is a received voice packet, copied out of the datagram and
+         * queued for an output's render pass.
+         */
+        struct QueuedVoicePacket {
+            uint32_t streamId;
+            uint32_t sequence;
+            bool lastPacket;
+            size_t audioLen;
+            unsigned char audio[voicePacketBlockSize];
+            size_t transceiverCount;
+            dto::RxTransceiver transceivers[maxRxTransceiversPerPacket];
+        };
+
+        /** RadioConfig is a radio's settings, as set by the client. */
+        struct RadioConfig {
+            unsigned int Frequency = 0;
+            float Gain = 1.0f;
+            bool BypassEffects = false;
+            bool HfSquelch = false;
+            bool OnHeadset = true;
+        };
+
+        /** RenderConfig is the snapshot of the radio settings the render pass works from.
+         * A new one is published to each output whenever a setting changes.
+         */
+        struct RenderConfig {
+            std::vector<RadioConfig> Radios;
+            bool SplitChannels = false;
+        };
+
+        /** RadioFx is one radio's render state on one output: the playback position of its
+         * mixing effects, and its filters.
+         *
+         * The effect sources are created along with the output and are only ever rewound
+         * or stopped, so the render pass never allocates them.
+         */
+        class RadioFx {
+        public:
+            explicit RadioFx(const EffectResources &resources);
+
+            audio::RecordedSampleSource Click;
+            audio::RecordedSampleSource Crackle;
+            audio::RecordedSampleSource AcBus;
+            audio::RecordedSampleSource VhfWhiteNoise;
+            audio::RecordedSampleSource HfWhiteNoise;
+            audio::SineToneSource BlockTone;
+            bool BlockToneActive;
+            audio::SimpleCompressorEffect simpleCompressorEffect;
+            audio::VHFFilterSource vhfFilter;
+            /** Frequency is the frequency the effects were last rendered for. */
+            unsigned int Frequency;
+            int LastRxCount;
+        };
+
+        /** OutputDeviceState is the state for rendering one output (the headset or the
+         * speaker).
+         *
+         * Apart from mStreams, mPackets and mConfig, which hand data over from the network
+         * and control sides without locking, it's only ever touched by the thread rendering
+         * the output.
+         */
+        class OutputDeviceState {
+        public:
+            audio::SampleType *mChannelBuffer;
+            audio::SampleType *mMixingBuffer; // for single channel mode
+            audio::SampleType *mLeftMixingBuffer;
+            audio::SampleType *mRightMixingBuffer;
+            audio::SampleType *mFetchBuffer;
+            util::PublishedPtr<StreamSet> mStreams;
+            util::SpscQueue<QueuedVoicePacket> mPackets;
+            util::PublishedPtr<RenderConfig> mConfig;
+            /** mRadioFx holds the render state of every radio, whether or not it's
+             * currently routed to this output. */
+            std::vector<std::unique_ptr<RadioFx>> mRadioFx;
+            OutputDeviceState(size_t radioCount, const EffectResources &resources);
+            virtual ~OutputDeviceState();
+        };
+
         enum class RadioSimulationState
         {
             RxStarted,
@@ -143,7 +242,21 @@ namespace afv_native {
 
             RadioSimulation(const RadioSimulation& copySrc) = delete;
 
-            void rxVoicePacket(const afv::dto::AudioRxOnTransceivers &pkt);
+            bool rxVoicePacket(const afv::dto::AudioRxOnTransceivers &pkt);
+            /** rxVoicePacket queues a received voice packet on its callsign's streams.
+             *
+             * @param arrivalUs the time the packet arrived, on the util::monotime_get_us
+             *      clock, or 0 to use the current time.
+             * @return true if the packet was queued for both outputs, false if it was
+             *      dropped (and counted in its stream's PacketsDropped).
+             */
+            bool rxVoicePacket(const afv::dto::AudioRxOnTransceiversView &pkt, int64_t arrivalUs = 0);
+
+            /** voicePacketQueueSpace returns how many more voice packets can be queued
+             * before the render passes take delivery of them.  Past that, rxVoicePacket
+             * drops packets.
+             */
+            size_t voicePacketQueueSpace();
 
             void setCallsign(const std::string &newCallsign);
             void setFrequency(unsigned int radio, unsigned int frequency);
@@ -175,11 +288,32 @@ namespace afv_native {
             void setSplitAudioChannels(bool splitChannels);
 
             void putAudioFrame(const audio::SampleType *bufferIn) override;
+            /** beginBatch corks the voice channel while transmitting, so the voice frames
+             * from one input callback (and anything else sent meanwhile, such as a
+             * heartbeat) leave in a single batched write. */
+            void beginBatch() override;
+            void endBatch() override;
             audio::SourceStatus getAudioFrame(audio::SampleType *bufferOut, bool onHeadset);
 
+            /** renderBuses renders the headset and speaker buses in a single pass.  Either
+             * output may be null to skip that bus.  Each output must have room for a stereo
+             * frame if split audio channels are enabled.
+             *
+             * It never blocks or allocates - the streams, packets and radio settings are all
+             * handed over through each output's OutputDeviceState.
+             */
+            audio::SourceStatus renderBuses(audio::SampleType *headsetOut, audio::SampleType *speakerOut);
+
             /** Contains the number of IncomingAudioStreams known to the simulation stack */
             std::atomic<uint32_t> IncomingAudioStreams;
 
+            /** getStreamStats returns the statistics for every incoming stream currently known.
+             *
+             * This never blocks, so it's safe to call from the UI thread.  The list itself is a
+             * snapshot, but the counters within it continue to update live.
+             */
+            std::shared_ptr<const StreamStatsList> getStreamStats() const;
+
             int lastReceivedRadio() const;
             util::ChainedCallback<void(RadioSimulationState)>  RadioStateCallback;
 
@@ -205,16 +339,37 @@ namespace afv_native {
             cryptodto::UDPChannel *mChannel;
             std::string mCallsign;
 
-            std::mutex mStreamMapLock;
-            std::unordered_map<std::string, struct CallsignMeta> mHeadsetIncomingStreams;
-            std::unordered_map<std::string, struct CallsignMeta> mSpeakerIncomingStreams;
+            /** mStreamMapLock guards the network side of the streams.  It's never taken by
+             * the render pass.
+             */
+            util::CheckedMutex mStreamMapLock;
+            /** scratch key for stream map lookups - guarded by mStreamMapLock. */
+            std::string mRxCallsign;
+            std::unordered_map<std::string, std::shared_ptr<CallsignMeta>> mHeadsetIncomingStreams;
+            std::unordered_map<std::string, std::shared_ptr<CallsignMeta>> mSpeakerIncomingStreams;
+            /** mLastStreamId is the id given to the most recently created stream. */
+            uint32_t mLastStreamId;
+            /** mStreamStats holds the statistics shared by each callsign's headset and
+             * speaker streams.  Guarded by mStreamMapLock.
+             */
+            std::unordered_map<std::string, std::shared_ptr<StreamStats>> mStreamStats;
+            /** mStreamStatsSnapshot is republished (with std::atomic_store) whenever
+             * mStreamStats changes.
+             */
+            std::shared_ptr<const StreamStatsList> mStreamStatsSnapshot;
 
-            std::mutex mRadioStateLock;
+            /** mRadioStateLock guards mRadioConfig and mSplitChannels.  It's never taken by
+             * the render pass, which works from the snapshot published by publishConfig.
+             */
+            util::CheckedMutex mRadioStateLock;
             std::atomic<bool> mPtt;
             bool mLastFramePtt;
-            unsigned int mTxRadio;
+            std::atomic<unsigned int> mTxRadio;
             std::atomic<uint32_t> mTxSequence;
-            std::vector<RadioState> mRadioState;
+            std::vector<RadioConfig> mRadioConfig;
+            /** mRxStreamCount is how many streams each radio was receiving in the last
+             * render pass. */
+            std::vector<std::atomic<int>> mRxStreamCount;
 
             bool mSplitChannels = false;
 
@@ -228,31 +383,78 @@ namespace afv_native {
 
             unsigned int mLastReceivedRadio;
 
+            /** mBatchChannel is the channel corked by beginBatch, if any.  Only touched
+             * from the input callback. */
+            cryptodto::UDPChannel *mBatchChannel;
+
             std::shared_ptr<VoiceCompressionSink> mVoiceSink;
             std::shared_ptr<audio::SpeexPreprocessor> mVoiceFilter;
 
             event::EventCallbackTimer mMaintenanceTimer;
             RollingAverage<double> mVuMeter;
 
-            void resetRadioFx(unsigned int radio, bool except_click = false);
+            /** publishConfig publishes the radio settings to each output's render pass.
+             * @note mRadioStateLock must be held by the caller.
+             */
+            void publishConfig();
+
+            void resetRadioFx(RadioFx &fx, bool except_click = false);
 
-            void set_radio_effects(size_t rxIter);
+            void set_radio_effects(RadioFx &fx);
 
-            bool mix_effect(std::shared_ptr<audio::ISampleSource> effect, float gain, std::shared_ptr<OutputDeviceState> state);
+            void mix_effect(audio::ISampleSource &effect, float gain, OutputDeviceState *state);
 
             void processCompressedFrame(std::vector<unsigned char> compressedData) override;
 
-            static void dtoHandler(
-                    const std::string &dtoName, const unsigned char *bufIn, size_t bufLen, void *user_data);
-            void instDtoHandler(
-                    const std::string &dtoName, const unsigned char *bufIn, size_t bufLen);
+            /** dtoHandler is registered with the UDPChannel to receive AR (voice) DTOs. */
+            static void dtoHandler(const unsigned char *bufIn, size_t bufLen, void *user_data);
+            void instDtoHandler(const unsigned char *bufIn, size_t bufLen);
 
             void maintainIncomingStreams();
+
+            /** newStream creates a stream with the next stream id.
+             * @note mStreamMapLock must be held by the caller.
+             */
+            std::shared_ptr<CallsignMeta> newStream();
+            /** queueVoicePacket queues pkt for stream on state's render pass.
+             * @return false if the packet had to be dropped.
+             * @note mStreamMapLock must be held by the caller.
+             */
+            bool queueVoicePacket(
+                    OutputDeviceState *state,
+                    const CallsignMeta &stream,
+                    const afv::dto::AudioRxOnTransceiversView &pkt);
+            /** publishStreams publishes the current streams to each output's render pass.
+             * @note mStreamMapLock must be held by the caller.
+             */
+            void publishStreams();
+            void publishStreamSet(
+                    OutputDeviceState *state,
+                    const std::unordered_map<std::string, std::shared_ptr<CallsignMeta>> &streams);
+
+            /** attachStreamStats finds or creates the statistics for mRxCallsign and attaches
+             * them to whichever of its streams don't have them yet.
+             * @note mStreamMapLock must be held by the caller.
+             */
+            void attachStreamStats(CallsignMeta &headsetStream, CallsignMeta &speakerStream);
+            /** publishStreamStats republishes mStreamStatsSnapshot.
+             * @note mStreamMapLock must be held by the caller.
+             */
+            void publishStreamStats();
         private:
             bool _process_radio(
-                    const std::map<void *, audio::SampleType[audio::frameSizeSamples]> &sampleCache,
-                    size_t rxIter,
-                    bool onHeadset);
+                    OutputDeviceState *state,
+                    const RenderConfig *config,
+                    const StreamSet *streams,
+                    size_t rxIter);
+
+            /** _render renders one output's radios into bufferOut. */
+            void _render(OutputDeviceState *state, bool onHeadset, audio::SampleType *bufferOut);
+            /** _prepare_output takes delivery of the output's queued packets, fetches a
+             * frame from each of its active streams and clears its mixing buffers.
+             */
+            void _prepare_output(OutputDeviceState *state, const StreamSet *streams);
+            void _mix_down(OutputDeviceState *state, const RenderConfig *config, audio::SampleType *bufferOut);
 
             inline void interleave(audio::SampleType* leftChannel, audio::SampleType* rightChannel, audio::SampleType* outputBuffer, size_t numSamples) {
                 for (size_t i = 0; i < numSamples; i++) {
@@ -34,10 +34,11 @@
 #ifndef AFV_NATIVE_REMOTEVOICESOURCE_H
 #define AFV_NATIVE_REMOTEVOICESOURCE_H
 
-#include <mutex>
+#include <memory>
 #include <speexdsp/include/speex/speex_jitter.h>
 #include <opus/include/opus.h>
 
+#include "afv-native/afv/StreamStats.h"
 #include "afv-native/afv/dto/interfaces/IAudio.h"
 #include "afv-native/audio/audio_params.h"
 #include "afv-native/audio/ISampleSource.h"
@@ -59,13 +60,35 @@ namespace afv_native {
          *
          * @note this is analogous to the GeoVR CallsignSampleProvider, but without the effects pass which is handled
          * elsewhere.
+         *
+         * @note this isn't thread-safe.  RadioSimulation queues received packets to the render pass,
+         * which appends and decodes them on the one thread.
          */
         class RemoteVoiceSource: public audio::ISampleSource {
         protected:
             JitterBuffer *mJitterBuffer;
             OpusDecoder *mDecoder;
 
-            std::mutex mJitterBufferMutex;
+            /** PacketBlock prefixes the storage for each encoded frame we hand to the
+             * jitter buffer.  Standard sized blocks are recycled through mFreeBlocks
+             * rather than being freed, and voicePacketPoolBlocks of them are allocated
+             * up front, so reception normally doesn't allocate at all.
+             */
+            struct PacketBlock {
+                /** the source that owns this block, or nullptr if it was individually allocated. */
+                RemoteVoiceSource *Pool;
+                PacketBlock *Next;
+            };
+            PacketBlock *mFreeBlocks;
+
+            /** allocPacketData returns storage for a len byte frame. */
+            char *allocPacketData(size_t len);
+            /** releasePacketData returns storage obtained from allocPacketData. */
+            static void releasePacketData(void *data);
+
+            /** mStats, if set, receives the playout counters for this stream. */
+            std::shared_ptr<StreamStats> mStats;
+
             bool mIsActive;
             util::monotime_t mLastActive;
         protected:
@@ -80,10 +103,23 @@ namespace afv_native {
             RemoteVoiceSource(const RemoteVoiceSource& copySrc) = delete;
 
             void appendAudioDTO(const dto::IAudio &audio);
+
+            /** appendAudio copies an encoded frame straight into the jitter buffer.
+             *
+             * @param audio the Opus encoded frame.  This is copied, so need only be valid
+             *      for the duration of the call.
+             */
+            void appendAudio(const unsigned char *audio, size_t audioLen, uint32_t sequence, bool lastPacket);
             audio::SourceStatus getAudioFrame(audio::SampleType *bufferOut) override;
 
             util::monotime_t getLastActivityTime() const;
 
+            /** setStats attaches the statistics object that playout counters are recorded into.
+             *
+             * @note this must not be called concurrently with getAudioFrame.
+             */
+            void setStats(std::shared_ptr<StreamStats> stats);
+
             /** flush resets the stream, preserving any jitter adjustments, but otherwise clearing the codec state and
              * jitter buffered packets.
              */
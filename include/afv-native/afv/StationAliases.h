@@ -0,0 +1,90 @@
+/* afv/StationAliases.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_STATIONALIASES_H
+#define AFV_NATIVE_STATIONALIASES_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "afv-native/afv/dto/Station.h"
+
+namespace afv_native {
+    namespace afv {
+        /** StationAliases is an immutable set of station aliases, indexed by both the
+         * real and the aliased frequency.
+         *
+         * Once built it's never modified, so it's shared between threads by
+         * std::shared_ptr<const StationAliases> and can be read without locking.
+         */
+        class StationAliases {
+        public:
+            explicit StationAliases(std::vector<dto::Station> stations);
+            StationAliases(const StationAliases &cpysrc) = delete;
+
+            const std::vector<dto::Station> &getStations() const;
+            size_t size() const;
+
+            /** findByFrequency returns the first station on the real frequency freq,
+             * or nullptr if there is none. */
+            const dto::Station *findByFrequency(unsigned int freq) const;
+
+            /** findByAlias returns the station using the aliased frequency freq, or
+             * nullptr if there is none. */
+            const dto::Station *findByAlias(unsigned int freq) const;
+
+            /** saveCache writes the set, along with the ETag it was served with, to a
+             * compact (MessagePack) cache file at path.
+             *
+             * @return true if the cache was written.
+             */
+            bool saveCache(const std::string &path, const std::string &etag) const;
+
+            /** loadCache reads a cache previously written by saveCache.
+             *
+             * @param etag set to the ETag stored with the cache.
+             * @return the cached set, or nullptr if the file is missing or unreadable.
+             */
+            static std::shared_ptr<const StationAliases> loadCache(const std::string &path, std::string &etag);
+
+        protected:
+            const std::vector<dto::Station> mStations;
+            std::unordered_map<unsigned int, size_t> mByFrequency;
+            std::unordered_map<unsigned int, size_t> mByAlias;
+        };
+    }
+}
+
+#endif //AFV_NATIVE_STATIONALIASES_H
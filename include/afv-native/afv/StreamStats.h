@@ -0,0 +1,110 @@
+/* afv/StreamStats.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_STREAMSTATS_H
+#define AFV_NATIVE_STREAMSTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "afv-native/util/AtomicHistogram.h"
+
+namespace afv_native {
+    namespace afv {
+        /** StreamStats holds the network quality counters for a single received voice stream
+         * (callsign).
+         *
+         * The public counters may be read from any thread without locking.
+         */
+        class StreamStats {
+        public:
+            explicit StreamStats(std::string callsign);
+            StreamStats(const StreamStats &cpysrc) = delete;
+
+            const std::string Callsign;
+
+            /** PacketsReceived counts all voice packets received for this stream. */
+            std::atomic<uint64_t> PacketsReceived;
+            /** PacketsMissing counts sequence numbers skipped over when a packet arrives
+             * ahead of the next expected one.  Late packets that later fill a gap are
+             * counted in PacketsLate, so PacketsMissing - PacketsLate approximates loss.
+             */
+            std::atomic<uint64_t> PacketsMissing;
+            /** PacketsLate counts packets that arrived behind a higher sequence number. */
+            std::atomic<uint64_t> PacketsLate;
+            /** JitterUs is the smoothed (RFC 3550) inter-arrival jitter, in microseconds. */
+            std::atomic<uint32_t> JitterUs;
+            /** PacketsDropped counts packets that couldn't be queued for playback, either
+             * because the audio output wasn't keeping up (or isn't running), or because
+             * they were oversized.
+             */
+            std::atomic<uint64_t> PacketsDropped;
+
+            /** FramesDecoded counts frames successfully pulled from the jitter buffer and decoded. */
+            std::atomic<uint64_t> FramesDecoded;
+            /** PlcFrames counts frames synthesised by packet loss concealment. */
+            std::atomic<uint64_t> PlcFrames;
+            /** SilenceFrames counts frames of silence inserted by the jitter buffer. */
+            std::atomic<uint64_t> SilenceFrames;
+            std::atomic<uint64_t> DecodeErrors;
+
+            /** ReorderDepth records, for each late packet, how many sequence numbers it was behind. */
+            util::AtomicHistogram ReorderDepth;
+            /** TransitDeltaMs records each packet's deviation from its expected arrival time. */
+            util::AtomicHistogram TransitDeltaMs;
+
+            /** packetReceived updates the network counters for a newly received packet.
+             *
+             * @note this is not thread-safe - calls must be serialised by the caller.
+             *
+             * @param sequence the packet's SequenceCounter.
+             * @param arrivalUs the arrival time on a monotonic microsecond clock.
+             * @param lastPacket true if the packet was flagged as the last in its transmission.
+             */
+            void packetReceived(uint32_t sequence, int64_t arrivalUs, bool lastPacket);
+
+        protected:
+            bool mInTransmission;
+            uint32_t mHighestSequence;
+            int64_t mHighestArrivalUs;
+            double mJitterUs;
+        };
+
+        typedef std::vector<std::shared_ptr<const StreamStats>> StreamStatsList;
+    }
+}
+
+#endif //AFV_NATIVE_STREAMSTATS_H
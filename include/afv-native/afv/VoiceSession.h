@@ -34,6 +34,7 @@
 #ifndef AFV_NATIVE_VOICESESSION_H
 #define AFV_NATIVE_VOICESESSION_H
 
+#include <atomic>
 #include <string>
 #include <event2/util.h>
 
@@ -45,6 +46,7 @@
 #include "afv-native/http/Request.h"
 #include "afv-native/http/RESTRequest.h"
 #include "afv-native/event/EventCallbackTimer.h"
+#include "afv-native/util/AtomicHistogram.h"
 #include "afv-native/util/monotime.h"
 #include "afv-native/util/ChainedCallback.h"
 
@@ -55,7 +57,12 @@ namespace afv_native {
         enum class VoiceSessionState {
             Connected,
             Disconnected,
-            Error
+            Error,
+            /// the voice server stopped responding and we're re-establishing the session
+            /// with our existing API token.  Audio and radio state should be kept.
+            Resuming,
+            /// a Resuming session has been re-established.
+            Resumed,
         };
 
         enum class VoiceSessionError {
@@ -69,7 +76,15 @@ namespace afv_native {
         public:
             util::ChainedCallback<void(VoiceSessionState)> StateCallback;
 
-            VoiceSession(APISession &session, const std::string &callsign = "");
+            /** construct a VoiceSession.
+             *
+             * @param session the APISession to authenticate against.
+             * @param callsign the callsign to register the session with.
+             * @param channelEvBase if set, the event_base to run the voice UDP channel on.
+             *      This may be serviced by a different thread to the session's own
+             *      event_base.  If nullptr, the session's event_base is used.
+             */
+            VoiceSession(APISession &session, const std::string &callsign = "", struct event_base *channelEvBase = nullptr);
             virtual ~VoiceSession();
 
             void setCallsign(const std::string &newCallsign);
@@ -82,9 +97,17 @@ namespace afv_native {
                     const std::vector<dto::Transceiver> &txDto,
                     std::function<void(http::Request *, bool)> callback);
             cryptodto::UDPChannel & getUDPChannel();
+            const cryptodto::UDPChannel & getUDPChannel() const;
 
             VoiceSessionError getLastError() const;
 
+            /** HeartbeatRttMs is the round trip time of the most recently acknowledged
+             * heartbeat, in milliseconds, or -1 if none has been measured yet.
+             */
+            std::atomic<int64_t> HeartbeatRttMs;
+            /** HeartbeatRtt records the round trip time (ms) of every acknowledged heartbeat. */
+            util::AtomicHistogram HeartbeatRtt;
+
         protected:
             APISession &mSession;
             std::string mCallsign;
@@ -95,10 +118,14 @@ namespace afv_native {
             cryptodto::UDPChannel mChannel;
 
             event::EventCallbackTimer mHeartbeatTimer;
-            util::monotime_t mLastHeartbeatReceived;
+            /** updated from the UDP channel's thread when a heartbeat ack arrives. */
+            std::atomic<util::monotime_t> mLastHeartbeatReceived;
+            /** the time the outstanding heartbeat was sent, or 0 once it's been acknowledged. */
+            std::atomic<util::monotime_t> mLastHeartbeatSent;
             event::EventCallbackTimer mHeartbeatTimeout;
 
             VoiceSessionError mLastError;
+            bool mResuming;
 
             /** setupSession use the information in the PostCallsignResponse DTO to start up
              * the UDP session and tasks
@@ -117,6 +144,20 @@ namespace afv_native {
              */
             void failSession();
 
+            /** resumeSession tries to recover a session whose heartbeats have timed out
+             * without a full reconnect.
+             *
+             * It re-requests the callsign session with the existing bearer token, and
+             * meanwhile reopens the UDP channel with the old keys and starts sending
+             * heartbeats.  If the session can't be resumed within afvHeartbeatTimeoutMs,
+             * it falls back to a full disconnect and reconnect.
+             *
+             * @return false if resumption isn't possible (the API session isn't running).
+             */
+            bool resumeSession();
+            void completeResume(const dto::PostCallsignResponse &cresp);
+            void abandonResume();
+
             void sendHeartbeatCallback();
             void receivedHeartbeat();
             void heartbeatTimedOut();
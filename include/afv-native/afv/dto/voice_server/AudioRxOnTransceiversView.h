@@ -0,0 +1,141 @@
+/* afv/dto/voice_server/AudioRxOnTransceiversView.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_AUDIORXONTRANSCEIVERSVIEW_H
+#define AFV_NATIVE_AUDIORXONTRANSCEIVERSVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "afv-native/afv/params.h"
+#include "afv-native/afv/dto/domain/RxTransceiver.h"
+#include "afv-native/util/MsgpackReader.h"
+
+namespace afv_native {
+    namespace afv {
+        namespace dto {
+            /** AudioRxOnTransceiversView is a non-owning decode of an AR (AudioRxOnTransceivers)
+             * DTO.
+             *
+             * Rather than unpacking into a msgpack zone and then converting into an
+             * AudioRxOnTransceivers, the fields are read straight out of the received
+             * buffer: the callsign and audio are views into it, and the transceivers are
+             * held in fixed storage.  The view is only valid as long as the buffer it was
+             * decoded from.
+             */
+            class AudioRxOnTransceiversView {
+            public:
+                const char *Callsign;
+                size_t CallsignLen;
+                uint32_t SequenceCounter;
+                const unsigned char *Audio;
+                size_t AudioLen;
+                bool LastPacket;
+                RxTransceiver Transceivers[maxRxTransceiversPerPacket];
+                size_t TransceiverCount;
+
+                AudioRxOnTransceiversView():
+                        Callsign(nullptr),
+                        CallsignLen(0),
+                        SequenceCounter(0),
+                        Audio(nullptr),
+                        AudioLen(0),
+                        LastPacket(false),
+                        Transceivers(),
+                        TransceiverCount(0)
+                {
+                }
+
+                /** decode reads the AR DTO in bufIn.
+                 *
+                 * The layout must match AudioRxOnTransceivers' MSGPACK_DEFINE_ARRAY:
+                 * [Callsign, SequenceCounter, Audio, LastPacket, [[ID, Frequency, DistanceRatio]...]]
+                 *
+                 * @return true if the DTO decoded successfully, false if it was malformed.
+                 */
+                bool decode(const unsigned char *bufIn, size_t bufLen)
+                {
+                    util::MsgpackReader reader(bufIn, bufLen);
+                    uint32_t fieldCount;
+                    uint64_t intValue;
+
+                    if (!reader.readArrayHeader(fieldCount) || fieldCount != 5) {
+                        return false;
+                    }
+                    if (!reader.readStr(Callsign, CallsignLen)) {
+                        return false;
+                    }
+                    if (!reader.readUInt(intValue) || intValue > UINT32_MAX) {
+                        return false;
+                    }
+                    SequenceCounter = static_cast<uint32_t>(intValue);
+                    if (!reader.readBin(Audio, AudioLen)) {
+                        return false;
+                    }
+                    if (!reader.readBool(LastPacket)) {
+                        return false;
+                    }
+                    uint32_t transceiverCount;
+                    if (!reader.readArrayHeader(transceiverCount)) {
+                        return false;
+                    }
+                    TransceiverCount = 0;
+                    for (uint32_t i = 0; i < transceiverCount; i++) {
+                        RxTransceiver trx;
+                        uint32_t trxFieldCount;
+                        if (!reader.readArrayHeader(trxFieldCount) || trxFieldCount != 3) {
+                            return false;
+                        }
+                        if (!reader.readUInt(intValue) || intValue > UINT16_MAX) {
+                            return false;
+                        }
+                        trx.ID = static_cast<uint16_t>(intValue);
+                        if (!reader.readUInt(intValue) || intValue > UINT32_MAX) {
+                            return false;
+                        }
+                        trx.Frequency = static_cast<uint32_t>(intValue);
+                        if (!reader.readFloat(trx.DistanceRatio)) {
+                            return false;
+                        }
+                        if (TransceiverCount < maxRxTransceiversPerPacket) {
+                            Transceivers[TransceiverCount++] = trx;
+                        }
+                    }
+                    return true;
+                }
+            };
+        }
+    }
+}
+
+#endif //AFV_NATIVE_AUDIORXONTRANSCEIVERSVIEW_H
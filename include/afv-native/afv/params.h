@@ -34,6 +34,8 @@
 #ifndef AFV_NATIVE_PARAMS_H
 #define AFV_NATIVE_PARAMS_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 namespace afv_native {
@@ -43,6 +45,31 @@ namespace afv_native {
         const unsigned afvHeartbeatIntervalMs = 3000;
         const unsigned afvHeartbeatTimeoutMs = 10000;
         const unsigned afvTransciverUpdateIntervalMs = 20000;
+        // quiet period used to coalesce a burst of retunes into one transceiver
+        // update.  Skipped if the PTT is waiting on the update.
+        const unsigned afvTransceiverUpdateCoalesceMs = 25;
+        // how soon to retry a transceiver update that failed.
+        const unsigned afvTransceiverUpdateRetryMs = 1000;
+        // how often to touch the API server while authenticated so the pooled
+        // connection stays open for the next real request.  Kept under the common
+        // 60 second idle timeout on load balancers.
+        const unsigned afvApiKeepWarmIntervalMs = 45000;
+
+        // most transceivers we'll track from a single received voice packet.  Any more
+        // than this are validated but otherwise ignored.
+        const size_t maxRxTransceiversPerPacket = 16;
+
+        // size of the pooled blocks used to hold encoded voice frames in the jitter
+        // buffer.  Frames larger than this are still accepted, but are allocated
+        // individually.
+        const size_t voicePacketBlockSize = 512;
+        // blocks preallocated for each stream's jitter buffer, so decoding doesn't
+        // normally allocate.  Around 640ms of buffered audio.
+        const size_t voicePacketPoolBlocks = 32;
+
+        // received voice packets that can be queued for each output's render pass.
+        // Packets larger than voicePacketBlockSize can't be queued.
+        const uint32_t voicePacketQueueDepth = 256;
     }
 }
 
@@ -39,10 +39,12 @@
 #include <map>
 #include <vector>
 #include <atomic>
-#include <mutex>
 
 #include "afv-native/audio/ISampleSink.h"
 #include "afv-native/audio/ISampleSource.h"
+#include "afv-native/util/AtomicHistogram.h"
+#include "afv-native/util/PublishedPtr.h"
+#include "afv-native/util/RealtimeTuning.h"
 
 namespace afv_native {
     namespace audio {
@@ -54,12 +56,79 @@ namespace afv_native {
          * the constructor and device probe functions as necessary.
          */
         class AudioDevice {
+        public:
+            /** StreamStatistics is a snapshot of the callback timing of one direction
+             * (playback or capture) of a device.
+             */
+            struct StreamStatistics {
+                /** CallbackJitterUs is the distribution of how far (us) each callback
+                 * arrived from when it was due, going by the length of the previous one. */
+                util::HistogramSnapshot CallbackJitterUs;
+                /** CallbackDurationUs is the distribution of the time (us) spent in each callback. */
+                util::HistogramSnapshot CallbackDurationUs;
+                /** DeadlineMisses counts callbacks that took longer than the audio they handled. */
+                uint32_t DeadlineMisses;
+                /** Xruns estimates the xruns from the callback timing: it counts the gaps
+                 * between callbacks longer than the backend's reported latency could
+                 * cover, which would have drained (playback) or overrun (capture) its
+                 * buffer.  The backends don't report actual xruns to us. */
+                uint32_t Xruns;
+                /** BackendLatencyUs is the buffering the backend reported when the stream opened. */
+                uint32_t BackendLatencyUs;
+                /** BufferLatencyUs is the most our own re-framing adds on top of that. */
+                uint32_t BufferLatencyUs;
+            };
+
         protected:
-            std::shared_ptr<ISampleSink> mSink;
-            std::mutex mSinkPtrLock;
-            std::shared_ptr<ISampleSource> mSource;
-            std::mutex mSourcePtrLock;
+            /** StreamMonitor tracks the callback timing of one stream.  begin() and end()
+             * must only be called from that stream's callback, and never block.
+             */
+            class StreamMonitor {
+            public:
+                StreamMonitor();
+                StreamMonitor(const StreamMonitor &) = delete;
+
+                /** reset clears the statistics, and sets the latencies for a newly opened stream. */
+                void reset(uint32_t backendLatencyUs, uint32_t bufferLatencyUs);
+                /** begin marks the start of a callback handling nFrames samples.
+                 *
+                 * @return true if this callback arrived later than the backend's reported
+                 *      latency could cover, and so probably followed an xrun.
+                 */
+                bool begin(unsigned int nFrames);
+                void end();
+                StreamStatistics snapshot() const;
+
+            protected:
+                util::AtomicHistogram mJitterUs;
+                util::AtomicHistogram mDurationUs;
+                std::atomic<uint32_t> mDeadlineMisses;
+                std::atomic<uint32_t> mXruns;
+                std::atomic<uint32_t> mBackendLatencyUs;
+                std::atomic<uint32_t> mBufferLatencyUs;
+                // these are only touched from the callback.
+                int64_t mLastStartUs;
+                int64_t mCurrentStartUs;
+                /** mExpectedIntervalUs is the length of the audio in the current callback. */
+                int64_t mExpectedIntervalUs;
+            };
+
+            StreamMonitor mOutputMonitor;
+            StreamMonitor mInputMonitor;
+
+            /** mSink and mSource are read from the device callbacks, which must never
+             * block, so they're handed over with PublishedPtr rather than a mutex. */
+            util::PublishedPtr<ISampleSink> mSink;
+            util::PublishedPtr<ISampleSource> mSource;
+
+            /** mPeriodMs is the period to request from the device, in milliseconds. */
+            unsigned int mPeriodMs;
 
+            /** mDuplex requests that playback and capture be opened as one stream. */
+            bool mDuplex;
+
+            /** mRealtimeOptions is applied to the callback threads and buffers on open. */
+            util::RealtimeOptions mRealtimeOptions;
 
             /** Ensures data within the abstract is zeroed.   Should always be called via
              * the initialiser chain of any subclasses.
@@ -75,6 +144,17 @@ namespace afv_native {
              */
             typedef unsigned int Api;
 
+            /** NullApi selects a device with no hardware behind it, which plays into
+             * nothing and records silence, paced by the system clock.
+             */
+            static const Api NullApi = 0xfffffffe;
+
+            /** FileApi selects a device like NullApi's, but which writes its output to
+             * the WAV file named by the output device id, and loops the WAV file named by
+             * the input device id as its input.
+             */
+            static const Api FileApi = 0xfffffffd;
+
             /** DeviceInfo is a uniform structure by which API implementations can return
              * information about known devices.  The "id" value should be used as an
              * argument to the constructor of the driver instance to set the desired device.
@@ -103,7 +183,8 @@ namespace afv_native {
 
             /** setSource sets the ISampleSource for this AudioDevice.
              *
-             * Any existing source will have it's pointer released.
+             * Any existing source will have it's pointer released once the device
+             * callback has finished with it.  This never blocks the callback.
              *
              * This can be set to the invalid/empty pointer to disable the source, in which
              * case the device should output silence.
@@ -114,7 +195,8 @@ namespace afv_native {
 
             /** setSink sets the ISampleSink for this AudioDevice.
              *
-             * Any existing sink will have its pointer released.
+             * Any existing sink will have its pointer released once the device
+             * callback has finished with it.  This never blocks the callback.
              *
              * This can be set to the invalid/empty pointer to disable the sink, in which
              * case the device should simply discard any samples received from the hardware.
@@ -123,13 +205,51 @@ namespace afv_native {
              */
             virtual void setSink(std::shared_ptr<ISampleSink> newSink);
 
-            /** OutputUnderflows is a monotonic counter of the number of playback buffer
-             * underflows that have occurred since the AudioDevice was constructed.
+            /** setPeriodMs sets the device period (callback interval) to request the
+             * next time the device is opened.  This is a hint - backends may round it or
+             * deliver callbacks of varying sizes.  Values outside 1 to frameLengthMs are
+             * clamped.
+             */
+            void setPeriodMs(unsigned int periodMs);
+            unsigned int getPeriodMs() const;
+
+            /** setDuplex asks for the output and input to be opened as a single
+             * full-duplex stream the next time openOutput() is called, so capture and
+             * playback run from one callback on one clock.  Once a duplex stream is
+             * open, openInput() just returns success.
+             *
+             * Backends that can't open the pair together fall back to separate streams;
+             * isDuplexOpen() reports which one was used.
+             */
+            void setDuplex(bool duplex);
+            bool getDuplex() const;
+            virtual bool isDuplexOpen() const;
+
+            /** setRealtimeOptions sets the scheduling and memory locking to use for the
+             * device's callback threads the next time it's opened.
+             */
+            void setRealtimeOptions(const util::RealtimeOptions &options);
+
+            /** getOutputStatistics and getInputStatistics return the callback timing
+             * of the playback and capture streams since they were last opened.
+             */
+            StreamStatistics getOutputStatistics() const;
+            StreamStatistics getInputStatistics() const;
+
+            /** OutputUnderflows is a monotonic counter of the playback callbacks, since
+             * the AudioDevice was constructed, that arrived late enough to have probably
+             * underflowed the playback buffer.
+             *
+             * This is an estimate from the callback timing (see StreamStatistics::Xruns),
+             * not a count of underflows reported by the backend.  It misses any the
+             * backend hides from us, and may count late callbacks the backend had more
+             * buffering for than it reported.
              */
             std::atomic<uint32_t>   OutputUnderflows;
 
-            /** InputOverflows is a monotonic counter of the number of recording buffer
-             * overflows that have occurred since the AudioDevice was constructed.
+            /** InputOverflows is the capture counterpart of OutputUnderflows: an estimate
+             * of the recording buffer overflows since the AudioDevice was constructed,
+             * from the capture callbacks that arrived late.
              */
             std::atomic<uint32_t>   InputOverflows;
 
@@ -137,6 +257,11 @@ namespace afv_native {
             static std::map<Api,std::string> getAPIs();
             static std::map<int,DeviceInfo> getCompatibleInputDevicesForApi(AudioDevice::Api api);
             static std::map<int,DeviceInfo> getCompatibleOutputDevicesForApi(AudioDevice::Api api);
+            /** invalidateDeviceCache marks the cached device list as stale, so it's
+             * enumerated again the next time it's needed.  Hosts that get hotplug
+             * notifications from the OS should call this when devices change.
+             */
+            static void invalidateDeviceCache();
             static std::shared_ptr<AudioDevice> makeDevice(
                     const std::string &userStreamName,
                     const std::string &outputDeviceId,
@@ -0,0 +1,119 @@
+/* afv-native/audio/ClockBridge.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_CLOCKBRIDGE_H
+#define AFV_NATIVE_CLOCKBRIDGE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <speexdsp/include/speex/speex_resampler.h>
+
+#include "afv-native/audio/ISampleSink.h"
+#include "afv-native/audio/ISampleSource.h"
+
+namespace afv_native {
+    namespace audio {
+        /** ClockBridge carries a source rendered on one device's clock (the master)
+         * over to a device running on a different clock (the slave).
+         *
+         * The master hands each frame it renders over with putAudioFrame() into a small
+         * FIFO, and the slave plays it back through getAudioFrame().  As the two
+         * clocks drift, the FIFO's fill level is steered back to its target by
+         * resampling what the slave reads by a few hundred parts per million, rather
+         * than letting it slowly run dry or overflow.
+         *
+         * Exactly one thread may call putAudioFrame(), and exactly one may call
+         * getAudioFrame(); none of them block or allocate.
+         */
+        class ClockBridge: public ISampleSource, public ISampleSink {
+        public:
+            /** maxCorrectionPpm is the largest rate correction that will be applied. */
+            static const int maxCorrectionPpm = 5000;
+
+            explicit ClockBridge(unsigned int channels);
+            virtual ~ClockBridge();
+
+            /** putAudioFrame queues a frame the master has already rendered.  bufferIn
+             * must hold a full interleaved frame of every channel.
+             */
+            void putAudioFrame(const SampleType *bufferIn) override;
+
+            SourceStatus getAudioFrame(SampleType *bufferOut) override;
+
+            /** getCorrectionPpm returns the rate correction currently being applied.
+             * Positive values mean the slave clock is slow and the FIFO is being drained
+             * faster than real-time.
+             */
+            int getCorrectionPpm() const;
+            uint32_t getUnderruns() const;
+            uint32_t getOverruns() const;
+
+        protected:
+            static const unsigned int fifoFrames = 6;
+
+            const unsigned int mChannels;
+            SpeexResamplerState *mResampler;
+
+            /** mFifo holds fifoFrames interleaved frames, plus a spare to render dropped
+             * frames into.  mWriteFrame and mReadFrame count frames written and read,
+             * and only ever increase. */
+            std::vector<SampleType> mFifo;
+            std::atomic<uint32_t> mWriteFrame;
+            std::atomic<uint32_t> mReadFrame;
+            /** mReadOffset is how many samples of the frame at mReadFrame have been consumed. */
+            unsigned int mReadOffset;
+            /** mPrimed is cleared after an underrun, so playback waits for the FIFO to refill. */
+            bool mPrimed;
+            /** mFillAverage is the smoothed FIFO fill level, in samples. */
+            double mFillAverage;
+            /** mLastPutUs is when the master last delivered a frame. */
+            std::atomic<int64_t> mLastPutUs;
+
+            std::atomic<int> mCorrectionPpm;
+            std::atomic<uint32_t> mUnderruns;
+            std::atomic<uint32_t> mOverruns;
+
+            void setCorrection(int ppm);
+
+            /** writeSlot returns where the next frame should be written, or the spare
+             * slot (with full set) if the slave has stalled and the frame is to be dropped.
+             */
+            SampleType *writeSlot(bool &full);
+            void commitSlot(bool full);
+        };
+    }
+}
+
+#endif //AFV_NATIVE_CLOCKBRIDGE_H
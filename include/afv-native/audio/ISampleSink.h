@@ -41,6 +41,13 @@ namespace afv_native {
         class ISampleSink {
         public:
             virtual void putAudioFrame(const SampleType *bufferIn) = 0;
+
+            /** beginBatch and endBatch bracket the frames a device delivers from a single
+             * callback, so a sink can hold back work (such as sending) until the whole
+             * run has been delivered.  Calls are never nested.
+             */
+            virtual void beginBatch() {}
+            virtual void endBatch() {}
         };
     }
 }
@@ -53,6 +53,10 @@ namespace afv_native {
             SourceStatus getAudioFrame(SampleType *bufferOut) override;
 
             bool isPlaying() const;
+            /** rewind restarts playback from the beginning of the sample. */
+            void rewind();
+            /** stop ends playback.  getAudioFrame returns Closed until it's rewound. */
+            void stop();
 
         };
     }
@@ -12,10 +12,14 @@ namespace afv_native::audio
         explicit SimpleCompressorEffect();
         virtual ~SimpleCompressorEffect();
 
+        SimpleCompressorEffect(const SimpleCompressorEffect &cpysrc) = delete;
+        SimpleCompressorEffect &operator=(const SimpleCompressorEffect &cpysrc) = delete;
+
         void transformFrame(SampleType *bufferOut, SampleType const bufferIn[]);
 
     private:
         sf_compressor_state_st m_simpleCompressor;
+        // allocated up front, as transformFrame is called from the audio callbacks.
         sf_snd m_inputSound;
         sf_snd m_outputSound;
     };
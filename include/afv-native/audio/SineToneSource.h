@@ -52,6 +52,8 @@ namespace afv_native {
         public:
             explicit SineToneSource(double freqHz, float gain=1.0);
             SourceStatus getAudioFrame(SampleType *bufferOut) override;
+            /** rewind restarts the tone from zero phase. */
+            void rewind();
         };
     }
 }
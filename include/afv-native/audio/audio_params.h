@@ -57,6 +57,11 @@ namespace afv_native {
         typedef float SampleType;
 
         const size_t frameSizeBytes = frameSizeSamples * sizeof(SampleType);
+
+        /** default audio device period.  The devices buffer internally, so this doesn't
+         * need to match (or divide) frameLengthMs - shorter periods lower the output
+         * latency on backends that can sustain them. */
+        const unsigned int defaultDevicePeriodMs = 10;
     }
 }
 
@@ -0,0 +1,151 @@
+/* cryptodto/CaptureFile.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_CAPTUREFILE_H
+#define AFV_NATIVE_CAPTUREFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "afv-native/cryptodto/params.h"
+
+namespace afv_native {
+    namespace cryptodto {
+        /** Capture files hold the DTOs received on a channel, after decryption, in the
+         * order they were accepted.
+         *
+         * The file is a CaptureFileHeader followed by a sequence of records.  Each
+         * record is a CaptureRecordHeader, the DTO name, then the DTO body, padded with
+         * zeros to a multiple of captureRecordAlignment bytes so that every record header
+         * is aligned when the file is memory mapped.  Integers are stored in host order,
+         * which is little endian on every platform we support.
+         */
+        const char captureFileMagic[8] = {'A', 'F', 'V', 'C', 'A', 'P', 'T', '1'};
+        const uint32_t captureFileVersion = 1;
+        const size_t captureRecordAlignment = 8;
+
+        struct CaptureFileHeader {
+            char Magic[8];
+            uint32_t Version;
+            uint32_t Reserved;
+        };
+
+        struct CaptureRecordHeader {
+            /** microseconds since the capture was started. */
+            uint64_t TimestampUs;
+            /** the cryptodto sequence number the DTO arrived with. */
+            uint64_t Sequence;
+            uint32_t DtoLen;
+            uint16_t NameLen;
+            uint16_t Reserved;
+        };
+
+        /** CaptureRecord is a decoded record, pointing into the CaptureReader's mapping. */
+        struct CaptureRecord {
+            uint64_t TimestampUs;
+            uint64_t Sequence;
+            const char *Name;
+            size_t NameLen;
+            const unsigned char *Dto;
+            size_t DtoLen;
+        };
+
+        /** CaptureWriter appends records to a new capture file.
+         *
+         * record may be called from any thread.
+         */
+        class CaptureWriter {
+        public:
+            CaptureWriter();
+            CaptureWriter(const CaptureWriter &cpysrc) = delete;
+            virtual ~CaptureWriter();
+
+            /** open creates (or truncates) the capture file at path and writes its header. */
+            bool open(const std::string &path);
+            void close();
+            bool isOpen() const;
+
+            /** record appends a DTO to the capture.
+             *
+             * @param arrivalUs the time the DTO arrived, on the util::monotime_get_us clock.
+             */
+            void record(
+                    int64_t arrivalUs,
+                    sequence_t sequence,
+                    const char *dtoName,
+                    size_t dtoNameLen,
+                    const unsigned char *dto,
+                    size_t dtoLen);
+
+        protected:
+            std::mutex mLock;
+            FILE *mFile;
+            int64_t mStartUs;
+        };
+
+        /** CaptureReader maps a capture file into memory and iterates over its records
+         * without copying them.
+         */
+        class CaptureReader {
+        public:
+            CaptureReader();
+            CaptureReader(const CaptureReader &cpysrc) = delete;
+            virtual ~CaptureReader();
+
+            bool open(const std::string &path);
+            void close();
+
+            /** next decodes the record at the read position and advances past it.
+             *
+             * @return false at the end of the capture, or if the record is truncated.
+             */
+            bool next(CaptureRecord &recordOut);
+
+            /** rewind returns the read position to the first record. */
+            void rewind();
+
+        protected:
+            const unsigned char *mData;
+            size_t mSize;
+            size_t mOffset;
+#ifdef _WIN32
+            void *mFileHandle;
+            void *mMappingHandle;
+#endif
+        };
+    }
+}
+
+#endif //AFV_NATIVE_CAPTUREFILE_H
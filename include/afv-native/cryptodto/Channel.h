@@ -37,10 +37,12 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <cstring>
 #include <openssl/evp.h>
 #include <msgpack.hpp>
 
 #include "afv-native/cryptodto/params.h"
+#include "afv-native/cryptodto/DatagramWriter.h"
 #include "afv-native/cryptodto/SequenceTest.h"
 #include "afv-native/cryptodto/dto/ICryptoDTO.h"
 #include "afv-native/Log.h"
@@ -53,26 +55,94 @@ namespace afv_native {
             class Header;
         }
 
+        enum class DecapsulateOutcome {
+            OK,
+            // the datagram was truncated, or its framing or header were invalid.
+            Malformed,
+            // the header was well formed, but for a different channel.
+            WrongTag,
+            // the body failed to authenticate.
+            DecryptFailed,
+        };
+
         class Channel {
         protected:
             unsigned char aeadTransmitKey[aeadModeKeySize];
             unsigned char aeadReceiveKey[aeadModeKeySize];
 
+            /** mHeaderPrefix caches the on-wire encoding of the constant leading
+             * part of our datagram header - the header length, the array marker and
+             * the ChannelTag.  Only the sequence and mode follow it.
+             *
+             * It is rebuilt whenever the ChannelTag changes via setChannelConfig.
+             */
+            std::vector<unsigned char> mHeaderPrefix;
+
+            /** mHeaderTagOffset and mHeaderTagLen locate the raw ChannelTag bytes
+             * within mHeaderPrefix, so inbound tags can be compared without decoding.
+             */
+            size_t mHeaderTagOffset;
+            size_t mHeaderTagLen;
+
+            /** mTxCipherContext is kept for the life of the channel so encryption
+             * doesn't need to allocate a new cipher context per datagram.
+             *
+             * It is not thread-safe - callers of Encapsulate must serialise their
+             * access.
+             */
+            EVP_CIPHER_CTX *mTxCipherContext;
+
+            /** mRxCipherContext is the receive-side counterpart to mTxCipherContext, and
+             * is likewise only safe to use from one thread at a time.
+             */
+            EVP_CIPHER_CTX *mRxCipherContext;
+
             static void make_aead_key(unsigned char keyBuffer[]);
 
+            void updateHeaderPrefix();
+
+            /** parseHeader validates the length-prefixed header at the start of
+             * datagram and checks its tag against our ChannelTag.
+             *
+             * This only accepts the 3 element array form that dto::Header encodes to,
+             * but is tolerant of any valid msgpack integer encodings for the fields.
+             *
+             * @param bodyOffset set to the offset of the body following the header.
+             */
+            DecapsulateOutcome parseHeader(
+                    const unsigned char *datagram,
+                    size_t datagramLen,
+                    size_t &bodyOffset,
+                    sequence_t &sequence,
+                    CryptoDtoMode &modeOut) const;
+
+            /** decryptChaCha20Poly1305 verifies and decrypts cipherLen bytes (including
+             * the trailing AEAD tag) from cipherIn into bodyOut.
+             *
+             * bodyOut and cipherIn may be the same buffer to decrypt in place.
+             *
+             * @return the length of the plaintext, or 0 if the message failed to verify.
+             */
             size_t decryptChaCha20Poly1305(
                     unsigned char *bodyOut,
                     const unsigned char *cipherIn,
                     size_t cipherLen,
-                    const dto::Header &header,
+                    sequence_t sequence,
                     const unsigned char *aadIn,
                     size_t aadLen);
 
+            /** encryptChaCha20Poly1305 encrypts plainLen bytes from plainIn into cipherOut
+             * and appends the AEAD tag.
+             *
+             * cipherOut and plainIn may be the same buffer to encrypt in place, but must
+             * not otherwise overlap.  cipherOut must have room for plainLen +
+             * aeadModeTagSize bytes.
+             */
             size_t encryptChaCha20Poly1305(
                     unsigned char *cipherOut,
                     const unsigned char *plainIn,
                     size_t plainLen,
-                    const dto::Header &header,
+                    sequence_t sequence,
                     const unsigned char *aadIn,
                     size_t aadLen);
 
@@ -80,38 +150,57 @@ namespace afv_native {
 
         protected:
 
-            /** encodeDto takes the DTO provided as dto and encodes it into dtoBuf.
+            /** encodeHeader writes the length-prefixed cryptodto header for a datagram
+             * into dgWriter, which must be empty.
              *
-             * This forms the ciphertext portion of an encrypted DTO message.
+             * @return true if the header was written, false if it didn't fit.
+             */
+            bool encodeHeader(DatagramWriter &dgWriter, sequence_t sequence, CryptoDtoMode mode) const;
+
+            /** sealPayload applies the nominated cipher mode, in place, to the body of the
+             * datagram held in dgWriter.
+             *
+             * @param dgWriter the writer holding the encoded header followed by the plaintext
+             *      body.  Any AEAD tag is appended to it.
+             * @param bodyOffset the offset of the start of the body (the end of the header).
+             * @return the final length of the datagram, or 0 if it couldn't be sealed.
+             */
+            size_t sealPayload(DatagramWriter &dgWriter, size_t bodyOffset, sequence_t sequence, CryptoDtoMode mode);
+
+            /** encodeDto takes the DTO provided as dto and encodes it into dgWriter.
+             *
+             * This forms the ciphertext portion of an encrypted DTO message.  The DTO
+             * is packed directly into the output buffer, and its length patched in
+             * afterwards.
              *
              * @tparam T type of the DTO.  T must provide a getName() method that
              *          returns the DTO name, and be encodable by msgpack-c.
-             * @param dtoBuf the sbuffer object to pass the encoded dto out in.
+             * @param dgWriter the writer to encode the dto into.
              * @param dto the dto to encode
              * @return true if the message was successfully encoded, false otherwise.
              */
             template<class T>
-            static bool encodeDto(msgpack::sbuffer &dtoBuf, const T &dto)
+            static bool encodeDto(DatagramWriter &dgWriter, const T &dto)
             {
                 // assemble the body and pack it.
-                std::string dtoName = dto.getName();
+                const std::string dtoName = dto.getName();
                 uint16_t nLen = static_cast<uint16_t>(dtoName.length());
-                dtoBuf.write(reinterpret_cast<char *>(&nLen), 2);
-                dtoBuf.write(dtoName.data(), nLen);
-
-                // because we don't know the dto size in advance, pack it into it's own
-                // temp buffer, then copy it into the actual payload buffer.
-                msgpack::sbuffer dtoTempBuf;
-                msgpack::pack(dtoTempBuf, dto);
-                nLen = static_cast<uint16_t>(dtoTempBuf.size());
-                if (dtoTempBuf.size() > UINT16_MAX) {
+                dgWriter.write(reinterpret_cast<char *>(&nLen), 2);
+                dgWriter.write(dtoName.data(), nLen);
+
+                // reserve the dto length and pack the dto straight in behind it.
+                unsigned char *dtoLenPtr = dgWriter.reserve(2);
+                const size_t dtoOffset = dgWriter.size();
+                msgpack::pack(dgWriter, dto);
+                if (dgWriter.overflowed()) {
                     return false;
                 }
-
-                dtoBuf.write(reinterpret_cast<char *>(&nLen), 2);
-                dtoBuf.write(dtoTempBuf.data(), dtoTempBuf.size());
-
-                assert(dtoBuf.size() == (dtoTempBuf.size() + 2 + dtoName.size() + 2));
+                const size_t dtoLen = dgWriter.size() - dtoOffset;
+                if (dtoLen > UINT16_MAX) {
+                    return false;
+                }
+                nLen = static_cast<uint16_t>(dtoLen);
+                ::memcpy(dtoLenPtr, &nLen, 2);
                 return true;
             }
 
@@ -121,9 +210,19 @@ namespace afv_native {
             time_t LastReceive;
 
             explicit Channel();
+            Channel(const Channel &cpysrc) = delete;
+            virtual ~Channel();
 
             virtual void setChannelConfig(const dto::ChannelConfig &config);
 
+            /** Encapsulate encodes and seals dto as a complete cryptodto datagram in bufOut.
+             *
+             * The header, DTO and AEAD tag are all written directly into bufOut in a
+             * single pass.
+             *
+             * @return the size of the datagram, or 0 if it could not be encoded (for
+             *      instance, if it would not fit in bufOutLen).
+             */
             template<class T>
             size_t Encapsulate(
                     unsigned char *bufOut,
@@ -132,18 +231,15 @@ namespace afv_native {
                     cryptodto::CryptoDtoMode mode,
                     const T &dto)
             {
-                msgpack::sbuffer dtoBuf;
-                if (!encodeDto(dtoBuf, dto)) {
+                DatagramWriter dgWriter(bufOut, bufOutLen);
+                if (!encodeHeader(dgWriter, sequence, mode)) {
                     return 0;
                 }
-                // use the generic encapsulate method.
-                return Encapsulate(
-                        reinterpret_cast<const unsigned char *>(dtoBuf.data()),
-                        dtoBuf.size(),
-                        sequence,
-                        mode,
-                        bufOut,
-                        bufOutLen);
+                const size_t bodyOffset = dgWriter.size();
+                if (!encodeDto(dgWriter, dto)) {
+                    return 0;
+                }
+                return sealPayload(dgWriter, bodyOffset, sequence, mode);
             }
 
             size_t Encapsulate(
@@ -154,14 +250,30 @@ namespace afv_native {
                     unsigned char *cipherTextBufOut,
                     size_t cipherTextLen);
 
-            bool Decapsulate(
-                    const unsigned char *cipherTextIn,
-                    size_t cipherTextLen,
-                    std::string &channelTag,
+            /** Decapsulate validates and decodes the datagram held in datagram.
+             *
+             * The header tag is checked against our ChannelTag before any decryption
+             * is attempted, and the body is then decrypted in place, so the contents
+             * of datagram are destroyed by this call.
+             *
+             * @param dtoNameOut set to point at the (unterminated) DTO name within datagram.
+             * @param dtoNameLenOut set to the length of the DTO name.
+             * @param dtoOut set to point at the DTO payload (including its length prefix)
+             *      within datagram.  Like dtoNameOut, it remains valid only as long as
+             *      datagram does.
+             * @param dtoLenOut set to the length of the DTO payload.
+             * @return DecapsulateOutcome::OK if the datagram was decoded successfully,
+             *      otherwise the reason it was rejected.
+             */
+            DecapsulateOutcome Decapsulate(
+                    unsigned char *datagram,
+                    size_t datagramLen,
                     sequence_t &sequence,
                     CryptoDtoMode &modeOut,
-                    std::string &dtoNameOut,
-                    msgpack::sbuffer &dtoOut);
+                    const char *&dtoNameOut,
+                    size_t &dtoNameLenOut,
+                    const unsigned char *&dtoOut,
+                    size_t &dtoLenOut);
         };
     }
 }
@@ -0,0 +1,115 @@
+/* cryptodto/DatagramWriter.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_DATAGRAMWRITER_H
+#define AFV_NATIVE_DATAGRAMWRITER_H
+
+#include <cstddef>
+#include <cstring>
+
+namespace afv_native {
+    namespace cryptodto {
+        /** DatagramWriter is an append-only writer over a fixed, preallocated buffer.
+         *
+         * It satisfies the msgpack-c output stream interface, so DTOs can be packed
+         * straight into a datagram buffer without any intermediate copies or
+         * allocations.
+         *
+         * Writes that would run past the end of the buffer are discarded and the
+         * writer is flagged as overflowed - callers should check overflowed() once
+         * they have finished writing rather than checking each write.
+         */
+        class DatagramWriter {
+        protected:
+            unsigned char *mBuffer;
+            size_t mCapacity;
+            size_t mOffset;
+            bool mOverflowed;
+        public:
+            DatagramWriter(unsigned char *buffer, size_t capacity):
+                    mBuffer(buffer),
+                    mCapacity(capacity),
+                    mOffset(0),
+                    mOverflowed(false)
+            {
+            }
+
+            DatagramWriter(const DatagramWriter &cpysrc) = delete;
+
+            void write(const char *data, size_t len)
+            {
+                unsigned char *dst = reserve(len);
+                if (dst != nullptr) {
+                    ::memcpy(dst, data, len);
+                }
+            }
+
+            /** reserve claims the next len bytes of the buffer so they can be filled in later.
+             *
+             * @return a pointer to the reserved space, or nullptr if the buffer is exhausted.
+             */
+            unsigned char *reserve(size_t len)
+            {
+                if (mOverflowed || len > (mCapacity - mOffset)) {
+                    mOverflowed = true;
+                    return nullptr;
+                }
+                unsigned char *dst = mBuffer + mOffset;
+                mOffset += len;
+                return dst;
+            }
+
+            unsigned char *data() const
+            {
+                return mBuffer;
+            }
+
+            size_t size() const
+            {
+                return mOffset;
+            }
+
+            size_t capacity() const
+            {
+                return mCapacity;
+            }
+
+            bool overflowed() const
+            {
+                return mOverflowed;
+            }
+        };
+    }
+}
+
+#endif //AFV_NATIVE_DATAGRAMWRITER_H
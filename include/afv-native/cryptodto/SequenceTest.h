@@ -36,6 +36,7 @@
 
 #include <cstdint>
 #include <cassert>
+#include <vector>
 
 #include "afv-native/cryptodto/params.h"
 
@@ -50,12 +51,32 @@ namespace afv_native {
                     Overflow,
         };
 
+        /** SequenceTest implements the anti-replay sliding window for received sequence numbers.
+         *
+         * The window is tracked as a ring of bitfield words, indexed by the sequence number
+         * modulo the ring size, so moving the window forward never needs to shift the
+         * whole bitmap.  Windows of up to maxSequenceWindow packets are supported.
+         */
         class SequenceTest {
         private:
-            sequence_bitfield_t _bitfield;
+            /** _bitfield holds one bit per sequence number in (_min, _min + _window],
+             * at position (sequence & _bitMask).  Bits are cleared as the window
+             * moves past them.
+             */
+            std::vector<sequence_bitfield_t> _bitfield;
+            sequence_t _bitMask;
             sequence_t _min;
             unsigned _window;
 
+            bool testBit(sequence_t sequence) const;
+            void setBit(sequence_t sequence);
+
+            /** clearRange clears the bits for all of the sequence numbers in [from, to). */
+            void clearRange(sequence_t from, sequence_t to);
+
+            /** advanceWindow moves _min forward past any already received sequence numbers,
+             * starting with _min itself.
+             */
             void advanceWindow();
         public:
             SequenceTest(sequence_t start_sequence, unsigned window);
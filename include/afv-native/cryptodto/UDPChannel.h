@@ -35,20 +35,63 @@
 #define AFV_NATIVE_UDPCHANNEL_H
 
 #include <atomic>
+#include <condition_variable>
 #include <functional>
-#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <event2/event.h>
 
 #include "afv-native/Log.h"
+#include "afv-native/cryptodto/CaptureFile.h"
 #include "afv-native/cryptodto/Channel.h"
 #include "afv-native/cryptodto/dto/ICryptoDTO.h"
+#include "afv-native/util/AtomicHistogram.h"
+#include "afv-native/util/RealtimeCheck.h"
 
 namespace afv_native
 {
     namespace cryptodto
     {
-        typedef void (*DtoHandlerFunc)(
-            const std::string& dtoName, const unsigned char* bufIn, size_t bufLen, void* user_data);
+        /** ChannelStats is a point-in-time copy of a UDPChannel's receive counters. */
+        struct ChannelStats {
+            uint64_t RxDatagrams;
+            uint64_t RxAccepted;
+            uint64_t RxReplayDrops;
+            uint64_t RxWindowJumps;
+            uint64_t RxDecryptFailures;
+            uint64_t RxMalformed;
+            uint64_t RxWrongTag;
+            uint64_t RxUnhandled;
+            util::HistogramSnapshot RxReorderDepth;
+        };
+
+        /** UDPSocketOptions controls how a UDPChannel configures its socket when it is
+         * opened.  Anything left at its default is left at the system default.
+         */
+        struct UDPSocketOptions {
+            /** SO_RCVBUF size in bytes, or 0 to leave it alone. */
+            int ReceiveBufferBytes = 0;
+            /** SO_SNDBUF size in bytes, or 0 to leave it alone. */
+            int SendBufferBytes = 0;
+            /** DSCP codepoint to mark outbound datagrams with (46 is Expedited
+             * Forwarding), or -1 to leave them unmarked.  Not supported on Windows.
+             */
+            int Dscp = -1;
+            /** SO_PRIORITY for outbound datagrams, or -1 to leave it alone.  Linux only. */
+            int Priority = -1;
+            /** request kernel receive timestamps (SO_TIMESTAMPNS).  Linux only - elsewhere
+             * datagrams are timestamped when they are read from the socket.
+             */
+            bool KernelTimestamps = false;
+        };
+
+        /** DtoHandlerFunc is the signature for DTO handlers registered with a UDPChannel.
+         *
+         * bufIn points into the channel's receive buffer and is only valid for the
+         * duration of the call.
+         */
+        typedef void (*DtoHandlerFunc)(const unsigned char* bufIn, size_t bufLen, void* user_data);
 
         class UDPChannel : public Channel
         {
@@ -56,25 +99,111 @@ namespace afv_native
             std::string mAddress;
 
             /** mDatagramRxBuffer is the channel-internal holding buffer for a
-             * freshly received datagram.  By storing it initially in a pre-reserved
-             * buffer, we can avoid reallocation hell which is worse than just having
-             * to copy the payload out one extra time.
+             * freshly received datagram.  Datagrams are decrypted in place within
+             * this buffer and DTO handlers are given a pointer straight into it, so
+             * handlers must not retain the pointer after they return.
+             *
+             * Where batched receive is available, this holds udpRxBatchSize
+             * consecutive datagram slots, each maxPermittedDatagramSize long.
              */
             unsigned char* mDatagramRxBuffer;
 
+            /** mTxQueueBuffer holds udpTxBatchSize preallocated slots, each
+             * maxTxDatagramSize long, for encapsulated outbound datagrams.  DTOs are
+             * serialised and sealed directly into their slot.  Datagrams are queued
+             * here by sendDto and flushed to the socket in as few syscalls as the
+             * platform allows.
+             *
+             * mTxQueueLock must be held to access the queue.
+             */
+            unsigned char* mTxQueueBuffer;
+            size_t mTxQueueLen[udpTxBatchSize];
+            unsigned int mTxQueueDepth;
+            unsigned int mTxCorkDepth;
+            util::CheckedMutex mTxQueueLock;
+
             evutil_socket_t mUDPSocket;
             struct event_base* mEvBase;
             struct event* mSocketEvent;
             std::atomic<sequence_t> mTxSequence;
             SequenceTest receiveSequence;
+            /** mRxHighestSequence is the highest sequence accepted since the last reset, used
+             * to measure reorder depth.  Only touched from the channel's event loop.
+             */
+            sequence_t mRxHighestSequence;
+            bool mRxHighestSequenceValid;
 
             unsigned int mAcceptableCiphers;
 
+            UDPSocketOptions mSocketOptions;
+            /** mKernelTimestamps is set if the open socket is delivering receive timestamps. */
+            bool mKernelTimestamps;
+            /** mRxTimestampUs is the arrival time (see util::monotime_get_us) of the datagram
+             * currently being dispatched.  Only touched from the channel's event loop.
+             */
+            int64_t mRxTimestampUs;
+
             static void evReadCallback(evutil_socket_t fd, short events, void* arg);
             void readCallback();
+            void processDatagram(unsigned char* dgBuffer, size_t dgSize, int64_t arrivalUs);
+
+            /** applySocketOptions applies mSocketOptions to the freshly created socket. */
+            void applySocketOptions(int addressFamily);
+
+            /** flushTxQueue writes all queued datagrams out to the socket.
+             *
+             * @note mTxQueueLock must be held by the caller.
+             */
+            void flushTxQueue();
 
         protected:
-            std::unordered_map<std::string, std::function<void(const unsigned char* data, size_t len)> > mDtoHandlers;
+            struct DtoHandlerEntry {
+                char Name[maxDtoNameLength];
+                size_t NameLen;
+                DtoHandlerFunc Func;
+                void* UserData;
+                /** Callback holds the handler when registered as a std::function, in
+                 * which case Func is null.  It's shared so dispatch can hold on to it
+                 * outside the lock without copying the function.
+                 */
+                std::shared_ptr<const std::function<void(const unsigned char* data, size_t len)>> Callback;
+            };
+
+            /** mDtoHandlers is the dispatch table for received DTOs.  With only a
+             * handful of DTO types in use, names are matched against the raw bytes in
+             * the datagram by a linear scan, and the handler called directly.
+             *
+             * Handlers are invoked from whichever thread runs mEvBase, which need not be
+             * the thread that registered them.  The entry is looked up under
+             * mDtoHandlersLock, but the handler is called without it held, so handlers
+             * may register and unregister handlers themselves.
+             */
+            DtoHandlerEntry mDtoHandlers[maxDtoHandlers];
+            unsigned int mDtoHandlerCount;
+            std::mutex mDtoHandlersLock;
+            /** mDtoDispatchStarted and mDtoDispatchFinished count handler calls, so a
+             * call is in progress (on mDtoDispatchThread) whenever they differ.
+             * unregisterDtoHandler waits on mDtoDispatchDone for a call in progress on
+             * another thread to finish, so the handler's user_data can be released as
+             * soon as it returns.  All guarded by mDtoHandlersLock.
+             */
+            uint64_t mDtoDispatchStarted;
+            uint64_t mDtoDispatchFinished;
+            std::thread::id mDtoDispatchThread;
+            std::condition_variable mDtoDispatchDone;
+
+            /** mCapture, if set, records every DTO accepted by the channel.  Guarded by
+             * mDtoHandlersLock.
+             */
+            std::shared_ptr<CaptureWriter> mCapture;
+
+            DtoHandlerEntry* findDtoHandler(const char* dtoName, size_t dtoNameLen);
+
+            /** claimDtoHandler finds or allocates the table entry for dtoName.
+             *
+             * @note mDtoHandlersLock must be held by the caller.
+             */
+            DtoHandlerEntry* claimDtoHandler(const std::string& dtoName);
             int mLastErrno;
 
             void enableRxMode(CryptoDtoMode mode);
@@ -84,9 +213,51 @@ namespace afv_native
             bool RxModeEnabled(CryptoDtoMode mode) const;
 
         public:
-            explicit UDPChannel(struct event_base* evBase, int receiveSequenceHistorySize = 10);
+            explicit UDPChannel(struct event_base* evBase, int receiveSequenceHistorySize = defaultSequenceWindow);
             virtual ~UDPChannel();
 
+            /** RxWakeups is a monotonic count of socket read notifications handled. */
+            std::atomic<uint64_t> RxWakeups;
+            /** RxSyscalls is a monotonic count of receive syscalls issued. */
+            std::atomic<uint64_t> RxSyscalls;
+            /** RxDatagrams is a monotonic count of datagrams read from the socket. */
+            std::atomic<uint64_t> RxDatagrams;
+            /** TxSyscalls is a monotonic count of send syscalls issued. */
+            std::atomic<uint64_t> TxSyscalls;
+            /** TxDatagrams is a monotonic count of datagrams handed to the socket. */
+            std::atomic<uint64_t> TxDatagrams;
+
+            /** RxAccepted is a monotonic count of datagrams that passed all checks and were
+             * dispatched to a handler.
+             */
+            std::atomic<uint64_t> RxAccepted;
+            /** RxReplayDrops counts datagrams discarded as duplicates or as too old for the
+             * anti-replay window.
+             */
+            std::atomic<uint64_t> RxReplayDrops;
+            /** RxWindowJumps counts datagrams far enough ahead to move the whole anti-replay window. */
+            std::atomic<uint64_t> RxWindowJumps;
+            std::atomic<uint64_t> RxDecryptFailures;
+            std::atomic<uint64_t> RxMalformed;
+            std::atomic<uint64_t> RxWrongTag;
+            /** RxUnhandled counts valid datagrams dropped because no handler was registered
+             * for their DTO.
+             */
+            std::atomic<uint64_t> RxUnhandled;
+            /** RxReorderDepth records, for each accepted datagram that arrived behind a
+             * higher sequence, how many sequence numbers it was behind.
+             */
+            util::AtomicHistogram RxReorderDepth;
+
+            /** getStats returns a copy of the receive counters.  Safe to call from any thread. */
+            ChannelStats getStats() const;
+
+            /** setCapture starts recording received DTOs, after decryption, to capture.
+             *
+             * Pass nullptr to stop recording.
+             */
+            void setCapture(std::shared_ptr<CaptureWriter> capture);
+
             bool open();
             void close();
             bool isOpen() const;
@@ -99,44 +270,92 @@ namespace afv_native
                     LOG("UDPChannel", "tried to send on closed socket");
                     return;
                 }
-                std::vector<unsigned char> dgBuffer(maxPermittedDatagramSize);
+                std::lock_guard<util::CheckedMutex> txGuard(mTxQueueLock);
+                if (mTxQueueDepth >= udpTxBatchSize)
+                {
+                    flushTxQueue();
+                }
+                unsigned char* dgBuffer = mTxQueueBuffer + (mTxQueueDepth * maxTxDatagramSize);
                 sequence_t thisSeq = std::atomic_fetch_add(&mTxSequence, static_cast<sequence_t>(1));
 
                 size_t dgSize = Encapsulate<T>(
-                    dgBuffer.data(),
-                    maxPermittedDatagramSize,
+                    dgBuffer,
+                    maxTxDatagramSize,
                     thisSeq,
                     CryptoDtoMode::CryptoModeChaCha20Poly1305,
                     pkt);
-                dgBuffer.resize(dgSize);
                 if (dgSize > 0)
                 {
-                    auto sent = ::send(mUDPSocket, reinterpret_cast<char*>(dgBuffer.data()), dgBuffer.size(), 0);
-                    if (sent < 0)
+                    mTxQueueLen[mTxQueueDepth++] = dgSize;
+                    if (mTxCorkDepth == 0)
                     {
-                        if (errno == EWOULDBLOCK)
-                        {
-                            LOG("udpchannel", "UDP packet dropped on send due to TxBuffer being full");
-                        }
-                        else
-                        {
-                            LOG("udpchannel", "error sending datagram: %s", evutil_socket_error_to_string(evutil_socket_geterror(mUDPSocket)));
-                        }
-                    }
-                    else if (sent < dgBuffer.size())
-                    {
-                        LOG("udpchannel", "short write sending datagram - sent %d of %d bytes", send, dgBuffer.size());
+                        flushTxQueue();
                     }
                 }
+                else
+                {
+                    LOG("UDPChannel", "failed to encapsulate %s - dropped", pkt.getName().c_str());
+                }
             }
 
-            void registerDtoHandler(
+            /** corkTx holds back any datagrams sent via sendDto until the matching
+             * uncorkTx call, at which point they are all written out together.
+             *
+             * Calls may be nested.  Prefer the TxBatch guard to calling these directly.
+             */
+            void corkTx();
+            void uncorkTx();
+
+            /** TxBatch corks the channel for its lifetime so that all DTOs sent
+             * within its scope leave in a single batched write where supported.
+             */
+            class TxBatch
+            {
+            public:
+                explicit TxBatch(UDPChannel& channel) :
+                    mChannel(channel)
+                {
+                    mChannel.corkTx();
+                }
+                ~TxBatch()
+                {
+                    mChannel.uncorkTx();
+                }
+                TxBatch(const TxBatch&) = delete;
+
+            private:
+                UDPChannel& mChannel;
+            };
+
+            /** registerDtoHandler sets the handler to be called when a DTO named dtoName
+             * is received, replacing any existing handler for that name.
+             *
+             * @return true if the handler was registered, false if the name is too long
+             *      or the dispatch table is full.
+             */
+            bool registerDtoHandler(const std::string& dtoName, DtoHandlerFunc func, void* user_data);
+            bool registerDtoHandler(
                 const std::string& dtoName,
                 std::function<void(const unsigned char* data, size_t len)> callback);
+            /** unregisterDtoHandler removes the handler for dtoName.  If that handler is
+             * running on another thread, this waits for it to return.  It's safe to call
+             * from within a handler.
+             */
             void unregisterDtoHandler(const std::string& dtoName);
 
             void setAddress(const std::string& address);
 
+            /** setSocketOptions sets the options applied the next time the channel is opened. */
+            void setSocketOptions(const UDPSocketOptions& options);
+            const UDPSocketOptions& getSocketOptions() const;
+
+            /** getRxTimestampUs returns the arrival time, on the util::monotime_get_us
+             * clock, of the datagram being dispatched.
+             *
+             * @note this is only meaningful when called from within a DTO handler.
+             */
+            int64_t getRxTimestampUs() const;
+
             int getLastErrno() const;
 
             void setChannelConfig(const dto::ChannelConfig& config) override;
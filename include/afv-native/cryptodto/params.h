@@ -54,6 +54,31 @@ namespace afv_native {
         // handler.
         const int maxPermittedDatagramSize = 65536;
 
+        // maximum size of a datagram we will generate ourselves.  This bounds the
+        // per-channel transmit buffers and is comfortably larger than any DTO the
+        // client sends (voice frames are well under 1KiB).
+        const int maxTxDatagramSize = 4096;
+
+        // number of datagrams we will pull from the socket per receive syscall
+        // on platforms that support batched receive (recvmmsg).
+        const int udpRxBatchSize = 16;
+
+        // maximum number of outbound datagrams that can be queued for a single
+        // batched send (sendmmsg).
+        const int udpTxBatchSize = 8;
+
+        // size of the per-channel DTO dispatch table, and the longest DTO name it can match.
+        const int maxDtoHandlers = 8;
+        const int maxDtoNameLength = 16;
+
+        // upper limit on the anti-replay window size (in packets) for received datagrams.
+        const unsigned maxSequenceWindow = 4096;
+
+        // default anti-replay window used by UDPChannel.  This needs to be wide enough
+        // to absorb the reordering seen on long-haul links without rejecting late
+        // packets as replays.
+        const unsigned defaultSequenceWindow = 256;
+
         enum CryptoDtoMode {
             CryptoModeUndefined = 0,
             CryptoModeNone = 1,
@@ -49,7 +49,26 @@ namespace afv_native {
         AudioError,
         RxStarted,
         RxStopped,
+        VoiceServerResuming, // the voice session was lost and is being resumed without a full reconnect
+        VoiceServerResumed,
+        ConnectPhaseCompleted, // data is a pointer to the ConnectPhase, data2 a pointer to an int64_t of ms since connect()
     };
+
+    /** ConnectPhase identifies the steps between Client::connect() and being ready to
+     * transmit.  Several of these run concurrently, so they don't necessarily complete
+     * in this order.
+     */
+    enum class ConnectPhase {
+        Started,
+        Authenticated,
+        VoiceSessionEstablished,
+        AudioStarted,
+        TransceiversSynced,
+        StationAliasesLoaded,
+        /// the voice session, audio and transceivers are all up - the client can transmit.
+        Ready,
+    };
+    const unsigned connectPhaseCount = static_cast<unsigned>(ConnectPhase::Ready) + 1;
 }
 
 #endif //AFV_NATIVE_EVENT_H
@@ -0,0 +1,94 @@
+/* event/EventLoopThread.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_EVENTLOOPTHREAD_H
+#define AFV_NATIVE_EVENTLOOPTHREAD_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <event2/event.h>
+
+#include "afv-native/event/LoopLagMonitor.h"
+
+namespace afv_native {
+    namespace event {
+        /** EventLoopThread owns a libevent event_base and runs it on its own thread.
+         *
+         * This is used to keep latency sensitive IO (the voice UDP channel) off the
+         * event loop the host application drives, so that slow HTTP callbacks or
+         * other work on that loop can't hold it up.
+         *
+         * The event_base is created with locking enabled, so events may be added to
+         * and removed from it from other threads.  Callbacks registered against it
+         * will, of course, run on the loop thread.
+         */
+        class EventLoopThread {
+        protected:
+            std::string mName;
+            struct event_base *mEvBase;
+            LoopLagMonitor *mLagMonitor;
+            std::thread mThread;
+            std::atomic<bool> mRunning;
+
+            static void evBreakCallback(evutil_socket_t fd, short events, void *arg);
+            void run();
+        public:
+            explicit EventLoopThread(std::string name);
+            EventLoopThread(const EventLoopThread &cpysrc) = delete;
+            virtual ~EventLoopThread();
+
+            /** start launches the loop thread.
+             *
+             * @return true if the loop is running, false if the event_base couldn't be
+             *      created.
+             */
+            bool start();
+
+            /** stop breaks out of the loop and waits for the thread to exit.
+             *
+             * Any events still registered against the base are left in place and will
+             * resume if the loop is restarted.
+             */
+            void stop();
+
+            bool isRunning() const;
+
+            struct event_base *getEventBase() const;
+
+            LoopLagStats getLagStats() const;
+        };
+    }
+}
+
+#endif //AFV_NATIVE_EVENTLOOPTHREAD_H
@@ -0,0 +1,88 @@
+/* event/LoopLagMonitor.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_LOOPLAGMONITOR_H
+#define AFV_NATIVE_LOOPLAGMONITOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "afv-native/event/EventTimer.h"
+
+namespace afv_native {
+    namespace event {
+        /** interval, in milliseconds, between lag samples taken by a LoopLagMonitor. */
+        const unsigned int loopLagSampleIntervalMs = 100;
+
+        struct LoopLagStats {
+            /** number of samples taken since the monitor was started. */
+            uint64_t Samples;
+            /** lag of the most recent sample, in microseconds. */
+            uint64_t LastLagUs;
+            /** worst lag observed, in microseconds. */
+            uint64_t MaxLagUs;
+            /** sum of all observed lag, in microseconds.  Divide by Samples for the mean. */
+            uint64_t TotalLagUs;
+        };
+
+        /** LoopLagMonitor measures how late an event loop is to service its timers.
+         *
+         * It re-arms itself every loopLagSampleIntervalMs, and on each firing records how
+         * far past the requested deadline it was dispatched.  A loop that is being held up
+         * by slow callbacks will show this as lag.
+         *
+         * The statistics are safe to read from any thread.
+         */
+        class LoopLagMonitor: public EventTimer {
+        protected:
+            std::chrono::steady_clock::time_point mDeadline;
+            std::atomic<uint64_t> mSamples;
+            std::atomic<uint64_t> mLastLagUs;
+            std::atomic<uint64_t> mMaxLagUs;
+            std::atomic<uint64_t> mTotalLagUs;
+
+            void triggered() override;
+            void arm();
+        public:
+            explicit LoopLagMonitor(struct event_base *evBase);
+
+            void start();
+            void stop();
+
+            LoopLagStats getStats() const;
+        };
+    }
+}
+
+#endif //AFV_NATIVE_LOOPLAGMONITOR_H
@@ -34,6 +34,7 @@
 #ifndef AFV_NATIVE_REQUEST_H
 #define AFV_NATIVE_REQUEST_H
 
+#include <map>
 #include <string>
 #include <functional>
 #include <curl/curl.h>
@@ -58,6 +59,8 @@ namespace afv_native {
 
             void transferInfoCallback(curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
             size_t writeCallback(char *buffer, size_t size, size_t nitems);
+            static size_t curlHeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata);
+            size_t headerCallback(char *buffer, size_t size, size_t nitems);
             size_t readCallback(char *buffer, size_t size, size_t nitems);
 
         protected:
@@ -67,9 +70,15 @@ namespace afv_native {
 
             Progress mProgress;
 
+            /** mCurlHandle is created on first use and kept for the life of the Request.
+             * It's reset between transfers, which keeps its connection and TLS session
+             * caches warm.
+             */
             CURL *mCurlHandle;
             struct curl_slist *mHeaders;
             TransferManager *mTM;
+            /** mShareHandle is the share handle joined via shareState, if any. */
+            CURLSH *mShareHandle;
 
             std::vector<unsigned char> mReq;
             size_t mReqBufOffset;
@@ -78,6 +87,8 @@ namespace afv_native {
             std::string mRespContentType;
 
             std::vector<unsigned char> mResp;
+            /** mRespHeaders holds the response headers, keyed by lower-cased name. */
+            std::map<std::string, std::string> mRespHeaders;
 
             char mCurlErrorBuffer[CURL_ERROR_SIZE];
 
@@ -89,8 +100,13 @@ namespace afv_native {
 
             std::function<void(Request *, bool)> mCompletionCallback;
 
+            RequestTiming mTiming;
+
             virtual bool setupHandle();
 
+            /** updateTiming collects the timing breakdown for the transfer that just ended. */
+            void updateTiming();
+
         public:
             Request(const std::string &url, Method method);
             /* no copy constructor - Request must not be copied as it would break the internal states. */
@@ -130,6 +146,9 @@ namespace afv_native {
 
             void setFollowRedirect(bool follow);
 
+            /** shareState joins the Request to transferManager's shared DNS, TLS session
+             * and connection caches for all of its subsequent transfers.
+             */
             void shareState(TransferManager &transferManager);
 
             /** doSync() performs the request synchronously.
@@ -171,6 +190,11 @@ namespace afv_native {
 
             std::string getResponseBody() const;
 
+            /** returns the value of the named response header, or an empty string if
+             * it wasn't sent.  Header names are case-insensitive.
+             */
+            std::string getResponseHeader(const std::string &name) const;
+
             void clearRequestBody();
 
             int getDownloadTotal() const;
@@ -183,6 +207,9 @@ namespace afv_native {
 
             CURL *getCurlHandle() const;
 
+            /** getTiming returns the timing breakdown of the last completed transfer. */
+            const RequestTiming &getTiming() const;
+
             /** notifyTransferCompleted is invoked either by the synchronous method
              * or by the asynchronous scheduler to indicate that the transfer for this
              * request completed.
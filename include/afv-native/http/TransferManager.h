@@ -98,6 +98,11 @@ namespace afv_native {
              * @return the internal CURLM handle
              */
             CURLM *getCurlMultiHandle() const;
+
+            /** Return the internal CURLSH handle used to share DNS, TLS session and
+             * connection caches between requests.
+             */
+            CURLSH *getCurlShareHandle() const;
         };
     }
 }
@@ -35,6 +35,7 @@
 #define AFV_NATIVE_HTTP_H
 
 #include <cstddef>
+#include <cstdint>
 
 namespace afv_native {
     namespace http {
@@ -43,6 +44,7 @@ namespace afv_native {
             POST,
             PUT,
             DEL,
+            HEAD,
         };
 
         enum class Progress {
@@ -53,6 +55,23 @@ namespace afv_native {
             Error,
         };
 
+        /** RequestTiming breaks down where the time went in a completed transfer.
+         *
+         * All times are in microseconds from the start of the transfer, so each includes
+         * the ones before it.
+         */
+        struct RequestTiming {
+            int64_t NameLookupUs = 0;
+            int64_t ConnectUs = 0;
+            /** time to complete the TLS handshake, or 0 for plain HTTP. */
+            int64_t TlsUs = 0;
+            /** time to the first byte of the response. */
+            int64_t FirstByteUs = 0;
+            int64_t TotalUs = 0;
+            /** true if the transfer used an already open connection. */
+            bool ConnectionReused = false;
+        };
+
         const size_t AllocChunkSize = 8192;
     }
 }
@@ -0,0 +1,102 @@
+/* util/AtomicHistogram.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_ATOMICHISTOGRAM_H
+#define AFV_NATIVE_ATOMICHISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace afv_native {
+    namespace util {
+        const size_t histogramBuckets = 16;
+
+        /** HistogramSnapshot is a point-in-time copy of an AtomicHistogram.
+         *
+         * Bucket 0 counts values of 0, and bucket n (n >= 1) counts values in the range
+         * [2^(n-1), 2^n).  The final bucket also counts anything larger.
+         */
+        struct HistogramSnapshot {
+            uint64_t Buckets[histogramBuckets];
+        };
+
+        /** AtomicHistogram is a log2-bucketed histogram that can be recorded into from
+         * one thread and read from any other without locking.
+         */
+        class AtomicHistogram {
+        protected:
+            std::atomic<uint64_t> mBuckets[histogramBuckets];
+        public:
+            AtomicHistogram()
+            {
+                reset();
+            }
+
+            AtomicHistogram(const AtomicHistogram &cpysrc) = delete;
+
+            static size_t bucketFor(uint64_t value)
+            {
+                size_t bucket = 0;
+                while (value != 0 && bucket < (histogramBuckets - 1)) {
+                    value >>= 1;
+                    bucket++;
+                }
+                return bucket;
+            }
+
+            void record(uint64_t value)
+            {
+                mBuckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void reset()
+            {
+                for (auto &bucket: mBuckets) {
+                    bucket.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            HistogramSnapshot snapshot() const
+            {
+                HistogramSnapshot snap;
+                for (size_t i = 0; i < histogramBuckets; i++) {
+                    snap.Buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+                }
+                return snap;
+            }
+        };
+    }
+}
+
+#endif //AFV_NATIVE_ATOMICHISTOGRAM_H
@@ -0,0 +1,295 @@
+/* util/MsgpackReader.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_MSGPACKREADER_H
+#define AFV_NATIVE_MSGPACKREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace afv_native {
+    namespace util {
+        /** MsgpackReader is a minimal, non-allocating, forward-only reader for msgpack
+         * encoded data.
+         *
+         * It's intended for hot paths where the layout of the message is known in
+         * advance, so the fields can be pulled out in order without building a
+         * msgpack object tree.  Strings and binary fields are returned as views into
+         * the source buffer.
+         *
+         * Every read validates the type marker and bounds, and returns false on any
+         * mismatch.  Once a read has failed the reader should be discarded.
+         */
+        class MsgpackReader {
+        protected:
+            const unsigned char *mBuffer;
+            size_t mLength;
+            size_t mOffset;
+
+            bool readBE(size_t width, uint64_t &valueOut)
+            {
+                if ((mLength - mOffset) < width) {
+                    return false;
+                }
+                uint64_t value = 0;
+                for (size_t i = 0; i < width; i++) {
+                    value = (value << 8) | mBuffer[mOffset + i];
+                }
+                mOffset += width;
+                valueOut = value;
+                return true;
+            }
+
+            bool readRaw(size_t len, const unsigned char *&dataOut)
+            {
+                if ((mLength - mOffset) < len) {
+                    return false;
+                }
+                dataOut = mBuffer + mOffset;
+                mOffset += len;
+                return true;
+            }
+        public:
+            MsgpackReader(const unsigned char *buffer, size_t length):
+                    mBuffer(buffer),
+                    mLength(length),
+                    mOffset(0)
+            {
+            }
+
+            size_t offset() const
+            {
+                return mOffset;
+            }
+
+            bool atEnd() const
+            {
+                return mOffset == mLength;
+            }
+
+            bool readArrayHeader(uint32_t &countOut)
+            {
+                if (mOffset >= mLength) {
+                    return false;
+                }
+                const unsigned char marker = mBuffer[mOffset++];
+                uint64_t count;
+                if ((marker & 0xf0) == 0x90) {
+                    countOut = marker & 0x0f;
+                    return true;
+                } else if (marker == 0xdc) {
+                    if (!readBE(2, count)) {
+                        return false;
+                    }
+                } else if (marker == 0xdd) {
+                    if (!readBE(4, count)) {
+                        return false;
+                    }
+                } else {
+                    return false;
+                }
+                countOut = static_cast<uint32_t>(count);
+                return true;
+            }
+
+            /** readUInt reads any msgpack integer encoding, accepting only non-negative values. */
+            bool readUInt(uint64_t &valueOut)
+            {
+                if (mOffset >= mLength) {
+                    return false;
+                }
+                const unsigned char marker = mBuffer[mOffset++];
+                if (marker <= 0x7f) {
+                    valueOut = marker;
+                    return true;
+                }
+                size_t width;
+                bool isSigned = false;
+                switch (marker) {
+                case 0xcc: width = 1; break;
+                case 0xcd: width = 2; break;
+                case 0xce: width = 4; break;
+                case 0xcf: width = 8; break;
+                case 0xd0: width = 1; isSigned = true; break;
+                case 0xd1: width = 2; isSigned = true; break;
+                case 0xd2: width = 4; isSigned = true; break;
+                case 0xd3: width = 8; isSigned = true; break;
+                default:
+                    return false;
+                }
+                uint64_t value;
+                if (!readBE(width, value)) {
+                    return false;
+                }
+                if (isSigned && ((value >> ((width * 8) - 1)) & 1)) {
+                    return false;
+                }
+                valueOut = value;
+                return true;
+            }
+
+            bool readBool(bool &valueOut)
+            {
+                if (mOffset >= mLength) {
+                    return false;
+                }
+                const unsigned char marker = mBuffer[mOffset++];
+                if (marker == 0xc2 || marker == 0xc3) {
+                    valueOut = (marker == 0xc3);
+                    return true;
+                }
+                return false;
+            }
+
+            /** readFloat reads a float32 or float64, or a non-negative integer, as a float. */
+            bool readFloat(float &valueOut)
+            {
+                if (mOffset >= mLength) {
+                    return false;
+                }
+                const unsigned char marker = mBuffer[mOffset];
+                uint64_t bits;
+                if (marker == 0xca) {
+                    mOffset++;
+                    if (!readBE(4, bits)) {
+                        return false;
+                    }
+                    uint32_t bits32 = static_cast<uint32_t>(bits);
+                    ::memcpy(&valueOut, &bits32, sizeof(valueOut));
+                    return true;
+                } else if (marker == 0xcb) {
+                    mOffset++;
+                    if (!readBE(8, bits)) {
+                        return false;
+                    }
+                    double dValue;
+                    ::memcpy(&dValue, &bits, sizeof(dValue));
+                    valueOut = static_cast<float>(dValue);
+                    return true;
+                }
+                uint64_t iValue;
+                if (!readUInt(iValue)) {
+                    return false;
+                }
+                valueOut = static_cast<float>(iValue);
+                return true;
+            }
+
+            /** readStr reads a str field, returning a view of its (unterminated) bytes. */
+            bool readStr(const char *&dataOut, size_t &lenOut)
+            {
+                if (mOffset >= mLength) {
+                    return false;
+                }
+                const unsigned char marker = mBuffer[mOffset++];
+                uint64_t len;
+                if ((marker & 0xe0) == 0xa0) {
+                    len = marker & 0x1f;
+                } else if (marker == 0xd9) {
+                    if (!readBE(1, len)) {
+                        return false;
+                    }
+                } else if (marker == 0xda) {
+                    if (!readBE(2, len)) {
+                        return false;
+                    }
+                } else if (marker == 0xdb) {
+                    if (!readBE(4, len)) {
+                        return false;
+                    }
+                } else {
+                    return false;
+                }
+                const unsigned char *data;
+                if (!readRaw(len, data)) {
+                    return false;
+                }
+                dataOut = reinterpret_cast<const char *>(data);
+                lenOut = len;
+                return true;
+            }
+
+            /** readBin reads a bin field, returning a view of its bytes.
+             *
+             * For compatibility with encoders that don't use the bin family, str fields
+             * are also accepted.
+             */
+            bool readBin(const unsigned char *&dataOut, size_t &lenOut)
+            {
+                if (mOffset >= mLength) {
+                    return false;
+                }
+                const unsigned char marker = mBuffer[mOffset];
+                uint64_t len;
+                switch (marker) {
+                case 0xc4:
+                    mOffset++;
+                    if (!readBE(1, len)) {
+                        return false;
+                    }
+                    break;
+                case 0xc5:
+                    mOffset++;
+                    if (!readBE(2, len)) {
+                        return false;
+                    }
+                    break;
+                case 0xc6:
+                    mOffset++;
+                    if (!readBE(4, len)) {
+                        return false;
+                    }
+                    break;
+                default: {
+                    const char *strData;
+                    size_t strLen;
+                    if (!readStr(strData, strLen)) {
+                        return false;
+                    }
+                    dataOut = reinterpret_cast<const unsigned char *>(strData);
+                    lenOut = strLen;
+                    return true;
+                }
+                }
+                if (!readRaw(len, dataOut)) {
+                    return false;
+                }
+                lenOut = len;
+                return true;
+            }
+        };
+    }
+}
+
+#endif //AFV_NATIVE_MSGPACKREADER_H
@@ -0,0 +1,182 @@
+/* util/PublishedPtr.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_PUBLISHEDPTR_H
+#define AFV_NATIVE_PUBLISHEDPTR_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace afv_native {
+    namespace util {
+        /** PublishedPtr hands a shared object from a control thread to a single
+         * real-time reader (such as an audio callback) without the reader ever
+         * blocking, allocating or touching a reference count.
+         *
+         * The control thread owns the object via a shared_ptr and publishes the raw
+         * pointer atomically.  When it's replaced, the old object is retired rather
+         * than released, and only freed (on the control thread) once the reader is
+         * known to have finished with it.
+         *
+         * Only one thread may read at a time.  Writers are serialised with each other,
+         * but never with the reader.
+         */
+        template<typename T>
+        class PublishedPtr {
+        protected:
+            std::atomic<T *> mPtr;
+            std::atomic<uint32_t> mReaderActive;
+            std::atomic<uint64_t> mReaderEpoch;
+
+            std::mutex mWriterLock;
+            std::shared_ptr<T> mOwner;
+            std::vector<std::pair<uint64_t, std::shared_ptr<T>>> mRetired;
+
+            void reclaimLocked()
+            {
+                if (mRetired.empty()) {
+                    return;
+                }
+                if (mReaderActive.load() == 0) {
+                    // any read that starts from here on will see the current pointer.
+                    mRetired.clear();
+                    return;
+                }
+                const uint64_t epoch = mReaderEpoch.load();
+                auto iter = mRetired.begin();
+                while (iter != mRetired.end()) {
+                    // the read in progress when this was retired has since finished.
+                    if (epoch > iter->first) {
+                        iter = mRetired.erase(iter);
+                    } else {
+                        ++iter;
+                    }
+                }
+            }
+
+        public:
+            PublishedPtr():
+                mPtr(nullptr),
+                mReaderActive(0),
+                mReaderEpoch(0),
+                mWriterLock(),
+                mOwner(),
+                mRetired()
+            {
+            }
+
+            PublishedPtr(const PublishedPtr &cpysrc) = delete;
+
+            /** publish replaces the current object with newObject (which may be empty). */
+            void publish(std::shared_ptr<T> newObject)
+            {
+                std::lock_guard<std::mutex> writerGuard(mWriterLock);
+                auto oldObject = std::move(mOwner);
+                mOwner = std::move(newObject);
+                mPtr.store(mOwner.get());
+                if (oldObject) {
+                    mRetired.emplace_back(mReaderEpoch.load(), std::move(oldObject));
+                }
+                reclaimLocked();
+            }
+
+            /** reclaim frees any retired objects the reader has finished with. */
+            void reclaim()
+            {
+                std::lock_guard<std::mutex> writerGuard(mWriterLock);
+                reclaimLocked();
+            }
+
+            /** get returns the current object.  Control thread only. */
+            std::shared_ptr<T> get()
+            {
+                std::lock_guard<std::mutex> writerGuard(mWriterLock);
+                return mOwner;
+            }
+
+            /** ReadGuard pins the published pointer for the duration of one read. */
+            class ReadGuard {
+            protected:
+                PublishedPtr &mSlot;
+                T *mPtr;
+            public:
+                explicit ReadGuard(PublishedPtr &slot):
+                    mSlot(slot),
+                    mPtr(nullptr)
+                {
+                    mSlot.mReaderActive.store(1);
+                    mPtr = mSlot.mPtr.load();
+                }
+
+                ~ReadGuard()
+                {
+                    mSlot.mReaderActive.store(0);
+                    mSlot.mReaderEpoch.fetch_add(1);
+                }
+
+                ReadGuard(const ReadGuard &cpysrc) = delete;
+
+                T *get() const
+                {
+                    return mPtr;
+                }
+
+                explicit operator bool() const
+                {
+                    return mPtr != nullptr;
+                }
+
+                T *operator->() const
+                {
+                    return mPtr;
+                }
+
+                /** detach stops the reader using the current object, without releasing
+                 * it.  It stays owned by the slot until it's next replaced.
+                 */
+                void detach()
+                {
+                    T *expected = mPtr;
+                    mSlot.mPtr.compare_exchange_strong(expected, nullptr);
+                    mPtr = nullptr;
+                }
+            };
+        };
+    }
+}
+
+#endif //AFV_NATIVE_PUBLISHEDPTR_H
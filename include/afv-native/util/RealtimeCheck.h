@@ -0,0 +1,127 @@
+/* util/RealtimeCheck.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_REALTIMECHECK_H
+#define AFV_NATIVE_REALTIMECHECK_H
+
+#include <cstdint>
+#include <mutex>
+
+/** AFV_RT_CHECK marks an operation that must never happen on a real-time (audio
+ * callback) thread, such as taking a lock or logging.
+ *
+ * It does nothing unless the library is built with AFV_NATIVE_RT_CHECKS, in which
+ * case reaching it inside a RealtimeScope is reported as a violation.  Checked
+ * builds also report any heap allocation made inside a RealtimeScope.
+ */
+#ifdef AFV_NATIVE_RT_CHECKS
+#define AFV_RT_CHECK(what) do { \
+        if (::afv_native::util::inRealtimeScope()) { \
+            ::afv_native::util::realtimeViolation(what); \
+        } \
+    } while (0)
+#else
+#define AFV_RT_CHECK(what) do {} while (0)
+#endif
+
+namespace afv_native {
+    namespace util {
+        /** RealtimeScope marks the current thread as real-time for its lifetime.  The
+         * audio device callbacks hold one for the duration of each callback.
+         */
+        class RealtimeScope {
+        public:
+#ifdef AFV_NATIVE_RT_CHECKS
+            RealtimeScope();
+            ~RealtimeScope();
+#else
+            RealtimeScope() {}
+            ~RealtimeScope() {}
+#endif
+            RealtimeScope(const RealtimeScope &cpysrc) = delete;
+        };
+
+        /** inRealtimeScope returns true if the calling thread is inside a RealtimeScope.
+         * Always false unless built with AFV_NATIVE_RT_CHECKS. */
+        bool inRealtimeScope();
+
+        /** realtimeViolation records that what was done on a real-time thread. */
+        void realtimeViolation(const char *what);
+
+        /** setRealtimeTrap sets whether a violation aborts the process (so a debugger
+         * stops at the offending call) rather than just being counted.
+         */
+        void setRealtimeTrap(bool abortOnViolation);
+
+        uint64_t getRealtimeViolationCount();
+
+        /** getLastRealtimeViolation describes the most recent violation, or returns
+         * nullptr if there haven't been any. */
+        const char *getLastRealtimeViolation();
+
+        /** CheckedMutex is a std::mutex for locks that must never be taken on a real-time
+         * thread.  In checked builds, locking it inside a RealtimeScope is reported as a
+         * violation.
+         *
+         * It can be used with std::lock_guard and std::unique_lock, but not with
+         * std::condition_variable.
+         */
+        class CheckedMutex {
+        public:
+            CheckedMutex() = default;
+            CheckedMutex(const CheckedMutex &cpysrc) = delete;
+
+            void lock()
+            {
+                AFV_RT_CHECK("mutex lock");
+                mMutex.lock();
+            }
+
+            bool try_lock()
+            {
+                AFV_RT_CHECK("mutex lock");
+                return mMutex.try_lock();
+            }
+
+            void unlock()
+            {
+                mMutex.unlock();
+            }
+
+        protected:
+            std::mutex mMutex;
+        };
+    }
+}
+
+#endif //AFV_NATIVE_REALTIMECHECK_H
@@ -0,0 +1,88 @@
+/* util/RealtimeTuning.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_REALTIMETUNING_H
+#define AFV_NATIVE_REALTIMETUNING_H
+
+#include <cstddef>
+#include <vector>
+
+namespace afv_native {
+    namespace util {
+        enum class ThreadPriority {
+            /// leave the thread as the backend created it.
+            Normal,
+            /// raise the thread above ordinary threads (nice -10 on Linux).
+            High,
+            /// real-time scheduling (SCHED_FIFO on Linux and macOS, time-critical on Windows).
+            Realtime,
+        };
+
+        /** RealtimeOptions controls how the audio threads are scheduled and whether
+         * the memory they touch is locked into RAM.
+         *
+         * Raising priority and locking memory usually need privileges (CAP_SYS_NICE,
+         * an rtprio/memlock limit, or similar).  Anything that can't be applied is
+         * logged and otherwise ignored.
+         */
+        struct RealtimeOptions {
+            ThreadPriority Priority;
+            /** CpuSet lists the CPUs the audio threads may run on.  Empty means any. */
+            std::vector<int> CpuSet;
+            /** LockMemory pre-faults and locks the audio buffers, and locks the rest of
+             * the process as far as the memlock limit allows. */
+            bool LockMemory;
+
+            RealtimeOptions();
+        };
+
+        /** tuneCurrentThread applies the priority and CPU set to the calling thread,
+         * and pre-faults its stack if memory locking is enabled.  This is meant to be
+         * called once from each audio thread before it starts real-time work.
+         *
+         * @return true if everything requested was applied.
+         */
+        bool tuneCurrentThread(const RealtimeOptions &options);
+
+        /** prefaultAndLock touches every page of [data, data+length) and locks it into RAM. */
+        bool prefaultAndLock(void *data, size_t length);
+
+        /** lockProcessMemory locks the process's current memory into RAM, and all future
+         * mappings too where the memlock limit is unlimited.  Only the first call does
+         * anything.
+         */
+        bool lockProcessMemory();
+    }
+}
+
+#endif //AFV_NATIVE_REALTIMETUNING_H
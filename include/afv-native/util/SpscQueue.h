@@ -0,0 +1,132 @@
+/* util/SpscQueue.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_SPSCQUEUE_H
+#define AFV_NATIVE_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace afv_native {
+    namespace util {
+        /** SpscQueue is a fixed size, lock-free queue between exactly one producer
+         * thread and exactly one consumer thread.
+         *
+         * Entries are filled and read in place, so large entries aren't copied through
+         * the queue.  Neither side ever blocks or allocates - the producer is told when
+         * the queue is full instead.
+         */
+        template<typename T>
+        class SpscQueue {
+        protected:
+            std::vector<T> mSlots;
+            uint32_t mMask;
+            /** mHead and mTail count entries pushed and popped, and only ever increase. */
+            std::atomic<uint32_t> mHead;
+            std::atomic<uint32_t> mTail;
+
+            static uint32_t roundCapacity(uint32_t capacity)
+            {
+                uint32_t rounded = 1;
+                while (rounded < capacity) {
+                    rounded <<= 1;
+                }
+                return rounded;
+            }
+
+        public:
+            /** capacity is rounded up to a power of two. */
+            explicit SpscQueue(uint32_t capacity):
+                mSlots(roundCapacity(capacity)),
+                mMask(roundCapacity(capacity) - 1),
+                mHead(0),
+                mTail(0)
+            {
+            }
+
+            SpscQueue(const SpscQueue &cpysrc) = delete;
+
+            /** beginPush returns the slot to fill in, or nullptr if the queue is full.
+             * The entry isn't visible to the consumer until commitPush() is called.
+             * Producer only.
+             */
+            T *beginPush()
+            {
+                const uint32_t head = mHead.load(std::memory_order_relaxed);
+                const uint32_t tail = mTail.load(std::memory_order_acquire);
+                if ((head - tail) > mMask) {
+                    return nullptr;
+                }
+                return &mSlots[head & mMask];
+            }
+
+            /** spaceFree returns how many more entries can be pushed before the queue is
+             * full.  Producer only.
+             */
+            uint32_t spaceFree() const
+            {
+                const uint32_t head = mHead.load(std::memory_order_relaxed);
+                const uint32_t tail = mTail.load(std::memory_order_acquire);
+                return (mMask + 1) - (head - tail);
+            }
+
+            /** commitPush publishes the slot returned by beginPush.  Producer only. */
+            void commitPush()
+            {
+                mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            /** front returns the oldest entry, or nullptr if the queue is empty.  The entry
+             * stays valid until pop() is called.  Consumer only.
+             */
+            T *front()
+            {
+                const uint32_t tail = mTail.load(std::memory_order_relaxed);
+                const uint32_t head = mHead.load(std::memory_order_acquire);
+                if (head == tail) {
+                    return nullptr;
+                }
+                return &mSlots[tail & mMask];
+            }
+
+            /** pop releases the entry returned by front back to the producer.  Consumer only. */
+            void pop()
+            {
+                mTail.store(mTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+        };
+    }
+}
+
+#endif //AFV_NATIVE_SPSCQUEUE_H
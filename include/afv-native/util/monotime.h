@@ -50,6 +50,13 @@ namespace afv_native {
          * @return monotonic time in ms precision.
          */
         monotime_t monotime_get();
+
+        /** monotime_get_us() returns the same monotonic clock as monotime_get(), but with
+         * microsecond precision.
+         *
+         * It is used to timestamp packet arrivals for jitter measurement.
+         */
+        monotime_t monotime_get_us();
     }
 }
 
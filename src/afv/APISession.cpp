@@ -52,6 +52,7 @@ using json = nlohmann::json;
 APISession::APISession(event_base* evBase, http::TransferManager& tm, std::string baseUrl, std::string clientName) :
     StateCallback(),
     AliasUpdateCallback(),
+    AliasCurrentCallback(),
     mEvBase(evBase),
     mTransferManager(tm),
     mBaseURL(std::move(baseUrl)),
@@ -61,8 +62,13 @@ APISession::APISession(event_base* evBase, http::TransferManager& tm, std::strin
     mBearerToken(),
     mAuthenticationRequest(mBaseURL + "/api/v1/auth", http::Method::POST, json()),
     mRefreshTokenTimer(mEvBase, std::bind(&APISession::Connect, this)),
+    mKeepWarmRequest(mBaseURL + "/", http::Method::HEAD),
+    mKeepWarmTimer(mEvBase, std::bind(&APISession::_keepWarm, this)),
     mLastError(APISessionError::NoError),
     mStationAliasRequest(mBaseURL + "/api/v1/stations/aliased", http::Method::GET, nullptr),
+    mStationAliases(),
+    mStationAliasETag(),
+    mStationAliasCachePath(),
     mState(APISessionState::Disconnected)
 {
 }
@@ -103,6 +109,8 @@ void
 afv::APISession::Disconnect()
 {
     mRefreshTokenTimer.disable();
+    mKeepWarmTimer.disable();
+    mKeepWarmRequest.reset();
     mBearerToken = "";
     mAuthenticationRequest.reset();
     setState(APISessionState::Disconnected);
@@ -185,6 +193,14 @@ APISession::_authenticationCallback(http::RESTRequest* req, bool success)
             raiseError(APISessionError::InvalidAuthToken);
             return;
         }
+        const auto &timing = req->getTiming();
+        LOG("APISession", "authenticated in %lldms (connect %lldms, tls %lldms, first byte %lldms%s)",
+            static_cast<long long>(timing.TotalUs / 1000),
+            static_cast<long long>(timing.ConnectUs / 1000),
+            static_cast<long long>(timing.TlsUs / 1000),
+            static_cast<long long>(timing.FirstByteUs / 1000),
+            timing.ConnectionReused ? ", reused connection" : "");
+        mKeepWarmTimer.enable(afvApiKeepWarmIntervalMs);
         setState(APISessionState::Running);
     }
     else
@@ -285,6 +301,11 @@ void APISession::updateStationAliases()
     mStationAliasRequest.reset();
     mStationAliasRequest.setUrl(mBaseURL + "/api/v1/stations/aliased");
     setAuthenticationFor(mStationAliasRequest);
+    if (std::atomic_load(&mStationAliases) && !mStationAliasETag.empty())
+    {
+        // only fetch the aliases again if they've changed since our copy.
+        mStationAliasRequest.setHeader("If-None-Match", mStationAliasETag);
+    }
     mStationAliasRequest.setCompletionCallback(
         [this](http::Request* req, bool success)
     {
@@ -296,9 +317,28 @@ void APISession::updateStationAliases()
     mStationAliasRequest.doAsync(mTransferManager);
 }
 
+void APISession::_keepWarm()
+{
+    // don't stack up probes if the last one is still waiting on a dead connection.
+    const auto progress = mKeepWarmRequest.getProgress();
+    if (progress != http::Progress::Connecting && progress != http::Progress::Transferring)
+    {
+        mKeepWarmRequest.reset();
+        mKeepWarmRequest.setUrl(mBaseURL + "/");
+        mKeepWarmRequest.shareState(mTransferManager);
+        mKeepWarmRequest.doAsync(mTransferManager);
+    }
+    mKeepWarmTimer.enable(afvApiKeepWarmIntervalMs);
+}
+
 void APISession::_stationsCallback(http::RESTRequest* req, bool success)
 {
-    if (success && req->getStatusCode() == 200)
+    if (success && req->getStatusCode() == 304)
+    {
+        LOG("APISession", "station aliases unchanged.");
+        AliasCurrentCallback.invokeAll();
+    }
+    else if (success && req->getStatusCode() == 200)
     {
         auto jsReturn = req->getResponse();
 
@@ -308,21 +348,29 @@ void APISession::_stationsCallback(http::RESTRequest* req, bool success)
         }
         else
         {
-            mAliasedStations.clear();
+            std::vector<dto::Station> stations;
+            stations.reserve(jsReturn.size());
             for (const auto& sJson : jsReturn)
             {
                 dto::Station s;
                 try
                 {
                     sJson.get_to(s);
-                    mAliasedStations.emplace_back(s);
+                    stations.emplace_back(std::move(s));
                 }
                 catch (nlohmann::json::exception& e)
                 {
                     LOG("APISession", "couldn't decode station alias: %s", e.what());
                 }
             }
-            LOG("APISession", "got %d station aliases.", mAliasedStations.size());
+            LOG("APISession", "got %d station aliases.", stations.size());
+            auto aliases = std::make_shared<const StationAliases>(std::move(stations));
+            mStationAliasETag = req->getResponseHeader("ETag");
+            if (!mStationAliasCachePath.empty())
+            {
+                aliases->saveCache(mStationAliasCachePath, mStationAliasETag);
+            }
+            std::atomic_store(&mStationAliases, std::shared_ptr<const StationAliases>(std::move(aliases)));
             AliasUpdateCallback.invokeAll();
         }
     }
@@ -344,5 +392,33 @@ void APISession::_stationsCallback(http::RESTRequest* req, bool success)
 
 std::vector<dto::Station> APISession::getStationAliases() const
 {
-    return mAliasedStations;
+    auto aliases = std::atomic_load(&mStationAliases);
+    if (!aliases)
+    {
+        return std::vector<dto::Station>();
+    }
+    return aliases->getStations();
+}
+
+std::shared_ptr<const StationAliases> APISession::getStationAliasIndex() const
+{
+    return std::atomic_load(&mStationAliases);
+}
+
+void APISession::setStationAliasCachePath(const std::string& path)
+{
+    mStationAliasCachePath = path;
+    if (path.empty())
+    {
+        return;
+    }
+    std::string etag;
+    auto aliases = StationAliases::loadCache(path, etag);
+    if (aliases)
+    {
+        LOG("APISession", "loaded %d station aliases from cache.", aliases->size());
+        mStationAliasETag = std::move(etag);
+        std::atomic_store(&mStationAliases, std::move(aliases));
+        AliasUpdateCallback.invokeAll();
+    }
 }
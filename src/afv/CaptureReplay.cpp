@@ -0,0 +1,159 @@
+/* afv/CaptureReplay.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/afv/CaptureReplay.h"
+
+#include <cstring>
+
+#include "afv-native/Log.h"
+#include "afv-native/afv/dto/voice_server/AudioRxOnTransceiversView.h"
+#include "afv-native/audio/audio_params.h"
+
+using namespace afv_native::afv;
+using namespace afv_native;
+
+CaptureReplay::CaptureReplay(struct event_base *evBase, RadioSimulation &radio):
+        PacketsReplayed(0),
+        PacketsDropped(0),
+        RecordsSkipped(0),
+        mRadio(radio),
+        mReader(),
+        mTimer(evBase, std::bind(&CaptureReplay::timerFired, this)),
+        mRunning(false),
+        mOriginalTiming(true),
+        mNext(),
+        mHaveNext(false),
+        mStartTime(0),
+        mStartTimestampUs(0)
+{
+}
+
+CaptureReplay::~CaptureReplay()
+{
+    stop();
+}
+
+bool CaptureReplay::open(const std::string &path)
+{
+    stop();
+    return mReader.open(path);
+}
+
+bool CaptureReplay::replayRecord(const cryptodto::CaptureRecord &record)
+{
+    if (record.NameLen != 2 || ::memcmp(record.Name, "AR", 2) != 0) {
+        RecordsSkipped++;
+        return false;
+    }
+    dto::AudioRxOnTransceiversView pktView;
+    if (!pktView.decode(record.Dto, record.DtoLen)) {
+        RecordsSkipped++;
+        return false;
+    }
+    if (mRadio.rxVoicePacket(pktView)) {
+        PacketsReplayed++;
+    } else {
+        PacketsDropped++;
+    }
+    return true;
+}
+
+bool CaptureReplay::start(bool originalTiming)
+{
+    stop();
+    mHaveNext = mReader.next(mNext);
+    if (!mHaveNext) {
+        return false;
+    }
+    mOriginalTiming = originalTiming;
+    mStartTime = util::monotime_get();
+    mStartTimestampUs = mNext.TimestampUs;
+    mRunning = true;
+    timerFired();
+    return true;
+}
+
+void CaptureReplay::stop()
+{
+    mTimer.disable();
+    mRunning = false;
+}
+
+bool CaptureReplay::isRunning() const
+{
+    return mRunning;
+}
+
+void CaptureReplay::timerFired()
+{
+    if (mOriginalTiming) {
+        replayTimed();
+    } else {
+        replayPaced();
+    }
+    if (!mHaveNext) {
+        LOG("capturereplay", "replay finished: %llu packets, %llu dropped",
+            static_cast<unsigned long long>(PacketsReplayed),
+            static_cast<unsigned long long>(PacketsDropped));
+        mRunning = false;
+    }
+}
+
+void CaptureReplay::replayPaced()
+{
+    // the render passes take delivery of everything queued each frame, so anything we
+    // queue beyond the space left now would just be dropped.
+    size_t space = mRadio.voicePacketQueueSpace();
+    while (mHaveNext && space > 0) {
+        if (replayRecord(mNext)) {
+            space--;
+        }
+        mHaveNext = mReader.next(mNext);
+    }
+    if (mHaveNext) {
+        mTimer.enable(audio::frameLengthMs);
+    }
+}
+
+void CaptureReplay::replayTimed()
+{
+    const uint64_t elapsedUs = static_cast<uint64_t>(util::monotime_get() - mStartTime) * 1000;
+    while (mHaveNext && (mNext.TimestampUs - mStartTimestampUs) <= elapsedUs) {
+        replayRecord(mNext);
+        mHaveNext = mReader.next(mNext);
+    }
+    if (mHaveNext) {
+        const uint64_t waitUs = (mNext.TimestampUs - mStartTimestampUs) - elapsedUs;
+        mTimer.enable(static_cast<unsigned int>((waitUs + 999) / 1000));
+    }
+}
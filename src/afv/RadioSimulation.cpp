@@ -32,6 +32,7 @@
 */
 
 
+#include <algorithm>
 #include <cmath>
 #include <atomic>
 #include <iostream>
@@ -55,13 +56,20 @@ const double minDb = -40.0;
 const double maxDb = 0.0;
 
 CallsignMeta::CallsignMeta():
+    id(0),
     source(),
-    transceivers()
+    transceivers(),
+    stats(),
+    lastActivity(0),
+    frame(audio::frameSizeSamples, 0.0f),
+    frameValid(false)
 {
     source = std::make_shared<RemoteVoiceSource>();
+    // the render pass replaces these per packet, so it mustn't ever need to grow them.
+    transceivers.reserve(maxRxTransceiversPerPacket);
 }
 
-OutputAudioDevice::OutputAudioDevice(std::weak_ptr<RadioSimulation> radio, bool onHeadset) :
+OutputAudioDevice::OutputAudioDevice(RadioSimulation *radio, bool onHeadset) :
     mRadio(radio),
     onHeadset(onHeadset)
 {
@@ -70,11 +78,62 @@ OutputAudioDevice::OutputAudioDevice(std::weak_ptr<RadioSimulation> radio, bool
 
 audio::SourceStatus OutputAudioDevice::getAudioFrame(audio::SampleType *bufferOut)
 {
-    return mRadio.lock()->getAudioFrame(bufferOut, onHeadset);
+    return mRadio->getAudioFrame(bufferOut, onHeadset);
 }
 
-OutputDeviceState::OutputDeviceState()
+SharedClockOutput::SharedClockOutput(RadioSimulation *radio, std::shared_ptr<audio::ISampleSink> speakerSink) :
+    mRadio(radio),
+    mSpeakerSink(std::move(speakerSink)),
+    mSpeakerFrame(new audio::SampleType[audio::frameSizeSamples * 2])
+{
+
+}
+
+SharedClockOutput::~SharedClockOutput()
+{
+    delete[] mSpeakerFrame;
+}
+
+audio::SourceStatus SharedClockOutput::getAudioFrame(audio::SampleType *bufferOut)
+{
+    const auto rv = mRadio->renderBuses(bufferOut, mSpeakerSink ? mSpeakerFrame : nullptr);
+    if (rv == audio::SourceStatus::OK && mSpeakerSink) {
+        mSpeakerSink->putAudioFrame(mSpeakerFrame);
+    }
+    return rv;
+}
+
+RadioFx::RadioFx(const EffectResources &resources):
+    Click(resources.mClick, false),
+    Crackle(resources.mCrackle, true),
+    AcBus(resources.mAcBus, true),
+    VhfWhiteNoise(resources.mVhfWhiteNoise, true),
+    HfWhiteNoise(resources.mHfWhiteNoise, true),
+    BlockTone(fxBlockToneFreq),
+    BlockToneActive(false),
+    simpleCompressorEffect(),
+    vhfFilter(),
+    Frequency(0),
+    LastRxCount(0)
 {
+    // nothing plays until the render pass starts it.
+    Click.stop();
+    Crackle.stop();
+    AcBus.stop();
+    VhfWhiteNoise.stop();
+    HfWhiteNoise.stop();
+}
+
+OutputDeviceState::OutputDeviceState(size_t radioCount, const EffectResources &resources):
+    mStreams(),
+    mPackets(voicePacketQueueDepth),
+    mConfig(),
+    mRadioFx()
+{
+    mRadioFx.reserve(radioCount);
+    for (size_t i = 0; i < radioCount; i++) {
+        mRadioFx.emplace_back(new RadioFx(resources));
+    }
     mChannelBuffer = new audio::SampleType[audio::frameSizeSamples];
     mMixingBuffer = new audio::SampleType[audio::frameSizeSamples];
     mLeftMixingBuffer = new audio::SampleType[audio::frameSizeSamples];
@@ -101,19 +160,35 @@ RadioSimulation::RadioSimulation(
     mResources(std::move(resources)),
     mChannel(),
     mStreamMapLock(),
+    mRxCallsign(),
     mHeadsetIncomingStreams(),
     mSpeakerIncomingStreams(),
+    mLastStreamId(0),
+    mStreamStats(),
+    mStreamStatsSnapshot(std::make_shared<const StreamStatsList>()),
     mRadioStateLock(),
     mPtt(false),
     mLastFramePtt(false),
     mTxRadio(0),
     mTxSequence(0),
-    mRadioState(radioCount),
+    mRadioConfig(radioCount),
+    mRxStreamCount(radioCount),
+    mBatchChannel(nullptr),
     mVoiceSink(std::make_shared<VoiceCompressionSink>(*this)),
     mVoiceFilter(),
     mMaintenanceTimer(mEvBase, std::bind(&RadioSimulation::maintainIncomingStreams, this)),
     mVuMeter(300 / audio::frameLengthMs) // VU is a 300ms zero to peak response...
 {
+    mHeadsetState = std::make_shared<OutputDeviceState>(radioCount, *mResources);
+    mSpeakerState = std::make_shared<OutputDeviceState>(radioCount, *mResources);
+    {
+        std::lock_guard<util::CheckedMutex> streamGuard(mStreamMapLock);
+        publishStreams();
+    }
+    {
+        std::lock_guard<util::CheckedMutex> radioStateGuard(mRadioStateLock);
+        publishConfig();
+    }
     setUDPChannel(channel);
     mMaintenanceTimer.enable(maintenanceTimerIntervalMs);
 }
@@ -168,23 +243,36 @@ void RadioSimulation::putAudioFrame(const audio::SampleType *bufferIn)
     mVoiceSink->putAudioFrame(samples);
 }
 
+void RadioSimulation::beginBatch()
+{
+    // nothing is sent while idle, so don't bother taking the channel's queue lock.
+    if (mChannel != nullptr && (mPtt.load() || mLastFramePtt)) {
+        mBatchChannel = mChannel;
+        mBatchChannel->corkTx();
+    }
+}
+
+void RadioSimulation::endBatch()
+{
+    if (mBatchChannel != nullptr) {
+        mBatchChannel->uncorkTx();
+        mBatchChannel = nullptr;
+    }
+}
+
 void RadioSimulation::processCompressedFrame(std::vector<unsigned char> compressedData)
 {
     if (mChannel != nullptr && mChannel->isOpen()) {
         dto::AudioTxOnTransceivers audioOutDto;
-        {
-            std::lock_guard<std::mutex> radioStateGuard(mRadioStateLock);
-
-            if (!mPtt.load()) {
-                audioOutDto.LastPacket = true;
-                mLastFramePtt = false;
-            } else {
-                audioOutDto.LastPacket = false;
-                mLastFramePtt = true;
-            }
-
-            audioOutDto.Transceivers.emplace_back(mTxRadio);
+        if (!mPtt.load()) {
+            audioOutDto.LastPacket = true;
+            mLastFramePtt = false;
+        } else {
+            audioOutDto.LastPacket = false;
+            mLastFramePtt = true;
         }
+
+        audioOutDto.Transceivers.emplace_back(mTxRadio.load());
         audioOutDto.SequenceCounter = std::atomic_fetch_add<uint32_t>(&mTxSequence, 1);
         audioOutDto.Callsign = mCallsign;
         audioOutDto.Audio = std::move(compressedData);
@@ -202,7 +290,7 @@ RadioSimulation::mix_buffers(audio::SampleType* RESTRICT src_dst, const audio::S
 }
 
 bool RadioSimulation::getTxActive(unsigned int radio) {
-    if (radio != mTxRadio) {
+    if (radio != mTxRadio.load()) {
         return false;
     }
     return mPtt.load();
@@ -211,9 +299,10 @@ bool RadioSimulation::getTxActive(unsigned int radio) {
 bool
 RadioSimulation::getRxActive(unsigned int radio)
 {
-    std::lock_guard<std::mutex> radioStateGuard(mRadioStateLock);
-
-    return (mRadioState[radio].mLastRxCount > 0);
+    if (radio >= mRxStreamCount.size()) {
+        return false;
+    }
+    return (mRxStreamCount[radio].load(std::memory_order_relaxed) > 0);
 }
 
 inline bool
@@ -223,17 +312,25 @@ freqIsHF(unsigned int freq)
 }
 
 bool RadioSimulation::_process_radio(
-    const std::map<void *, audio::SampleType[audio::frameSizeSamples]> &sampleCache,
-    size_t rxIter,
-    bool onHeadset)
+    OutputDeviceState *state,
+    const RenderConfig *config,
+    const StreamSet *streams,
+    size_t rxIter)
 {
-    std::shared_ptr<OutputDeviceState> state = onHeadset ? mHeadsetState : mSpeakerState;
+    const RadioConfig &radio = config->Radios[rxIter];
+    RadioFx &fx = *state->mRadioFx[rxIter];
+    if (fx.Frequency != radio.Frequency) {
+        // reset all of the effects, except the click which should be audiable due to the Squelch-gate kicking in on the new frequency
+        resetRadioFx(fx, true);
+        fx.Frequency = radio.Frequency;
+    }
 
     ::memset(state->mChannelBuffer, 0, audio::frameSizeBytes);
-    if (mPtt.load() && mTxRadio == rxIter) {
+    if (mPtt.load() && mTxRadio.load() == rxIter) {
         // don't analyze and mix-in the radios transmitting, but suppress the
         // effects.
-        resetRadioFx(rxIter);
+        resetRadioFx(fx);
+        mRxStreamCount[rxIter].store(0, std::memory_order_relaxed);
         return true;
     }
     // now, find all streams that this applies to.
@@ -242,25 +339,29 @@ bool RadioSimulation::_process_radio(
     float vhfGain = 0.0f;
     float acBusGain = 0.0f;
     uint32_t concurrentStreams = 0;
-    for (auto &srcPair: (onHeadset ? mHeadsetIncomingStreams : mSpeakerIncomingStreams)) {
-        if (!srcPair.second.source || !srcPair.second.source->isActive() || (sampleCache.find(srcPair.second.source.get()) == sampleCache.end())) {
+    for (const auto &stream: streams->streams) {
+        if (!stream->source->isActive()) {
+            continue;
+        }
+        if (!stream->frameValid) {
             continue;
         }
+        const audio::SampleType *streamFrame = stream->frame.data();
         bool mUseStream = false;
         float voiceGain = 1.0f;
-        for (const afv::dto::RxTransceiver &tx: srcPair.second.transceivers) {
-            if (tx.Frequency == mRadioState[rxIter].Frequency) {
+        for (const afv::dto::RxTransceiver &tx: stream->transceivers) {
+            if (tx.Frequency == radio.Frequency) {
                 mUseStream = true;
 
                 float crackleFactor = 0.0f;
-                if (!mRadioState[rxIter].mBypassEffects) {
+                if (!radio.BypassEffects) {
                     crackleFactor = static_cast<float>((exp(tx.DistanceRatio) * pow(tx.DistanceRatio, -4.0) / 350.0) - 0.00776652);
                     crackleFactor = fmax(0.0f, crackleFactor);
                     crackleFactor = fmin(0.20f, crackleFactor);
 
                     if (freqIsHF(tx.Frequency))
                     {
-                        if (!mRadioState[rxIter].mHfSquelch)
+                        if (!radio.HfSquelch)
                         {
                             hfGain = fxHfWhiteNoiseGain;
                         }
@@ -286,21 +387,17 @@ bool RadioSimulation::_process_radio(
         }
         if (mUseStream) {
             // then include this stream.
-            try {
-                mix_buffers(
-                            state->mChannelBuffer,
-                            sampleCache.at(srcPair.second.source.get()),
-                            voiceGain * mRadioState[rxIter].Gain);
-                concurrentStreams++;
-            } catch (const std::out_of_range &) {
-                LOG("RadioSimulation", "internal error:  Tried to mix uncached stream");
-            }
+            mix_buffers(
+                        state->mChannelBuffer,
+                        streamFrame,
+                        voiceGain * radio.Gain);
+            concurrentStreams++;
         }
     }
 
     if (concurrentStreams > 0) {
 
-        if (!mRadioState[rxIter].mBypassEffects) {
+        if (!radio.BypassEffects) {
 
             // limiter effect
             for(unsigned int i = 0; i < audio::frameSizeSamples; i++)
@@ -311,54 +408,38 @@ bool RadioSimulation::_process_radio(
                     state->mChannelBuffer[i] = -1.0f;
             }
 
-            mRadioState[rxIter].vhfFilter.transformFrame(state->mChannelBuffer, state->mChannelBuffer);
-            mRadioState[rxIter].simpleCompressorEffect.transformFrame(state->mChannelBuffer, state->mChannelBuffer);
+            fx.vhfFilter.transformFrame(state->mChannelBuffer, state->mChannelBuffer);
+            fx.simpleCompressorEffect.transformFrame(state->mChannelBuffer, state->mChannelBuffer);
 
-            set_radio_effects(rxIter);
-            if (!mix_effect(mRadioState[rxIter].Crackle, crackleGain * mRadioState[rxIter].Gain, state))
-            {
-                mRadioState[rxIter].Crackle.reset();
-            }
-            if (!mix_effect(mRadioState[rxIter].HfWhiteNoise, hfGain * mRadioState[rxIter].Gain, state))
-            {
-                mRadioState[rxIter].HfWhiteNoise.reset();
-            }
-            if (!mix_effect(mRadioState[rxIter].VhfWhiteNoise, vhfGain * mRadioState[rxIter].Gain, state))
-            {
-                mRadioState[rxIter].VhfWhiteNoise.reset();
-            }
-            if (!mix_effect(mRadioState[rxIter].AcBus, acBusGain * mRadioState[rxIter].Gain, state))
-            {
-                mRadioState[rxIter].AcBus.reset();
-            }
+            set_radio_effects(fx);
+            mix_effect(fx.Crackle, crackleGain * radio.Gain, state);
+            mix_effect(fx.HfWhiteNoise, hfGain * radio.Gain, state);
+            mix_effect(fx.VhfWhiteNoise, vhfGain * radio.Gain, state);
+            mix_effect(fx.AcBus, acBusGain * radio.Gain, state);
         } // bypass effects
         if (concurrentStreams > 1) {
-            if (!mRadioState[rxIter].BlockTone) {
-                mRadioState[rxIter].BlockTone = std::make_shared<audio::SineToneSource>(fxBlockToneFreq);
-            }
-            if (!mix_effect(mRadioState[rxIter].BlockTone, fxBlockToneGain * mRadioState[rxIter].Gain, state)) {
-                mRadioState[rxIter].BlockTone.reset();
+            if (!fx.BlockToneActive) {
+                fx.BlockTone.rewind();
+                fx.BlockToneActive = true;
             }
+            mix_effect(fx.BlockTone, fxBlockToneGain * radio.Gain, state);
         } else {
-            if (mRadioState[rxIter].BlockTone) {
-                mRadioState[rxIter].BlockTone.reset();
-            }
+            fx.BlockToneActive = false;
         }
     } else {
-        resetRadioFx(rxIter, true);
-        if (mRadioState[rxIter].mLastRxCount > 0) {
-            mRadioState[rxIter].Click = std::make_shared<audio::RecordedSampleSource>(mResources->mClick, false);
+        resetRadioFx(fx, true);
+        if (fx.LastRxCount > 0) {
+            fx.Click.rewind();
         }
     }
-    mRadioState[rxIter].mLastRxCount = concurrentStreams;
+    fx.LastRxCount = concurrentStreams;
+    mRxStreamCount[rxIter].store(concurrentStreams, std::memory_order_relaxed);
 
     // if we have a pending click, play it.
-    if (!mix_effect(mRadioState[rxIter].Click, fxClickGain * mRadioState[rxIter].Gain, state)) {
-        mRadioState[rxIter].Click.reset();
-    }
+    mix_effect(fx.Click, fxClickGain * radio.Gain, state);
 
     // now, finally, mix the channel buffer into the mixing buffer.
-    if(mSplitChannels) {
+    if(config->SplitChannels) {
         if(rxIter == 0) {
             mix_buffers(state->mLeftMixingBuffer, state->mChannelBuffer);
         } else if(rxIter == 1) {
@@ -373,113 +454,278 @@ bool RadioSimulation::_process_radio(
 
 audio::SourceStatus RadioSimulation::getAudioFrame(audio::SampleType *bufferOut, bool onHeadset)
 {
-    std::shared_ptr<OutputDeviceState> state = onHeadset ? mHeadsetState : mSpeakerState;
+    return onHeadset ? renderBuses(bufferOut, nullptr) : renderBuses(nullptr, bufferOut);
+}
 
-    std::lock_guard<std::mutex> radioStateGuard(mRadioStateLock);
-    std::lock_guard<std::mutex> streamGuard(mStreamMapLock);
+audio::SourceStatus RadioSimulation::renderBuses(audio::SampleType *headsetOut, audio::SampleType *speakerOut)
+{
+    if (headsetOut) {
+        _render(mHeadsetState.get(), true, headsetOut);
+    }
+    if (speakerOut) {
+        _render(mSpeakerState.get(), false, speakerOut);
+    }
+    return audio::SourceStatus::OK;
+}
+
+void RadioSimulation::_render(OutputDeviceState *state, bool onHeadset, audio::SampleType *bufferOut)
+{
+    // both are published from the constructor onwards, so are never null.
+    util::PublishedPtr<StreamSet>::ReadGuard streams(state->mStreams);
+    util::PublishedPtr<RenderConfig>::ReadGuard config(state->mConfig);
 
-    std::map<void *, audio::SampleType[audio::frameSizeSamples]> sampleCache;
-    for (auto &src: (onHeadset ? mHeadsetIncomingStreams : mSpeakerIncomingStreams)) {
-        if (src.second.source && src.second.source->isActive() && (sampleCache.find(src.second.source.get()) == sampleCache.end())) {
-            const auto rv = src.second.source->getAudioFrame(sampleCache[src.second.source.get()]);
-            if (rv != audio::SourceStatus::OK) {
-                sampleCache.erase(src.second.source.get());
+    _prepare_output(state, streams.get());
+    for (size_t rxIter = 0; rxIter < config->Radios.size(); rxIter++) {
+        if (config->Radios[rxIter].OnHeadset == onHeadset) {
+            _process_radio(state, config.get(), streams.get(), rxIter);
+        } else {
+            // the radio is on the other output - forget where its effects were, so
+            // they don't pick up from there if it comes back.
+            resetRadioFx(*state->mRadioFx[rxIter]);
+        }
+    }
+    _mix_down(state, config.get(), bufferOut);
+}
+
+void RadioSimulation::_prepare_output(OutputDeviceState *state, const StreamSet *streams)
+{
+    // take delivery of the packets received since the last pass.
+    while (QueuedVoicePacket *pkt = state->mPackets.front()) {
+        if (pkt->streamId > streams->newestId) {
+            // its stream was published after we took our snapshot of the set.
+            break;
+        }
+        for (const auto &stream: streams->streams) {
+            if (stream->id == pkt->streamId) {
+                stream->source->appendAudio(pkt->audio, pkt->audioLen, pkt->sequence, pkt->lastPacket);
+                stream->transceivers.assign(pkt->transceivers, pkt->transceivers + pkt->transceiverCount);
+                break;
             }
         }
+        // if the stream wasn't found, it's since been purged.
+        state->mPackets.pop();
+    }
+
+    for (const auto &stream: streams->streams) {
+        stream->frameValid = stream->source->isActive() &&
+            stream->source->getAudioFrame(stream->frame.data()) == audio::SourceStatus::OK;
     }
 
     ::memset(state->mLeftMixingBuffer, 0, sizeof(audio::SampleType) * audio::frameSizeSamples);
     ::memset(state->mRightMixingBuffer, 0, sizeof(audio::SampleType) * audio::frameSizeSamples);
     ::memset(state->mMixingBuffer, 0, sizeof(audio::SampleType) * audio::frameSizeSamples);
+}
 
-    size_t rxIter = 0;
-    for (rxIter = 0; rxIter < mRadioState.size(); rxIter++) {
-        if(mRadioState[rxIter].onHeadset == onHeadset) {
-            _process_radio(sampleCache, rxIter, onHeadset);
-        }
-    }
-
-    if(mSplitChannels) {
-        audio::SampleType interleavedSamples[audio::frameSizeSamples * 2];
-        interleave(state->mLeftMixingBuffer, state->mRightMixingBuffer, interleavedSamples, audio::frameSizeSamples);
-        ::memcpy(bufferOut, interleavedSamples, sizeof(audio::SampleType) * audio::frameSizeSamples * 2);
+void RadioSimulation::_mix_down(OutputDeviceState *state, const RenderConfig *config, audio::SampleType *bufferOut)
+{
+    if(config->SplitChannels) {
+        interleave(state->mLeftMixingBuffer, state->mRightMixingBuffer, bufferOut, audio::frameSizeSamples);
     }
     else {
         ::memcpy(bufferOut, state->mMixingBuffer, sizeof(audio::SampleType) * audio::frameSizeSamples);
     }
-
-    return audio::SourceStatus::OK;
 }
 
-void RadioSimulation::set_radio_effects(size_t rxIter)
+void RadioSimulation::set_radio_effects(RadioFx &fx)
 {
-    if (!mRadioState[rxIter].VhfWhiteNoise)
+    if (!fx.VhfWhiteNoise.isPlaying())
     {
-        mRadioState[rxIter].VhfWhiteNoise = std::make_shared<audio::RecordedSampleSource>(mResources->mVhfWhiteNoise, true);
+        fx.VhfWhiteNoise.rewind();
     }
-    if (!mRadioState[rxIter].HfWhiteNoise)
+    if (!fx.HfWhiteNoise.isPlaying())
     {
-        mRadioState[rxIter].HfWhiteNoise = std::make_shared<audio::RecordedSampleSource>(mResources->mHfWhiteNoise, true);
+        fx.HfWhiteNoise.rewind();
     }
-    if (!mRadioState[rxIter].Crackle)
+    if (!fx.Crackle.isPlaying())
     {
-        mRadioState[rxIter].Crackle = std::make_shared<audio::RecordedSampleSource>(mResources->mCrackle, true);
+        fx.Crackle.rewind();
     }
-    if (!mRadioState[rxIter].AcBus)
+    if (!fx.AcBus.isPlaying())
     {
-        mRadioState[rxIter].AcBus = std::make_shared<audio::RecordedSampleSource>(mResources->mAcBus, true);
+        fx.AcBus.rewind();
     }
 }
 
-bool RadioSimulation::mix_effect(std::shared_ptr<audio::ISampleSource> effect, float gain, std::shared_ptr<OutputDeviceState> state) {
-    if (effect && gain > 0.0f) {
-        auto rv = effect->getAudioFrame(state->mFetchBuffer);
-        if (rv == audio::SourceStatus::OK) {
-            RadioSimulation::mix_buffers(state->mChannelBuffer, state->mFetchBuffer, gain);
-        } else {
-            return false;
+void RadioSimulation::mix_effect(audio::ISampleSource &effect, float gain, OutputDeviceState *state) {
+    if (gain > 0.0f && effect.getAudioFrame(state->mFetchBuffer) == audio::SourceStatus::OK) {
+        RadioSimulation::mix_buffers(state->mChannelBuffer, state->mFetchBuffer, gain);
+    }
+}
+
+bool RadioSimulation::rxVoicePacket(const afv::dto::AudioRxOnTransceivers &pkt)
+{
+    dto::AudioRxOnTransceiversView pktView;
+    pktView.Callsign = pkt.Callsign.data();
+    pktView.CallsignLen = pkt.Callsign.size();
+    pktView.SequenceCounter = pkt.SequenceCounter;
+    pktView.Audio = pkt.Audio.data();
+    pktView.AudioLen = pkt.Audio.size();
+    pktView.LastPacket = pkt.LastPacket;
+    pktView.TransceiverCount = std::min(pkt.Transceivers.size(), maxRxTransceiversPerPacket);
+    std::copy_n(pkt.Transceivers.begin(), pktView.TransceiverCount, pktView.Transceivers);
+    return rxVoicePacket(pktView);
+}
+
+bool RadioSimulation::rxVoicePacket(const afv::dto::AudioRxOnTransceiversView &pkt, int64_t arrivalUs)
+{
+    std::lock_guard<util::CheckedMutex> streamMapLock(mStreamMapLock);
+    // reuse the key's storage rather than building a new string per packet.
+    mRxCallsign.assign(pkt.Callsign, pkt.CallsignLen);
+
+    //FIXME:  Deal with the case of a single-callsign transmitting multiple different voicestreams simultaneously.
+    auto &headsetStream = mHeadsetIncomingStreams[mRxCallsign];
+    auto &speakerStream = mSpeakerIncomingStreams[mRxCallsign];
+    if (!headsetStream || !speakerStream) {
+        if (!headsetStream) {
+            headsetStream = newStream();
+        }
+        if (!speakerStream) {
+            speakerStream = newStream();
         }
+        attachStreamStats(*headsetStream, *speakerStream);
+        publishStreams();
+    }
+    if (arrivalUs == 0) {
+        arrivalUs = util::monotime_get_us();
+    }
+    headsetStream->stats->packetReceived(pkt.SequenceCounter, arrivalUs, pkt.LastPacket);
+    headsetStream->lastActivity = util::monotime_get();
+    speakerStream->lastActivity = headsetStream->lastActivity;
+
+    const bool headsetQueued = queueVoicePacket(mHeadsetState.get(), *headsetStream, pkt);
+    const bool speakerQueued = queueVoicePacket(mSpeakerState.get(), *speakerStream, pkt);
+    if (!headsetQueued || !speakerQueued) {
+        headsetStream->stats->PacketsDropped++;
+        return false;
     }
     return true;
 }
 
-void RadioSimulation::rxVoicePacket(const afv::dto::AudioRxOnTransceivers &pkt)
+size_t RadioSimulation::voicePacketQueueSpace()
 {
-    std::lock_guard<std::mutex> streamMapLock(mStreamMapLock);
-    //FIXME:  Deal with the case of a single-callsign transmitting multiple different voicestreams simultaneously.
-    mHeadsetIncomingStreams[pkt.Callsign].source->appendAudioDTO(pkt);
-    mHeadsetIncomingStreams[pkt.Callsign].transceivers = pkt.Transceivers;
+    std::lock_guard<util::CheckedMutex> streamMapLock(mStreamMapLock);
+    return std::min(mHeadsetState->mPackets.spaceFree(), mSpeakerState->mPackets.spaceFree());
+}
 
-    mSpeakerIncomingStreams[pkt.Callsign].source->appendAudioDTO(pkt);
-    mSpeakerIncomingStreams[pkt.Callsign].transceivers = pkt.Transceivers;
+std::shared_ptr<CallsignMeta> RadioSimulation::newStream()
+{
+    auto stream = std::make_shared<CallsignMeta>();
+    stream->id = ++mLastStreamId;
+    return stream;
+}
+
+bool RadioSimulation::queueVoicePacket(
+    OutputDeviceState *state,
+    const CallsignMeta &stream,
+    const afv::dto::AudioRxOnTransceiversView &pkt)
+{
+    if (pkt.AudioLen > voicePacketBlockSize) {
+        return false;
+    }
+    QueuedVoicePacket *queued = state->mPackets.beginPush();
+    if (queued == nullptr) {
+        // the render pass isn't keeping up, or isn't running at all.
+        return false;
+    }
+    queued->streamId = stream.id;
+    queued->sequence = pkt.SequenceCounter;
+    queued->lastPacket = pkt.LastPacket;
+    queued->audioLen = pkt.AudioLen;
+    ::memcpy(queued->audio, pkt.Audio, pkt.AudioLen);
+    queued->transceiverCount = pkt.TransceiverCount;
+    std::copy_n(pkt.Transceivers, pkt.TransceiverCount, queued->transceivers);
+    state->mPackets.commitPush();
+    return true;
+}
+
+void RadioSimulation::attachStreamStats(CallsignMeta &headsetStream, CallsignMeta &speakerStream)
+{
+    auto &stats = mStreamStats[mRxCallsign];
+    if (!stats) {
+        stats = std::make_shared<StreamStats>(mRxCallsign);
+        publishStreamStats();
+    }
+    // only new streams are missing their stats - the render pass may be using the others.
+    if (!headsetStream.stats) {
+        headsetStream.stats = stats;
+        headsetStream.source->setStats(stats);
+    }
+    if (!speakerStream.stats) {
+        speakerStream.stats = stats;
+        speakerStream.source->setStats(stats);
+    }
+}
+
+void RadioSimulation::publishStreams()
+{
+    publishStreamSet(mHeadsetState.get(), mHeadsetIncomingStreams);
+    publishStreamSet(mSpeakerState.get(), mSpeakerIncomingStreams);
+}
+
+void RadioSimulation::publishStreamSet(
+    OutputDeviceState *state,
+    const std::unordered_map<std::string, std::shared_ptr<CallsignMeta>> &streams)
+{
+    auto streamSet = std::make_shared<StreamSet>();
+    streamSet->streams.reserve(streams.size());
+    for (const auto &streamPair: streams) {
+        streamSet->streams.emplace_back(streamPair.second);
+    }
+    streamSet->newestId = mLastStreamId;
+    state->mStreams.publish(std::move(streamSet));
+}
+
+void RadioSimulation::publishStreamStats()
+{
+    auto snapshot = std::make_shared<StreamStatsList>();
+    snapshot->reserve(mStreamStats.size());
+    for (const auto &statsPair: mStreamStats) {
+        snapshot->emplace_back(statsPair.second);
+    }
+    std::atomic_store(&mStreamStatsSnapshot, std::shared_ptr<const StreamStatsList>(std::move(snapshot)));
+}
+
+std::shared_ptr<const StreamStatsList> RadioSimulation::getStreamStats() const
+{
+    return std::atomic_load(&mStreamStatsSnapshot);
 }
 
 void RadioSimulation::setFrequency(unsigned int radio, unsigned int frequency)
 {
-    std::lock_guard<std::mutex> radioStateGuard(mRadioStateLock);
-    if (radio >= mRadioState.size()) {
+    std::lock_guard<util::CheckedMutex> radioStateGuard(mRadioStateLock);
+    if (radio >= mRadioConfig.size()) {
         return;
     }
-    if (mRadioState[radio].Frequency == frequency) {
+    if (mRadioConfig[radio].Frequency == frequency) {
         return;
     }
-    mRadioState[radio].Frequency = frequency;
-    // reset all of the effects, except the click which should be audiable due to the Squelch-gate kicking in on the new frequency
-    resetRadioFx(radio, true);
+    // the render pass resets the radio's effects when it sees the new frequency.
+    mRadioConfig[radio].Frequency = frequency;
+    publishConfig();
     LOG("RadioSimulation", "setFrequency: %i: %i", radio, frequency);
 }
 
-void RadioSimulation::resetRadioFx(unsigned int radio, bool except_click)
+void RadioSimulation::publishConfig()
+{
+    auto config = std::make_shared<RenderConfig>();
+    config->Radios = mRadioConfig;
+    config->SplitChannels = mSplitChannels;
+    // the outputs only ever read it, so they can share the one copy.
+    mHeadsetState->mConfig.publish(config);
+    mSpeakerState->mConfig.publish(std::move(config));
+}
+
+void RadioSimulation::resetRadioFx(RadioFx &fx, bool except_click)
 {
     if (!except_click) {
-        mRadioState[radio].Click.reset();
-        mRadioState[radio].mLastRxCount = 0;
+        fx.Click.stop();
+        fx.LastRxCount = 0;
     }
-    mRadioState[radio].BlockTone.reset();
-    mRadioState[radio].Crackle.reset();
-    mRadioState[radio].VhfWhiteNoise.reset();
-    mRadioState[radio].HfWhiteNoise.reset();
-    mRadioState[radio].AcBus.reset();
+    fx.BlockToneActive = false;
+    fx.Crackle.stop();
+    fx.VhfWhiteNoise.stop();
+    fx.HfWhiteNoise.stop();
+    fx.AcBus.stop();
 }
 
 void RadioSimulation::setPtt(bool pressed)
@@ -489,18 +735,22 @@ void RadioSimulation::setPtt(bool pressed)
 
 void RadioSimulation::setGain(unsigned int radio, float gain)
 {
-    std::lock_guard<std::mutex> radioStateGuard(mRadioStateLock);
-    mRadioState[radio].Gain = gain;
+    std::lock_guard<util::CheckedMutex> radioStateGuard(mRadioStateLock);
+    if (radio >= mRadioConfig.size()) {
+        return;
+    }
+    mRadioConfig[radio].Gain = gain;
+    publishConfig();
     LOG("RadioSimulation", "setGain: %i: %f", radio, gain);
 }
 
 void RadioSimulation::setTxRadio(unsigned int radio)
 {
-    std::lock_guard<std::mutex> radioStateGuard(mRadioStateLock);
-    if (radio >= mRadioState.size()) {
+    std::lock_guard<util::CheckedMutex> radioStateGuard(mRadioStateLock);
+    if (radio >= mRadioConfig.size()) {
         return;
     }
-    mTxRadio = radio;
+    mTxRadio.store(radio);
     LOG("RadioSimulation", "setTxRadio: %i", radio);
 }
 
@@ -509,25 +759,27 @@ void RadioSimulation::setMicrophoneVolume(float volume)
     mMicVolume = volume;
 }
 
-void RadioSimulation::dtoHandler(const std::string &dtoName, const unsigned char *bufIn, size_t bufLen, void *user_data)
+void RadioSimulation::dtoHandler(const unsigned char *bufIn, size_t bufLen, void *user_data)
 {
     auto *thisRs = reinterpret_cast<RadioSimulation *>(user_data);
-    thisRs->instDtoHandler(dtoName, bufIn, bufLen);
+    thisRs->instDtoHandler(bufIn, bufLen);
 }
 
-void RadioSimulation::instDtoHandler(const std::string &dtoName, const unsigned char *bufIn, size_t bufLen)
+void RadioSimulation::instDtoHandler(const unsigned char *bufIn, size_t bufLen)
 {
-    if (dtoName == "AR") {
-        try {
-            dto::AudioRxOnTransceivers audioIn;
-            auto unpacker = msgpack::unpack(reinterpret_cast<const char *>(bufIn), bufLen);
-            auto msgpackObj = unpacker.get();
-            msgpackObj.convert(audioIn);
-            rxVoicePacket(audioIn);
-        } catch (msgpack::type_error &e) {
-            LOG("radiosimulation", "Error unmarshalling %s packet: %s", dtoName.c_str(), e.what());
-        }
+    // decode in place - the audio goes straight from the datagram into the jitter buffers.
+    dto::AudioRxOnTransceiversView rxAudio;
+    if (bufIn == nullptr) {
+        LOG("radiosimulation", "received empty audio packet");
+        return;
     }
+    if (!rxAudio.decode(bufIn, bufLen)) {
+        LOG("radiosimulation", "unable to unpack audio data received");
+        LOGDUMPHEX("radiosimulation", bufIn, bufLen);
+        return;
+    }
+    // use the channel's timestamp so queueing within the event loop doesn't show up as jitter.
+    rxVoicePacket(rxAudio, mChannel->getRxTimestampUs());
 }
 
 void RadioSimulation::setUDPChannel(cryptodto::UDPChannel *newChannel)
@@ -537,34 +789,23 @@ void RadioSimulation::setUDPChannel(cryptodto::UDPChannel *newChannel)
     }
     mChannel = newChannel;
     if (mChannel != nullptr) {
-        mChannel->registerDtoHandler(
-                    "AR", [this](const unsigned char *data, size_t len) {
-            try {
-                dto::AudioRxOnTransceivers rxAudio;
-                auto objHdl = msgpack::unpack(reinterpret_cast<const char *>(data), len);
-                objHdl.get().convert(rxAudio);
-                this->rxVoicePacket(rxAudio);
-            } catch (const msgpack::type_error &e) {
-                LOG("radiosimulation", "unable to unpack audio data received: %s", e.what());
-                LOGDUMPHEX("radiosimulation", data, len);
-            }
-        });
+        mChannel->registerDtoHandler("AR", &RadioSimulation::dtoHandler, this);
     }
 }
 
 void RadioSimulation::maintainIncomingStreams()
 {
-    std::lock_guard<std::mutex> ml(mStreamMapLock);
+    std::lock_guard<util::CheckedMutex> ml(mStreamMapLock);
     std::vector<std::string> callsignsToPurge;
     std::vector<std::string> speakerCallsignsToPurge;
     util::monotime_t now = util::monotime_get();
     for (const auto &streamPair: mHeadsetIncomingStreams) {
-        if ((now - streamPair.second.source->getLastActivityTime()) > audio::compressedSourceCacheTimeoutMs) {
+        if ((now - streamPair.second->lastActivity) > audio::compressedSourceCacheTimeoutMs) {
             callsignsToPurge.emplace_back(streamPair.first);
         }
     }
     for (const auto &streamPair : mSpeakerIncomingStreams) {
-        if ((now - streamPair.second.source->getLastActivityTime()) > audio::compressedSourceCacheTimeoutMs) {
+        if ((now - streamPair.second->lastActivity) > audio::compressedSourceCacheTimeoutMs) {
             speakerCallsignsToPurge.emplace_back(streamPair.first);
         }
     }
@@ -574,6 +815,23 @@ void RadioSimulation::maintainIncomingStreams()
     for(const auto &callsign: speakerCallsignsToPurge) {
         mSpeakerIncomingStreams.erase(callsign);
     }
+    if (!callsignsToPurge.empty() || !speakerCallsignsToPurge.empty()) {
+        for (auto statsIter = mStreamStats.begin(); statsIter != mStreamStats.end();) {
+            if (mHeadsetIncomingStreams.count(statsIter->first) == 0 &&
+                mSpeakerIncomingStreams.count(statsIter->first) == 0) {
+                statsIter = mStreamStats.erase(statsIter);
+            } else {
+                ++statsIter;
+            }
+        }
+        publishStreamStats();
+        // the purged streams are freed once the render pass has let go of the old sets.
+        publishStreams();
+    }
+    mHeadsetState->mStreams.reclaim();
+    mSpeakerState->mStreams.reclaim();
+    mHeadsetState->mConfig.reclaim();
+    mSpeakerState->mConfig.reclaim();
     mMaintenanceTimer.enable(maintenanceTimerIntervalMs);
 }
 
@@ -585,9 +843,12 @@ void RadioSimulation::setCallsign(const std::string &newCallsign)
 void RadioSimulation::reset()
 {
     {
-        std::lock_guard<std::mutex> ml(mStreamMapLock);
+        std::lock_guard<util::CheckedMutex> ml(mStreamMapLock);
         mHeadsetIncomingStreams.clear();
         mSpeakerIncomingStreams.clear();
+        mStreamStats.clear();
+        publishStreamStats();
+        publishStreams();
     }
     mTxSequence.store(0);
     mPtt.store(false);
@@ -624,39 +885,43 @@ void RadioSimulation::setEnableInputFilters(bool enableInputFilters)
 
 void RadioSimulation::setEnableOutputEffects(bool enableEffects)
 {
-    std::lock_guard<std::mutex> radioStateGuard(mRadioStateLock);
-    for (auto &thisRadio: mRadioState) {
-        thisRadio.mBypassEffects = !enableEffects;
+    std::lock_guard<util::CheckedMutex> radioStateGuard(mRadioStateLock);
+    for (auto &thisRadio: mRadioConfig) {
+        thisRadio.BypassEffects = !enableEffects;
     }
+    publishConfig();
 }
 
 void RadioSimulation::setEnableHfSquelch(bool enableSquelch)
 {
-    std::lock_guard<std::mutex> radioStateGuard(mRadioStateLock);
-    for (auto& thisRadio : mRadioState) {
-        thisRadio.mHfSquelch = enableSquelch;
+    std::lock_guard<util::CheckedMutex> radioStateGuard(mRadioStateLock);
+    for (auto& thisRadio : mRadioConfig) {
+        thisRadio.HfSquelch = enableSquelch;
     }
+    publishConfig();
 }
 
 void RadioSimulation::setupDevices(util::ChainedCallback<void (ClientEventType, void *, void *)> *eventCallback)
 {
-    mHeadsetDevice = std::make_shared<OutputAudioDevice>(shared_from_this(), true);
-    mSpeakerDevice = std::make_shared<OutputAudioDevice>(shared_from_this(), false);
-
-    mHeadsetState = std::make_shared<OutputDeviceState>();
-    mSpeakerState = std::make_shared<OutputDeviceState>();
+    mHeadsetDevice = std::make_shared<OutputAudioDevice>(this, true);
+    mSpeakerDevice = std::make_shared<OutputAudioDevice>(this, false);
 
     ClientEventCallback = eventCallback;
 }
 
 void RadioSimulation::setOnHeadset(unsigned int radio, bool onHeadset)
 {
-    std::lock_guard<std::mutex> mRadioStateGuard(mRadioStateLock);
-    mRadioState[radio].onHeadset = onHeadset;
+    std::lock_guard<util::CheckedMutex> mRadioStateGuard(mRadioStateLock);
+    if (radio >= mRadioConfig.size()) {
+        return;
+    }
+    mRadioConfig[radio].OnHeadset = onHeadset;
+    publishConfig();
 }
 
 void RadioSimulation::setSplitAudioChannels(bool splitChannels)
 {
-    std::lock_guard<std::mutex> mRadioStateGuard(mRadioStateLock);
+    std::lock_guard<util::CheckedMutex> mRadioStateGuard(mRadioStateLock);
     mSplitChannels = splitChannels;
+    publishConfig();
 }
@@ -37,6 +37,7 @@
 #include <algorithm>
 
 #include "afv-native/Log.h"
+#include "afv-native/afv/params.h"
 #include "afv-native/audio/audio_params.h"
 #include "afv-native/util/monotime.h"
 
@@ -46,7 +47,8 @@ using namespace afv_native;
 using namespace std;
 
 RemoteVoiceSource::RemoteVoiceSource():
-        mJitterBufferMutex(),
+        mFreeBlocks(nullptr),
+        mStats(),
         mIsActive(false),
         mSilentFrames(0),
         mEnding(false),
@@ -54,11 +56,21 @@ RemoteVoiceSource::RemoteVoiceSource():
         mCurrentFrame(0)
 {
     mJitterBuffer = jitter_buffer_init(1);
-    jitter_buffer_ctl(mJitterBuffer, JITTER_BUFFER_SET_DESTROY_CALLBACK, reinterpret_cast<void *>(::free));
+    jitter_buffer_ctl(mJitterBuffer, JITTER_BUFFER_SET_DESTROY_CALLBACK, reinterpret_cast<void *>(&RemoteVoiceSource::releasePacketData));
 
     spx_uint32_t jitterMargin = 0;
     jitter_buffer_ctl(mJitterBuffer, JITTER_BUFFER_SET_MARGIN, &jitterMargin);
 
+    for (size_t i = 0; i < voicePacketPoolBlocks; i++) {
+        auto *block = static_cast<PacketBlock *>(::malloc(sizeof(PacketBlock) + voicePacketBlockSize));
+        if (block == nullptr) {
+            break;
+        }
+        block->Pool = this;
+        block->Next = mFreeBlocks;
+        mFreeBlocks = block;
+    }
+
     int opus_status;
     mDecoder = opus_decoder_create(sampleRateHz, 1, &opus_status);
     if (opus_status != OPUS_OK) {
@@ -73,18 +85,67 @@ RemoteVoiceSource::~RemoteVoiceSource()
         opus_decoder_destroy(mDecoder);
         mDecoder = nullptr;
     }
+    // this hands any frames still buffered back to the pool, so it must go first.
     jitter_buffer_destroy(mJitterBuffer);
     mJitterBuffer = nullptr;
+    while (mFreeBlocks != nullptr) {
+        PacketBlock *block = mFreeBlocks;
+        mFreeBlocks = block->Next;
+        ::free(block);
+    }
+}
+
+char *RemoteVoiceSource::allocPacketData(size_t len)
+{
+    PacketBlock *block;
+    if (len > voicePacketBlockSize) {
+        // oversized - allocate it on its own and don't return it to the pool.
+        block = static_cast<PacketBlock *>(::malloc(sizeof(PacketBlock) + len));
+        if (block == nullptr) {
+            return nullptr;
+        }
+        block->Pool = nullptr;
+    } else if (mFreeBlocks != nullptr) {
+        block = mFreeBlocks;
+        mFreeBlocks = block->Next;
+    } else {
+        block = static_cast<PacketBlock *>(::malloc(sizeof(PacketBlock) + voicePacketBlockSize));
+        if (block == nullptr) {
+            return nullptr;
+        }
+        block->Pool = this;
+    }
+    block->Next = nullptr;
+    return reinterpret_cast<char *>(block + 1);
+}
+
+void RemoteVoiceSource::releasePacketData(void *data)
+{
+    if (data == nullptr) {
+        return;
+    }
+    PacketBlock *block = static_cast<PacketBlock *>(data) - 1;
+    if (block->Pool == nullptr) {
+        ::free(block);
+        return;
+    }
+    block->Next = block->Pool->mFreeBlocks;
+    block->Pool->mFreeBlocks = block;
 }
 
 void RemoteVoiceSource::appendAudioDTO(const dto::IAudio &audio)
+{
+    appendAudio(audio.Audio.data(), audio.Audio.size(), audio.SequenceCounter, audio.LastPacket);
+}
+
+void RemoteVoiceSource::appendAudio(const unsigned char *audio, size_t audioLen, uint32_t sequence, bool lastPacket)
 {
     JitterBufferPacket newPacket;
     ::memset(&newPacket, 0, sizeof(newPacket));
 
-    if (audio.LastPacket) {
+    if (lastPacket) {
         mEnding = true;
-        mEndingSequence = audio.SequenceCounter;
+        mEndingSequence = sequence;
     } else {
         mEnding = false;
     }
@@ -94,18 +155,19 @@ void RemoteVoiceSource::appendAudioDTO(const dto::IAudio &audio)
         flush();
     }
 
-    newPacket.data = static_cast<char *>(::malloc(audio.Audio.size()));
-    memcpy(newPacket.data, audio.Audio.data(), audio.Audio.size());
-    newPacket.len = audio.Audio.size();
-    newPacket.timestamp = audio.SequenceCounter;
+    newPacket.len = audioLen;
+    newPacket.timestamp = sequence;
     newPacket.span = 1;
-    {
-        std::lock_guard<std::mutex> lock(mJitterBufferMutex);
 
-        jitter_buffer_put(mJitterBuffer, &newPacket);
-        mSilentFrames = 0;
-        mLastActive = currentTime;
+    // the jitter buffer takes ownership of the data - it's handed back via releasePacketData.
+    newPacket.data = allocPacketData(audioLen);
+    if (newPacket.data == nullptr) {
+        return;
     }
+    ::memcpy(newPacket.data, audio, audioLen);
+    jitter_buffer_put(mJitterBuffer, &newPacket);
+    mSilentFrames = 0;
+    mLastActive = currentTime;
     mIsActive = true;
 }
 
@@ -118,10 +180,7 @@ SourceStatus RemoteVoiceSource::getAudioFrame(SampleType *bufferOut)
     spx_int32_t tsOut;
     int jitter_status;
     int opus_res = OPUS_OK;
-    {
-        std::lock_guard<std::mutex> lock(mJitterBufferMutex);
-        jitter_status = jitter_buffer_get(mJitterBuffer, &pktOut, 1, &tsOut);
-    }
+    jitter_status = jitter_buffer_get(mJitterBuffer, &pktOut, 1, &tsOut);
     if (mDecoder != nullptr) {
         switch (jitter_status) {
         case JITTER_BUFFER_MISSING:
@@ -132,11 +191,17 @@ SourceStatus RemoteVoiceSource::getAudioFrame(SampleType *bufferOut)
             } else {
                 // prod opus to perform gap compensation.
                 opus_res = opus_decode_float(mDecoder, nullptr, 0, bufferOut, frameSizeSamples, false);
+                if (mStats) {
+                    mStats->PlcFrames++;
+                }
             }
             break;
         case JITTER_BUFFER_INSERTION:
             // insert silence.
             ::memset(bufferOut, 0, frameSizeSamples * sizeof(SampleType));
+            if (mStats) {
+                mStats->SilenceFrames++;
+            }
             break;
         case JITTER_BUFFER_OK:
             mCurrentFrame = tsOut;
@@ -147,7 +212,9 @@ SourceStatus RemoteVoiceSource::getAudioFrame(SampleType *bufferOut)
                     bufferOut,
                     frameSizeSamples,
                     false);
-                ::free(pktOut.data);
+            if (mStats && opus_res >= 0) {
+                mStats->FramesDecoded++;
+            }
             break;
         default:
             LOG("instreambuffer", "Got Error return from the jitter buffer: %d", jitter_status);
@@ -155,6 +222,9 @@ SourceStatus RemoteVoiceSource::getAudioFrame(SampleType *bufferOut)
             break;
         }
         if (opus_res < 0) {
+            if (mStats) {
+                mStats->DecodeErrors++;
+            }
             LOG("instreambuffer", "Opus returned an error decoding frame: %s", opus_strerror(opus_res));
         }
     } else {
@@ -162,18 +232,17 @@ SourceStatus RemoteVoiceSource::getAudioFrame(SampleType *bufferOut)
         memset(bufferOut, 0, frameSizeSamples * sizeof(SampleType));
         rv = SourceStatus::Error;
     }
-    {
-        std::lock_guard<std::mutex> lock(mJitterBufferMutex);
-        jitter_buffer_tick(mJitterBuffer);
-        // if we don't have a terminally flagged marker, check for timeouts.
-        spx_int32_t bufCount = 0;
-        jitter_buffer_ctl(mJitterBuffer, JITTER_BUFFER_GET_AVAILABLE_COUNT, &bufCount);
-        if (bufCount == 0) {
-            mSilentFrames += 1;
-            if (mSilentFrames > frameTimeOut) {
-                if (rv != SourceStatus::Error) {
-                    rv = SourceStatus::Closed;
-                }
+    // return the frame we just decoded to the pool.
+    releasePacketData(pktOut.data);
+    jitter_buffer_tick(mJitterBuffer);
+    // if we don't have a terminally flagged marker, check for timeouts.
+    spx_int32_t bufCount = 0;
+    jitter_buffer_ctl(mJitterBuffer, JITTER_BUFFER_GET_AVAILABLE_COUNT, &bufCount);
+    if (bufCount == 0) {
+        mSilentFrames += 1;
+        if (mSilentFrames > frameTimeOut) {
+            if (rv != SourceStatus::Error) {
+                rv = SourceStatus::Closed;
             }
         }
     }
@@ -183,13 +252,15 @@ SourceStatus RemoteVoiceSource::getAudioFrame(SampleType *bufferOut)
     return rv;
 }
 
+void RemoteVoiceSource::setStats(std::shared_ptr<StreamStats> stats)
+{
+    mStats = std::move(stats);
+}
+
 void RemoteVoiceSource::flush()
 {
-    {
-        std::lock_guard<std::mutex> lock(mJitterBufferMutex);
-        // this nukes the jitter buffer contents, without resetting the latency timers.
-        jitter_buffer_reset(mJitterBuffer);
-    }
+    // this nukes the jitter buffer contents, without resetting the latency timers.
+    jitter_buffer_reset(mJitterBuffer);
     opus_decoder_ctl(mDecoder, OPUS_RESET_STATE);
 }
 
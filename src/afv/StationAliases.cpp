@@ -0,0 +1,149 @@
+/* afv/StationAliases.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/afv/StationAliases.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <nlohmann/json.hpp>
+
+#include "afv-native/Log.h"
+
+using namespace afv_native::afv;
+using json = nlohmann::json;
+
+static const int stationAliasCacheVersion = 1;
+
+StationAliases::StationAliases(std::vector<dto::Station> stations):
+    mStations(std::move(stations)),
+    mByFrequency(),
+    mByAlias()
+{
+    mByFrequency.reserve(mStations.size());
+    mByAlias.reserve(mStations.size());
+    for (size_t i = 0; i < mStations.size(); i++) {
+        const auto &station = mStations[i];
+        // emplace keeps the first station seen for a frequency.
+        if (station.Frequency != 0) {
+            mByFrequency.emplace(station.Frequency, i);
+        }
+        if (station.FrequencyAlias != 0) {
+            mByAlias.emplace(station.FrequencyAlias, i);
+        }
+    }
+}
+
+const std::vector<dto::Station> &StationAliases::getStations() const
+{
+    return mStations;
+}
+
+size_t StationAliases::size() const
+{
+    return mStations.size();
+}
+
+const dto::Station *StationAliases::findByFrequency(unsigned int freq) const
+{
+    auto iter = mByFrequency.find(freq);
+    if (iter == mByFrequency.end()) {
+        return nullptr;
+    }
+    return &mStations[iter->second];
+}
+
+const dto::Station *StationAliases::findByAlias(unsigned int freq) const
+{
+    auto iter = mByAlias.find(freq);
+    if (iter == mByAlias.end()) {
+        return nullptr;
+    }
+    return &mStations[iter->second];
+}
+
+bool StationAliases::saveCache(const std::string &path, const std::string &etag) const
+{
+    json j = {
+            {"version", stationAliasCacheVersion},
+            {"etag", etag},
+            {"stations", mStations},
+    };
+    const auto packed = json::to_msgpack(j);
+
+    // write to a temporary file and swap it in, so a crash never leaves a torn cache.
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            LOG("StationAliases", "couldn't open %s for writing", tmpPath.c_str());
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(packed.data()), packed.size());
+        if (!out) {
+            LOG("StationAliases", "couldn't write %s", tmpPath.c_str());
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+    }
+    // rename won't replace an existing file on Windows.
+    std::remove(path.c_str());
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        LOG("StationAliases", "couldn't replace %s", path.c_str());
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const StationAliases> StationAliases::loadCache(const std::string &path, std::string &etag)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    std::vector<uint8_t> packed((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    try {
+        auto j = json::from_msgpack(packed);
+        if (j.at("version").get<int>() != stationAliasCacheVersion) {
+            LOG("StationAliases", "ignoring cache %s - unsupported version", path.c_str());
+            return nullptr;
+        }
+        auto stations = j.at("stations").get<std::vector<dto::Station>>();
+        etag = j.at("etag").get<std::string>();
+        return std::make_shared<const StationAliases>(std::move(stations));
+    } catch (const json::exception &e) {
+        LOG("StationAliases", "couldn't read cache %s: %s", path.c_str(), e.what());
+        return nullptr;
+    }
+}
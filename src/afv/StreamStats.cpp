@@ -0,0 +1,96 @@
+/* afv/StreamStats.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/afv/StreamStats.h"
+
+#include <cmath>
+
+#include "afv-native/audio/audio_params.h"
+
+using namespace afv_native::afv;
+using namespace afv_native;
+
+/** a packet more than this far behind the highest sequence number seen is taken to be the
+ * start of a new transmission rather than a late packet.
+ */
+static const uint32_t streamRestartThreshold = 64;
+
+StreamStats::StreamStats(std::string callsign):
+        Callsign(std::move(callsign)),
+        PacketsReceived(0),
+        PacketsMissing(0),
+        PacketsLate(0),
+        JitterUs(0),
+        PacketsDropped(0),
+        FramesDecoded(0),
+        PlcFrames(0),
+        SilenceFrames(0),
+        DecodeErrors(0),
+        ReorderDepth(),
+        TransitDeltaMs(),
+        mInTransmission(false),
+        mHighestSequence(0),
+        mHighestArrivalUs(0),
+        mJitterUs(0.0)
+{
+}
+
+void StreamStats::packetReceived(uint32_t sequence, int64_t arrivalUs, bool lastPacket)
+{
+    PacketsReceived++;
+
+    const bool restarted = !mInTransmission ||
+                           (sequence < mHighestSequence && (mHighestSequence - sequence) > streamRestartThreshold);
+    if (restarted) {
+        mHighestSequence = sequence;
+        mHighestArrivalUs = arrivalUs;
+    } else if (sequence > mHighestSequence) {
+        PacketsMissing += (sequence - mHighestSequence - 1);
+
+        // RFC 3550 style jitter: the difference between the spacing of the arrivals and
+        // the spacing of the frames they carry.
+        const int64_t expectedUs = static_cast<int64_t>(sequence - mHighestSequence) * audio::frameLengthMs * 1000;
+        const int64_t transitDeltaUs = (arrivalUs - mHighestArrivalUs) - expectedUs;
+        const double absDeltaUs = std::fabs(static_cast<double>(transitDeltaUs));
+        mJitterUs += (absDeltaUs - mJitterUs) / 16.0;
+        JitterUs.store(static_cast<uint32_t>(mJitterUs));
+        TransitDeltaMs.record(static_cast<uint64_t>(absDeltaUs / 1000.0));
+
+        mHighestSequence = sequence;
+        mHighestArrivalUs = arrivalUs;
+    } else {
+        PacketsLate++;
+        ReorderDepth.record(mHighestSequence - sequence);
+    }
+    mInTransmission = !lastPacket;
+}
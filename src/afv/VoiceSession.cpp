@@ -47,18 +47,22 @@ using namespace afv_native::afv;
 using namespace afv_native;
 using json = nlohmann::json;
 
-VoiceSession::VoiceSession(APISession &session, const std::string &callsign):
+VoiceSession::VoiceSession(APISession &session, const std::string &callsign, struct event_base *channelEvBase):
+        HeartbeatRttMs(-1),
+        HeartbeatRtt(),
         mSession(session),
         mCallsign(callsign),
         mBaseUrl(""),
         mVoiceSessionSetupRequest("", http::Method::POST, json()),
         mVoiceSessionTeardownRequest("", http::Method::DEL, json()),
         mTransceiverUpdateRequest("", http::Method::POST, json()),
-        mChannel(session.getEventBase()),
+        mChannel(channelEvBase != nullptr ? channelEvBase : session.getEventBase()),
         mHeartbeatTimer(mSession.getEventBase(), std::bind(&VoiceSession::sendHeartbeatCallback, this)),
         mLastHeartbeatReceived(0),
+        mLastHeartbeatSent(0),
         mHeartbeatTimeout(mSession.getEventBase(), std::bind(&VoiceSession::heartbeatTimedOut, this)),
-        mLastError(VoiceSessionError::NoError)
+        mLastError(VoiceSessionError::NoError),
+        mResuming(false)
 {
     updateBaseUrl();
 }
@@ -98,11 +102,17 @@ void VoiceSession::voiceSessionSetupRequestCallback(http::Request *req, bool suc
                 auto j = restreq->getResponse();
                 dto::PostCallsignResponse cresp;
                 j.get_to(cresp);
-                if (!setupSession(cresp)) {
+                if (mResuming) {
+                    completeResume(cresp);
+                } else if (!setupSession(cresp)) {
                     failSession();
                 }
             } catch (json::exception &e) {
                 LOG("voicesession", "exception parsing voice session setup: %s", e.what());
+                if (mResuming) {
+                    abandonResume();
+                    return;
+                }
                 mLastError = VoiceSessionError::BadResponseFromAPIServer;
                 failSession();
             }
@@ -110,6 +120,10 @@ void VoiceSession::voiceSessionSetupRequestCallback(http::Request *req, bool suc
             LOG("voicesession",
                 "request for voice session failed: got status %d",
                 req->getStatusCode());
+            if (mResuming) {
+                abandonResume();
+                return;
+            }
             mLastError = VoiceSessionError::BadResponseFromAPIServer;
             failSession();
         }
@@ -117,6 +131,10 @@ void VoiceSession::voiceSessionSetupRequestCallback(http::Request *req, bool suc
         LOG("voicesession",
             "request for voice session failed: got internal error %s",
             req->getCurlError().c_str());
+        if (mResuming) {
+            abandonResume();
+            return;
+        }
         mLastError = VoiceSessionError::BadResponseFromAPIServer;
         failSession();
     }
@@ -135,6 +153,7 @@ bool VoiceSession::setupSession(const dto::PostCallsignResponse &cresp)
     mVoiceSessionSetupRequest.reset();
     mVoiceSessionTeardownRequest.reset();
     mLastHeartbeatReceived = util::monotime_get();
+    mLastHeartbeatSent = 0;
     mHeartbeatTimer.enable(afvHeartbeatIntervalMs);
     mHeartbeatTimeout.enable(afvHeartbeatTimeoutMs);
     mChannel.registerDtoHandler(
@@ -149,8 +168,67 @@ bool VoiceSession::setupSession(const dto::PostCallsignResponse &cresp)
     return true;
 }
 
+bool VoiceSession::resumeSession()
+{
+    // we can only skip the login if our token is still good.
+    if (mSession.getState() != APISessionState::Running) {
+        return false;
+    }
+    LOG("voicesession", "attempting to resume voice session");
+    mResuming = true;
+    StateCallback.invokeAll(VoiceSessionState::Resuming);
+
+    // ask for the session again with the token we already have...
+    mVoiceSessionSetupRequest.reset();
+    updateBaseUrl();
+    mSession.setAuthenticationFor(mVoiceSessionSetupRequest);
+    mVoiceSessionSetupRequest.setCompletionCallback(std::bind(&VoiceSession::voiceSessionSetupRequestCallback, this, std::placeholders::_1, std::placeholders::_2));
+    auto &transferManager = mSession.getTransferManager();
+    mVoiceSessionSetupRequest.shareState(transferManager);
+    mVoiceSessionSetupRequest.doAsync(transferManager);
+
+    // ... and in the meantime, get a fresh socket (and NAT binding) and start probing
+    // with the old keys in case the server still has our session.
+    mChannel.close();
+    mChannel.open();
+    mHeartbeatTimer.disable();
+    sendHeartbeatCallback();
+    mHeartbeatTimeout.enable(afvHeartbeatTimeoutMs);
+    return true;
+}
+
+void VoiceSession::completeResume(const dto::PostCallsignResponse &cresp)
+{
+    mChannel.close();
+    mChannel.setAddress(cresp.VoiceServer.AddressIpV4);
+    mChannel.setChannelConfig(cresp.VoiceServer.ChannelConfig);
+    if (!mChannel.open()) {
+        LOG("voicesession", "unable to reopen UDP session while resuming");
+        abandonResume();
+        return;
+    }
+    mVoiceSessionSetupRequest.reset();
+    mResuming = false;
+    mLastHeartbeatReceived = util::monotime_get();
+    mHeartbeatTimer.disable();
+    sendHeartbeatCallback();
+    mHeartbeatTimeout.enable(afvHeartbeatTimeoutMs);
+    mLastError = VoiceSessionError::NoError;
+    LOG("voicesession", "voice session resumed");
+    StateCallback.invokeAll(VoiceSessionState::Resumed);
+}
+
+void VoiceSession::abandonResume()
+{
+    LOG("voicesession", "couldn't resume voice session - reconnecting");
+    mResuming = false;
+    mLastError = VoiceSessionError::Timeout;
+    Disconnect(true, true);
+}
+
 void VoiceSession::failSession()
 {
+    mResuming = false;
     mHeartbeatTimer.disable();
     mHeartbeatTimeout.disable();
     mChannel.close();
@@ -168,6 +246,7 @@ void VoiceSession::sendHeartbeatCallback()
 {
     dto::Heartbeat hbDto(mCallsign);
     if (mChannel.isOpen()) {
+        mLastHeartbeatSent = util::monotime_get();
         mChannel.sendDto(hbDto);
         mHeartbeatTimer.enable(afvHeartbeatIntervalMs);
     }
@@ -175,15 +254,35 @@ void VoiceSession::sendHeartbeatCallback()
 
 void VoiceSession::receivedHeartbeat()
 {
-    mLastHeartbeatReceived = util::monotime_get();
-    mHeartbeatTimeout.disable();
-    mHeartbeatTimeout.enable(afvHeartbeatTimeoutMs);
+    // this can be called on the channel's thread, so we can't touch the timeout
+    // timer here - heartbeatTimedOut checks this when it fires instead.
+    const util::monotime_t now = util::monotime_get();
+    mLastHeartbeatReceived = now;
+    // only the first ack for each heartbeat is timed.
+    const util::monotime_t sent = mLastHeartbeatSent.exchange(0);
+    if (sent != 0 && now >= sent) {
+        HeartbeatRttMs = static_cast<int64_t>(now - sent);
+        HeartbeatRtt.record(now - sent);
+    }
 }
 
 void VoiceSession::heartbeatTimedOut()
 {
     util::monotime_t now = util::monotime_get();
-    LOG("voicesession", "heartbeat timeout - %d ms elapsed - disconnecting", now - mLastHeartbeatReceived);
+    const util::monotime_t elapsed = now - mLastHeartbeatReceived;
+    if (elapsed < afvHeartbeatTimeoutMs) {
+        // we've heard from the server since the timeout was armed - wait out the remainder.
+        mHeartbeatTimeout.enable(static_cast<unsigned int>(afvHeartbeatTimeoutMs - elapsed));
+        return;
+    }
+    if (mResuming) {
+        abandonResume();
+        return;
+    }
+    LOG("voicesession", "heartbeat timeout - %d ms elapsed", static_cast<int>(elapsed));
+    if (resumeSession()) {
+        return;
+    }
     mLastError = VoiceSessionError::Timeout;
     Disconnect(true, true);
 }
@@ -257,6 +356,11 @@ afv_native::cryptodto::UDPChannel &VoiceSession::getUDPChannel()
     return mChannel;
 }
 
+const afv_native::cryptodto::UDPChannel &VoiceSession::getUDPChannel() const
+{
+    return mChannel;
+}
+
 void VoiceSession::updateBaseUrl()
 {
     mBaseUrl = mSession.getBaseUrl() + "/api/v1/users/" + mSession.getUsername() + "/callsigns/" + mCallsign;
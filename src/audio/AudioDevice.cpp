@@ -34,19 +34,27 @@
 #include "afv-native/audio/AudioDevice.h"
 
 #include <memory>
+#include <cstdlib>
 #include <cstring>
 #include <algorithm>
 
 #include "afv-native/Log.h"
+#include "afv-native/util/monotime.h"
 
 using namespace afv_native::audio;
 using namespace std;
 
+const AudioDevice::Api AudioDevice::NullApi;
+const AudioDevice::Api AudioDevice::FileApi;
+
 AudioDevice::AudioDevice():
+    mOutputMonitor(),
+    mInputMonitor(),
     mSink(),
-    mSinkPtrLock(),
     mSource(),
-    mSourcePtrLock(),
+    mPeriodMs(defaultDevicePeriodMs),
+    mDuplex(false),
+    mRealtimeOptions(),
     OutputUnderflows(0),
     InputOverflows(0)
 {
@@ -57,15 +65,106 @@ AudioDevice::~AudioDevice()
 }
 
 void AudioDevice::setSource(std::shared_ptr<ISampleSource> newSrc) {
-    std::lock_guard<std::mutex> sourceGuard(mSourcePtrLock);
-
-    mSource = std::move(newSrc);
+    mSource.publish(std::move(newSrc));
 }
 
 void AudioDevice::setSink(std::shared_ptr<ISampleSink> newSink) {
-    std::lock_guard<std::mutex> sinkGuard(mSinkPtrLock);
+    mSink.publish(std::move(newSink));
+}
+
+void AudioDevice::setPeriodMs(unsigned int periodMs) {
+    mPeriodMs = std::max<unsigned int>(1, std::min<unsigned int>(periodMs, frameLengthMs));
+}
+
+unsigned int AudioDevice::getPeriodMs() const {
+    return mPeriodMs;
+}
+
+void AudioDevice::setDuplex(bool duplex) {
+    mDuplex = duplex;
+}
+
+bool AudioDevice::getDuplex() const {
+    return mDuplex;
+}
+
+bool AudioDevice::isDuplexOpen() const {
+    return false;
+}
+
+void AudioDevice::setRealtimeOptions(const util::RealtimeOptions &options) {
+    mRealtimeOptions = options;
+}
+
+AudioDevice::StreamStatistics AudioDevice::getOutputStatistics() const {
+    return mOutputMonitor.snapshot();
+}
+
+AudioDevice::StreamStatistics AudioDevice::getInputStatistics() const {
+    return mInputMonitor.snapshot();
+}
+
+AudioDevice::StreamMonitor::StreamMonitor():
+    mJitterUs(),
+    mDurationUs(),
+    mDeadlineMisses(0),
+    mXruns(0),
+    mBackendLatencyUs(0),
+    mBufferLatencyUs(0),
+    mLastStartUs(0),
+    mCurrentStartUs(0),
+    mExpectedIntervalUs(0)
+{
+}
+
+void AudioDevice::StreamMonitor::reset(uint32_t backendLatencyUs, uint32_t bufferLatencyUs) {
+    mJitterUs.reset();
+    mDurationUs.reset();
+    mDeadlineMisses.store(0);
+    mXruns.store(0);
+    mBackendLatencyUs.store(backendLatencyUs);
+    mBufferLatencyUs.store(bufferLatencyUs);
+    mLastStartUs = 0;
+    mExpectedIntervalUs = 0;
+}
+
+bool AudioDevice::StreamMonitor::begin(unsigned int nFrames) {
+    const int64_t now = util::monotime_get_us();
+    bool xrun = false;
+    if (mLastStartUs != 0 && mExpectedIntervalUs > 0) {
+        const int64_t interval = now - mLastStartUs;
+        mJitterUs.record(static_cast<uint64_t>(std::abs(interval - mExpectedIntervalUs)));
+        // if we're later than the backend could cover, it must have run out.
+        const int64_t lateness = interval - mExpectedIntervalUs;
+        const int64_t slack = mBackendLatencyUs.load(std::memory_order_relaxed);
+        if (slack > 0 && lateness > slack) {
+            mXruns.fetch_add(1, std::memory_order_relaxed);
+            xrun = true;
+        }
+    }
+    mLastStartUs = now;
+    mCurrentStartUs = now;
+    mExpectedIntervalUs = static_cast<int64_t>(nFrames) * 1000000 / sampleRateHz;
+    return xrun;
+}
+
+void AudioDevice::StreamMonitor::end() {
+    const int64_t duration = util::monotime_get_us() - mCurrentStartUs;
+    mDurationUs.record(static_cast<uint64_t>(std::max<int64_t>(0, duration)));
+    if (duration > mExpectedIntervalUs) {
+        mDeadlineMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+}
 
-    mSink = std::move(newSink);
+AudioDevice::StreamStatistics AudioDevice::StreamMonitor::snapshot() const {
+    StreamStatistics stats;
+    stats.CallbackJitterUs = mJitterUs.snapshot();
+    stats.CallbackDurationUs = mDurationUs.snapshot();
+    stats.DeadlineMisses = mDeadlineMisses.load(std::memory_order_relaxed);
+    stats.Xruns = mXruns.load(std::memory_order_relaxed);
+    stats.BackendLatencyUs = mBackendLatencyUs.load(std::memory_order_relaxed);
+    stats.BufferLatencyUs = mBufferLatencyUs.load(std::memory_order_relaxed);
+    return stats;
 }
 
 AudioDevice::DeviceInfo::DeviceInfo(std::string newName, std::string newId) :
@@ -0,0 +1,220 @@
+/* audio/ClockBridge.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/audio/ClockBridge.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "afv-native/Log.h"
+#include "afv-native/util/monotime.h"
+
+using namespace afv_native::audio;
+using namespace std;
+
+/** the FIFO level to aim for, in samples.  The master delivers whole frames, so the
+ * level is measured as if it were delivering continuously; a frame and a half leaves
+ * half a frame of slack for callback jitter even straight after a delivery. */
+static const double targetFillSamples = frameSizeSamples * 3.0 / 2.0;
+/** how much correction to apply per frame of error. */
+static const double correctionPpmPerFrame = 10000.0;
+/** smoothing factor for the fill level - roughly a one second time constant. */
+static const double fillSmoothing = 0.02;
+/** don't bother re-tuning the resampler for changes smaller than this. */
+static const int correctionStepPpm = 10;
+static const spx_uint32_t correctionDenominator = 1000000;
+
+const int ClockBridge::maxCorrectionPpm;
+const unsigned int ClockBridge::fifoFrames;
+
+ClockBridge::ClockBridge(unsigned int channels):
+    mChannels(std::max(1u, channels)),
+    mResampler(nullptr),
+    mFifo((fifoFrames + 1) * frameSizeSamples * mChannels, 0.0f),
+    mWriteFrame(0),
+    mReadFrame(0),
+    mReadOffset(0),
+    mPrimed(false),
+    mFillAverage(targetFillSamples),
+    mLastPutUs(0),
+    mCorrectionPpm(0),
+    mUnderruns(0),
+    mOverruns(0)
+{
+    int err = 0;
+    mResampler = speex_resampler_init(mChannels, sampleRateHz, sampleRateHz, SPEEX_RESAMPLER_QUALITY_VOIP, &err);
+    if (mResampler == nullptr) {
+        LOG("ClockBridge", "Couldn't create resampler (error %d), drift will not be compensated", err);
+        return;
+    }
+    // the resampler only grows its filter when the ratio changes, so size it for the
+    // largest correction now and it will never allocate from the audio callbacks.
+    setCorrection(maxCorrectionPpm);
+    setCorrection(-maxCorrectionPpm);
+    setCorrection(0);
+    speex_resampler_skip_zeros(mResampler);
+}
+
+ClockBridge::~ClockBridge()
+{
+    if (mResampler) {
+        speex_resampler_destroy(mResampler);
+        mResampler = nullptr;
+    }
+}
+
+void ClockBridge::setCorrection(int ppm)
+{
+    if (mResampler) {
+        speex_resampler_set_rate_frac(
+                mResampler,
+                correctionDenominator + ppm,
+                correctionDenominator,
+                sampleRateHz,
+                sampleRateHz);
+    }
+    mCorrectionPpm.store(ppm, std::memory_order_relaxed);
+}
+
+SampleType *ClockBridge::writeSlot(bool &full)
+{
+    const size_t frameSamples = frameSizeSamples * mChannels;
+    const uint32_t writeFrame = mWriteFrame.load(std::memory_order_relaxed);
+    const uint32_t readFrame = mReadFrame.load(std::memory_order_acquire);
+
+    full = (writeFrame - readFrame) >= fifoFrames;
+    return mFifo.data() + (full ? fifoFrames : (writeFrame % fifoFrames)) * frameSamples;
+}
+
+void ClockBridge::commitSlot(bool full)
+{
+    if (full) {
+        mOverruns.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    mLastPutUs.store(util::monotime_get_us(), std::memory_order_relaxed);
+    mWriteFrame.store(mWriteFrame.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void ClockBridge::putAudioFrame(const SampleType *bufferIn)
+{
+    bool full = false;
+    SampleType *slot = writeSlot(full);
+    if (!full) {
+        ::memcpy(slot, bufferIn, sizeof(SampleType) * frameSizeSamples * mChannels);
+    }
+    commitSlot(full);
+}
+
+SourceStatus ClockBridge::getAudioFrame(SampleType *bufferOut)
+{
+    const size_t frameSamples = frameSizeSamples * mChannels;
+    uint32_t readFrame = mReadFrame.load(std::memory_order_relaxed);
+    uint32_t writeFrame = mWriteFrame.load(std::memory_order_acquire);
+
+    const double fill = static_cast<double>(writeFrame - readFrame) * frameSizeSamples - mReadOffset;
+    if (!mPrimed) {
+        if (fill < targetFillSamples) {
+            ::memset(bufferOut, 0, frameSamples * sizeof(SampleType));
+            return SourceStatus::OK;
+        }
+        mPrimed = true;
+    }
+
+    // the master hands over a whole frame at a time, so discount the part of its last
+    // frame that it wouldn't have delivered yet had it been delivering continuously.
+    // Without this, the level only moves when a read crosses a delivery, by which
+    // point it's too late to correct for.
+    const util::monotime_t sincePutUs = std::max<util::monotime_t>(0, std::min<util::monotime_t>(
+            util::monotime_get_us() - mLastPutUs.load(std::memory_order_relaxed), frameLengthMs * 1000));
+    const double effectiveFill = fill - frameSizeSamples + static_cast<double>(sincePutUs) * sampleRateHz / 1000000.0;
+
+    mFillAverage += (effectiveFill - mFillAverage) * fillSmoothing;
+    const int ppm = std::max(-maxCorrectionPpm, std::min(maxCorrectionPpm,
+            static_cast<int>(std::lround((mFillAverage - targetFillSamples) / frameSizeSamples * correctionPpmPerFrame))));
+    if (std::abs(ppm - mCorrectionPpm.load(std::memory_order_relaxed)) >= correctionStepPpm) {
+        setCorrection(ppm);
+    }
+
+    size_t samplesDone = 0;
+    while (samplesDone < frameSizeSamples) {
+        if (readFrame == writeFrame) {
+            writeFrame = mWriteFrame.load(std::memory_order_acquire);
+        }
+        if (readFrame == writeFrame) {
+            // run dry - pad with silence, and wait for the FIFO to refill before resuming.
+            ::memset(bufferOut + samplesDone * mChannels, 0, (frameSizeSamples - samplesDone) * mChannels * sizeof(SampleType));
+            mUnderruns.fetch_add(1, std::memory_order_relaxed);
+            mPrimed = false;
+            break;
+        }
+        const SampleType *in = mFifo.data() + (readFrame % fifoFrames) * frameSamples + mReadOffset * mChannels;
+        spx_uint32_t inLen = frameSizeSamples - mReadOffset;
+        spx_uint32_t outLen = frameSizeSamples - samplesDone;
+        if (mResampler) {
+            speex_resampler_process_interleaved_float(mResampler, in, &inLen, bufferOut + samplesDone * mChannels, &outLen);
+        } else {
+            inLen = outLen = std::min(inLen, outLen);
+            ::memcpy(bufferOut + samplesDone * mChannels, in, inLen * mChannels * sizeof(SampleType));
+        }
+        if (inLen == 0 && outLen == 0) {
+            ::memset(bufferOut + samplesDone * mChannels, 0, (frameSizeSamples - samplesDone) * mChannels * sizeof(SampleType));
+            break;
+        }
+        mReadOffset += inLen;
+        samplesDone += outLen;
+        if (mReadOffset >= frameSizeSamples) {
+            mReadOffset = 0;
+            readFrame++;
+            mReadFrame.store(readFrame, std::memory_order_release);
+        }
+    }
+    return SourceStatus::OK;
+}
+
+int ClockBridge::getCorrectionPpm() const
+{
+    return mCorrectionPpm.load(std::memory_order_relaxed);
+}
+
+uint32_t ClockBridge::getUnderruns() const
+{
+    return mUnderruns.load(std::memory_order_relaxed);
+}
+
+uint32_t ClockBridge::getOverruns() const
+{
+    return mOverruns.load(std::memory_order_relaxed);
+}
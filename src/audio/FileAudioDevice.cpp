@@ -0,0 +1,192 @@
+/* audio/FileAudioDevice.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "FileAudioDevice.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "afv-native/Log.h"
+#include "afv-native/audio/WavFile.h"
+
+using namespace afv_native::audio;
+using namespace std;
+
+static const size_t wavHeaderSize = 44;
+/** maxWavDataBytes is the most sample data a WAV file can describe - its RIFF
+ * chunk size is only 32 bits wide. */
+static const uint32_t maxWavDataBytes = UINT32_MAX - static_cast<uint32_t>(wavHeaderSize - 8);
+
+static void putLE16(uint8_t *dst, uint16_t value)
+{
+    dst[0] = static_cast<uint8_t>(value & 0xff);
+    dst[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void putLE32(uint8_t *dst, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        dst[i] = static_cast<uint8_t>((value >> (8 * i)) & 0xff);
+    }
+}
+
+/** writeWavHeader writes a 16-bit PCM WAV header for dataBytes of samples at the start of fh. */
+static bool writeWavHeader(FILE *fh, unsigned int channels, uint32_t dataBytes)
+{
+    uint8_t header[wavHeaderSize];
+    const uint16_t blockAlign = static_cast<uint16_t>(channels * sizeof(int16_t));
+    ::memcpy(header, "RIFF", 4);
+    putLE32(header + 4, static_cast<uint32_t>(wavHeaderSize - 8) + dataBytes);
+    ::memcpy(header + 8, "WAVE", 4);
+    ::memcpy(header + 12, "fmt ", 4);
+    putLE32(header + 16, 16);
+    putLE16(header + 20, 1); // PCM
+    putLE16(header + 22, static_cast<uint16_t>(channels));
+    putLE32(header + 24, sampleRateHz);
+    putLE32(header + 28, sampleRateHz * blockAlign);
+    putLE16(header + 32, blockAlign);
+    putLE16(header + 34, 16);
+    ::memcpy(header + 36, "data", 4);
+    putLE32(header + 40, dataBytes);
+    return ::fseek(fh, 0, SEEK_SET) == 0 && ::fwrite(header, sizeof(header), 1, fh) == 1;
+}
+
+FileAudioDevice::FileAudioDevice(
+        const std::string &userStreamName,
+        const std::string &outputPath,
+        const std::string &inputPath,
+        bool splitChannels):
+    NullAudioDevice(userStreamName, splitChannels),
+    mOutputPath(outputPath),
+    mInputPath(inputPath),
+    mOutputFile(nullptr),
+    mOutputBytes(0),
+    mOutputPcm(frameSizeSamples * mOutputChannels),
+    mInputSamples(),
+    mInputOffset(0)
+{
+}
+
+FileAudioDevice::~FileAudioDevice()
+{
+    FileAudioDevice::close();
+}
+
+bool FileAudioDevice::openOutput()
+{
+    if (!mOutputPath.empty() && mOutputFile == nullptr) {
+        mOutputFile = ::fopen(mOutputPath.c_str(), "wb");
+        if (mOutputFile == nullptr) {
+            LOG("FileAudioDevice", "%s: couldn't create %s", mUserStreamName.c_str(), mOutputPath.c_str());
+            return false;
+        }
+        mOutputBytes = 0;
+        // a placeholder until we know how long the data is.
+        writeWavHeader(mOutputFile, mOutputChannels, 0);
+    }
+    return NullAudioDevice::openOutput();
+}
+
+bool FileAudioDevice::openInput()
+{
+    if (!mInputPath.empty() && !mInputSamples) {
+        std::unique_ptr<AudioSampleData> wavData(LoadWav(mInputPath.c_str()));
+        if (!wavData) {
+            LOG("FileAudioDevice", "%s: couldn't load %s", mUserStreamName.c_str(), mInputPath.c_str());
+            return false;
+        }
+        mInputSamples.reset(new WavSampleStorage(*wavData));
+        mInputOffset = 0;
+        if (mInputSamples->lengthInSamples() == 0) {
+            LOG("FileAudioDevice", "%s: %s has no samples, using silence", mUserStreamName.c_str(), mInputPath.c_str());
+        }
+    }
+    return NullAudioDevice::openInput();
+}
+
+void FileAudioDevice::close()
+{
+    NullAudioDevice::close();
+    finishOutput();
+    mInputSamples.reset();
+}
+
+void FileAudioDevice::finishOutput()
+{
+    if (mOutputFile == nullptr) {
+        return;
+    }
+    if (!writeWavHeader(mOutputFile, mOutputChannels, mOutputBytes)) {
+        LOG("FileAudioDevice", "%s: couldn't finish %s", mUserStreamName.c_str(), mOutputPath.c_str());
+    }
+    ::fclose(mOutputFile);
+    mOutputFile = nullptr;
+}
+
+void FileAudioDevice::captureFrame(SampleType *bufferOut)
+{
+    const size_t inputLength = mInputSamples ? mInputSamples->lengthInSamples() : 0;
+    if (inputLength == 0) {
+        NullAudioDevice::captureFrame(bufferOut);
+        return;
+    }
+    const SampleType *input = mInputSamples->data();
+    size_t samplesDone = 0;
+    while (samplesDone < frameSizeSamples) {
+        const size_t samplesToCopy = std::min<size_t>(frameSizeSamples - samplesDone, inputLength - mInputOffset);
+        ::memcpy(bufferOut + samplesDone, input + mInputOffset, samplesToCopy * sizeof(SampleType));
+        samplesDone += samplesToCopy;
+        mInputOffset = (mInputOffset + samplesToCopy) % inputLength;
+    }
+}
+
+void FileAudioDevice::playbackFrame(const SampleType *bufferIn)
+{
+    if (mOutputFile == nullptr) {
+        return;
+    }
+    for (size_t i = 0; i < mOutputPcm.size(); i++) {
+        const float sample = std::max(-1.0f, std::min(1.0f, bufferIn[i]));
+        mOutputPcm[i] = static_cast<int16_t>(sample * 32767.0f);
+    }
+    // WAV is little-endian, as are all of the hosts we build for.
+    const size_t bytes = mOutputPcm.size() * sizeof(int16_t);
+    if (bytes > maxWavDataBytes - mOutputBytes) {
+        LOG("FileAudioDevice", "%s: %s has reached the WAV size limit, stopped recording", mUserStreamName.c_str(), mOutputPath.c_str());
+        finishOutput();
+        return;
+    }
+    if (::fwrite(mOutputPcm.data(), bytes, 1, mOutputFile) == 1) {
+        mOutputBytes += static_cast<uint32_t>(bytes);
+    }
+}
@@ -0,0 +1,90 @@
+/* audio/FileAudioDevice.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_FILEAUDIODEVICE_H
+#define AFV_NATIVE_FILEAUDIODEVICE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NullAudioDevice.h"
+#include "afv-native/audio/WavSampleStorage.h"
+
+namespace afv_native {
+    namespace audio {
+        /** FileAudioDevice is a NullAudioDevice that plays its output into a WAV file
+         * and takes its input from another, looping it.
+         *
+         * The device names are the file paths.  Either may be empty, in which case that
+         * side behaves as the null device.  Output is written as 16-bit PCM at the
+         * codec's sample rate, so it can be fed straight back in as input.  Recording
+ * stops (and the file is finished) once it reaches the 4GiB WAV size limit.
+         */
+        class FileAudioDevice: public NullAudioDevice {
+        public:
+            FileAudioDevice(
+                    const std::string &userStreamName,
+                    const std::string &outputPath,
+                    const std::string &inputPath,
+                    bool splitChannels);
+            virtual ~FileAudioDevice();
+
+            bool openOutput() override;
+            bool openInput() override;
+            void close() override;
+
+        protected:
+            void captureFrame(SampleType *bufferOut) override;
+            void playbackFrame(const SampleType *bufferIn) override;
+
+        private:
+            void finishOutput();
+
+            const std::string mOutputPath;
+            const std::string mInputPath;
+
+            FILE *mOutputFile;
+            /** mOutputBytes is how much sample data has been written to mOutputFile. */
+            uint32_t mOutputBytes;
+            std::vector<int16_t> mOutputPcm;
+
+            std::unique_ptr<WavSampleStorage> mInputSamples;
+            size_t mInputOffset;
+        };
+    }
+}
+
+#endif //AFV_NATIVE_FILEAUDIODEVICE_H
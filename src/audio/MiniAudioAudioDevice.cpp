@@ -1,8 +1,15 @@
 #include "MiniAudioAudioDevice.h"
+#include "NullAudioDevice.h"
+#include "FileAudioDevice.h"
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <cstring>
+#include <unordered_map>
+
+#include "afv-native/util/RealtimeCheck.h"
 
 using namespace afv_native::audio;
 using namespace std;
@@ -15,6 +22,141 @@ void logger(void* pUserData, ma_uint32 logLevel, const char* message)
     LOG("MiniAudioAudioDevice", "%s: %s", ma_log_level_to_string(logLevel), msg.c_str());
 }
 
+namespace {
+    /** backendLatencyUs works out how much audio (us) a backend buffers from its period layout. */
+    uint32_t backendLatencyUs(ma_uint32 periodSizeInFrames, ma_uint32 periods, ma_uint32 sampleRate)
+    {
+        if(sampleRate == 0) {
+            return 0;
+        }
+        return static_cast<uint32_t>(static_cast<uint64_t>(periodSizeInFrames) * periods * 1000000 / sampleRate);
+    }
+
+    /** SharedContext is the one miniaudio context used by every device, along with a
+     * cache of the devices it last enumerated.
+     *
+     * Enumerating is slow on some backends (hundreds of milliseconds on systems with
+     * many endpoints), so the list is only refreshed after it's been invalidated by a
+     * device notification or AudioDevice::invalidateDeviceCache(), or when a device
+     * can't be found in it.
+     */
+    class SharedContext {
+    public:
+        static SharedContext &get()
+        {
+            // deliberately never destroyed - devices may still be closing during static
+            // destruction.
+            static SharedContext *instance = new SharedContext();
+            return *instance;
+        }
+
+        ma_context *context()
+        {
+            return mContextInitialized ? &mContext : nullptr;
+        }
+
+        void invalidate()
+        {
+            mCacheValid.store(false);
+        }
+
+        std::vector<ma_device_info> getDevices(bool forInput)
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            refreshIfInvalid();
+            return forInput ? mInputDevices : mOutputDevices;
+        }
+
+        bool findDevice(const std::string &deviceName, bool forInput, ma_device_id &deviceId)
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            refreshIfInvalid();
+            if (lookup(deviceName, forInput, deviceId)) {
+                return true;
+            }
+            // it may have been plugged in since we last looked.
+            mCacheValid.store(false);
+            refreshIfInvalid();
+            return lookup(deviceName, forInput, deviceId);
+        }
+
+    private:
+        std::mutex mLock;
+        ma_context mContext;
+        bool mContextInitialized;
+        std::atomic<bool> mCacheValid;
+        std::vector<ma_device_info> mInputDevices;
+        std::vector<ma_device_info> mOutputDevices;
+        std::unordered_map<std::string, size_t> mInputsByName;
+        std::unordered_map<std::string, size_t> mOutputsByName;
+
+        SharedContext():
+            mContextInitialized(false),
+            mCacheValid(false)
+        {
+            ma_context_config contextConfig = ma_context_config_init();
+            contextConfig.threadPriority = ma_thread_priority_normal;
+            contextConfig.jack.pClientName = "xpilot";
+            contextConfig.pulse.pApplicationName = "xpilot";
+            ma_result result = ma_context_init(NULL, 0, &contextConfig, &mContext);
+            if(result == MA_SUCCESS) {
+                mContextInitialized = true;
+                ma_log_register_callback(ma_context_get_log(&mContext), ma_log_callback_init(logger, NULL));
+                LOG("MiniAudioAudioDevice", "Context initialized. Audio Backend: %s", ma_get_backend_name(mContext.backend));
+            }
+            else {
+                LOG("MiniAudioAudioDevice", "Error initializing context: %s", ma_result_description(result));
+            }
+        }
+
+        bool lookup(const std::string &deviceName, bool forInput, ma_device_id &deviceId) const
+        {
+            const auto &byName = forInput ? mInputsByName : mOutputsByName;
+            const auto &devices = forInput ? mInputDevices : mOutputDevices;
+            auto it = byName.find(deviceName);
+            if (it == byName.end()) {
+                return false;
+            }
+            deviceId = devices[it->second].id;
+            return true;
+        }
+
+        /** refreshIfInvalid re-enumerates the devices if the cache is stale.  mLock must be held. */
+        void refreshIfInvalid()
+        {
+            if (mCacheValid.exchange(true) || !mContextInitialized) {
+                return;
+            }
+            mInputDevices.clear();
+            mOutputDevices.clear();
+            mInputsByName.clear();
+            mOutputsByName.clear();
+
+            ma_device_info *playbackDevices;
+            ma_uint32 playbackCount;
+            ma_device_info *captureDevices;
+            ma_uint32 captureCount;
+            ma_result result = ma_context_get_devices(&mContext, &playbackDevices, &playbackCount, &captureDevices, &captureCount);
+            if(result != MA_SUCCESS) {
+                LOG("MiniAudioAudioDevice", "Error querying devices: %s", ma_result_description(result));
+                mCacheValid.store(false);
+                return;
+            }
+            mOutputDevices.assign(playbackDevices, playbackDevices + playbackCount);
+            mInputDevices.assign(captureDevices, captureDevices + captureCount);
+            for(size_t i = 0; i < mOutputDevices.size(); i++) {
+                mOutputsByName.emplace(mOutputDevices[i].name, i);
+                LOG("MiniAudioAudioDevice", "Output: %s%s", mOutputDevices[i].name, mOutputDevices[i].isDefault ? " (Default)" : "");
+            }
+            for(size_t i = 0; i < mInputDevices.size(); i++) {
+                mInputsByName.emplace(mInputDevices[i].name, i);
+                LOG("MiniAudioAudioDevice", "Input: %s%s", mInputDevices[i].name, mInputDevices[i].isDefault ? " (Default)" : "");
+            }
+            LOG("MiniAudioAudioDevice", "Found %u output and %u input devices", playbackCount, captureCount);
+        }
+    };
+}
+
 MiniAudioAudioDevice::MiniAudioAudioDevice(
         const std::string& userStreamName,
         const std::string& outputDeviceName,
@@ -27,20 +169,17 @@ MiniAudioAudioDevice::MiniAudioAudioDevice(
     mInputDeviceName(inputDeviceName),
     mInputInitialized(false),
     mOutputInitialized(false),
-    mSplitChannels(splitChannels)
+    mDuplexOpen(false),
+    mSplitChannels(splitChannels),
+    mStopping(false),
+    mOutputChannels(splitChannels ? 2 : 1),
+    mOutputFrame(),
+    mOutputFrameOffset(0),
+    mInputFrame(),
+    mInputFrameFill(0),
+    mOutputThreadTuned(false),
+    mInputThreadTuned(false)
 {
-    ma_context_config contextConfig = ma_context_config_init();
-    contextConfig.threadPriority = ma_thread_priority_normal;
-    contextConfig.jack.pClientName = "xpilot";
-    contextConfig.pulse.pApplicationName = "xpilot";
-    ma_result result = ma_context_init(NULL, 0, &contextConfig, &context);
-    if(result == MA_SUCCESS) {
-        ma_log_register_callback(ma_context_get_log(&context), ma_log_callback_init(logger, NULL));
-        LOG("MiniAudioAudioDevice", "Context initialized. Audio Backend: %s", ma_get_backend_name(context.backend));
-    }
-    else {
-        LOG("MiniAudioAudioDevice", "Error initializing context: %s", ma_result_description(result));
-    }
 }
 
 MiniAudioAudioDevice::~MiniAudioAudioDevice()
@@ -55,268 +194,341 @@ bool MiniAudioAudioDevice::openOutput()
 
 bool MiniAudioAudioDevice::openInput()
 {
+    if(mDuplexOpen) {
+        return true; // already capturing on the output device
+    }
     return initInput();
 }
 
+bool MiniAudioAudioDevice::isDuplexOpen() const
+{
+    return mDuplexOpen;
+}
+
 void MiniAudioAudioDevice::close()
 {
+    // we're stopping these ourselves, so their stop notifications aren't news.
+    mStopping = true;
     if(mInputInitialized)
         ma_device_uninit(&inputDev);
 
     if(mOutputInitialized)
         ma_device_uninit(&outputDev);
-
-    ma_context_uninit(&context);
+    mStopping = false;
 
     mInputInitialized = false;
     mOutputInitialized = false;
+    mDuplexOpen = false;
+
+    // the callbacks have stopped, so anything they were holding can go now.
+    mSource.reclaim();
+    mSink.reclaim();
 }
 
 std::map<int, ma_device_info> MiniAudioAudioDevice::getCompatibleInputDevices()
 {
     std::map<int, ma_device_info> deviceList;
-
-    ma_device_info* devices;
-    ma_uint32 deviceCount;
-    ma_context context;
-
-    ma_result result = ma_context_init(NULL, 0, NULL, &context);
-    if(result == MA_SUCCESS) {
-        result = ma_context_get_devices(&context, NULL, NULL, &devices, &deviceCount);
-        if(result == MA_SUCCESS) {
-            LOG("MiniAudioAudioDevice", "Successfully queried %d input devices", deviceCount);
-            for(ma_uint32 i = 0; i < deviceCount; i++) {
-                deviceList.emplace(i, devices[i]);
-
-                // log detailed device info
-                {
-                    ma_device_info detailedDeviceInfo;
-                    result = ma_context_get_device_info(&context, ma_device_type_capture, &devices[i].id, &detailedDeviceInfo);
-                    if(result == MA_SUCCESS)
-                    {
-                        LOG("MiniAudioAudioDevice", "Input: %s (Default: %s, Format Count: %d)",
-                            devices[i].name,
-                            detailedDeviceInfo.isDefault ? "Yes" : "No",
-                            detailedDeviceInfo.nativeDataFormatCount);
-
-                        ma_uint32 iFormat;
-                        for(iFormat = 0; iFormat < detailedDeviceInfo.nativeDataFormatCount; ++iFormat)
-                        {
-                            LOG("MiniAudioAudioDevice", "   --> Format: %s, Channels: %d, Sample Rate: %d",
-                                ma_get_format_name(detailedDeviceInfo.nativeDataFormats[iFormat].format),
-                                detailedDeviceInfo.nativeDataFormats[iFormat].channels,
-                                detailedDeviceInfo.nativeDataFormats[iFormat].sampleRate);
-                        }
-                    }
-                    else {
-                        LOG("MiniAudioAudioDevice", "Error getting input device info: %s", ma_result_description(result));
-                    }
-                }
-            }
-        }
-        else {
-            LOG("MiniAudioAudioDevice", "Error querying input devices: %s", ma_result_description(result));
-        }
-    }
-    else {
-        LOG("MiniAudioAudioDevice", "Error initializing input device context: %s", ma_result_description(result));
+    auto devices = SharedContext::get().getDevices(true);
+    for(size_t i = 0; i < devices.size(); i++) {
+        deviceList.emplace(static_cast<int>(i), devices[i]);
     }
-
-    ma_context_uninit(&context);
-
     return deviceList;
 }
 
 std::map<int, ma_device_info> MiniAudioAudioDevice::getCompatibleOutputDevices()
 {
     std::map<int, ma_device_info> deviceList;
-
-    ma_device_info* devices;
-    ma_uint32 deviceCount;
-    ma_context context;
-
-    ma_result result = ma_context_init(NULL, 0, NULL, &context);
-    if(result == MA_SUCCESS) {
-        result = ma_context_get_devices(&context, &devices, &deviceCount, NULL, NULL);
-        if(result == MA_SUCCESS) {
-            LOG("MiniAudioAudioDevice", "Successfully queried %d output devices", deviceCount);
-            for(ma_uint32 i = 0; i < deviceCount; i++) {
-                deviceList.emplace(i, devices[i]);
-
-                // log detailed device info
-                {
-                    ma_device_info detailedDeviceInfo;
-                    result = ma_context_get_device_info(&context, ma_device_type_playback, &devices[i].id, &detailedDeviceInfo);
-                    if(result == MA_SUCCESS)
-                    {
-                        LOG("MiniAudioAudioDevice", "Output: %s (Default: %s, Format Count: %d)",
-                            devices[i].name,
-                            detailedDeviceInfo.isDefault ? "Yes" : "No",
-                            detailedDeviceInfo.nativeDataFormatCount);
-
-                        ma_uint32 iFormat;
-                        for(iFormat = 0; iFormat < detailedDeviceInfo.nativeDataFormatCount; ++iFormat)
-                        {
-                            LOG("MiniAudioAudioDevice", "   --> Format: %s, Channels: %d, Sample Rate: %d",
-                                ma_get_format_name(detailedDeviceInfo.nativeDataFormats[iFormat].format),
-                                detailedDeviceInfo.nativeDataFormats[iFormat].channels,
-                                detailedDeviceInfo.nativeDataFormats[iFormat].sampleRate);
-                        }
-                    }
-                    else {
-                        LOG("MiniAudioAudioDevice", "Error getting output device info: %s", ma_result_description(result));
-                    }
-                }
-            }
-        }
-        else {
-            LOG("MiniAudioAudioDevice", "Error querying output devices: %s", ma_result_description(result));
-        }
-    }
-    else {
-        LOG("MiniAudioAudioDevice", "Error initializing output device context: %s", ma_result_description(result));
+    auto devices = SharedContext::get().getDevices(false);
+    for(size_t i = 0; i < devices.size(); i++) {
+        deviceList.emplace(static_cast<int>(i), devices[i]);
     }
-
-    ma_context_uninit(&context);
-
     return deviceList;
 }
 
 bool MiniAudioAudioDevice::initOutput()
 {
-    if(mOutputInitialized)
+    if(mOutputInitialized) {
+        mStopping = true;
         ma_device_uninit(&outputDev);
+        mStopping = false;
+    }
+    mOutputInitialized = false;
+    mDuplexOpen = false;
 
     if(mOutputDeviceName.empty()) {
         LOG("MiniAudioAudioDevice::initOutput()", "Device name is empty");
         return false; // bail early if the device name is empty
     }
 
+    ma_context *context = SharedContext::get().context();
+    if(context == nullptr) {
+        LOG("MiniAudioAudioDevice::initOutput()", "No audio context");
+        return false;
+    }
+
     ma_device_id outputDeviceId;
     if(!getDeviceForName(mOutputDeviceName, false, outputDeviceId)) {
         LOG("MiniAudioAudioDevice::initOutput()", "No device found for %s", mOutputDeviceName.c_str());
         return false; // no device found
     }
 
-    ma_device_config cfg = ma_device_config_init(ma_device_type_playback);
+    // start with an empty frame so the first callback pulls from the source.
+    mOutputChannels = mSplitChannels ? 2 : 1;
+    mOutputFrame.assign(frameSizeSamples * mOutputChannels, 0.0f);
+    mOutputFrameOffset = frameSizeSamples;
+    mOutputThreadTuned = false;
+
+    // in duplex mode the capture side shares the playback device's clock, so the
+    // microphone and the headset can't drift apart.
+    ma_device_id inputDeviceId;
+    bool duplex = mDuplex && !mInputDeviceName.empty() && getDeviceForName(mInputDeviceName, true, inputDeviceId);
+
+    ma_device_config cfg = ma_device_config_init(duplex ? ma_device_type_duplex : ma_device_type_playback);
     cfg.playback.pDeviceID = &outputDeviceId;
     cfg.playback.format = ma_format_f32;
-    cfg.playback.channels = mSplitChannels ? 2 : 1;
+    cfg.playback.channels = mOutputChannels;
     cfg.playback.shareMode = ma_share_mode_shared;
     cfg.sampleRate = sampleRateHz;
-    cfg.periodSizeInFrames = frameSizeSamples;
+    // we re-frame the audio ourselves, so there's no need for miniaudio to add
+    // another buffer to guarantee fixed-size callbacks.
+    cfg.periodSizeInMilliseconds = mPeriodMs;
+    cfg.noFixedSizedCallback = MA_TRUE;
+    cfg.performanceProfile = ma_performance_profile_low_latency;
     cfg.pUserData = this;
     cfg.dataCallback = maOutputCallback;
+    cfg.notificationCallback = maNotificationCallback;
+    if(duplex) {
+        mInputFrame.assign(frameSizeSamples, 0.0f);
+        mInputFrameFill = 0;
+        mInputThreadTuned = false;
+        cfg.capture.pDeviceID = &inputDeviceId;
+        cfg.capture.format = ma_format_f32;
+        cfg.capture.channels = 1;
+        cfg.capture.shareMode = ma_share_mode_shared;
+        cfg.dataCallback = maDuplexCallback;
+    }
+
+    lockBuffers();
 
     ma_result result;
 
-    result = ma_device_init(&context, &cfg, &outputDev);
+    result = ma_device_init(context, &cfg, &outputDev);
+    if(result != MA_SUCCESS && duplex) {
+        LOG("MiniAudioAudioDevice", "Could not open duplex device (%s), using separate devices", ma_result_description(result));
+        duplex = false;
+        cfg.deviceType = ma_device_type_playback;
+        cfg.dataCallback = maOutputCallback;
+        result = ma_device_init(context, &cfg, &outputDev);
+    }
     if(result != MA_SUCCESS) {
         LOG("MiniAudioAudioDevice", "Error initializing output device: %s", ma_result_description(result));
         return false;
     }
 
+    // the monitors are written from the callback, so they have to be reset
+    // before the device starts calling it.
+    mOutputMonitor.reset(
+            backendLatencyUs(outputDev.playback.internalPeriodSizeInFrames, outputDev.playback.internalPeriods, outputDev.playback.internalSampleRate),
+            frameLengthMs * 1000);
+    if(duplex) {
+        mInputMonitor.reset(
+                backendLatencyUs(outputDev.capture.internalPeriodSizeInFrames, outputDev.capture.internalPeriods, outputDev.capture.internalSampleRate),
+                frameLengthMs * 1000);
+    }
+
     result = ma_device_start(&outputDev);
     if(result != MA_SUCCESS) {
         LOG("MiniAudioAudioDevice", "Error starting output device: %s", ma_result_description(result));
+        ma_device_uninit(&outputDev);
         return false;
     }
 
     mOutputInitialized = true;
+    mDuplexOpen = duplex;
+    LOG("MiniAudioAudioDevice", "Opened output %s: %s, %u channels, %u Hz, %u frame period%s",
+        outputDev.playback.name,
+        ma_get_format_name(outputDev.playback.internalFormat),
+        outputDev.playback.internalChannels,
+        outputDev.playback.internalSampleRate,
+        outputDev.playback.internalPeriodSizeInFrames,
+        duplex ? " (duplex)" : "");
     return true;
 }
 
 bool MiniAudioAudioDevice::initInput()
 {
-    if(mInputInitialized)
+    if(mInputInitialized) {
+        mStopping = true;
         ma_device_uninit(&inputDev);
+        mStopping = false;
+    }
+    mInputInitialized = false;
 
     if(mInputDeviceName.empty()) {
         LOG("MiniAudioAudioDevice::initInput()", "Device name is empty");
         return false; // bail early if the device name is empty
     }
 
+    ma_context *context = SharedContext::get().context();
+    if(context == nullptr) {
+        LOG("MiniAudioAudioDevice::initInput()", "No audio context");
+        return false;
+    }
+
     ma_device_id inputDeviceId;
     if(!getDeviceForName(mInputDeviceName, true, inputDeviceId)) {
         LOG("MiniAudioAudioDevice::initInput()", "No device found for %s", mInputDeviceName.c_str());
         return false; // no device found
     }
 
+    mInputFrame.assign(frameSizeSamples, 0.0f);
+    mInputFrameFill = 0;
+    mInputThreadTuned = false;
+    lockBuffers();
+
     ma_device_config cfg = ma_device_config_init(ma_device_type_capture);
     cfg.capture.pDeviceID = &inputDeviceId;
     cfg.capture.format = ma_format_f32;
     cfg.capture.channels = 1;
     cfg.capture.shareMode = ma_share_mode_shared;
     cfg.sampleRate = sampleRateHz;
-    cfg.periodSizeInFrames = frameSizeSamples;
+    cfg.periodSizeInMilliseconds = mPeriodMs;
+    cfg.noFixedSizedCallback = MA_TRUE;
+    cfg.performanceProfile = ma_performance_profile_low_latency;
     cfg.pUserData = this;
     cfg.dataCallback = maInputCallback;
+    cfg.notificationCallback = maNotificationCallback;
 
     ma_result result;
 
-    result = ma_device_init(&context, &cfg, &inputDev);
+    result = ma_device_init(context, &cfg, &inputDev);
     if(result != MA_SUCCESS) {
         LOG("MiniAudioAudioDevice", "Error initializing input device: %s", ma_result_description(result));
         return false;
     }
 
+    mInputMonitor.reset(
+            backendLatencyUs(inputDev.capture.internalPeriodSizeInFrames, inputDev.capture.internalPeriods, inputDev.capture.internalSampleRate),
+            frameLengthMs * 1000);
+
     result = ma_device_start(&inputDev);
     if(result != MA_SUCCESS) {
         LOG("MiniAudioAudioDevice", "Error starting input device: %s", ma_result_description(result));
+        ma_device_uninit(&inputDev);
         return false;
     }
 
     mInputInitialized = true;
+    LOG("MiniAudioAudioDevice", "Opened input %s: %s, %u channels, %u Hz, %u frame period",
+        inputDev.capture.name,
+        ma_get_format_name(inputDev.capture.internalFormat),
+        inputDev.capture.internalChannels,
+        inputDev.capture.internalSampleRate,
+        inputDev.capture.internalPeriodSizeInFrames);
     return true;
 }
 
 bool MiniAudioAudioDevice::getDeviceForName(const std::string &deviceName, bool forInput, ma_device_id &deviceId)
 {
-    auto allDevices = forInput ? getCompatibleInputDevices() : getCompatibleOutputDevices();
+    return SharedContext::get().findDevice(deviceName, forInput, deviceId);
+}
 
-    if(!allDevices.empty()) {
-        for(const auto& devicePair : allDevices) {
-            if(devicePair.second.name == deviceName) {
-                deviceId = devicePair.second.id;
-                return true;
-            }
-        }
+void MiniAudioAudioDevice::lockBuffers()
+{
+    if(!mRealtimeOptions.LockMemory) {
+        return;
+    }
+    bool locked = util::prefaultAndLock(mOutputFrame.data(), mOutputFrame.size() * sizeof(SampleType));
+    locked = util::prefaultAndLock(mInputFrame.data(), mInputFrame.size() * sizeof(SampleType)) && locked;
+    if(!locked) {
+        LOG("MiniAudioAudioDevice", "%s: couldn't lock audio buffers", mUserStreamName.c_str());
     }
+    util::lockProcessMemory();
+}
 
-    return false;
+void MiniAudioAudioDevice::fillOutputFrame(util::PublishedPtr<ISampleSource>::ReadGuard &source)
+{
+    if (source) {
+        if (source->getAudioFrame(mOutputFrame.data()) == SourceStatus::OK) {
+            return;
+        }
+        // stop using it, but leave it to setSource to actually release it.
+        source.detach();
+    }
+    // if there's no source, play silence to avoid making horrible buzzing sounds.
+    std::fill(mOutputFrame.begin(), mOutputFrame.end(), 0.0f);
 }
 
 int MiniAudioAudioDevice::outputCallback(void *outputBuffer, unsigned int nFrames)
 {
+    // this may log, so it has to happen before we declare ourselves real-time.
+    if (!mOutputThreadTuned) {
+        util::tuneCurrentThread(mRealtimeOptions);
+        mOutputThreadTuned = true;
+    }
+    util::RealtimeScope rtScope;
+    if (mOutputMonitor.begin(nFrames)) {
+        OutputUnderflows.fetch_add(1, std::memory_order_relaxed);
+    }
     if (outputBuffer) {
-        std::lock_guard<std::mutex> sourceGuard(mSourcePtrLock);
-        for (size_t i = 0; i < nFrames; i += frameSizeSamples) {
-            if (mSource) {
-                SourceStatus rv;
-                rv = mSource->getAudioFrame(reinterpret_cast<float *>(outputBuffer) + i);
-                if (rv != SourceStatus::OK) {
-                    ::memset(reinterpret_cast<float *>(outputBuffer) + i, 0, frameSizeBytes);
-                    mSource.reset();
-                }
-            } else {
-                // if there's no source, but there is an output buffer, zero it to avoid making horrible buzzing sounds.
-                ::memset(reinterpret_cast<float *>(outputBuffer) + i, 0, frameSizeBytes);
+        util::PublishedPtr<ISampleSource>::ReadGuard source(mSource);
+        auto *out = reinterpret_cast<SampleType *>(outputBuffer);
+        size_t framesDone = 0;
+        while (framesDone < nFrames) {
+            if (mOutputFrameOffset >= frameSizeSamples) {
+                fillOutputFrame(source);
+                mOutputFrameOffset = 0;
             }
+            const size_t framesToCopy = std::min<size_t>(frameSizeSamples - mOutputFrameOffset, nFrames - framesDone);
+            ::memcpy(
+                    out + framesDone * mOutputChannels,
+                    mOutputFrame.data() + mOutputFrameOffset * mOutputChannels,
+                    framesToCopy * mOutputChannels * sizeof(SampleType));
+            mOutputFrameOffset += framesToCopy;
+            framesDone += framesToCopy;
         }
     }
 
+    mOutputMonitor.end();
     return 0;
 }
 
 int MiniAudioAudioDevice::inputCallback(const void *inputBuffer, unsigned int nFrames)
 {
-    std::lock_guard<std::mutex> sinkGuard(mSinkPtrLock);
-    if (mSink && inputBuffer) {
-        for (size_t i = 0; i < nFrames; i += frameSizeSamples) {
-            mSink->putAudioFrame(reinterpret_cast<const float *>(inputBuffer) + i);
+    if (!mInputThreadTuned) {
+        util::tuneCurrentThread(mRealtimeOptions);
+        mInputThreadTuned = true;
+    }
+    util::RealtimeScope rtScope;
+    if (inputBuffer == nullptr) {
+        return 0;
+    }
+    if (mInputMonitor.begin(nFrames)) {
+        InputOverflows.fetch_add(1, std::memory_order_relaxed);
+    }
+    util::PublishedPtr<ISampleSink>::ReadGuard sink(mSink);
+    const auto *in = reinterpret_cast<const SampleType *>(inputBuffer);
+    if (sink) {
+        sink->beginBatch();
+    }
+    size_t framesDone = 0;
+    while (framesDone < nFrames) {
+        const size_t framesToCopy = std::min<size_t>(frameSizeSamples - mInputFrameFill, nFrames - framesDone);
+        ::memcpy(mInputFrame.data() + mInputFrameFill, in + framesDone, framesToCopy * sizeof(SampleType));
+        mInputFrameFill += framesToCopy;
+        framesDone += framesToCopy;
+        if (mInputFrameFill >= frameSizeSamples) {
+            if (sink) {
+                sink->putAudioFrame(mInputFrame.data());
+            }
+            mInputFrameFill = 0;
         }
     }
+    if (sink) {
+        sink->endBatch();
+    }
 
+    mInputMonitor.end();
     return 0;
 }
 
@@ -332,13 +544,54 @@ void MiniAudioAudioDevice::maInputCallback(ma_device *pDevice, void *pOutput, co
     device->inputCallback(pInput, frameCount);
 }
 
+void MiniAudioAudioDevice::maDuplexCallback(ma_device *pDevice, void *pOutput, const void *pInput, ma_uint32 frameCount)
+{
+    auto device = reinterpret_cast<MiniAudioAudioDevice*>(pDevice->pUserData);
+    device->inputCallback(pInput, frameCount);
+    device->outputCallback(pOutput, frameCount);
+}
+
+void MiniAudioAudioDevice::maNotificationCallback(const ma_device_notification *pNotification)
+{
+    auto device = reinterpret_cast<MiniAudioAudioDevice*>(pNotification->pDevice->pUserData);
+    switch(pNotification->type) {
+    case ma_device_notification_type_stopped:
+        if(device->mStopping) {
+            break;
+        }
+        // a device stopping on its own usually means it's been unplugged.
+        LOG("MiniAudioAudioDevice", "%s stopped unexpectedly", device->mUserStreamName.c_str());
+        SharedContext::get().invalidate();
+        break;
+    case ma_device_notification_type_rerouted:
+        LOG("MiniAudioAudioDevice", "%s was rerouted", device->mUserStreamName.c_str());
+        SharedContext::get().invalidate();
+        break;
+    default:
+        break;
+    }
+}
+
 /* ========== Factory hooks ============= */
 
+void AudioDevice::invalidateDeviceCache() {
+    SharedContext::get().invalidate();
+}
+
 map<AudioDevice::Api, std::string> AudioDevice::getAPIs() {
-    return {};
+    return {
+        {AudioDevice::NullApi, "Null"},
+        {AudioDevice::FileApi, "WAV File"},
+    };
 }
 
 map<int, AudioDevice::DeviceInfo> AudioDevice::getCompatibleInputDevicesForApi(AudioDevice::Api api) {
+    if (api == AudioDevice::NullApi) {
+        return {{0, AudioDevice::DeviceInfo("Null")}};
+    }
+    if (api == AudioDevice::FileApi) {
+        return {}; // any path will do.
+    }
     auto allDevices = MiniAudioAudioDevice::getCompatibleInputDevices();
     map<int, AudioDevice::DeviceInfo> returnDevices;
     for (const auto &p: allDevices) {
@@ -348,6 +601,12 @@ map<int, AudioDevice::DeviceInfo> AudioDevice::getCompatibleInputDevicesForApi(A
 }
 
 map<int, AudioDevice::DeviceInfo> AudioDevice::getCompatibleOutputDevicesForApi(AudioDevice::Api api) {
+    if (api == AudioDevice::NullApi) {
+        return {{0, AudioDevice::DeviceInfo("Null")}};
+    }
+    if (api == AudioDevice::FileApi) {
+        return {};
+    }
     auto allDevices = MiniAudioAudioDevice::getCompatibleOutputDevices();
     map<int, AudioDevice::DeviceInfo> returnDevices;
     for (const auto &p: allDevices) {
@@ -363,6 +622,12 @@ AudioDevice::makeDevice(
         const std::string &inputDeviceId,
         AudioDevice::Api audioApi,
         bool splitChannels) {
+    if (audioApi == AudioDevice::NullApi) {
+        return std::make_shared<NullAudioDevice>(userStreamName, splitChannels);
+    }
+    if (audioApi == AudioDevice::FileApi) {
+        return std::make_shared<FileAudioDevice>(userStreamName, outputDeviceId, inputDeviceId, splitChannels);
+    }
     auto devsp = std::make_shared<MiniAudioAudioDevice>(userStreamName, outputDeviceId, inputDeviceId, audioApi, splitChannels);
     return devsp;
 }
@@ -10,7 +10,9 @@
 #include "afv-native/Log.h"
 #include "afv-native/audio/AudioDevice.h"
 
+#include <atomic>
 #include <map>
+#include <vector>
 
 namespace afv_native
 {
@@ -30,6 +32,7 @@ namespace afv_native
             bool openOutput() override;
             bool openInput() override;
             void close() override;
+            bool isDuplexOpen() const override;
 
             static std::map<int, ma_device_info> getCompatibleInputDevices();
             static std::map<int, ma_device_info> getCompatibleOutputDevices();
@@ -40,8 +43,14 @@ namespace afv_native
             bool getDeviceForName(const std::string& deviceName, bool forInput, ma_device_id& deviceId);
             static void maOutputCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
             static void maInputCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+            static void maDuplexCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+            static void maNotificationCallback(const ma_device_notification* pNotification);
             int outputCallback(void* outputBuffer, unsigned int nFrames);
             int inputCallback(const void* inputBuffer, unsigned int nFrames);
+            /** fillOutputFrame pulls the next codec frame from the source into mOutputFrame. */
+            void fillOutputFrame(util::PublishedPtr<ISampleSource>::ReadGuard &source);
+            /** lockBuffers pre-faults and locks the frame buffers if mRealtimeOptions asks for it. */
+            void lockBuffers();
 
         private:
             std::string mUserStreamName;
@@ -49,10 +58,28 @@ namespace afv_native
             std::string mInputDeviceName;
             bool mOutputInitialized;
             bool mInputInitialized;
+            /** mDuplexOpen is set when outputDev is also capturing, leaving inputDev unused. */
+            bool mDuplexOpen;
             bool mSplitChannels;
-            ma_context context;
+            /** mStopping is set while we're stopping the devices ourselves. */
+            std::atomic<bool> mStopping;
             ma_device outputDev;
             ma_device inputDev;
+
+            /* the device periods needn't match the codec's frame size, so both sides
+             * buffer a single codec frame.  These are only touched by the callbacks once
+             * the devices are started. */
+            unsigned int mOutputChannels;
+            std::vector<SampleType> mOutputFrame;
+            /** mOutputFrameOffset is how many (multi-channel) samples of mOutputFrame have been played. */
+            size_t mOutputFrameOffset;
+            std::vector<SampleType> mInputFrame;
+            /** mInputFrameFill is how many samples of mInputFrame have been captured. */
+            size_t mInputFrameFill;
+            /** mOutputThreadTuned and mInputThreadTuned are set once the callback thread
+             * has had mRealtimeOptions applied to it. */
+            bool mOutputThreadTuned;
+            bool mInputThreadTuned;
         };
     }
 }
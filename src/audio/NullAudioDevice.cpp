@@ -0,0 +1,185 @@
+/* audio/NullAudioDevice.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "NullAudioDevice.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "afv-native/Log.h"
+#include "afv-native/util/RealtimeCheck.h"
+
+using namespace afv_native::audio;
+using namespace std;
+
+/** if the pacing thread falls this many frames behind (the host was suspended, say),
+ * it starts again from now rather than trying to catch up all at once. */
+static const int maxFramesBehind = 5;
+
+NullAudioDevice::NullAudioDevice(const std::string &userStreamName, bool splitChannels):
+    AudioDevice(),
+    mUserStreamName(userStreamName),
+    mOutputChannels(splitChannels ? 2 : 1),
+    mOutputOpen(false),
+    mInputOpen(false),
+    mRunning(false),
+    mThreadLock(),
+    mThread(),
+    mOutputFrame(frameSizeSamples * mOutputChannels, 0.0f),
+    mInputFrame(frameSizeSamples, 0.0f)
+{
+}
+
+NullAudioDevice::~NullAudioDevice()
+{
+    NullAudioDevice::close();
+}
+
+bool NullAudioDevice::openOutput()
+{
+    if (!mOutputOpen.load()) {
+        mOutputMonitor.reset(frameLengthMs * 1000, 0);
+        mOutputOpen.store(true);
+    }
+    startThread();
+    return true;
+}
+
+bool NullAudioDevice::openInput()
+{
+    if (!mInputOpen.load()) {
+        mInputMonitor.reset(frameLengthMs * 1000, 0);
+        mInputOpen.store(true);
+    }
+    startThread();
+    return true;
+}
+
+void NullAudioDevice::close()
+{
+    {
+        std::lock_guard<std::mutex> threadLock(mThreadLock);
+        mRunning.store(false);
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+    }
+    mOutputOpen.store(false);
+    mInputOpen.store(false);
+
+    // the pacing thread has stopped, so anything it was holding can go now.
+    mSource.reclaim();
+    mSink.reclaim();
+}
+
+void NullAudioDevice::startThread()
+{
+    std::lock_guard<std::mutex> threadLock(mThreadLock);
+    if (mRunning.load()) {
+        return;
+    }
+    if (mRealtimeOptions.LockMemory) {
+        util::prefaultAndLock(mOutputFrame.data(), mOutputFrame.size() * sizeof(SampleType));
+        util::prefaultAndLock(mInputFrame.data(), mInputFrame.size() * sizeof(SampleType));
+        util::lockProcessMemory();
+    }
+    mRunning.store(true);
+    mThread = std::thread(&NullAudioDevice::run, this);
+    LOG("NullAudioDevice", "%s: started", mUserStreamName.c_str());
+}
+
+void NullAudioDevice::captureFrame(SampleType *bufferOut)
+{
+    std::fill(bufferOut, bufferOut + frameSizeSamples, 0.0f);
+}
+
+void NullAudioDevice::playbackFrame(const SampleType *bufferIn)
+{
+}
+
+void NullAudioDevice::run()
+{
+    typedef std::chrono::steady_clock clock;
+    const auto framePeriod = std::chrono::milliseconds(frameLengthMs);
+
+    util::tuneCurrentThread(mRealtimeOptions);
+
+    auto deadline = clock::now() + framePeriod;
+    while (mRunning.load()) {
+        std::this_thread::sleep_until(deadline);
+
+        if (mOutputOpen.load()) {
+            if (mOutputMonitor.begin(frameSizeSamples)) {
+                OutputUnderflows.fetch_add(1, std::memory_order_relaxed);
+            }
+            {
+                util::RealtimeScope rtScope;
+                util::PublishedPtr<ISampleSource>::ReadGuard source(mSource);
+                bool haveFrame = false;
+                if (source) {
+                    haveFrame = source->getAudioFrame(mOutputFrame.data()) == SourceStatus::OK;
+                    if (!haveFrame) {
+                        source.detach();
+                    }
+                }
+                if (!haveFrame) {
+                    std::fill(mOutputFrame.begin(), mOutputFrame.end(), 0.0f);
+                }
+            }
+            mOutputMonitor.end();
+            playbackFrame(mOutputFrame.data());
+        }
+
+        if (mInputOpen.load()) {
+            if (mInputMonitor.begin(frameSizeSamples)) {
+                InputOverflows.fetch_add(1, std::memory_order_relaxed);
+            }
+            captureFrame(mInputFrame.data());
+            {
+                util::RealtimeScope rtScope;
+                util::PublishedPtr<ISampleSink>::ReadGuard sink(mSink);
+                if (sink) {
+                    sink->putAudioFrame(mInputFrame.data());
+                }
+            }
+            mInputMonitor.end();
+        }
+
+        deadline += framePeriod;
+        const auto now = clock::now();
+        if (now - deadline > framePeriod * maxFramesBehind) {
+            LOG("NullAudioDevice", "%s: fell behind, resynchronising", mUserStreamName.c_str());
+            deadline = now + framePeriod;
+        }
+    }
+}
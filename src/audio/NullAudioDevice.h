@@ -0,0 +1,91 @@
+/* audio/NullAudioDevice.h
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFV_NATIVE_NULLAUDIODEVICE_H
+#define AFV_NATIVE_NULLAUDIODEVICE_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "afv-native/audio/AudioDevice.h"
+
+namespace afv_native {
+    namespace audio {
+        /** NullAudioDevice is a device with no hardware behind it.
+         *
+         * A thread paced by the monotonic clock pulls a frame from the source and
+         * pushes a frame of silence to the sink every frameLengthMs, exactly as a sound
+         * card would, so the Client can run on hosts with no audio at all.
+         *
+         * Subclasses can override captureFrame() and playbackFrame() to supply input
+         * and consume output.
+         */
+        class NullAudioDevice: public AudioDevice {
+        public:
+            NullAudioDevice(const std::string &userStreamName, bool splitChannels);
+            virtual ~NullAudioDevice();
+
+            bool openOutput() override;
+            bool openInput() override;
+            void close() override;
+
+        protected:
+            /** captureFrame fills bufferOut with the next frameSizeSamples of input. */
+            virtual void captureFrame(SampleType *bufferOut);
+            /** playbackFrame takes a frame of output - frameSizeSamples samples of
+             * mOutputChannels interleaved channels. */
+            virtual void playbackFrame(const SampleType *bufferIn);
+
+            const std::string mUserStreamName;
+            const unsigned int mOutputChannels;
+
+        private:
+            void startThread();
+            void run();
+
+            std::atomic<bool> mOutputOpen;
+            std::atomic<bool> mInputOpen;
+            std::atomic<bool> mRunning;
+            std::mutex mThreadLock;
+            std::thread mThread;
+
+            std::vector<SampleType> mOutputFrame;
+            std::vector<SampleType> mInputFrame;
+        };
+    }
+}
+
+#endif //AFV_NATIVE_NULLAUDIODEVICE_H
@@ -80,3 +80,14 @@ bool RecordedSampleSource::isPlaying() const
 {
     return mPlay;
 }
+
+void RecordedSampleSource::rewind()
+{
+    mCurPosition = 0;
+    mPlay = true;
+}
+
+void RecordedSampleSource::stop()
+{
+    mPlay = false;
+}
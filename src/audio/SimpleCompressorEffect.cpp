@@ -5,30 +5,27 @@ using namespace afv_native::audio;
 SimpleCompressorEffect::SimpleCompressorEffect()
 {
     sf_defaultcomp(&m_simpleCompressor, sampleRateHz);
+    m_inputSound = sf_snd_new(frameSizeSamples, sampleRateHz, true);
+    m_outputSound = sf_snd_new(frameSizeSamples, sampleRateHz, true);
 }
 
 SimpleCompressorEffect::~SimpleCompressorEffect()
 {
-
+    sf_snd_free(m_inputSound);
+    sf_snd_free(m_outputSound);
 }
 
 void SimpleCompressorEffect::transformFrame(SampleType *bufferOut, const SampleType bufferIn[])
 {
-    sf_snd output_snd = sf_snd_new(frameSizeSamples, sampleRateHz, true);
-    sf_snd input_snd = sf_snd_new(frameSizeSamples, sampleRateHz, true);
-
     for(int i = 0; i < frameSizeSamples; i++)
     {
-        input_snd->samples[i].L = bufferIn[i];
+        m_inputSound->samples[i].L = bufferIn[i];
     }
 
-    sf_compressor_process(&m_simpleCompressor, frameSizeSamples, input_snd->samples, output_snd->samples);
+    sf_compressor_process(&m_simpleCompressor, frameSizeSamples, m_inputSound->samples, m_outputSound->samples);
 
     for(int i = 0; i < frameSizeSamples; i++)
     {
-        bufferOut[i] = static_cast<SampleType>(output_snd->samples[i].L);
+        bufferOut[i] = static_cast<SampleType>(m_outputSound->samples[i].L);
     }
-
-    sf_snd_free(input_snd);
-    sf_snd_free(output_snd);
 }
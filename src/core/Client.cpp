@@ -42,16 +42,31 @@
 
 using namespace afv_native;
 
+static std::unique_ptr<event::EventLoopThread> makeVoiceLoop(bool dedicatedVoiceThread)
+{
+    if (!dedicatedVoiceThread) {
+        return nullptr;
+    }
+    auto voiceLoop = std::make_unique<event::EventLoopThread>("voice");
+    if (!voiceLoop->start()) {
+        LOG("Client", "unable to start dedicated voice thread - falling back to the main event loop");
+        return nullptr;
+    }
+    return voiceLoop;
+}
+
 Client::Client(
         struct event_base *evBase,
         unsigned int numRadios,
         const std::string &clientName,
-        std::string baseUrl):
+        std::string baseUrl,
+        bool dedicatedVoiceThread):
         mFxRes(std::make_shared<afv::EffectResources>()),
         mEvBase(evBase),
         mTransferManager(mEvBase),
         mAPISession(mEvBase, mTransferManager, std::move(baseUrl), clientName),
-        mVoiceSession(mAPISession),
+        mVoiceLoop(makeVoiceLoop(dedicatedVoiceThread)),
+        mVoiceSession(mAPISession, "", mVoiceLoop ? mVoiceLoop->getEventBase() : nullptr),
         mRadioSim(std::make_shared<afv::RadioSimulation>(mEvBase, mFxRes, &mVoiceSession.getUDPChannel(), numRadios)),
         mSpeakerDevice(),
         mHeadsetDevice(),
@@ -62,19 +77,39 @@ Client::Client(
         mRadioState(2),
         mCallsign(),
         mTxUpdatePending(false),
+        mTxUpdateSentTime(0),
+        mInFlightFreqs(),
         mWantPtt(false),
         mPtt(false),
+        mOptimisticPtt(false),
+        mLastRetuneTime(0),
+        mPttRequestTime(0),
+        mPttOpenTime(0),
+        mPttGuardDelay(),
+        mRetuneToPtt(),
+        mTransceiverUpdateRtt(),
+        mAudioRunning(false),
+        mConnectStartTime(0),
+        mConnectTimeline(),
         mTransceiverUpdateTimer(mEvBase, std::bind(&Client::sendTransceiverUpdate, this)),
+        mMainLoopLag(mEvBase),
+        mCaptureReplay(),
         mClientName(clientName),
         mAudioApi(0),
         mAudioInputDeviceName(),
         mSpeakerDeviceName(),
         mHeadsetDeviceName(),
         mSplitAudioChannels(false),
+        mAudioPeriodMs(audio::defaultDevicePeriodMs),
+        mAudioDuplex(false),
+        mAudioSharedClock(false),
+        mAudioRealtimeOptions(),
+        mSpeakerBridge(),
         ClientEventCallback()
 {
     mAPISession.StateCallback.addCallback(this, std::bind(&Client::sessionStateCallback, this, std::placeholders::_1));
     mAPISession.AliasUpdateCallback.addCallback(this, std::bind(&Client::aliasUpdateCallback, this));
+    mAPISession.AliasCurrentCallback.addCallback(this, std::bind(&Client::aliasCurrentCallback, this));
     mVoiceSession.StateCallback.addCallback(this, std::bind(&Client::voiceStateCallback, this, std::placeholders::_1));
     // forcibly synchronise the RadioSim state.
     mRadioSim->setTxRadio(0);
@@ -82,6 +117,10 @@ Client::Client(
         mRadioSim->setFrequency(i, mRadioState[i].mNextFreq);
     }
     mRadioSim->setupDevices(&ClientEventCallback);
+    for (auto &phaseMs: mConnectTimeline.PhaseMs) {
+        phaseMs = -1;
+    }
+    mMainLoopLag.start();
 }
 
 Client::~Client()
@@ -89,11 +128,13 @@ Client::~Client()
     mVoiceSession.StateCallback.removeCallback(this);
     mAPISession.StateCallback.removeCallback(this);
     mAPISession.AliasUpdateCallback.removeCallback(this);
+    mAPISession.AliasCurrentCallback.removeCallback(this);
 
     // disconnect the radiosim from the UDP channel so if it's held open by the
     // audio device, it doesn't crash the client.
     mRadioSim->setPtt(false);
     mRadioSim->setUDPChannel(nullptr);
+    mMainLoopLag.stop();
 }
 
 void Client::setClientPosition(double lat, double lon, double amslm, double aglm)
@@ -114,9 +155,12 @@ void Client::setRadioState(unsigned int radioNum, int freq)
         return;
     }
     mRadioState[radioNum].mNextFreq = freq;
+    mLastRetuneTime = util::monotime_get();
     // pass down so we get inbound filtering.
     mRadioSim->setFrequency(radioNum, freq);
-    if (mRadioState[radioNum].mCurrentFreq != freq) {
+    // the pending update may carry a frequency we've since tuned away from, so
+    // compare against that too.
+    if (mRadioState[radioNum].mCurrentFreq != freq || mTxUpdatePending) {
         queueTransceiverUpdate();
     }
 }
@@ -128,17 +172,52 @@ void Client::setTxRadio(unsigned int radioNum)
 
 bool Client::connect()
 {
+    if (!isAPIConnected() && mAPISession.getState() != afv::APISessionState::Disconnected) {
+        return false;
+    }
+    mConnectStartTime = util::monotime_get();
+    for (auto &phaseMs: mConnectTimeline.PhaseMs) {
+        phaseMs = -1;
+    }
+    markConnectPhase(ConnectPhase::Started);
+
     if (!isAPIConnected()) {
-        if (mAPISession.getState() != afv::APISessionState::Disconnected) {
-            return false;
-        }
         mAPISession.Connect();
     } else {
         mVoiceSession.Connect();
     }
+    // open the audio devices while we wait on the API server, rather than after.
+    if (!mAudioRunning) {
+        startAudio();
+    }
     return true;
 }
 
+void Client::markConnectPhase(ConnectPhase phase)
+{
+    auto &phaseMs = mConnectTimeline.PhaseMs[static_cast<unsigned>(phase)];
+    if (mConnectStartTime == 0 || phaseMs >= 0) {
+        return;
+    }
+    phaseMs = util::monotime_get() - mConnectStartTime;
+    LOG("afv::Client", "connect phase %u completed at %lldms", static_cast<unsigned>(phase), static_cast<long long>(phaseMs));
+    ClientEventCallback.invokeAll(ClientEventType::ConnectPhaseCompleted, &phase, &phaseMs);
+
+    if (phase != ConnectPhase::Ready) {
+        const auto &timeline = mConnectTimeline.PhaseMs;
+        if (timeline[static_cast<unsigned>(ConnectPhase::VoiceSessionEstablished)] >= 0 &&
+            timeline[static_cast<unsigned>(ConnectPhase::AudioStarted)] >= 0 &&
+            timeline[static_cast<unsigned>(ConnectPhase::TransceiversSynced)] >= 0) {
+            markConnectPhase(ConnectPhase::Ready);
+        }
+    }
+}
+
+ConnectTimeline Client::getConnectTimeline() const
+{
+    return mConnectTimeline;
+}
+
 void Client::disconnect()
 {
     // voicesession must come first.
@@ -176,10 +255,28 @@ void Client::voiceStateCallback(afv::VoiceSessionState state)
     switch (state) {
     case afv::VoiceSessionState::Connected:
         LOG("afv::Client", "Voice Session Connected");
-        startAudio();
-        queueTransceiverUpdate();
+        markConnectPhase(ConnectPhase::VoiceSessionEstablished);
+        // the audio devices were opened (or failed to open, and said so) by
+        // connect() - don't try again here and raise a second AudioError.
+        queueTransceiverUpdate(true);
         ClientEventCallback.invokeAll(ClientEventType::VoiceServerConnected, nullptr, nullptr);
         break;
+    case afv::VoiceSessionState::Resuming:
+        // keep the audio devices and radio state - only the server session is being
+        // replaced.  The new session has to be told about our transceivers again, so
+        // treat them as unsynchronised until it has been.
+        LOG("afv::Client", "Voice Session Resuming");
+        stopTransceiverUpdate();
+        for (auto &radio: mRadioState) {
+            radio.mCurrentFreq = 0;
+        }
+        ClientEventCallback.invokeAll(ClientEventType::VoiceServerResuming, nullptr, nullptr);
+        break;
+    case afv::VoiceSessionState::Resumed:
+        LOG("afv::Client", "Voice Session Resumed");
+        queueTransceiverUpdate(true);
+        ClientEventCallback.invokeAll(ClientEventType::VoiceServerResumed, nullptr, nullptr);
+        break;
     case afv::VoiceSessionState::Disconnected:
         LOG("afv::Client", "Voice Session Disconnected");
         stopAudio();
@@ -216,6 +313,7 @@ void Client::sessionStateCallback(afv::APISessionState state)
         break;
     case afv::APISessionState::Running:
         LOG("afv_native::Client", "Connected to AFV API Server");
+        markConnectPhase(ConnectPhase::Authenticated);
         if (!isVoiceConnected()) {
             mVoiceSession.setCallsign(mCallsign);
             mVoiceSession.Connect();
@@ -227,10 +325,17 @@ void Client::sessionStateCallback(afv::APISessionState state)
         LOG("afv_native::Client", "Disconnected from AFV API Server.  Terminating sessions");
         // because we only ever commence a normal API Session teardown from a voicesession hook,
         // we don't need to call into voiceSession in this case only.
+        // we may have opened the audio devices ahead of a voice session that never came up.
+        if (!isVoiceConnected()) {
+            stopAudio();
+        }
         ClientEventCallback.invokeAll(ClientEventType::APIServerDisconnected, nullptr, nullptr);
         break;
     case afv::APISessionState::Error:
         LOG("afv_native::Client", "Got error from AFV API Server.  Disconnecting session");
+        if (!isVoiceConnected()) {
+            stopAudio();
+        }
         sessionError = mAPISession.getLastError();
         ClientEventCallback.invokeAll(ClientEventType::APIServerError, &sessionError, nullptr);
         break;
@@ -272,9 +377,26 @@ void Client::startAudio()
         LOG("afv::Client", "Speaker device already exists, skipping creation.");
     }
 
+    // on a shared clock (always the case in duplex mode) both buses are rendered in
+    // one pass on the headset's clock, and the speaker's half is handed across to the
+    // speaker device through the bridge.
+    if(mAudioDuplex || mAudioSharedClock) {
+        std::atomic_store(&mSpeakerBridge, std::make_shared<audio::ClockBridge>(mSplitAudioChannels ? 2 : 1));
+    }
+    else {
+        std::atomic_store(&mSpeakerBridge, std::shared_ptr<audio::ClockBridge>());
+    }
+
+    mSpeakerDevice->setPeriodMs(mAudioPeriodMs);
+    mSpeakerDevice->setRealtimeOptions(mAudioRealtimeOptions);
     if(mSpeakerDevice->openOutput()) {
         mSpeakerDevice->setSink(nullptr);
-        mSpeakerDevice->setSource(mRadioSim->speakerDevice());
+        if(mSpeakerBridge) {
+            mSpeakerDevice->setSource(mSpeakerBridge);
+        }
+        else {
+            mSpeakerDevice->setSource(mRadioSim->speakerDevice());
+        }
     }
     else {
         const char* error = "Audio Error: Could not open speaker audio device. Please check the xPilot audio settings and try again.";
@@ -303,10 +425,21 @@ void Client::startAudio()
        LOG("afv::Client", "Headset device already exists, skipping creation.");
     }
 
+    mHeadsetDevice->setPeriodMs(mAudioPeriodMs);
+    mHeadsetDevice->setDuplex(mAudioDuplex);
+    mHeadsetDevice->setRealtimeOptions(mAudioRealtimeOptions);
     if(mHeadsetDevice->openOutput()) {
        if(mHeadsetDevice->openInput()) {
             mHeadsetDevice->setSink(mRadioSim);
-            mHeadsetDevice->setSource(mRadioSim->headsetDevice());
+            if(mSpeakerBridge) {
+                mHeadsetDevice->setSource(std::make_shared<afv::SharedClockOutput>(mRadioSim.get(), mSpeakerBridge));
+            }
+            else {
+                mHeadsetDevice->setSource(mRadioSim->headsetDevice());
+            }
+            LOG("afv::Client", "Headset audio started (%s)", mHeadsetDevice->isDuplexOpen() ? "duplex" : "separate devices");
+            mAudioRunning = true;
+            markConnectPhase(ConnectPhase::AudioStarted);
        }
        else {
             const char* error = "Audio Error: Could not initialize microphone device.";
@@ -325,6 +458,7 @@ void Client::startAudio()
 
 void Client::stopAudio()
 {
+    mAudioRunning = false;
     if (mSpeakerDevice) {
         mSpeakerDevice->close();
         mSpeakerDevice.reset();
@@ -334,6 +468,7 @@ void Client::stopAudio()
         mHeadsetDevice->close();
         mHeadsetDevice.reset();
     }
+    std::atomic_store(&mSpeakerBridge, std::shared_ptr<audio::ClockBridge>());
 }
 
 std::vector<afv::dto::Transceiver> Client::makeTransceiverDto()
@@ -353,36 +488,62 @@ void Client::sendTransceiverUpdate()
     if (!isAPIConnected() || !isVoiceConnected()) {
         return;
     }
+    const auto now = util::monotime_get();
+    if (isInFlightUpdateCurrent() && (now - mTxUpdateSentTime) < afv::afvTransciverUpdateIntervalMs) {
+        // the pending update already carries what we want - don't restart it.
+        mTransceiverUpdateTimer.enable(afv::afvTransciverUpdateIntervalMs);
+        return;
+    }
     auto transceiverDto = makeTransceiverDto();
     mTxUpdatePending = true;
+    mTxUpdateSentTime = now;
+    mInFlightFreqs.clear();
+    for (const auto &tx: transceiverDto) {
+        mInFlightFreqs.push_back(tx.Frequency);
+    }
 
     /* ok - magic!
      *
      * so, in order to ensure that we flip the radio states to the CORRECT ONE
      * when the callback fires, we copy capture the update message itself (which is
      * all value copies) and use that to do the internal state update.
+     *
+     * postTransceiverUpdate cancels any update still in flight, so the latest state
+     * always wins and we never wait on a stale update.
     */
     mVoiceSession.postTransceiverUpdate(
             transceiverDto,
             [this, transceiverDto](http::Request *r, bool success) {
+                this->mTxUpdatePending = false;
                 if (success && r->getStatusCode() == 200) {
                     for (unsigned i = 0; i < this->mRadioState.size(); i++) {
                         this->mRadioState[i].mCurrentFreq = transceiverDto[i].Frequency;
                     }
-                    this->mTxUpdatePending = false;
+                    this->mTransceiverUpdateRtt.record(r->getTiming().TotalUs / 1000);
+                    this->markConnectPhase(ConnectPhase::TransceiversSynced);
+                    if (!this->areTransceiversSynced()) {
+                        this->queueTransceiverUpdate(true);
+                    }
                     this->unguardPtt();
+                } else {
+                    LOG("Client", "transceiver update failed - retrying");
+                    this->mTransceiverUpdateTimer.enable(afv::afvTransceiverUpdateRetryMs);
                 }
             });
     mTransceiverUpdateTimer.enable(afv::afvTransciverUpdateIntervalMs);
 }
 
-void Client::queueTransceiverUpdate()
+void Client::queueTransceiverUpdate(bool urgent)
 {
     mTransceiverUpdateTimer.disable();
     if (!isAPIConnected() || !isVoiceConnected()) {
         return;
     }
-    mTransceiverUpdateTimer.enable(0);
+    if (urgent || (mWantPtt && !mPtt)) {
+        mTransceiverUpdateTimer.enable(0);
+    } else {
+        mTransceiverUpdateTimer.enable(afv::afvTransceiverUpdateCoalesceMs);
+    }
 }
 
 
@@ -391,45 +552,87 @@ void Client::unguardPtt()
     if (mWantPtt && !mPtt) {
         LOG("Client", "PTT was guarded - checking.");
         if (!areTransceiversSynced()) {
-            LOG("Client", "Freqs still unsync'd.  Restarting update.");
-            queueTransceiverUpdate();
+            if (!isInFlightUpdateCurrent()) {
+                LOG("Client", "Freqs still unsync'd.  Restarting update.");
+                queueTransceiverUpdate(true);
+            }
             return;
         }
         LOG("Client", "Freqs in sync - allowing PTT now.");
-        mPtt = true;
-        mRadioSim->setPtt(true);
-        ClientEventCallback.invokeAll(ClientEventType::PttOpen, nullptr, nullptr);
+        openPtt();
     }
 }
 
+void Client::openPtt()
+{
+    const auto now = util::monotime_get();
+    mPtt = true;
+    mRadioSim->setPtt(true);
+    mPttGuardDelay.record(now - mPttRequestTime);
+    if (mLastRetuneTime > mPttOpenTime) {
+        mRetuneToPtt.record(now - mLastRetuneTime);
+    }
+    mPttOpenTime = now;
+    ClientEventCallback.invokeAll(ClientEventType::PttOpen, nullptr, nullptr);
+}
+
 void Client::setPtt(bool pttState)
 {
     if (pttState) {
+        if (!mWantPtt) {
+            mPttRequestTime = util::monotime_get();
+        }
         mWantPtt = true;
-        // if we're setting the Ptt, we have to check a few things.
-        // if we're still pending an update, and the radios are out of step, guard the Ptt.
-        if (!areTransceiversSynced() || mTxUpdatePending) {
-            if (!mTxUpdatePending) {
+        if (mPtt) {
+            return;
+        }
+        // if the server hasn't acknowledged our current frequencies yet, make sure an
+        // update is on its way, and (unless we're optimistic) guard the Ptt until it is.
+        if (!areTransceiversSynced()) {
+            if (!isInFlightUpdateCurrent()) {
+                queueTransceiverUpdate(true);
+            }
+            if (!mOptimisticPtt) {
                 LOG("Client", "Wanted to Open PTT mid-update - guarding");
-                queueTransceiverUpdate();
+                return;
             }
-            return;
+            LOG("Client", "Opening PTT ahead of transceiver update");
         }
-    } else {
-        mWantPtt = false;
+        LOG("Client", "Opened PTT");
+        openPtt();
+        return;
     }
-    if (mWantPtt == mPtt) {
+    mWantPtt = false;
+    if (!mPtt) {
         return;
     }
-    mPtt = mWantPtt;
-    mRadioSim->setPtt(mPtt);
-    if (mPtt) {
-        LOG("Client", "Opened PTT");
-        ClientEventCallback.invokeAll(ClientEventType::PttOpen, nullptr, nullptr);
-    } else if (!mWantPtt) {
-        LOG("Client", "Closed PTT");
-        ClientEventCallback.invokeAll(ClientEventType::PttClosed, nullptr, nullptr);
+    mPtt = false;
+    mRadioSim->setPtt(false);
+    LOG("Client", "Closed PTT");
+    ClientEventCallback.invokeAll(ClientEventType::PttClosed, nullptr, nullptr);
+}
+
+void Client::setOptimisticPtt(bool optimistic)
+{
+    mOptimisticPtt = optimistic;
+}
+
+bool Client::getOptimisticPtt() const
+{
+    return mOptimisticPtt;
+}
+
+bool Client::isInFlightUpdateCurrent() const
+{
+    if (!mTxUpdatePending || mInFlightFreqs.size() != mRadioState.size()) {
+        return false;
     }
+    for (size_t i = 0; i < mRadioState.size(); i++) {
+        if (mInFlightFreqs[i] != mRadioState[i].mNextFreq) {
+            return false;
+        }
+    }
+    return true;
 }
 
 bool Client::areTransceiversSynced() const
@@ -474,6 +677,8 @@ void Client::setBaseUrl(std::string newUrl)
 void Client::stopTransceiverUpdate()
 {
     mTransceiverUpdateTimer.disable();
+    mTxUpdatePending = false;
+    mInFlightFreqs.clear();
 }
 
 void Client::setAudioApi(audio::AudioDevice::Api api)
@@ -541,16 +746,60 @@ void Client::setSplitAudioChannels(bool split)
     mRadioSim->setSplitAudioChannels(split);
 }
 
+void Client::setAudioPeriodMs(unsigned int periodMs)
+{
+    mAudioPeriodMs = periodMs;
+}
+
+void Client::setAudioDuplex(bool duplex)
+{
+    mAudioDuplex = duplex;
+}
+
+void Client::setAudioSharedClock(bool sharedClock)
+{
+    mAudioSharedClock = sharedClock;
+}
+
+void Client::setAudioRealtimeOptions(const util::RealtimeOptions &options)
+{
+    mAudioRealtimeOptions = options;
+}
+
+int Client::getSpeakerClockCorrectionPpm() const
+{
+    auto bridge = std::atomic_load(&mSpeakerBridge);
+    return bridge ? bridge->getCorrectionPpm() : 0;
+}
+
 void Client::aliasUpdateCallback()
 {
+    markConnectPhase(ConnectPhase::StationAliasesLoaded);
     ClientEventCallback.invokeAll(ClientEventType::StationAliasesUpdated, nullptr, nullptr);
 }
 
+void Client::aliasCurrentCallback()
+{
+    // the cached aliases are still good - nothing changed for the client to
+    // reload, but they're as loaded as they're going to get.
+    markConnectPhase(ConnectPhase::StationAliasesLoaded);
+}
+
 std::vector<afv::dto::Station> Client::getStationAliases() const
 {
     return std::move(mAPISession.getStationAliases());
 }
 
+std::shared_ptr<const afv::StationAliases> Client::getStationAliasIndex() const
+{
+    return mAPISession.getStationAliasIndex();
+}
+
+void Client::setStationAliasCachePath(const std::string &path)
+{
+    mAPISession.setStationAliasCachePath(path);
+}
+
 std::shared_ptr<const afv::RadioSimulation> Client::getRadioSimulation() const {
     return mRadioSim;
 }
@@ -576,3 +825,89 @@ bool Client::getTxActive(unsigned int radioNumber) {
     }
     return false;
 }
+
+event::LoopLagStats Client::getMainLoopLag() const
+{
+    return mMainLoopLag.getStats();
+}
+
+event::LoopLagStats Client::getVoiceLoopLag() const
+{
+    if (mVoiceLoop) {
+        return mVoiceLoop->getLagStats();
+    }
+    return mMainLoopLag.getStats();
+}
+
+cryptodto::ChannelStats Client::getVoiceChannelStats() const
+{
+    return mVoiceSession.getUDPChannel().getStats();
+}
+
+int64_t Client::getHeartbeatRttMs() const
+{
+    return mVoiceSession.HeartbeatRttMs.load();
+}
+
+util::HistogramSnapshot Client::getHeartbeatRttHistogram() const
+{
+    return mVoiceSession.HeartbeatRtt.snapshot();
+}
+
+util::HistogramSnapshot Client::getPttGuardDelayHistogram() const
+{
+    return mPttGuardDelay.snapshot();
+}
+
+util::HistogramSnapshot Client::getRetuneToPttHistogram() const
+{
+    return mRetuneToPtt.snapshot();
+}
+
+util::HistogramSnapshot Client::getTransceiverUpdateRttHistogram() const
+{
+    return mTransceiverUpdateRtt.snapshot();
+}
+
+std::shared_ptr<const afv::StreamStatsList> Client::getStreamStats() const
+{
+    return mRadioSim->getStreamStats();
+}
+
+void Client::setVoiceSocketOptions(const cryptodto::UDPSocketOptions &options)
+{
+    mVoiceSession.getUDPChannel().setSocketOptions(options);
+}
+
+bool Client::startVoiceCapture(const std::string &path)
+{
+    auto capture = std::make_shared<cryptodto::CaptureWriter>();
+    if (!capture->open(path)) {
+        return false;
+    }
+    mVoiceSession.getUDPChannel().setCapture(std::move(capture));
+    return true;
+}
+
+void Client::stopVoiceCapture()
+{
+    mVoiceSession.getUDPChannel().setCapture(nullptr);
+}
+
+bool Client::replayVoiceCapture(const std::string &path, bool originalTiming)
+{
+    if (!mCaptureReplay) {
+        mCaptureReplay = std::unique_ptr<afv::CaptureReplay>(new afv::CaptureReplay(mEvBase, *mRadioSim));
+    }
+    if (!mCaptureReplay->open(path)) {
+        return false;
+    }
+    return mCaptureReplay->start(originalTiming);
+}
+
+void Client::stopVoiceCaptureReplay()
+{
+    if (mCaptureReplay) {
+        mCaptureReplay->stop();
+    }
+}
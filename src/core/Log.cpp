@@ -32,6 +32,7 @@
 */
 
 #include "afv-native/Log.h"
+#include "afv-native/util/RealtimeCheck.h"
 
 #include <cstdarg>
 #include <ctime>
@@ -79,6 +80,7 @@ static void* reference = nullptr;
 
 void afv_native::__Log(const char *file, int line, const char *subsystem, const char *format, ...)
 {
+    AFV_RT_CHECK("LOG");
     if (gLogger == nullptr) {
         return;
     }
@@ -0,0 +1,259 @@
+/* cryptodto/CaptureFile.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/cryptodto/CaptureFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "afv-native/Log.h"
+#include "afv-native/util/monotime.h"
+
+using namespace afv_native::cryptodto;
+using namespace afv_native;
+
+static size_t captureRecordSize(size_t nameLen, size_t dtoLen)
+{
+    const size_t len = sizeof(CaptureRecordHeader) + nameLen + dtoLen;
+    return (len + captureRecordAlignment - 1) & ~(captureRecordAlignment - 1);
+}
+
+CaptureWriter::CaptureWriter():
+        mLock(),
+        mFile(nullptr),
+        mStartUs(0)
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+bool CaptureWriter::open(const std::string &path)
+{
+    std::lock_guard<std::mutex> fileGuard(mLock);
+    if (mFile != nullptr) {
+        fclose(mFile);
+    }
+    mFile = fopen(path.c_str(), "wb");
+    if (mFile == nullptr) {
+        LOG("capturewriter", "couldn't open %s for writing", path.c_str());
+        return false;
+    }
+    CaptureFileHeader header;
+    ::memcpy(header.Magic, captureFileMagic, sizeof(header.Magic));
+    header.Version = captureFileVersion;
+    header.Reserved = 0;
+    fwrite(&header, sizeof(header), 1, mFile);
+    mStartUs = util::monotime_get_us();
+    return true;
+}
+
+void CaptureWriter::close()
+{
+    std::lock_guard<std::mutex> fileGuard(mLock);
+    if (mFile != nullptr) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+bool CaptureWriter::isOpen() const
+{
+    return mFile != nullptr;
+}
+
+void CaptureWriter::record(
+        int64_t arrivalUs,
+        sequence_t sequence,
+        const char *dtoName,
+        size_t dtoNameLen,
+        const unsigned char *dto,
+        size_t dtoLen)
+{
+    static const unsigned char padding[captureRecordAlignment] = {0};
+
+    std::lock_guard<std::mutex> fileGuard(mLock);
+    if (mFile == nullptr) {
+        return;
+    }
+    CaptureRecordHeader recHeader;
+    recHeader.TimestampUs = static_cast<uint64_t>(std::max<int64_t>(0, arrivalUs - mStartUs));
+    recHeader.Sequence = sequence;
+    recHeader.DtoLen = static_cast<uint32_t>(dtoLen);
+    recHeader.NameLen = static_cast<uint16_t>(dtoNameLen);
+    recHeader.Reserved = 0;
+    fwrite(&recHeader, sizeof(recHeader), 1, mFile);
+    fwrite(dtoName, 1, dtoNameLen, mFile);
+    fwrite(dto, 1, dtoLen, mFile);
+    const size_t padLen = captureRecordSize(dtoNameLen, dtoLen) - (sizeof(recHeader) + dtoNameLen + dtoLen);
+    if (padLen > 0) {
+        fwrite(padding, 1, padLen, mFile);
+    }
+}
+
+CaptureReader::CaptureReader():
+        mData(nullptr),
+        mSize(0),
+        mOffset(0)
+#ifdef _WIN32
+        , mFileHandle(INVALID_HANDLE_VALUE),
+        mMappingHandle(nullptr)
+#endif
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+    close();
+}
+
+bool CaptureReader::open(const std::string &path)
+{
+    close();
+#ifdef _WIN32
+    mFileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mFileHandle == INVALID_HANDLE_VALUE) {
+        LOG("capturereader", "couldn't open %s", path.c_str());
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(mFileHandle, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(CaptureFileHeader))) {
+        LOG("capturereader", "%s is too short to be a capture", path.c_str());
+        close();
+        return false;
+    }
+    mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMappingHandle == nullptr) {
+        close();
+        return false;
+    }
+    mData = reinterpret_cast<const unsigned char *>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (mData == nullptr) {
+        close();
+        return false;
+    }
+    mSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG("capturereader", "couldn't open %s", path.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CaptureFileHeader))) {
+        LOG("capturereader", "%s is too short to be a capture", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG("capturereader", "couldn't map %s", path.c_str());
+        return false;
+    }
+    madvise(mapping, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    mData = reinterpret_cast<const unsigned char *>(mapping);
+    mSize = static_cast<size_t>(st.st_size);
+#endif
+    CaptureFileHeader header;
+    ::memcpy(&header, mData, sizeof(header));
+    if (::memcmp(header.Magic, captureFileMagic, sizeof(header.Magic)) != 0 || header.Version != captureFileVersion) {
+        LOG("capturereader", "%s is not a version %u capture", path.c_str(), captureFileVersion);
+        close();
+        return false;
+    }
+    rewind();
+    return true;
+}
+
+void CaptureReader::close()
+{
+#ifdef _WIN32
+    if (mData != nullptr) {
+        UnmapViewOfFile(mData);
+    }
+    if (mMappingHandle != nullptr) {
+        CloseHandle(mMappingHandle);
+        mMappingHandle = nullptr;
+    }
+    if (mFileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(mFileHandle);
+        mFileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mData != nullptr) {
+        munmap(const_cast<unsigned char *>(mData), mSize);
+    }
+#endif
+    mData = nullptr;
+    mSize = 0;
+    mOffset = 0;
+}
+
+void CaptureReader::rewind()
+{
+    mOffset = sizeof(CaptureFileHeader);
+}
+
+bool CaptureReader::next(CaptureRecord &recordOut)
+{
+    if (mData == nullptr || (mSize - mOffset) < sizeof(CaptureRecordHeader)) {
+        return false;
+    }
+    // records are aligned, so the header can be read straight out of the mapping.
+    const auto *recHeader = reinterpret_cast<const CaptureRecordHeader *>(mData + mOffset);
+    const size_t recSize = captureRecordSize(recHeader->NameLen, recHeader->DtoLen);
+    if ((mSize - mOffset) < (sizeof(CaptureRecordHeader) + recHeader->NameLen + recHeader->DtoLen)) {
+        // a capture that was cut short while being written.
+        return false;
+    }
+    recordOut.TimestampUs = recHeader->TimestampUs;
+    recordOut.Sequence = recHeader->Sequence;
+    recordOut.Name = reinterpret_cast<const char *>(mData + mOffset + sizeof(CaptureRecordHeader));
+    recordOut.NameLen = recHeader->NameLen;
+    recordOut.Dto = mData + mOffset + sizeof(CaptureRecordHeader) + recHeader->NameLen;
+    recordOut.DtoLen = recHeader->DtoLen;
+    mOffset += std::min(recSize, mSize - mOffset);
+    return true;
+}
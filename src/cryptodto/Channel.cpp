@@ -33,22 +33,75 @@
 
 #include "afv-native/cryptodto/Channel.h"
 
+#include <cassert>
 #include <ctime>
 #include <cstring>
 #include <string>
 #include <openssl/rand.h>
 
-#include "afv-native/cryptodto/dto/Header.h"
 #include "afv-native/cryptodto/dto/ChannelConfig.h"
+#include "afv-native/util/MsgpackReader.h"
 
 using namespace afv_native::cryptodto;
 using namespace std;
 
+// the part of the header following the cached prefix: the sequence, always encoded as a
+// msgpack uint64 (marker + 8 bytes) so it can be patched in place, and the mode as a
+// positive fixint.
+static const size_t headerTrailerSize = 1 + 8 + 1;
+
 Channel::Channel():
+        mHeaderPrefix(),
+        mHeaderTagOffset(0),
+        mHeaderTagLen(0),
+        mTxCipherContext(nullptr),
+        mRxCipherContext(nullptr),
         ChannelTag()
 {
+    updateHeaderPrefix();
     make_aead_key(aeadTransmitKey);
     make_aead_key(aeadReceiveKey);
+
+    // bind the cipher once - per-datagram we only need to rekey and set the nonce.
+    mTxCipherContext = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(mTxCipherContext, EVP_chacha20_poly1305(), nullptr, nullptr, nullptr);
+    EVP_CIPHER_CTX_ctrl(mTxCipherContext, EVP_CTRL_AEAD_SET_IVLEN, aeadModeIVSize, nullptr);
+
+    mRxCipherContext = EVP_CIPHER_CTX_new();
+    EVP_DecryptInit_ex(mRxCipherContext, EVP_chacha20_poly1305(), nullptr, nullptr, nullptr);
+    EVP_CIPHER_CTX_ctrl(mRxCipherContext, EVP_CTRL_AEAD_SET_IVLEN, aeadModeIVSize, nullptr);
+}
+
+Channel::~Channel()
+{
+    EVP_CIPHER_CTX_free(mTxCipherContext);
+    mTxCipherContext = nullptr;
+    EVP_CIPHER_CTX_free(mRxCipherContext);
+    mRxCipherContext = nullptr;
+}
+
+void Channel::updateHeaderPrefix()
+{
+    msgpack::sbuffer prefixBuf;
+    msgpack::packer<msgpack::sbuffer> prefixPacker(prefixBuf);
+
+    // the header is a 3 element array (see dto::Header) with the tag first.
+    prefixPacker.pack_array(3);
+    prefixPacker.pack_str(static_cast<uint32_t>(ChannelTag.size()));
+    prefixPacker.pack_str_body(ChannelTag.data(), static_cast<uint32_t>(ChannelTag.size()));
+
+    mHeaderPrefix.clear();
+    const size_t headerLen = prefixBuf.size() + headerTrailerSize;
+    if (headerLen > UINT16_MAX) {
+        LOG("channel", "ChannelTag too long to encode (%d bytes)", static_cast<int>(ChannelTag.size()));
+        return;
+    }
+    const uint16_t nLen = static_cast<uint16_t>(headerLen);
+    mHeaderPrefix.resize(2 + prefixBuf.size());
+    ::memcpy(mHeaderPrefix.data(), &nLen, 2);
+    ::memcpy(mHeaderPrefix.data() + 2, prefixBuf.data(), prefixBuf.size());
+    mHeaderTagLen = ChannelTag.size();
+    mHeaderTagOffset = mHeaderPrefix.size() - mHeaderTagLen;
 }
 
 void Channel::make_aead_key(unsigned char keyBuffer[])
@@ -67,7 +120,7 @@ size_t Channel::encryptChaCha20Poly1305(
         unsigned char *cipherOut,
         const unsigned char *plainIn,
         size_t plainLen,
-        const dto::Header &header,
+        sequence_t sequence,
         const unsigned char *aadIn,
         size_t aadLen)
 {
@@ -75,52 +128,41 @@ size_t Channel::encryptChaCha20Poly1305(
     int enc_len = 0;
     unsigned char nonce[aeadModeIVSize];
 
-    makeChaCha20Poly1305Nonce(header.Sequence, nonce);
+    makeChaCha20Poly1305Nonce(sequence, nonce);
 
-    auto *cipher_context = EVP_CIPHER_CTX_new();
-    //per EVP_EncryptInit, use null keys, then set the keys later with type null.
-    if (!EVP_EncryptInit_ex(cipher_context, EVP_chacha20_poly1305(), nullptr, nullptr, nullptr)) {
-        goto abort;
-    }
-    if (!EVP_CIPHER_CTX_ctrl(cipher_context, EVP_CTRL_AEAD_SET_IVLEN, aeadModeIVSize, nullptr)) {
-        goto abort;
-    }
+    auto *cipher_context = mTxCipherContext;
+    // the cipher and IV length were bound at construction, so we only need to supply the key and nonce.
     if (!EVP_EncryptInit_ex(cipher_context, nullptr, nullptr, aeadTransmitKey, nonce)) {
-        goto abort;
+        return 0;
     }
     if (aadLen > 0) {
         if (!EVP_EncryptUpdate(cipher_context, nullptr, &enc_len, aadIn, aadLen)) {
-            goto abort;
+            return 0;
         }
     }
     if (!EVP_EncryptUpdate(cipher_context, cipherOut + cipherLen, &enc_len, plainIn, plainLen)) {
-        goto abort;
+        return 0;
     }
     cipherLen += enc_len;
     if (!EVP_EncryptFinal_ex(cipher_context, cipherOut + cipherLen, &enc_len)) {
-        goto abort;
+        return 0;
     }
     cipherLen += enc_len;
     // append the tag.
     if (!EVP_CIPHER_CTX_ctrl(cipher_context, EVP_CTRL_AEAD_GET_TAG, aeadModeTagSize, cipherOut + cipherLen)) {
-        goto abort;
+        return 0;
     }
 
     cipherLen += aeadModeTagSize;
 
-    EVP_CIPHER_CTX_free(cipher_context);
-
     return cipherLen;
-    abort:
-    EVP_CIPHER_CTX_free(cipher_context);
-    return 0;
 }
 
 size_t Channel::decryptChaCha20Poly1305(
         unsigned char *bodyOut,
         const unsigned char *cipherIn,
         size_t cipherLen,
-        const dto::Header &header,
+        sequence_t sequence,
         const unsigned char *aadIn,
         size_t aadLen)
 {
@@ -132,172 +174,213 @@ size_t Channel::decryptChaCha20Poly1305(
     size_t bodyLen = 0;
     unsigned char nonce[aeadModeIVSize];
     int dec_len = 0;
-    auto *cipher_context = EVP_CIPHER_CTX_new();
+    auto *cipher_context = mRxCipherContext;
 
-    makeChaCha20Poly1305Nonce(header.Sequence, nonce);
-    if (!EVP_DecryptInit_ex(cipher_context, EVP_chacha20_poly1305(), nullptr, nullptr, nullptr)) {
-        goto abort;
-    }
-    if (!EVP_CIPHER_CTX_ctrl(cipher_context, EVP_CTRL_AEAD_SET_IVLEN, aeadModeIVSize, nullptr)) {
-        goto abort;
-    }
+    makeChaCha20Poly1305Nonce(sequence, nonce);
+    // as with encryption, the cipher was bound at construction.
     if (!EVP_DecryptInit_ex(cipher_context, nullptr, nullptr, aeadReceiveKey, nonce)) {
-        goto abort;
+        return 0;
     }
     if (!EVP_CIPHER_CTX_ctrl(
             cipher_context, EVP_CTRL_AEAD_SET_TAG, aeadModeTagSize,
             (void *) (cipherIn + (cipherLen - aeadModeTagSize)))) {
-        goto abort;
+        return 0;
     };
     if (aadLen > 0) {
         if (!EVP_DecryptUpdate(cipher_context, nullptr, &dec_len, aadIn, aadLen)) {
-            goto abort;
+            return 0;
         }
         dec_len = 0;
     }
     if (!EVP_DecryptUpdate(cipher_context, bodyOut, &dec_len, cipherIn, cipherLen - aeadModeTagSize)) {
-        goto abort;
+        return 0;
     }
     bodyLen += dec_len;
     dec_len = 0;
     if (!EVP_DecryptFinal_ex(cipher_context, bodyOut + bodyLen, &dec_len)) {
-        goto abort;
+        return 0;
     }
     bodyLen += dec_len;
-    EVP_CIPHER_CTX_free(cipher_context);
 
     return bodyLen;
-    abort:
-    EVP_CIPHER_CTX_free(cipher_context);
-    return 0;
 }
 
-bool Channel::Decapsulate(
-        const unsigned char *cipherTextIn,
-        size_t cipherTextLen,
-        std::string &channelTag,
+DecapsulateOutcome Channel::parseHeader(
+        const unsigned char *datagram,
+        size_t datagramLen,
+        size_t &bodyOffset,
         sequence_t &sequence,
-        CryptoDtoMode &modeOut,
-        std::string &dtoNameOut,
-        msgpack::sbuffer &dtoOut)
+        CryptoDtoMode &modeOut) const
 {
-    size_t offset = 2;
-    if (cipherTextLen < 2) {
-        return false;
+    if (datagramLen < 2) {
+        return DecapsulateOutcome::Malformed;
     }
     uint16_t headerSize = 0;
-    ::memcpy(&headerSize, cipherTextIn, sizeof(headerSize));
+    ::memcpy(&headerSize, datagram, sizeof(headerSize));
+    const size_t headerEnd = 2 + static_cast<size_t>(headerSize);
+    if (headerEnd > datagramLen) {
+        return DecapsulateOutcome::Malformed;
+    }
 
-    // minimum bounds for the full message is the header size + header + dtonamesize + one byte for the dtoname.
-    if (cipherTextLen <= (2 + headerSize + 3)) {
-        return false;
+    util::MsgpackReader headerReader(datagram + 2, headerSize);
+    uint32_t arrayLen;
+    if (!headerReader.readArrayHeader(arrayLen) || arrayLen != 3) {
+        return DecapsulateOutcome::Malformed;
     }
 
-    auto headerObjHdl = msgpack::unpack(reinterpret_cast<const char *>(cipherTextIn) + offset, headerSize);
-    dto::Header header;
-    try {
-        headerObjHdl.get().convert(header);
-    } catch (const msgpack::type_error &) {
-        return false;
+    // ChannelTag - compared byte-for-byte against our cached encoding.
+    const char *tagData;
+    size_t tagLen;
+    if (!headerReader.readStr(tagData, tagLen)) {
+        return DecapsulateOutcome::Malformed;
+    }
+    if (tagLen != mHeaderTagLen ||
+        ::memcmp(tagData, mHeaderPrefix.data() + mHeaderTagOffset, tagLen) != 0) {
+        return DecapsulateOutcome::WrongTag;
     }
-    offset += headerSize;
 
-    modeOut = static_cast<cryptodto::CryptoDtoMode>(header.Mode);
+    uint64_t seqValue, modeValue;
+    if (!headerReader.readUInt(seqValue)) {
+        return DecapsulateOutcome::Malformed;
+    }
+    if (!headerReader.readUInt(modeValue) || modeValue >= CryptoModeLast) {
+        return DecapsulateOutcome::Malformed;
+    }
+    // there must be nothing left over in the header.
+    if (!headerReader.atEnd()) {
+        return DecapsulateOutcome::Malformed;
+    }
+
+    bodyOffset = headerEnd;
+    sequence = seqValue;
+    modeOut = static_cast<CryptoDtoMode>(modeValue);
+    return DecapsulateOutcome::OK;
+}
+
+DecapsulateOutcome Channel::Decapsulate(
+        unsigned char *datagram,
+        size_t datagramLen,
+        sequence_t &sequence,
+        CryptoDtoMode &modeOut,
+        const char *&dtoNameOut,
+        size_t &dtoNameLenOut,
+        const unsigned char *&dtoOut,
+        size_t &dtoLenOut)
+{
+    size_t offset = 0;
+    auto headerOutcome = parseHeader(datagram, datagramLen, offset, sequence, modeOut);
+    if (headerOutcome != DecapsulateOutcome::OK) {
+        return headerOutcome;
+    }
 
-    const size_t bodySize = cipherTextLen - offset;
-    std::vector<unsigned char> bodyOut(bodySize);
+    // minimum bounds for the body is the dtonamesize + one byte for the dtoname.
+    if ((datagramLen - offset) <= 3) {
+        return DecapsulateOutcome::Malformed;
+    }
+
+    unsigned char *body = datagram + offset;
+    const size_t bodySize = datagramLen - offset;
     size_t bodyLen = 0;
-    switch (header.Mode) {
+    switch (modeOut) {
     case CryptoModeNone:
-        ::memcpy(bodyOut.data(), cipherTextIn + offset, bodySize);
         bodyLen = bodySize;
         break;
     case CryptoModeChaCha20Poly1305:
         // make sure the message is long enough
-        if (bodySize <= 16) {
-            return false;
+        if (bodySize <= aeadModeTagSize) {
+            return DecapsulateOutcome::Malformed;
         }
-        bodyLen = decryptChaCha20Poly1305(bodyOut.data(), cipherTextIn + offset, bodySize, header, cipherTextIn, offset);
+        // decrypt over the top of the ciphertext - the header (our AAD) is left untouched.
+        bodyLen = decryptChaCha20Poly1305(body, body, bodySize, sequence, datagram, offset);
         if (bodyLen == 0) {
-            return false;
+            return DecapsulateOutcome::DecryptFailed;
         }
         break;
     default:
-        return false;
+        return DecapsulateOutcome::Malformed;
     }
 
     // now, extract the DTO name.
     uint16_t nameSize;
-    ::memcpy(&nameSize, bodyOut.data(), 2);
-    if (nameSize > bodyLen) {
-        return false;
+    ::memcpy(&nameSize, body, 2);
+    if (2 + static_cast<size_t>(nameSize) > bodyLen) {
+        return DecapsulateOutcome::Malformed;
     }
-    dtoNameOut = std::move(string(reinterpret_cast<char *>(bodyOut.data()) + 2, nameSize));
-    dtoOut.write(reinterpret_cast<char *>(bodyOut.data()) + 2 + nameSize, bodyLen - 2 - nameSize);
-
-    sequence = header.Sequence;
-    channelTag = std::move(header.ChannelTag);
-    return true;
+    dtoNameOut = reinterpret_cast<const char *>(body) + 2;
+    dtoNameLenOut = nameSize;
+    dtoOut = body + 2 + nameSize;
+    dtoLenOut = bodyLen - 2 - nameSize;
+    return DecapsulateOutcome::OK;
 }
 
-size_t Channel::Encapsulate(
-        const unsigned char *plainTextBuf,
-        size_t plainTextLen,
-        sequence_t sequence,
-        CryptoDtoMode mode,
-        unsigned char *cipherTextBufOut,
-        size_t cipherTextLen)
+bool Channel::encodeHeader(DatagramWriter &dgWriter, sequence_t sequence, CryptoDtoMode mode) const
 {
-    size_t offset = 0;
-    uint16_t nLen;
-    int enc_len;
+    assert(dgWriter.size() == 0);
+    // all of the modes encode as positive fixints.
+    assert(static_cast<unsigned int>(mode) <= 0x7f);
 
-    msgpack::sbuffer headerBuf;
-
-    // assemble the header and pack it.
-    dto::Header myHeader(ChannelTag, sequence, mode);
-    msgpack::pack(headerBuf, myHeader);
-
-    if (headerBuf.size() > UINT16_MAX) {
-        return 0;
+    if (mHeaderPrefix.empty()) {
+        return false;
     }
-
-    // now, copy out the header.
-    if (cipherTextLen < headerBuf.size() + 2) {
-        return 0;
+    unsigned char *headerPtr = dgWriter.reserve(mHeaderPrefix.size() + headerTrailerSize);
+    if (headerPtr == nullptr) {
+        return false;
+    }
+    // copy in the cached prefix, then patch in the sequence (big-endian, per msgpack) and mode.
+    ::memcpy(headerPtr, mHeaderPrefix.data(), mHeaderPrefix.size());
+    headerPtr += mHeaderPrefix.size();
+    *headerPtr++ = 0xcf;
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        *headerPtr++ = static_cast<unsigned char>((sequence >> shift) & 0xff);
     }
-    nLen = headerBuf.size();
-    ::memcpy(cipherTextBufOut, &nLen, 2);
-    offset += 2;
-    ::memcpy(cipherTextBufOut + offset, headerBuf.data(), headerBuf.size());
-    offset += headerBuf.size();
+    *headerPtr = static_cast<unsigned char>(mode);
+    return true;
+}
 
-    assert(offset == (headerBuf.size() + 2));
+size_t Channel::sealPayload(DatagramWriter &dgWriter, size_t bodyOffset, sequence_t sequence, CryptoDtoMode mode)
+{
+    unsigned char *dgBuffer = dgWriter.data();
+    const size_t plainTextLen = dgWriter.size() - bodyOffset;
+    size_t enc_len;
 
     switch (mode) {
     case CryptoModeChaCha20Poly1305:
-        if (cipherTextLen < (offset + plainTextLen + 16)) {
+        // the tag is appended after the ciphertext, so make sure it'll fit.
+        if (dgWriter.reserve(aeadModeTagSize) == nullptr) {
             return 0;
         }
         enc_len = encryptChaCha20Poly1305(
-                cipherTextBufOut + offset, plainTextBuf, plainTextLen, myHeader, cipherTextBufOut, offset);
+                dgBuffer + bodyOffset, dgBuffer + bodyOffset, plainTextLen, sequence, dgBuffer, bodyOffset);
         if (0 == enc_len) {
             return 0;
         }
-        offset += enc_len;
-        assert(offset == (headerBuf.size() + 2 + plainTextLen + 16));
-        break;
+        assert(enc_len == plainTextLen + aeadModeTagSize);
+        return bodyOffset + enc_len;
     case CryptoModeNone:
-        if (cipherTextLen < (offset + plainTextLen)) {
-            return 0;
-        }
-        ::memcpy(cipherTextBufOut + offset, plainTextBuf, plainTextLen);
-        offset += plainTextLen;
-        break;
+        return dgWriter.size();
     default:
         return 0;
     }
-    return offset;
+}
+
+size_t Channel::Encapsulate(
+        const unsigned char *plainTextBuf,
+        size_t plainTextLen,
+        sequence_t sequence,
+        CryptoDtoMode mode,
+        unsigned char *cipherTextBufOut,
+        size_t cipherTextLen)
+{
+    DatagramWriter dgWriter(cipherTextBufOut, cipherTextLen);
+    if (!encodeHeader(dgWriter, sequence, mode)) {
+        return 0;
+    }
+    const size_t bodyOffset = dgWriter.size();
+    dgWriter.write(reinterpret_cast<const char *>(plainTextBuf), plainTextLen);
+    if (dgWriter.overflowed()) {
+        return 0;
+    }
+    return sealPayload(dgWriter, bodyOffset, sequence, mode);
 }
 
 void Channel::setChannelConfig(const dto::ChannelConfig &config)
@@ -305,4 +388,5 @@ void Channel::setChannelConfig(const dto::ChannelConfig &config)
     ::memcpy(aeadTransmitKey, config.AeadTransmitKey, aeadModeKeySize);
     ::memcpy(aeadReceiveKey, config.AeadReceiveKey, aeadModeKeySize);
     ChannelTag = config.ChannelTag;
+    updateHeaderPrefix();
 }
@@ -45,44 +45,106 @@
 using namespace std;
 using namespace afv_native::cryptodto;
 
+static const unsigned bitsPerWord = sizeof(sequence_bitfield_t) * 8;
+
+/** findFirstClear returns the index of the lowest clear bit in word, or bitsPerWord if
+ * all bits are set.
+ */
+static inline unsigned findFirstClear(sequence_bitfield_t word)
+{
+    const sequence_bitfield_t inverted = ~word;
+    if (inverted == 0) {
+        return bitsPerWord;
+    }
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward64(&idx, inverted);
+    return static_cast<unsigned>(idx);
+#else
+#ifdef __GNUC__
+    return static_cast<unsigned>(__builtin_ctzll(inverted));
+#else
+#error No BSF for this compiler defined.
+#endif
+#endif
+}
+
 SequenceTest::SequenceTest(sequence_t start_sequence, unsigned window):
-        _bitfield(0),
+        _bitfield(),
+        _bitMask(0),
         _min(start_sequence),
         _window(window)
 {
     if (_window < 1) {
         _window = 1;
     }
-    if (_window > (sizeof(sequence_bitfield_t) * 8)) {
-        _window = sizeof(sequence_bitfield_t) * 8;
+    if (_window > maxSequenceWindow) {
+        _window = maxSequenceWindow;
+    }
+    // the ring must cover _min as well as the window following it, so it needs at
+    // least _window + 1 bits.  Round it up to a power-of-two number of words so we
+    // can mask rather than divide.
+    size_t words = 1;
+    while ((words * bitsPerWord) <= _window) {
+        words <<= 1;
     }
+    _bitfield.resize(words, 0);
+    _bitMask = (words * bitsPerWord) - 1;
+}
+
+bool
+SequenceTest::testBit(sequence_t sequence) const
+{
+    const sequence_t pos = sequence & _bitMask;
+    return (_bitfield[pos / bitsPerWord] >> (pos % bitsPerWord)) & 1U;
 }
 
 void
-SequenceTest::advanceWindow()
+SequenceTest::setBit(sequence_t sequence)
 {
-    // bitflip the bitfield and look for the first set bit - this will be the
-    // first unreceived packet in the window.
-    unsigned long idx = 0;
+    const sequence_t pos = sequence & _bitMask;
+    _bitfield[pos / bitsPerWord] |= (1ULL << (pos % bitsPerWord));
+}
 
-#ifdef _MSC_VER
-    auto found = _BitScanForward64(&idx, ~_bitfield);
-    // if idx == 0, then the window was fully received and we advance the full amount!
-    if (!found) {
-        idx = sizeof(_bitfield) * 8;
-    } else {
-        idx++;
+void
+SequenceTest::clearRange(sequence_t from, sequence_t to)
+{
+    if ((to - from) > _bitMask) {
+        std::fill(_bitfield.begin(), _bitfield.end(), 0);
+        return;
+    }
+    while (from < to) {
+        const sequence_t pos = from & _bitMask;
+        const unsigned bit = static_cast<unsigned>(pos % bitsPerWord);
+        const sequence_t run = std::min<sequence_t>(to - from, bitsPerWord - bit);
+        const sequence_bitfield_t mask = (run == bitsPerWord) ? ~0ULL : (((1ULL << run) - 1) << bit);
+        _bitfield[pos / bitsPerWord] &= ~mask;
+        from += run;
+    }
+}
+
+void
+SequenceTest::advanceWindow()
+{
+    // move _min on to the first unreceived packet, clearing the bits as we go.
+    // Each bit is only ever cleared once, so this is amortised O(1) per packet.
+    for (;;) {
+        const sequence_t pos = _min & _bitMask;
+        const unsigned bit = static_cast<unsigned>(pos % bitsPerWord);
+        sequence_bitfield_t &word = _bitfield[pos / bitsPerWord];
+        const unsigned run = findFirstClear(word >> bit);
+        const unsigned available = bitsPerWord - bit;
+        if (run < available) {
+            if (run > 0) {
+                word &= ~(((1ULL << run) - 1) << bit);
+                _min += run;
+            }
+            return;
+        }
+        // the rest of this word was all received.
+        word &= (bit == 0) ? 0ULL : ((1ULL << bit) - 1);
+        _min += available;
     }
-#else
-#ifdef __GNUC__
-    idx = __builtin_ctz(~_bitfield) + 1;
-#else
-#error No BSF for this compiler defined.
-#endif
-#endif
-    idx = std::min(idx, static_cast<unsigned long>(_window));
-    _min += idx;
-    _bitfield = _bitfield >> (idx);
 }
 
 ReceiveOutcome
@@ -92,39 +154,40 @@ SequenceTest::Received(sequence_t newSequence)
         return ReceiveOutcome::Before;
     }
     if (newSequence == _min) {
+        _min++;
         advanceWindow();
         return ReceiveOutcome::OK;
     }
     if (newSequence <= (_min + _window)) {
-        // always at least 1 because if it was min, we'd have exited earlier.
-        sequence_t bitidx = newSequence - _min - 1;
-
-        sequence_bitfield_t mask = 1ULL << bitidx;
-        if ((_bitfield & mask) == mask) {
+        if (testBit(newSequence)) {
             return ReceiveOutcome::Before;
         }
-        _bitfield |= mask;
+        setBit(newSequence);
         return ReceiveOutcome::OK;
     }
-    // if we're here, then we've forced a window jump.
-    sequence_t oldmin = _min;
-    while (_min < oldmin + _window) {
-        advanceWindow();
-        if ((_min + _window) > newSequence) {
-            // if we're now in window, break out.
-            break;
-        }
-    }
-    // did we fully advance the window?  If so abandon the old position and restart the stream.
-    if (_min >= oldmin + _window) {
+    // if we're here, then we've forced a window jump.  The window must move
+    // forward far enough that newSequence is the last slot in it.
+    const sequence_t newMin = newSequence - _window;
+    if (newMin >= _min + _window) {
+        // nothing from the old window survives, so abandon the old position and
+        // restart the stream.
+        std::fill(_bitfield.begin(), _bitfield.end(), 0);
         _min = newSequence + 1;
-        _bitfield = 0;
         return ReceiveOutcome::Overflow;
     }
-    // if we're inside the window now, mask and return.
-    sequence_t bitidx = newSequence - _min - 1;
-    sequence_bitfield_t mask = 1ULL << bitidx;
-    _bitfield |= mask;
+    // skip over the packets we're abandoning, then past any received run that follows them.
+    clearRange(_min, newMin);
+    _min = newMin;
+    advanceWindow();
+    if (_min == newSequence) {
+        // everything between the abandoned packets and newSequence had already been
+        // received, so newSequence is now the head of the window - move past it
+        // rather than marking it, or a replay of it would pass the _min test above.
+        _min++;
+        advanceWindow();
+    } else {
+        setBit(newSequence);
+    }
     return ReceiveOutcome::Overflow;
 }
 
@@ -137,5 +200,5 @@ SequenceTest::GetNext() const
 void SequenceTest::reset()
 {
     _min = 0;
-    _bitfield = 0;
+    std::fill(_bitfield.begin(), _bitfield.end(), 0);
 }
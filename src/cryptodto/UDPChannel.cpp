@@ -34,7 +34,9 @@
 #include "afv-native/cryptodto/UDPChannel.h"
 #include "afv-native/cryptodto/dto/ChannelConfig.h"
 
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
 #include <event2/util.h>
 
 #ifdef WIN32
@@ -45,14 +47,23 @@
 #include <afv-native/cryptodto/dto/ChannelConfig.h>
 
 #else
+#ifdef __linux__
+// recvmmsg/sendmmsg are GNU extensions.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#define AFV_NATIVE_HAVE_MMSG
+#endif
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
+#include <time.h>
 #include <unistd.h>
 #endif
 
 #include "afv-native/Log.h"
+#include "afv-native/util/monotime.h"
 
 using namespace afv_native::cryptodto;
 using namespace std;
@@ -61,16 +72,51 @@ UDPChannel::UDPChannel(struct event_base* evBase, int receiveSequenceHistorySize
     Channel(),
     mAddress(),
     mDatagramRxBuffer(nullptr),
+    mTxQueueBuffer(nullptr),
+    mTxQueueLen(),
+    mTxQueueDepth(0),
+    mTxCorkDepth(0),
+    mTxQueueLock(),
     mUDPSocket(-1),
     mEvBase(evBase),
     mSocketEvent(nullptr),
     mTxSequence(0),
     receiveSequence(0, receiveSequenceHistorySize),
+    mRxHighestSequence(0),
+    mRxHighestSequenceValid(false),
     mAcceptableCiphers(1U << cryptodto::CryptoDtoMode::CryptoModeChaCha20Poly1305),
+    mSocketOptions(),
+    mKernelTimestamps(false),
+    mRxTimestampUs(0),
     mDtoHandlers(),
-    mLastErrno(0)
+    mDtoHandlerCount(0),
+    mDtoHandlersLock(),
+    mDtoDispatchStarted(0),
+    mDtoDispatchFinished(0),
+    mDtoDispatchThread(),
+    mDtoDispatchDone(),
+    mCapture(),
+    mLastErrno(0),
+    RxWakeups(0),
+    RxSyscalls(0),
+    RxDatagrams(0),
+    TxSyscalls(0),
+    TxDatagrams(0),
+    RxAccepted(0),
+    RxReplayDrops(0),
+    RxWindowJumps(0),
+    RxDecryptFailures(0),
+    RxMalformed(0),
+    RxWrongTag(0),
+    RxUnhandled(0),
+    RxReorderDepth()
 {
+#ifdef AFV_NATIVE_HAVE_MMSG
+    mDatagramRxBuffer = new unsigned char[maxPermittedDatagramSize * udpRxBatchSize];
+#else
     mDatagramRxBuffer = new unsigned char[maxPermittedDatagramSize];
+#endif
+    mTxQueueBuffer = new unsigned char[maxTxDatagramSize * udpTxBatchSize];
 }
 
 UDPChannel::~UDPChannel()
@@ -78,13 +124,73 @@ UDPChannel::~UDPChannel()
     close();
     delete[] mDatagramRxBuffer;
     mDatagramRxBuffer = nullptr;
+    delete[] mTxQueueBuffer;
+    mTxQueueBuffer = nullptr;
+}
+
+UDPChannel::DtoHandlerEntry* UDPChannel::findDtoHandler(const char* dtoName, size_t dtoNameLen)
+{
+    for (unsigned int i = 0; i < mDtoHandlerCount; i++)
+    {
+        DtoHandlerEntry& entry = mDtoHandlers[i];
+        if (entry.NameLen == dtoNameLen && ::memcmp(entry.Name, dtoName, dtoNameLen) == 0)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+UDPChannel::DtoHandlerEntry* UDPChannel::claimDtoHandler(const std::string& dtoName)
+{
+    if (dtoName.size() > maxDtoNameLength)
+    {
+        LOG("UDPChannel", "can't register handler for %s - name too long", dtoName.c_str());
+        return nullptr;
+    }
+    DtoHandlerEntry* entry = findDtoHandler(dtoName.data(), dtoName.size());
+    if (entry == nullptr)
+    {
+        if (mDtoHandlerCount >= maxDtoHandlers)
+        {
+            LOG("UDPChannel", "can't register handler for %s - dispatch table full", dtoName.c_str());
+            return nullptr;
+        }
+        entry = &mDtoHandlers[mDtoHandlerCount++];
+        ::memcpy(entry->Name, dtoName.data(), dtoName.size());
+        entry->NameLen = dtoName.size();
+    }
+    return entry;
+}
+
+bool UDPChannel::registerDtoHandler(const string& dtoName, DtoHandlerFunc func, void* user_data)
+{
+    std::lock_guard<std::mutex> handlersGuard(mDtoHandlersLock);
+    DtoHandlerEntry* entry = claimDtoHandler(dtoName);
+    if (entry == nullptr)
+    {
+        return false;
+    }
+    entry->Func = func;
+    entry->UserData = user_data;
+    entry->Callback = nullptr;
+    return true;
 }
 
-void UDPChannel::registerDtoHandler(
+bool UDPChannel::registerDtoHandler(
     const string& dtoName,
     std::function<void(const unsigned char* data, size_t len)> callback)
 {
-    mDtoHandlers[dtoName] = callback;
+    std::lock_guard<std::mutex> handlersGuard(mDtoHandlersLock);
+    DtoHandlerEntry* entry = claimDtoHandler(dtoName);
+    if (entry == nullptr)
+    {
+        return false;
+    }
+    entry->Func = nullptr;
+    entry->UserData = nullptr;
+    entry->Callback = std::make_shared<const std::function<void(const unsigned char* data, size_t len)>>(std::move(callback));
+    return true;
 }
 
 void UDPChannel::evReadCallback(evutil_socket_t fd, short events, void* arg)
@@ -95,8 +201,96 @@ void UDPChannel::evReadCallback(evutil_socket_t fd, short events, void* arg)
 
 void UDPChannel::readCallback()
 {
+    RxWakeups++;
+#ifdef AFV_NATIVE_HAVE_MMSG
+    struct mmsghdr msgs[udpRxBatchSize];
+    struct iovec iovecs[udpRxBatchSize];
+    // space for an SCM_TIMESTAMPNS control message per datagram.
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    } ctrlBufs[udpRxBatchSize];
+    const bool kernelTimestamps = mKernelTimestamps;
+
+    // drain the socket, a batch at a time, until it would block.
+    for (;;)
+    {
+        ::memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < udpRxBatchSize; i++)
+        {
+            iovecs[i].iov_base = mDatagramRxBuffer + (i * maxPermittedDatagramSize);
+            iovecs[i].iov_len = maxPermittedDatagramSize;
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (kernelTimestamps)
+            {
+                msgs[i].msg_hdr.msg_control = ctrlBufs[i].buf;
+                msgs[i].msg_hdr.msg_controllen = sizeof(ctrlBufs[i].buf);
+            }
+        }
+        int dgCount = ::recvmmsg(mUDPSocket, msgs, udpRxBatchSize, MSG_DONTWAIT, nullptr);
+        RxSyscalls++;
+        // kernel timestamps are against the realtime clock, so we take both clocks once
+        // per batch to map them onto our monotonic one.
+        const int64_t monoNowUs = util::monotime_get_us();
+        int64_t realNowUs = 0;
+        if (kernelTimestamps)
+        {
+            struct timespec realNow;
+            clock_gettime(CLOCK_REALTIME, &realNow);
+            realNowUs = static_cast<int64_t>(realNow.tv_sec) * 1000000 + (realNow.tv_nsec / 1000);
+        }
+        if (dgCount < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                mLastErrno = errno;
+                LOG("udpchannel:readCallback", "recvmmsg error: %s", evutil_socket_error_to_string(mLastErrno));
+            }
+            return;
+        }
+        RxDatagrams += dgCount;
+        for (int i = 0; i < dgCount; i++)
+        {
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                LOG("udpchannel:readCallback",
+                    "recv'd datagram exceeding configured maximum of %d",
+                    maxPermittedDatagramSize);
+                continue;
+            }
+            int64_t arrivalUs = monoNowUs;
+            if (kernelTimestamps)
+            {
+                for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg))
+                {
+                    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+                    {
+                        struct timespec rxTime;
+                        ::memcpy(&rxTime, CMSG_DATA(cmsg), sizeof(rxTime));
+                        const int64_t rxTimeUs = static_cast<int64_t>(rxTime.tv_sec) * 1000000 + (rxTime.tv_nsec / 1000);
+                        // the time the datagram has spent queued, which can't be negative.
+                        arrivalUs = monoNowUs - std::max<int64_t>(0, realNowUs - rxTimeUs);
+                        break;
+                    }
+                }
+            }
+            processDatagram(mDatagramRxBuffer + (i * maxPermittedDatagramSize), msgs[i].msg_len, arrivalUs);
+            // a handler may have closed the channel underneath us.
+            if (mUDPSocket < 0)
+            {
+                return;
+            }
+        }
+        if (dgCount < udpRxBatchSize)
+        {
+            return;
+        }
+    }
+#else
     int dgSize = ::recv(
         mUDPSocket, reinterpret_cast<char*>(mDatagramRxBuffer), maxPermittedDatagramSize, 0);
+    RxSyscalls++;
     if (dgSize < 0)
     {
         mLastErrno = evutil_socket_geterror(mUDPSocket);
@@ -111,67 +305,219 @@ void UDPChannel::readCallback()
             maxPermittedDatagramSize);
         return;
     }
-    std::string channelTag, dtoName;
+    RxDatagrams++;
+    processDatagram(mDatagramRxBuffer, dgSize, util::monotime_get_us());
+#endif
+}
+
+void UDPChannel::processDatagram(unsigned char* dgBuffer, size_t dgSize, int64_t arrivalUs)
+{
     sequence_t seq;
-    msgpack::sbuffer dtoBuf;
     CryptoDtoMode cipherMode;
+    const char* dtoName = nullptr;
+    size_t dtoNameLen = 0;
+    const unsigned char* dtoBuf = nullptr;
+    size_t dtoBufLen = 0;
 
-    if (!Decapsulate(mDatagramRxBuffer, dgSize, channelTag, seq, cipherMode, dtoName, dtoBuf))
+    // the payload is decrypted in place - dtoName and dtoBuf point back into dgBuffer.
+    switch (Decapsulate(dgBuffer, dgSize, seq, cipherMode, dtoName, dtoNameLen, dtoBuf, dtoBufLen))
     {
-        LOG("udpchannel:readCallback", "recv'd invalid cryptodto frame.  Discarding");
-        return;
+        case DecapsulateOutcome::OK:
+            break;
+        case DecapsulateOutcome::WrongTag:
+            RxWrongTag++;
+            LOG("udpchannel:readCallback", "recv'd with invalid Tag.  Discarding");
+            return;
+        case DecapsulateOutcome::Malformed:
+            RxMalformed++;
+            LOG("udpchannel:readCallback", "recv'd invalid cryptodto frame.  Discarding");
+            return;
+        case DecapsulateOutcome::DecryptFailed:
+            RxDecryptFailures++;
+            LOG("udpchannel:readCallback", "recv'd invalid cryptodto frame.  Discarding");
+            return;
     }
     if (!RxModeEnabled(cipherMode))
     {
         LOG("udpchannel:readCallback", "got frame encrypted with undesired mode");
         return;
     }
-    if (channelTag != ChannelTag)
-    {
-        LOG("udpchannel:readCallback", "recv'd with invalid Tag.  Discarding");
-        return;
-    }
     auto rxOk = receiveSequence.Received(seq);
     switch (rxOk)
     {
         case ReceiveOutcome::Before:
+            RxReplayDrops++;
             LOG("udpchannel:readCallback", "recv'd duplicate sequence %d.  Discarding.", seq);
             return;
         case ReceiveOutcome::OK:
             break;
         case ReceiveOutcome::Overflow:
+            RxWindowJumps++;
             break;
     }
+    if (!mRxHighestSequenceValid || seq > mRxHighestSequence)
+    {
+        mRxHighestSequence = seq;
+        mRxHighestSequenceValid = true;
+    }
+    else
+    {
+        RxReorderDepth.record(mRxHighestSequence - seq);
+    }
     // validate that the packet has a valid payload.
-    if (dtoBuf.size() < 2)
+    if (dtoBufLen < 2)
     {
+        RxMalformed++;
         LOG("udpchannel:readCallback", "internal dto had bad length (too short)");
         return;
     }
     uint16_t dtoSize;
-    ::memcpy(&dtoSize, dtoBuf.data(), 2);
-    if (dtoSize != dtoBuf.size() - 2)
+    ::memcpy(&dtoSize, dtoBuf, 2);
+    if (dtoSize != dtoBufLen - 2)
     {
+        RxMalformed++;
         LOG("udpchannel:readCallback", "internal dto had bad length (length encoded mismatched datagram size)");
         return;
     }
-    auto dtoIter = mDtoHandlers.find(dtoName);
-    if (dtoIter == mDtoHandlers.end())
+    DtoHandlerFunc func = nullptr;
+    void* userData = nullptr;
+    std::shared_ptr<const std::function<void(const unsigned char* data, size_t len)>> callback;
     {
-        LOG("udpchannel:readCallback", "no handler for packet-type %s", dtoName.c_str());
-        return;
+        std::lock_guard<std::mutex> handlersGuard(mDtoHandlersLock);
+        if (mCapture)
+        {
+            mCapture->record(arrivalUs, seq, dtoName, dtoNameLen, dtoBuf + 2, dtoBufLen - 2);
+        }
+        const DtoHandlerEntry* handler = findDtoHandler(dtoName, dtoNameLen);
+        if (handler == nullptr)
+        {
+            RxUnhandled++;
+            LOG("udpchannel:readCallback", "no handler for packet-type %.*s", static_cast<int>(dtoNameLen), dtoName);
+            return;
+        }
+        func = handler->Func;
+        userData = handler->UserData;
+        callback = handler->Callback;
+        mDtoDispatchStarted++;
+        mDtoDispatchThread = std::this_thread::get_id();
+    }
+    RxAccepted++;
+    mRxTimestampUs = arrivalUs;
+    const unsigned char* payload = (dtoBufLen == 2) ? nullptr : (dtoBuf + 2);
+    if (callback)
+    {
+        (*callback)(payload, dtoBufLen - 2);
     }
     else
     {
-        if (dtoBuf.size() == 2)
+        func(payload, dtoBufLen - 2, userData);
+    }
+    {
+        std::lock_guard<std::mutex> handlersGuard(mDtoHandlersLock);
+        mDtoDispatchFinished++;
+    }
+    mDtoDispatchDone.notify_all();
+}
+
+ChannelStats UDPChannel::getStats() const
+{
+    ChannelStats stats;
+    stats.RxDatagrams = RxDatagrams.load();
+    stats.RxAccepted = RxAccepted.load();
+    stats.RxReplayDrops = RxReplayDrops.load();
+    stats.RxWindowJumps = RxWindowJumps.load();
+    stats.RxDecryptFailures = RxDecryptFailures.load();
+    stats.RxMalformed = RxMalformed.load();
+    stats.RxWrongTag = RxWrongTag.load();
+    stats.RxUnhandled = RxUnhandled.load();
+    stats.RxReorderDepth = RxReorderDepth.snapshot();
+    return stats;
+}
+
+void UDPChannel::applySocketOptions(int addressFamily)
+{
+    mKernelTimestamps = false;
+    if (mSocketOptions.ReceiveBufferBytes > 0)
+    {
+        const int bufSize = mSocketOptions.ReceiveBufferBytes;
+        if (::setsockopt(mUDPSocket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufSize), sizeof(bufSize)))
+        {
+            LOG("udpchannel", "couldn't set receive buffer size: %s", evutil_socket_error_to_string(EVUTIL_SOCKET_ERROR()));
+        }
+    }
+    if (mSocketOptions.SendBufferBytes > 0)
+    {
+        const int bufSize = mSocketOptions.SendBufferBytes;
+        if (::setsockopt(mUDPSocket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufSize), sizeof(bufSize)))
+        {
+            LOG("udpchannel", "couldn't set send buffer size: %s", evutil_socket_error_to_string(EVUTIL_SOCKET_ERROR()));
+        }
+    }
+    if (mSocketOptions.Dscp >= 0)
+    {
+#ifdef WIN32
+        LOG("udpchannel", "DSCP marking isn't supported on this platform");
+#else
+        // DSCP occupies the top 6 bits of the TOS/traffic class byte.
+        const int tos = (mSocketOptions.Dscp & 0x3f) << 2;
+        int rv;
+        if (addressFamily == AF_INET6)
         {
-            dtoIter->second(nullptr, 0);
+            rv = ::setsockopt(mUDPSocket, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos));
         }
         else
         {
-            dtoIter->second(reinterpret_cast<const unsigned char*>(dtoBuf.data()) + 2, dtoBuf.size() - 2);
+            rv = ::setsockopt(mUDPSocket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+        }
+        if (rv)
+        {
+            LOG("udpchannel", "couldn't set DSCP: %s", evutil_socket_error_to_string(errno));
         }
+#endif
     }
+#ifdef __linux__
+    if (mSocketOptions.Priority >= 0)
+    {
+        const int priority = mSocketOptions.Priority;
+        if (::setsockopt(mUDPSocket, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)))
+        {
+            LOG("udpchannel", "couldn't set socket priority: %s", evutil_socket_error_to_string(errno));
+        }
+    }
+    if (mSocketOptions.KernelTimestamps)
+    {
+        const int enable = 1;
+        if (::setsockopt(mUDPSocket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)))
+        {
+            LOG("udpchannel", "couldn't enable receive timestamps: %s", evutil_socket_error_to_string(errno));
+        }
+        else
+        {
+            mKernelTimestamps = true;
+        }
+    }
+#endif
+}
+
+void UDPChannel::setSocketOptions(const UDPSocketOptions& options)
+{
+    mSocketOptions = options;
+}
+
+const UDPSocketOptions& UDPChannel::getSocketOptions() const
+{
+    return mSocketOptions;
+}
+
+int64_t UDPChannel::getRxTimestampUs() const
+{
+    return mRxTimestampUs;
+}
+
+void UDPChannel::setCapture(std::shared_ptr<CaptureWriter> capture)
+{
+    std::lock_guard<std::mutex> handlersGuard(mDtoHandlersLock);
+    mCapture = std::move(capture);
 }
 
 bool UDPChannel::open()
@@ -195,6 +541,7 @@ bool UDPChannel::open()
             return false;
         }
         evutil_make_socket_nonblocking(mUDPSocket);
+        applySocketOptions(saddr.ss_family);
 
         if (saddr.ss_family == AF_INET6)
         {
@@ -252,7 +599,110 @@ void UDPChannel::close()
         #endif
         mUDPSocket = -1;
     }
+    {
+        std::lock_guard<util::CheckedMutex> txGuard(mTxQueueLock);
+        mTxQueueDepth = 0;
+    }
     receiveSequence.reset();
+    mRxHighestSequenceValid = false;
+}
+
+void UDPChannel::flushTxQueue()
+{
+    if (mTxQueueDepth == 0)
+    {
+        return;
+    }
+    if (mUDPSocket < 0)
+    {
+        mTxQueueDepth = 0;
+        return;
+    }
+#ifdef AFV_NATIVE_HAVE_MMSG
+    struct mmsghdr msgs[udpTxBatchSize];
+    struct iovec iovecs[udpTxBatchSize];
+
+    ::memset(msgs, 0, sizeof(msgs));
+    for (unsigned int i = 0; i < mTxQueueDepth; i++)
+    {
+        iovecs[i].iov_base = mTxQueueBuffer + (i * maxTxDatagramSize);
+        iovecs[i].iov_len = mTxQueueLen[i];
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    unsigned int dgSent = 0;
+    while (dgSent < mTxQueueDepth)
+    {
+        int sent = ::sendmmsg(mUDPSocket, msgs + dgSent, mTxQueueDepth - dgSent, MSG_DONTWAIT);
+        TxSyscalls++;
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                LOG("udpchannel", "%d UDP packets dropped on send due to TxBuffer being full", mTxQueueDepth - dgSent);
+            }
+            else
+            {
+                LOG("udpchannel", "error sending datagrams: %s", evutil_socket_error_to_string(errno));
+            }
+            break;
+        }
+        for (int i = 0; i < sent; i++)
+        {
+            const auto& msg = msgs[dgSent + i];
+            if (msg.msg_len < msg.msg_hdr.msg_iov->iov_len)
+            {
+                LOG("udpchannel", "short write sending datagram - sent %d of %d bytes", msg.msg_len, msg.msg_hdr.msg_iov->iov_len);
+            }
+        }
+        TxDatagrams += sent;
+        dgSent += sent;
+    }
+#else
+    for (unsigned int i = 0; i < mTxQueueDepth; i++)
+    {
+        const char* dgBuffer = reinterpret_cast<const char*>(mTxQueueBuffer + (i * maxTxDatagramSize));
+        auto sent = ::send(mUDPSocket, dgBuffer, mTxQueueLen[i], 0);
+        TxSyscalls++;
+        if (sent < 0)
+        {
+            if (evutil_socket_geterror(mUDPSocket) == EWOULDBLOCK)
+            {
+                LOG("udpchannel", "UDP packet dropped on send due to TxBuffer being full");
+            }
+            else
+            {
+                LOG("udpchannel", "error sending datagram: %s", evutil_socket_error_to_string(evutil_socket_geterror(mUDPSocket)));
+            }
+            continue;
+        }
+        TxDatagrams++;
+        if (static_cast<size_t>(sent) < mTxQueueLen[i])
+        {
+            LOG("udpchannel", "short write sending datagram - sent %d of %d bytes", sent, mTxQueueLen[i]);
+        }
+    }
+#endif
+    mTxQueueDepth = 0;
+}
+
+void UDPChannel::corkTx()
+{
+    std::lock_guard<util::CheckedMutex> txGuard(mTxQueueLock);
+    mTxCorkDepth++;
+}
+
+void UDPChannel::uncorkTx()
+{
+    std::lock_guard<util::CheckedMutex> txGuard(mTxQueueLock);
+    if (mTxCorkDepth > 0)
+    {
+        mTxCorkDepth--;
+    }
+    if (mTxCorkDepth == 0)
+    {
+        flushTxQueue();
+    }
 }
 
 void UDPChannel::setAddress(const std::string& address)
@@ -299,7 +749,38 @@ bool UDPChannel::RxModeEnabled(CryptoDtoMode mode) const
 
 void UDPChannel::unregisterDtoHandler(const std::string& dtoName)
 {
-    mDtoHandlers.erase(dtoName);
+    std::unique_lock<std::mutex> handlersGuard(mDtoHandlersLock);
+    DtoHandlerEntry* entry = findDtoHandler(dtoName.data(), dtoName.size());
+    if (entry == nullptr)
+    {
+        return;
+    }
+    // keep the table packed by moving the last entry into the freed slot.
+    DtoHandlerEntry& last = mDtoHandlers[mDtoHandlerCount - 1];
+    if (entry != &last)
+    {
+        ::memcpy(entry->Name, last.Name, last.NameLen);
+        entry->NameLen = last.NameLen;
+        entry->Func = last.Func;
+        entry->UserData = last.UserData;
+        entry->Callback = std::move(last.Callback);
+    }
+    last.NameLen = 0;
+    last.Func = nullptr;
+    last.UserData = nullptr;
+    last.Callback = nullptr;
+    mDtoHandlerCount--;
+
+    // a handler already running on another thread may still be using its user_data, so
+    // let it finish.  Later calls won't find the entry.  A handler unregistering itself
+    // (or another) mustn't wait on itself.
+    if (mDtoDispatchStarted != mDtoDispatchFinished && mDtoDispatchThread != std::this_thread::get_id())
+    {
+        const uint64_t inProgress = mDtoDispatchStarted;
+        mDtoDispatchDone.wait(handlersGuard, [this, inProgress]() {
+            return mDtoDispatchFinished >= inProgress;
+        });
+    }
 }
 
 int UDPChannel::getLastErrno() const
@@ -314,6 +795,7 @@ void UDPChannel::setChannelConfig(const dto::ChannelConfig& config)
     if (::memcmp(aeadReceiveKey, config.AeadReceiveKey, aeadModeKeySize) != 0)
     {
         receiveSequence.reset();
+        mRxHighestSequenceValid = false;
     }
     Channel::setChannelConfig(config);
 }
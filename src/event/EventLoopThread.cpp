@@ -0,0 +1,149 @@
+/* event/EventLoopThread.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/event/EventLoopThread.h"
+
+#include <mutex>
+#include <event2/thread.h>
+
+#include "afv-native/Log.h"
+
+using namespace afv_native::event;
+using namespace std;
+
+static once_flag evthreadInitFlag;
+
+static void enableEventThreading()
+{
+    call_once(evthreadInitFlag, []() {
+#ifdef WIN32
+        evthread_use_windows_threads();
+#else
+        evthread_use_pthreads();
+#endif
+    });
+}
+
+EventLoopThread::EventLoopThread(std::string name):
+        mName(std::move(name)),
+        mEvBase(nullptr),
+        mLagMonitor(nullptr),
+        mThread(),
+        mRunning(false)
+{
+    // locking must be enabled before the base is created for it to be usable across threads.
+    enableEventThreading();
+    mEvBase = event_base_new();
+    if (mEvBase == nullptr) {
+        LOG("EventLoopThread", "%s: failed to create event_base", mName.c_str());
+        return;
+    }
+    mLagMonitor = new LoopLagMonitor(mEvBase);
+}
+
+EventLoopThread::~EventLoopThread()
+{
+    stop();
+    delete mLagMonitor;
+    mLagMonitor = nullptr;
+    if (mEvBase != nullptr) {
+        event_base_free(mEvBase);
+        mEvBase = nullptr;
+    }
+}
+
+bool EventLoopThread::start()
+{
+    if (mEvBase == nullptr) {
+        return false;
+    }
+    if (mRunning) {
+        return true;
+    }
+    mRunning = true;
+    mLagMonitor->start();
+    mThread = std::thread(&EventLoopThread::run, this);
+    return true;
+}
+
+void EventLoopThread::stop()
+{
+    if (!mRunning) {
+        return;
+    }
+    mRunning = false;
+    // breaking the loop from outside races with the loop (re)starting, so schedule
+    // the break to run on the loop itself.
+    struct timeval immediately = {0, 0};
+    event_base_once(mEvBase, -1, EV_TIMEOUT, &EventLoopThread::evBreakCallback, mEvBase, &immediately);
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    mLagMonitor->stop();
+}
+
+void EventLoopThread::evBreakCallback(evutil_socket_t fd, short events, void *arg)
+{
+    event_base_loopbreak(reinterpret_cast<struct event_base *>(arg));
+}
+
+void EventLoopThread::run()
+{
+    LOG("EventLoopThread", "%s: loop started", mName.c_str());
+    while (mRunning) {
+        // keep running even when there's nothing registered - the channel may not be open yet.
+        if (event_base_loop(mEvBase, EVLOOP_NO_EXIT_ON_EMPTY) < 0) {
+            LOG("EventLoopThread", "%s: event_base_loop failed", mName.c_str());
+            break;
+        }
+    }
+    LOG("EventLoopThread", "%s: loop stopped", mName.c_str());
+}
+
+bool EventLoopThread::isRunning() const
+{
+    return mRunning;
+}
+
+struct event_base *EventLoopThread::getEventBase() const
+{
+    return mEvBase;
+}
+
+LoopLagStats EventLoopThread::getLagStats() const
+{
+    if (mLagMonitor == nullptr) {
+        return LoopLagStats{};
+    }
+    return mLagMonitor->getStats();
+}
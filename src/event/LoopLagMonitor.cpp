@@ -0,0 +1,90 @@
+/* event/LoopLagMonitor.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/event/LoopLagMonitor.h"
+
+using namespace afv_native::event;
+using namespace std;
+
+LoopLagMonitor::LoopLagMonitor(struct event_base *evBase):
+        EventTimer(evBase),
+        mDeadline(),
+        mSamples(0),
+        mLastLagUs(0),
+        mMaxLagUs(0),
+        mTotalLagUs(0)
+{
+}
+
+void LoopLagMonitor::arm()
+{
+    mDeadline = chrono::steady_clock::now() + chrono::milliseconds(loopLagSampleIntervalMs);
+    enable(loopLagSampleIntervalMs);
+}
+
+void LoopLagMonitor::start()
+{
+    arm();
+}
+
+void LoopLagMonitor::stop()
+{
+    disable();
+}
+
+void LoopLagMonitor::triggered()
+{
+    const auto now = chrono::steady_clock::now();
+    uint64_t lagUs = 0;
+    if (now > mDeadline) {
+        lagUs = static_cast<uint64_t>(chrono::duration_cast<chrono::microseconds>(now - mDeadline).count());
+    }
+    mLastLagUs.store(lagUs);
+    mTotalLagUs.fetch_add(lagUs);
+    mSamples.fetch_add(1);
+    // only this thread ever raises the maximum, so a plain compare is safe.
+    if (lagUs > mMaxLagUs.load()) {
+        mMaxLagUs.store(lagUs);
+    }
+    arm();
+}
+
+LoopLagStats LoopLagMonitor::getStats() const
+{
+    LoopLagStats stats;
+    stats.Samples = mSamples.load();
+    stats.LastLagUs = mLastLagUs.load();
+    stats.MaxLagUs = mMaxLagUs.load();
+    stats.TotalLagUs = mTotalLagUs.load();
+    return stats;
+}
@@ -35,6 +35,7 @@
 
 #include <string>
 #include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
@@ -53,17 +54,20 @@ Request::Request(const string &url, Method method):
         mCurlHandle(),
         mHeaders(nullptr),
         mTM(nullptr),
+        mShareHandle(nullptr),
         mReq(),
         mReqBufOffset(0),
         mRespStatusCode(0),
         mRespContentType(),
         mResp(),
+        mRespHeaders(),
         mCurlErrorBuffer(),
         mCompletionCallback(),
         mDownloadTotal(0),
         mDownloadProgress(0),
         mUploadTotal(0),
-        mUploadProgress(0)
+        mUploadProgress(0),
+        mTiming()
 {
     ::memset(mCurlErrorBuffer, 0, CURL_ERROR_SIZE);
 }
@@ -82,20 +86,18 @@ Request::~Request()
 
 void Request::reset()
 {
-    if (mCurlHandle) {
-        if (mTM != nullptr) {
-            curl_multi_remove_handle(mTM->getCurlMultiHandle(), mCurlHandle);
-            mTM->removeAsyncCallback(*this);
-            mTM = nullptr;
-        }
-        curl_easy_cleanup(mCurlHandle);
-        mCurlHandle = nullptr;
+    // the easy handle itself is kept - setupHandle resets it for the next transfer.
+    if (mCurlHandle && mTM != nullptr) {
+        curl_multi_remove_handle(mTM->getCurlMultiHandle(), mCurlHandle);
+        mTM->removeAsyncCallback(*this);
+        mTM = nullptr;
     }
     if (mHeaders != nullptr) {
         curl_slist_free_all(mHeaders);
         mHeaders = nullptr;
     }
     mResp.clear();
+    mRespHeaders.clear();
     mReq.clear();
     mReqBufOffset = 0;
     mProgress = Progress::New;
@@ -103,11 +105,22 @@ void Request::reset()
 
 bool Request::setupHandle()
 {
-    assert(mCurlHandle == nullptr);
-    mCurlHandle = curl_easy_init();
+    if (mCurlHandle == nullptr) {
+        mCurlHandle = curl_easy_init();
+    } else {
+        // clears the options from the last transfer, but keeps the connection cache.
+        curl_easy_reset(mCurlHandle);
+    }
+    if (mShareHandle != nullptr) {
+        curl_easy_setopt(mCurlHandle, CURLOPT_SHARE, mShareHandle);
+    }
     curl_easy_setopt(mCurlHandle, CURLOPT_URL, mURL.c_str());
     curl_easy_setopt(mCurlHandle, CURLOPT_WRITEFUNCTION, curlWriteCallback);
     curl_easy_setopt(mCurlHandle, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(mCurlHandle, CURLOPT_HEADERFUNCTION, curlHeaderCallback);
+    curl_easy_setopt(mCurlHandle, CURLOPT_HEADERDATA, this);
+    /* accept any compression libcurl was built with - it's decoded transparently. */
+    curl_easy_setopt(mCurlHandle, CURLOPT_ACCEPT_ENCODING, "");
     curl_easy_setopt(mCurlHandle, CURLOPT_ERRORBUFFER, mCurlErrorBuffer);
     curl_easy_setopt(mCurlHandle, CURLOPT_USERAGENT, "AFV-Native/1.0");
     curl_easy_setopt(mCurlHandle, CURLOPT_NOPROGRESS, 0);
@@ -123,6 +136,14 @@ bool Request::setupHandle()
     /* Disable Nagle because Mac says so.... */
     curl_easy_setopt(mCurlHandle, CURLOPT_TCP_NODELAY, 1);
 
+    /* keep idle connections alive between requests, and multiplex over a single
+     * HTTP/2 connection where the server supports it rather than opening another. */
+    curl_easy_setopt(mCurlHandle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(mCurlHandle, CURLOPT_TCP_KEEPIDLE, 30L);
+    curl_easy_setopt(mCurlHandle, CURLOPT_TCP_KEEPINTVL, 15L);
+    curl_easy_setopt(mCurlHandle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(mCurlHandle, CURLOPT_PIPEWAIT, 1L);
+
     /*FIXME:  We do not verify peers (yet).  This is not a code issue, but a larger OpenSSL management one.
      *
      * We do not verify peers because libcurl is a pain in the ass and does not
@@ -153,6 +174,10 @@ bool Request::setupHandle()
         curl_easy_setopt(mCurlHandle, CURLOPT_CUSTOMREQUEST, "DELETE");
         curl_easy_setopt(mCurlHandle, CURLOPT_FOLLOWLOCATION, 0);
         break;
+    case Method::HEAD:
+        curl_easy_setopt(mCurlHandle, CURLOPT_NOBODY, 1);
+        curl_easy_setopt(mCurlHandle, CURLOPT_FOLLOWLOCATION, 0);
+        break;
     }
     curl_easy_setopt(mCurlHandle, CURLOPT_FOLLOWLOCATION, mFollowRedirect);
     return true;
@@ -253,6 +278,39 @@ Request::writeCallback(char *buffer, size_t size, size_t nitems)
     return blockSize;
 }
 
+size_t
+Request::curlHeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    auto *r = reinterpret_cast<Request *>(userdata);
+    return r->headerCallback(buffer, size, nitems);
+}
+
+size_t
+Request::headerCallback(char *buffer, size_t size, size_t nitems)
+{
+    const size_t blockSize = size * nitems;
+    string line(buffer, blockSize);
+    // a new status line starts a new set of headers (redirects, 100 Continue).
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        mRespHeaders.clear();
+        return blockSize;
+    }
+    auto colon = line.find(':');
+    if (colon == string::npos) {
+        return blockSize;
+    }
+    string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    auto valueStart = line.find_first_not_of(" \t", colon + 1);
+    auto valueEnd = line.find_last_not_of(" \t\r\n");
+    if (valueStart == string::npos || valueEnd == string::npos || valueEnd < valueStart) {
+        mRespHeaders[name] = "";
+    } else {
+        mRespHeaders[name] = line.substr(valueStart, valueEnd - valueStart + 1);
+    }
+    return blockSize;
+}
+
 bool
 Request::doSync()
 {
@@ -275,6 +333,7 @@ void
 Request::notifyTransferError()
 {
     mProgress = Progress::Error;
+    updateTiming();
     mTM = nullptr;
     // chain the callback if necessary.
     if (mCompletionCallback) {
@@ -329,10 +388,37 @@ Request::transferInfoCallback(curl_off_t dltotal, curl_off_t dlnow, curl_off_t u
     mUploadProgress = ulnow;
 }
 
+void
+Request::updateTiming()
+{
+    curl_off_t t;
+    mTiming = RequestTiming();
+    if (CURLE_OK == curl_easy_getinfo(mCurlHandle, CURLINFO_NAMELOOKUP_TIME_T, &t)) {
+        mTiming.NameLookupUs = t;
+    }
+    if (CURLE_OK == curl_easy_getinfo(mCurlHandle, CURLINFO_CONNECT_TIME_T, &t)) {
+        mTiming.ConnectUs = t;
+    }
+    if (CURLE_OK == curl_easy_getinfo(mCurlHandle, CURLINFO_APPCONNECT_TIME_T, &t)) {
+        mTiming.TlsUs = t;
+    }
+    if (CURLE_OK == curl_easy_getinfo(mCurlHandle, CURLINFO_STARTTRANSFER_TIME_T, &t)) {
+        mTiming.FirstByteUs = t;
+    }
+    if (CURLE_OK == curl_easy_getinfo(mCurlHandle, CURLINFO_TOTAL_TIME_T, &t)) {
+        mTiming.TotalUs = t;
+    }
+    long newConnections = 0;
+    if (CURLE_OK == curl_easy_getinfo(mCurlHandle, CURLINFO_NUM_CONNECTS, &newConnections)) {
+        mTiming.ConnectionReused = (newConnections == 0);
+    }
+}
+
 void
 Request::notifyTransferCompleted()
 {
     mProgress = Progress::Finished;
+    updateTiming();
     long resp_code;
     if (CURLE_OK == curl_easy_getinfo(mCurlHandle, CURLINFO_RESPONSE_CODE, &resp_code)) {
         // downcast on Unixen. (sizeof(long) > sizeof(int)).
@@ -393,6 +479,24 @@ Request::getCurlHandle() const
     return mCurlHandle;
 }
 
+string
+Request::getResponseHeader(const string &name) const
+{
+    string key(name);
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+    auto iter = mRespHeaders.find(key);
+    if (iter == mRespHeaders.end()) {
+        return string();
+    }
+    return iter->second;
+}
+
+const RequestTiming &
+Request::getTiming() const
+{
+    return mTiming;
+}
+
 void Request::setCompletionCallback(std::function<void(Request *, bool)> cb)
 {
     mCompletionCallback = cb;
@@ -413,7 +517,8 @@ bool Request::doAsync(TransferManager &transferManager)
 
 void Request::shareState(TransferManager &transferManager)
 {
-    curl_easy_setopt(mCurlHandle, CURLOPT_SHARE, transferManager.getCurlMultiHandle());
+    // applied by setupHandle, as the handle is reset at the start of every transfer.
+    mShareHandle = transferManager.getCurlShareHandle();
 }
 
 const string &Request::getUrl() const
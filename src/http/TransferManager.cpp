@@ -50,6 +50,11 @@ TransferManager::TransferManager():
     curl_share_setopt(mCurlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
     curl_share_setopt(mCurlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
     curl_share_setopt(mCurlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_PSL);
+
+    // multiplex concurrent requests to the same host over one HTTP/2 connection, and
+    // keep a few idle connections around for the next request.
+    curl_multi_setopt(mCurlMultiHandle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(mCurlMultiHandle, CURLMOPT_MAXCONNECTS, 8L);
 }
 
 TransferManager::~TransferManager()
@@ -123,6 +128,12 @@ TransferManager::getCurlMultiHandle() const
     return mCurlMultiHandle;
 }
 
+CURLSH *
+TransferManager::getCurlShareHandle() const
+{
+    return mCurlShareHandle;
+}
+
 void TransferManager::registerForAsyncCallback(Request &req)
 {
     auto curlHandle = req.getCurlHandle();
@@ -0,0 +1,132 @@
+/* util/RealtimeCheck.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/util/RealtimeCheck.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace afv_native;
+
+static std::atomic<uint64_t> gViolationCount(0);
+static std::atomic<const char *> gLastViolation(nullptr);
+static std::atomic<bool> gTrapViolations(false);
+
+#ifdef AFV_NATIVE_RT_CHECKS
+static thread_local unsigned gRealtimeDepth = 0;
+
+util::RealtimeScope::RealtimeScope()
+{
+    gRealtimeDepth++;
+}
+
+util::RealtimeScope::~RealtimeScope()
+{
+    gRealtimeDepth--;
+}
+
+bool util::inRealtimeScope()
+{
+    return gRealtimeDepth > 0;
+}
+#else
+bool util::inRealtimeScope()
+{
+    return false;
+}
+#endif
+
+void util::realtimeViolation(const char *what)
+{
+    // nothing in here may allocate, lock or log - we're on the real-time thread.
+    gViolationCount.fetch_add(1, std::memory_order_relaxed);
+    gLastViolation.store(what);
+    if (gTrapViolations.load(std::memory_order_relaxed)) {
+        std::abort();
+    }
+}
+
+void util::setRealtimeTrap(bool abortOnViolation)
+{
+    gTrapViolations.store(abortOnViolation);
+}
+
+uint64_t util::getRealtimeViolationCount()
+{
+    return gViolationCount.load();
+}
+
+const char *util::getLastRealtimeViolation()
+{
+    return gLastViolation.load();
+}
+
+#ifdef AFV_NATIVE_RT_CHECKS
+/* Checked builds replace the global allocator so that any allocation or release made
+ * on a real-time thread is caught.  The array and sized forms all default to these.
+ *
+ * As these are the program-wide replacements, they take over from any allocator the
+ * host application provides - which is why this is only for debug builds. */
+void *operator new(std::size_t size)
+{
+    AFV_RT_CHECK("operator new");
+    void *p = std::malloc(size != 0 ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    AFV_RT_CHECK("operator new");
+    return std::malloc(size != 0 ? size : 1);
+}
+
+void operator delete(void *p) noexcept
+{
+    if (p != nullptr) {
+        AFV_RT_CHECK("operator delete");
+    }
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    if (p != nullptr) {
+        AFV_RT_CHECK("operator delete");
+    }
+    std::free(p);
+}
+#endif
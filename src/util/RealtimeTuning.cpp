@@ -0,0 +1,240 @@
+/* util/RealtimeTuning.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "afv-native/util/RealtimeTuning.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "afv-native/Log.h"
+
+using namespace afv_native;
+
+/** how much stack to pre-fault on each audio thread. */
+static const size_t prefaultStackBytes = 64 * 1024;
+#ifndef _WIN32
+/** the SCHED_FIFO priority to use - high, but below the kernel's own threads. */
+static const int realtimeSchedPriority = 70;
+#endif
+
+static std::atomic<bool> gProcessLocked(false);
+
+util::RealtimeOptions::RealtimeOptions():
+    Priority(ThreadPriority::Normal),
+    CpuSet(),
+    LockMemory(false)
+{
+}
+
+static size_t pageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    const long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? static_cast<size_t>(size) : 4096;
+#endif
+}
+
+static bool setPriority(util::ThreadPriority priority)
+{
+    switch (priority) {
+    case util::ThreadPriority::Normal:
+        return true;
+#ifdef _WIN32
+    case util::ThreadPriority::High:
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST) != 0;
+    case util::ThreadPriority::Realtime:
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+    case util::ThreadPriority::High:
+#ifdef __linux__
+        // on Linux, nice values are per-thread.
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), -10) != 0) {
+            LOG("RealtimeTuning", "Couldn't raise thread priority: %s", strerror(errno));
+            return false;
+        }
+        return true;
+#else
+        // no per-thread nice elsewhere, so use the bottom of the round-robin range.
+        {
+            sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = sched_get_priority_min(SCHED_RR);
+            const int rv = pthread_setschedparam(pthread_self(), SCHED_RR, &param);
+            if (rv != 0) {
+                LOG("RealtimeTuning", "Couldn't raise thread priority: %s", strerror(rv));
+                return false;
+            }
+            return true;
+        }
+#endif
+    case util::ThreadPriority::Realtime:
+        {
+            sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = std::min(realtimeSchedPriority, sched_get_priority_max(SCHED_FIFO));
+            const int rv = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (rv != 0) {
+                LOG("RealtimeTuning", "Couldn't set SCHED_FIFO: %s", strerror(rv));
+                return false;
+            }
+            return true;
+        }
+#endif
+    }
+    return false;
+}
+
+static bool setAffinity(const std::vector<int> &cpus)
+{
+    if (cpus.empty()) {
+        return true;
+    }
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int cpu: cpus) {
+        if (cpu >= 0 && cpu < static_cast<int>(sizeof(mask) * 8)) {
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+        }
+    }
+    if (mask == 0 || SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+        LOG("RealtimeTuning", "Couldn't set thread affinity");
+        return false;
+    }
+    return true;
+#elif defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu: cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpuSet);
+        }
+    }
+    const int rv = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    if (rv != 0) {
+        LOG("RealtimeTuning", "Couldn't set thread affinity: %s", strerror(rv));
+        return false;
+    }
+    return true;
+#else
+    LOG("RealtimeTuning", "Thread affinity isn't supported on this platform");
+    return false;
+#endif
+}
+
+/** prefaultSink receives a read back of each prefaulted page, so the stack is used
+ * as well as set. */
+static volatile char prefaultSink;
+
+static void prefaultStack()
+{
+    // touch the pages now so the first deep call on the audio thread doesn't fault.
+    volatile char stack[prefaultStackBytes];
+    const size_t step = pageSize();
+    for (size_t i = 0; i < prefaultStackBytes; i += step) {
+        stack[i] = 0;
+        prefaultSink = stack[i];
+    }
+}
+
+bool util::tuneCurrentThread(const RealtimeOptions &options)
+{
+    bool ok = setPriority(options.Priority);
+    ok = setAffinity(options.CpuSet) && ok;
+    if (options.LockMemory) {
+        prefaultStack();
+    }
+    return ok;
+}
+
+bool util::prefaultAndLock(void *data, size_t length)
+{
+    if (data == nullptr || length == 0) {
+        return true;
+    }
+    auto *bytes = reinterpret_cast<volatile char *>(data);
+    const size_t step = pageSize();
+    for (size_t i = 0; i < length; i += step) {
+        bytes[i] = bytes[i];
+    }
+    bytes[length - 1] = bytes[length - 1];
+#ifdef _WIN32
+    return VirtualLock(data, length) != 0;
+#else
+    return mlock(data, length) == 0;
+#endif
+}
+
+bool util::lockProcessMemory()
+{
+    if (gProcessLocked.exchange(true)) {
+        return true;
+    }
+#ifdef _WIN32
+    // there's no process-wide equivalent, only the per-buffer VirtualLock.
+    LOG("RealtimeTuning", "Process memory locking isn't supported on this platform");
+    return false;
+#else
+    // MCL_FUTURE makes every later allocation fail once the limit is reached, so
+    // only ask for it when there is no limit.
+    int flags = MCL_CURRENT;
+    rlimit limit;
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY) {
+        flags |= MCL_FUTURE;
+    }
+    if (mlockall(flags) != 0) {
+        LOG("RealtimeTuning", "Couldn't lock process memory: %s", strerror(errno));
+        return false;
+    }
+    LOG("RealtimeTuning", "Locked process memory%s", (flags & MCL_FUTURE) ? ", including future allocations" : "");
+    return true;
+#endif
+}
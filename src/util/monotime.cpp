@@ -44,3 +44,11 @@ afv_native::util::monotime_t afv_native::util::monotime_get()
 
     return msTime;
 }
+
+afv_native::util::monotime_t afv_native::util::monotime_get_us()
+{
+    const auto monoTime = chrono::steady_clock::now();
+    const auto usTime = chrono::duration_cast<chrono::microseconds>(monoTime.time_since_epoch()).count();
+
+    return usTime;
+}
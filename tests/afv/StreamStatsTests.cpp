@@ -0,0 +1,130 @@
+/* tests/afv/StreamStatsTests.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include "afv-native/afv/StreamStats.h"
+#include "afv-native/audio/audio_params.h"
+
+using namespace afv_native;
+using namespace afv_native::afv;
+
+namespace {
+    const int64_t frameUs = audio::frameLengthMs * 1000;
+}
+
+TEST(StreamStats, SteadyStreamHasNoLossOrJitter)
+{
+    StreamStats stats("TEST");
+    for (uint32_t seq = 0; seq < 100; seq++) {
+        stats.packetReceived(seq, seq * frameUs, false);
+    }
+    EXPECT_EQ(100u, stats.PacketsReceived.load());
+    EXPECT_EQ(0u, stats.PacketsMissing.load());
+    EXPECT_EQ(0u, stats.PacketsLate.load());
+    EXPECT_EQ(0u, stats.JitterUs.load());
+    EXPECT_EQ(99u, stats.TransitDeltaMs.snapshot().Buckets[0]);
+}
+
+TEST(StreamStats, CountsLostPackets)
+{
+    StreamStats stats("TEST");
+    const uint32_t sequences[] = {0, 1, 2, 5, 6, 9, 10};
+    for (auto seq: sequences) {
+        stats.packetReceived(seq, seq * frameUs, false);
+    }
+    EXPECT_EQ(7u, stats.PacketsReceived.load());
+    // 3 & 4, then 7 & 8.
+    EXPECT_EQ(4u, stats.PacketsMissing.load());
+    EXPECT_EQ(0u, stats.PacketsLate.load());
+    // the gaps were timed to match the lost frames, so aren't jitter.
+    EXPECT_EQ(0u, stats.JitterUs.load());
+}
+
+TEST(StreamStats, CountsReorderedPackets)
+{
+    StreamStats stats("TEST");
+    const uint32_t sequences[] = {0, 1, 3, 2, 4, 7, 5, 6, 8};
+    int64_t arrivalUs = 0;
+    for (auto seq: sequences) {
+        stats.packetReceived(seq, arrivalUs, false);
+        arrivalUs += frameUs;
+    }
+    EXPECT_EQ(9u, stats.PacketsReceived.load());
+    // 2 was skipped by 3, and 5 & 6 by 7 - all of which turned up late.
+    EXPECT_EQ(3u, stats.PacketsMissing.load());
+    EXPECT_EQ(3u, stats.PacketsLate.load());
+
+    const auto depths = stats.ReorderDepth.snapshot();
+    // 2 and 6 were 1 behind, 5 was 2 behind.
+    EXPECT_EQ(2u, depths.Buckets[util::AtomicHistogram::bucketFor(1)]);
+    EXPECT_EQ(1u, depths.Buckets[util::AtomicHistogram::bucketFor(2)]);
+}
+
+TEST(StreamStats, TracksJitter)
+{
+    StreamStats stats("TEST");
+    // every other packet arrives 4ms late, so each arrival is 4ms off from the last.
+    const int64_t skewUs = 4000;
+    const uint32_t packets = 200;
+    for (uint32_t seq = 0; seq < packets; seq++) {
+        stats.packetReceived(seq, seq * frameUs + ((seq % 2) ? skewUs : 0), false);
+        if (seq == 1) {
+            // the first deviation is smoothed by 1/16th.
+            EXPECT_EQ(static_cast<uint32_t>(skewUs / 16), stats.JitterUs.load());
+        }
+    }
+    EXPECT_NEAR(skewUs, stats.JitterUs.load(), 1);
+    EXPECT_EQ(0u, stats.PacketsMissing.load());
+    EXPECT_EQ(0u, stats.PacketsLate.load());
+    EXPECT_EQ(packets - 1, stats.TransitDeltaMs.snapshot().Buckets[util::AtomicHistogram::bucketFor(skewUs / 1000)]);
+}
+
+TEST(StreamStats, NewTransmissionRestartsSequence)
+{
+    StreamStats stats("TEST");
+    stats.packetReceived(100, 0, false);
+    stats.packetReceived(101, frameUs, true);
+    // a new transmission can start anywhere without counting as loss or reordering.
+    stats.packetReceived(10, 10 * frameUs, false);
+    stats.packetReceived(11, 11 * frameUs, false);
+    EXPECT_EQ(0u, stats.PacketsMissing.load());
+    EXPECT_EQ(0u, stats.PacketsLate.load());
+
+    // as can one whose final packet went missing, if it's far enough back.
+    stats.packetReceived(500, 12 * frameUs, false);
+    stats.packetReceived(20, 13 * frameUs, false);
+    stats.packetReceived(21, 14 * frameUs, false);
+    EXPECT_EQ(488u, stats.PacketsMissing.load());
+    EXPECT_EQ(0u, stats.PacketsLate.load());
+}
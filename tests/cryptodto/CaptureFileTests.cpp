@@ -0,0 +1,183 @@
+/* tests/cryptodto/CaptureFileTests.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "afv-native/cryptodto/CaptureFile.h"
+#include "afv-native/util/monotime.h"
+
+using namespace afv_native;
+using namespace afv_native::cryptodto;
+
+namespace {
+    struct TestDto {
+        const char *Name;
+        sequence_t Sequence;
+        int64_t OffsetUs;
+        std::vector<unsigned char> Body;
+    };
+
+    const std::vector<TestDto> testDtos = {
+            {"AR", 1, 0, {0x01, 0x02, 0x03, 0x04, 0x05}},
+            // an empty DTO, like a heartbeat acknowledgement.
+            {"HA", 2, 20000, {}},
+            // exactly fills its record, so has no padding.
+            {"AR", 7, 40000, {0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80}},
+    };
+
+    std::string capturePath(const char *name)
+    {
+        return ::testing::TempDir() + name;
+    }
+
+    void writeTestCapture(const std::string &path)
+    {
+        CaptureWriter writer;
+        ASSERT_TRUE(writer.open(path));
+        const int64_t baseUs = util::monotime_get_us();
+        for (const auto &dto: testDtos) {
+            writer.record(
+                    baseUs + dto.OffsetUs,
+                    dto.Sequence,
+                    dto.Name,
+                    std::char_traits<char>::length(dto.Name),
+                    dto.Body.data(),
+                    dto.Body.size());
+        }
+        writer.close();
+    }
+
+    /** truncateFile cuts the file at path down to its first len bytes. */
+    void truncateFile(const std::string &path, size_t len)
+    {
+        std::vector<char> contents;
+        {
+            std::ifstream in(path, std::ios::binary);
+            contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        ASSERT_LE(len, contents.size());
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), len);
+    }
+
+    void expectRecord(const TestDto &expected, const CaptureRecord &record, uint64_t firstTimestampUs)
+    {
+        EXPECT_EQ(expected.Sequence, record.Sequence);
+        EXPECT_EQ(std::string(expected.Name), std::string(record.Name, record.NameLen));
+        EXPECT_EQ(expected.Body, std::vector<unsigned char>(record.Dto, record.Dto + record.DtoLen));
+        EXPECT_EQ(static_cast<uint64_t>(expected.OffsetUs), record.TimestampUs - firstTimestampUs);
+        // records must stay aligned for the reader to use them in place.
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(record.Name - sizeof(CaptureRecordHeader)) % captureRecordAlignment);
+    }
+}
+
+TEST(CaptureFile, RoundTrip)
+{
+    const std::string path = capturePath("afv_capture_roundtrip.cap");
+    writeTestCapture(path);
+
+    CaptureReader reader;
+    ASSERT_TRUE(reader.open(path));
+    for (int pass = 0; pass < 2; pass++) {
+        CaptureRecord record;
+        uint64_t firstTimestampUs = 0;
+        for (size_t i = 0; i < testDtos.size(); i++) {
+            ASSERT_TRUE(reader.next(record));
+            if (i == 0) {
+                firstTimestampUs = record.TimestampUs;
+            }
+            expectRecord(testDtos[i], record, firstTimestampUs);
+        }
+        EXPECT_FALSE(reader.next(record));
+        reader.rewind();
+    }
+    reader.close();
+    std::remove(path.c_str());
+}
+
+TEST(CaptureFile, TruncatedMidRecord)
+{
+    const std::string path = capturePath("afv_capture_truncated.cap");
+    writeTestCapture(path);
+
+    // cut the file off part way through the last DTO's body.
+    size_t truncatedLen = sizeof(CaptureFileHeader);
+    for (size_t i = 0; i < testDtos.size() - 1; i++) {
+        const size_t recLen = sizeof(CaptureRecordHeader) + ::strlen(testDtos[i].Name) + testDtos[i].Body.size();
+        truncatedLen += (recLen + captureRecordAlignment - 1) & ~(captureRecordAlignment - 1);
+    }
+    truncatedLen += sizeof(CaptureRecordHeader) + ::strlen(testDtos.back().Name) + testDtos.back().Body.size() / 2;
+    truncateFile(path, truncatedLen);
+
+    CaptureReader reader;
+    ASSERT_TRUE(reader.open(path));
+    CaptureRecord record;
+    uint64_t firstTimestampUs = 0;
+    for (size_t i = 0; i < testDtos.size() - 1; i++) {
+        ASSERT_TRUE(reader.next(record));
+        if (i == 0) {
+            firstTimestampUs = record.TimestampUs;
+        }
+        expectRecord(testDtos[i], record, firstTimestampUs);
+    }
+    EXPECT_FALSE(reader.next(record));
+    // and it stays at the end.
+    EXPECT_FALSE(reader.next(record));
+    reader.close();
+
+    // a capture cut off within a record header is just as short.
+    truncateFile(path, sizeof(CaptureFileHeader) + sizeof(CaptureRecordHeader) / 2);
+    ASSERT_TRUE(reader.open(path));
+    EXPECT_FALSE(reader.next(record));
+    reader.close();
+    std::remove(path.c_str());
+}
+
+TEST(CaptureFile, RejectsBadHeader)
+{
+    const std::string path = capturePath("afv_capture_bad.cap");
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << "NOTACAPTUREFILE!";
+    }
+    CaptureReader reader;
+    EXPECT_FALSE(reader.open(path));
+    std::remove(path.c_str());
+}
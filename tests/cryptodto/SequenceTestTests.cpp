@@ -0,0 +1,137 @@
+/* tests/cryptodto/SequenceTestTests.cpp
+ *
+ * This file is part of AFV-Native.
+ *
+ * Copyright (c) 2019 Christopher Collins
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include "afv-native/cryptodto/SequenceTest.h"
+
+using namespace afv_native::cryptodto;
+
+TEST(SequenceTest, InOrder)
+{
+    SequenceTest st(0, 4);
+    for (sequence_t i = 0; i < 1000; i++) {
+        EXPECT_EQ(ReceiveOutcome::OK, st.Received(i));
+    }
+    EXPECT_EQ(1000u, st.GetNext());
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(999));
+}
+
+TEST(SequenceTest, ReorderWithinWindow)
+{
+    SequenceTest st(0, 8);
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(2));
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(1));
+    EXPECT_EQ(0u, st.GetNext());
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(2));
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(0));
+    EXPECT_EQ(3u, st.GetNext());
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(1));
+}
+
+TEST(SequenceTest, JumpSkipsLostPackets)
+{
+    SequenceTest st(0, 4);
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(0));
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(3));
+    // forces the window forward so 6 is its last slot, abandoning 1.
+    EXPECT_EQ(ReceiveOutcome::Overflow, st.Received(6));
+    EXPECT_EQ(2u, st.GetNext());
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(1));
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(3));
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(6));
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(4));
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(5));
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(2));
+    EXPECT_EQ(7u, st.GetNext());
+}
+
+TEST(SequenceTest, JumpOntoWindowHeadRejectsReplay)
+{
+    SequenceTest st(0, 4);
+    // lose packet 0, then receive 1 through 5.  5 forces the jump, and everything
+    // before it has been seen, so it becomes the head of the window.
+    for (sequence_t i = 1; i <= 4; i++) {
+        EXPECT_EQ(ReceiveOutcome::OK, st.Received(i));
+    }
+    EXPECT_EQ(ReceiveOutcome::Overflow, st.Received(5));
+    EXPECT_EQ(6u, st.GetNext());
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(5));
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(4));
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(6));
+}
+
+TEST(SequenceTest, JumpPastWholeWindowRestarts)
+{
+    SequenceTest st(0, 4);
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(2));
+    EXPECT_EQ(ReceiveOutcome::Overflow, st.Received(100));
+    EXPECT_EQ(101u, st.GetNext());
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(100));
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(2));
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(102));
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(102));
+}
+
+TEST(SequenceTest, RingWrapsAroundBitfield)
+{
+    // a window that doesn't fill its ring, walked far enough to wrap the ring many
+    // times, with every other packet arriving out of order.
+    SequenceTest st(0, 100);
+    for (sequence_t i = 0; i < 10000; i += 2) {
+        EXPECT_EQ(ReceiveOutcome::OK, st.Received(i + 1));
+        EXPECT_EQ(ReceiveOutcome::Before, st.Received(i + 1));
+        EXPECT_EQ(ReceiveOutcome::OK, st.Received(i));
+        EXPECT_EQ(i + 2, st.GetNext());
+    }
+    // stale bits from earlier laps of the ring must not leak into the window.
+    for (sequence_t i = 10001; i <= 10100; i++) {
+        EXPECT_EQ(ReceiveOutcome::OK, st.Received(i));
+    }
+    EXPECT_EQ(ReceiveOutcome::OK, st.Received(10000));
+    EXPECT_EQ(10101u, st.GetNext());
+}
+
+TEST(SequenceTest, LargeWindowJumpAcrossWords)
+{
+    SequenceTest st(0, 1000);
+    for (sequence_t i = 1; i <= 900; i++) {
+        EXPECT_EQ(ReceiveOutcome::OK, st.Received(i));
+    }
+    EXPECT_EQ(0u, st.GetNext());
+    // abandons 0, and the received run 1-900 carries the window up to 901.
+    EXPECT_EQ(ReceiveOutcome::Overflow, st.Received(1001));
+    EXPECT_EQ(901u, st.GetNext());
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(1001));
+    EXPECT_EQ(ReceiveOutcome::Before, st.Received(500));
+}